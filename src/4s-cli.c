@@ -24,13 +24,22 @@
 #include "cliopt.h"
 #include "pki.h"
 #include "shared_secret.h"
+#include "ocsp.h"
+#include "lib4s.h"
+#include "service.h"
+#include "pki_jobs.h"
+#include "metrics.h"
+#include "trace.h"
 
 
 #define MAX_USER_INPUT (2048)
 
+// id of the PKI of --rootdir in service mode
+#define SERVE_DEFAULT_PKI ("default")
+
 #define FREE_CTX(ctx) 					\
 if(1) { 								\
-	DEBUG_PRN("destroying(%p)",(ctx));	\
+	DEBUG_PRN("destroying(%p)",(void*)(ctx));	\
 	s4_destroy_context((ctx)); 			\
 	(ctx)=NULL; 						\
 } 
@@ -56,8 +65,19 @@ static void s4cli_message_handler( void* data, const char* title, const char* me
 	prompt(message, line, MAX_USER_INPUT );
 }
 
+// path of the trace written at exit, empty when not traced
+static char s4cli_trace_path[MAX_FILE_PATH+1] = "";
+
+static void s4cli_write_trace( void )
+{
+	if( trace_write_json( s4cli_trace_path ) == 0 ) {
+		printf("trace written to %s\n", s4cli_trace_path);
+	}
+}//eo s4cli_write_trace
+
 static void s4cli_init( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
 {
+	TRACE_SPAN( span, CLI_MODE_INIT_STR, NULL );
 	if( (NULL==s4c) || (NULL==s4evt) ) {
 		die(-1, "Invalid initialisation: program internal error");
 	}
@@ -105,19 +125,22 @@ static void s4cli_init( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
 	// TODO file saving in here
 
   	printf("Split ok. \n");
+	for( unsigned i=0; i<s4c->nb_share; i++ ) {
+		printf("\tshare %u fingerprint: %s\n", i+1, s4c->share_fingerprints[i] );
+	}
 
 }//eo 4scli_init
 
 
 static void s4cli_sign( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
 {
+	TRACE_SPAN( span, CLI_MODE_SIGN_STR, s4c->csr_path );
 
 	// Reconstruct the passphrase 
 	if( s4_reconstruct( s4c, s4evt ) ) {
 		FREE_CTX(s4c);
 		die(-1, "Failed to recover root passphrase");
 	}
-	DDEBUG_PRN("Reconstructed passphrase: %s",s4c->passphrase);
 
 	// Do the sub CA signing
 	if( sign_subca( s4c->pki_params.root_dir, s4c->csr_path, s4c->cert_path, s4c->passphrase, s4evt) != 0 ) {
@@ -128,37 +151,168 @@ static void s4cli_sign( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
 
 }//eo 4scli_sign
 
-static void s4cli_revoke( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
+static void s4cli_revoke( s_s4context *s4c, s_s4eventhandlers_t * s4evt, s_revocation_request_t *requests, unsigned nb_requests )
 {
+	TRACE_SPAN( span, CLI_MODE_REVOKE_STR, s4c->crl_path );
 	// Reconstruct the passphrase 
 	if( s4_reconstruct( s4c, s4evt ) ) {
+		free( requests );
 		FREE_CTX(s4c);
 		die(-1, "Failed to recover root passphrase");		
 	}
-	DEBUG_PRN("Reconstructed passphrase: [%s]",s4c->passphrase);
 
-	if( revoke_subca( s4c->pki_params.root_dir, s4c->cert_path, s4c->passphrase, s4evt) != 0 ) {
-		warn("Failed to revoke cert:%s", s4c->cert_path );			
+	// All the index updates, then a single CRL
+	if( revoke_subca_batch( s4c->pki_params.root_dir, requests, nb_requests, s4c->crl_path, s4c->passphrase, NULL, s4evt) != 0 ) {
+		warn("Failed to revoke %u certificate(s), CRL:%s", nb_requests, s4c->crl_path );
+		free( requests );
 		FREE_CTX(s4c);
 		die(-1, "Failed to revoke sub-CA");
 	}
+	free( requests );
+	
+}//eo 4scli_revoke
 
-	if( generate_crl( s4c->pki_params.root_dir, s4c->crl_path, s4c->passphrase, s4evt) != 0 ) {
-		warn("Failed to generate crl:%s", s4c->crl_path );			
+static void s4cli_crl_bundle( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
+{
+	TRACE_SPAN( span, CLI_MODE_CRL_BUNDLE_STR, NULL );
+	// Reconstruct the passphrase 
+	if( s4_reconstruct( s4c, s4evt ) ) {
 		FREE_CTX(s4c);
-		die(-1, "Failed to revoke sub-CA");
+		die(-1, "Failed to recover root passphrase");		
+	}
+
+	if( generate_crl_bundle( s4c->pki_params.root_dir, s4c->crl_bundle_size, s4c->crl_bundle_period, s4c->passphrase, s4evt) != 0 ) {
+		warn("Failed to generate a bundle of %u CRL", s4c->crl_bundle_size );
+		FREE_CTX(s4c);
+		die(-1, "Failed to generate the CRL bundle");
+	}
+
+}//eo 4scli_crl_bundle
+
+static void s4cli_ocsp_sign( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
+{
+	TRACE_SPAN( span, CLI_MODE_OCSP_SIGN_STR, NULL );
+	// Reconstruct the passphrase 
+	if( s4_reconstruct( s4c, s4evt ) ) {
+		FREE_CTX(s4c);
+		die(-1, "Failed to recover root passphrase");		
+	}
+
+	if( ocsp_presign( s4c->pki_params.root_dir, s4c->ocsp_period, s4c->passphrase, s4evt) != 0 ) {
+		FREE_CTX(s4c);
+		die(-1, "Failed to sign the OCSP responses");
+	}
+
+}//eo 4scli_ocsp_sign
+
+// open and unlock a PKI of the service, 0 on success
+static int s4cli_serve_open( s4_manager_t *mgr, const char *id, const char *root_dir, const char *const *shares, const unsigned nb_shares )
+{
+	char err[LIB4S_MAX_ERROR+1];
+
+	s4_pki_t *pki = s4_manager_open( mgr, id, root_dir, err, sizeof(err) );
+	if( NULL == pki ) {
+		warn("%s", err);
+		return -1;
+	}
+	if( s4_pki_unlock( pki, shares, nb_shares ) ) {
+		warn("Failed to unlock the PKI '%s': %s", id, s4_pki_last_error( pki, err, sizeof(err) ));
+		return -1;
+	}
+	printf("PKI '%s' unlocked\n", id);
+	return 0;
+}//eo s4cli_serve_open
+
+// --pki=<id>,<rootdir>,<secret>,<secret>[,...], 0 on success
+static int s4cli_serve_add( s4_manager_t *mgr, const char *spec )
+{
+	char        buf[MAX_CLIOPTION_VAL_LEN+1];
+	const char *parts[MAX_SHAMIR_SHARE_NUMBER+2];
+	unsigned    n    = 0;
+	char       *save = NULL;
+
+	strlcpy( buf, spec, sizeof(buf) );
+	for( char *tok = strtok_r( buf, ",", &save ); NULL!=tok; tok = strtok_r( NULL, ",", &save ) ) {
+		if( n == sizeof(parts)/sizeof(parts[0]) ) {
+			warn("Too many secrets for the PKI of --%s=%s", OPTION_PKI, spec);
+			return -1;
+		}
+		parts[n++] = tok;
+	}
+	if( n < 4 ) {
+		warn("Invalid --%s parameter, expected <id>,<rootdir>,<secret>,<secret>[,...]: %s", OPTION_PKI, spec);
+		return -1;
+	}
+	return s4cli_serve_open( mgr, parts[0], parts[1], parts+2, n-2 );
+}//eo s4cli_serve_add
+
+static void s4cli_serve( s_s4context *s4c, s_clioption* options, unsigned nb_options, const char *socket_path, unsigned timeout, unsigned queue_size )
+{
+	TRACE_SPAN( span, CLI_MODE_SERVE_STR, socket_path );
+
+	s4_manager_t *mgr = s4_manager_create();
+	if( NULL == mgr ) {
+		FREE_CTX(s4c);
+		die(-1, "Failed to create the PKI manager");
+	}
+
+	// each passphrase rebuilt once for all the requests, the PKI of --rootdir first
+	int err = s4cli_serve_open( mgr, SERVE_DEFAULT_PKI, s4c->pki_params.root_dir, s4c->shamir_secrets, s4c->nb_share_provided );
+	const char *spec = NULL;
+	for( unsigned i=0; !err && 0==cli_find_nth_option( OPTION_PKI, i, options, nb_options, &spec ); i++ ) {
+		err = s4cli_serve_add( mgr, spec );
+	}
+	if( err ) {
+		s4_manager_destroy( mgr );
+		FREE_CTX(s4c);
+		die(-1, "Failed to recover root passphrase");
 	}
-	
-}//eo 4scli_revoke
+
+	if( service_run( mgr, socket_path, timeout, queue_size ) != 0 ) {
+		s4_manager_destroy( mgr );
+		FREE_CTX(s4c);
+		die(-1, "Failed to start the PKI service");
+	}
+	s4_manager_destroy( mgr );
+
+}//eo 4scli_serve
+
+static void s4cli_jobs( s_s4context *s4c, s_s4eventhandlers_t * s4evt, const char *jobs_path, const char *result_path )
+{
+	TRACE_SPAN( span, CLI_MODE_JOBS_STR, jobs_path );
+	// the whole file is checked before asking for the secrets
+	s_pki_jobs_t jobs;
+	if( pki_jobs_load( jobs_path, &jobs ) ) {
+		FREE_CTX(s4c);
+		die(-1, "Invalid job file: %s", jobs_path);
+	}
+
+	if( s4_reconstruct( s4c, s4evt ) ) {
+		pki_jobs_free( &jobs );
+		FREE_CTX(s4c);
+		die(-1, "Failed to recover root passphrase");		
+	}
+
+	if( pki_jobs_run( s4c->pki_params.root_dir, s4c->passphrase, &jobs, result_path, s4evt ) != 0 ) {
+		pki_jobs_free( &jobs );
+		FREE_CTX(s4c);
+		die(-1, "Some jobs failed, results written to %s", result_path);
+	}
+	pki_jobs_free( &jobs );
+
+}//eo 4scli_jobs
 
 static unsigned load_secrets( const char*exe_name, s_s4context *s4c, s_clioption* options, unsigned nb_options )
 {
+	const char *paths[MAX_SHAMIR_SHARE_NUMBER+1];
 	unsigned i=0;
 //	cli_find_nth_option(           var, nth, options_list, nb_options, const char** val );
-	while( 0==cli_find_nth_option( OPTION_SECRET, i, options, nb_options, &(s4c->shamir_secrets[i]) )) {
+	while( i<=MAX_SHAMIR_SHARE_NUMBER && 0==cli_find_nth_option( OPTION_SECRET, i, options, nb_options, &(paths[i]) )) {
 		i++;
 	}
-	s4c->nb_share_provided = i;
+	if( s4_set_share_sources( s4c, paths, i ) ) {
+		return 0;
+	}
 		
 	DDEBUG_PRN("share lists");
 	for( i=0; i<s4c->nb_share_provided; i++ ) {
@@ -168,6 +322,45 @@ static unsigned load_secrets( const char*exe_name, s_s4context *s4c, s_clioption
 	return s4c->nb_share_provided;
 }//eo load_secrets
 
+static s_revocation_request_t* load_revocations( s_s4context *s4c, s_clioption* options, unsigned nb_options, unsigned *nb_requests )
+{
+	const char *names[] = { OPTION_CERT, OPTION_SERIAL };
+	const char *val = NULL;
+	unsigned n = 0;
+
+	s_revocation_request_t *requests = calloc( MAX_REVOCATION_BATCH, sizeof(s_revocation_request_t) );
+	if( NULL == requests ) {
+		FREE_CTX(s4c);
+		die( -1, "Failed to allocate memory for the revocation list");
+	}
+
+	for( unsigned k=0; k<sizeof(names)/sizeof(names[0]); k++ ) {
+		for( unsigned i=0; 0==cli_find_nth_option( names[k], i, options, nb_options, &val ); i++ ) {
+			if( n == MAX_REVOCATION_BATCH ) {
+				free( requests );
+				FREE_CTX(s4c);
+				die( -1, "Too many certificates to revoke (max:%d)", MAX_REVOCATION_BATCH );
+			}
+			if( parse_revocation_request( val, &(requests[n]) ) ) {
+				free( requests );
+				FREE_CTX(s4c);
+				die( -1, "Invalid certificate to revoke: %s", val );
+			}
+			DDEBUG_PRN("\t- revocation[%u]:%s", n, val);
+			n++;
+		}
+	}
+
+	if( 0 == n ) {
+		free( requests );
+		FREE_CTX(s4c);
+		die( -1, "No certificate to revoke: use --%s or --%s", OPTION_CERT, OPTION_SERIAL );
+	}
+
+	*nb_requests = n;
+	return requests;
+}//eo load_revocations
+
 #define REQUIRE_PARAM(pname,var,len)   cli_require_option(      (pname), argv[0], options, opt_count, (var), (len) )
 #define REQUIRE_INT_PARAM(pname,var)   cli_require_int_option(  (pname), argv[0], options, opt_count, &(var) )
 #define REQUIRE_UINT_PARAM(pname,var)  cli_require_int_option(  (pname), argv[0], options, opt_count, (int*)&(var) )
@@ -183,6 +376,13 @@ static unsigned load_secrets( const char*exe_name, s_s4context *s4c, s_clioption
  */
 int main( int argc, char** argv)
 {
+	// before any GMP integer: the shares are computed in the secure arenas
+	secure_arena_init();
+
+	if( log_configure( getenv( LOG_ENV_VAR ) ) ) {
+		warn("Ignoring the invalid %s variable", LOG_ENV_VAR);
+	}
+	log_start( stderr );
 
 	s_s4eventhandlers_t s4evt;
 	s4evt.data = NULL;
@@ -190,6 +390,7 @@ int main( int argc, char** argv)
 	s4evt.on_warning     = s4cli_warn_handler;
 	s4evt.do_message     = s4cli_message_handler;
 	s4evt.do_file_prompt = NULL;
+	s4evt.is_cancelled   = NULL;
 
     /**
      * context init
@@ -215,6 +416,22 @@ int main( int argc, char** argv)
 	cli_print_mode(opt_mode);
 	cli_print_opt(options, opt_count);
 
+	// Diagnostic levels given on the command line
+	char log_spec[MAX_CLIOPTION_VAL_LEN+1];
+	OPTIONAL_PARAM( OPTION_LOG, log_spec, MAX_CLIOPTION_VAL_LEN, "" );
+	if( log_configure( log_spec ) ) {
+		FREE_CTX(s4c);
+		die( -1, "Invalid --%s parameter: %s", OPTION_LOG, log_spec );
+	}
+
+	// Tracing the whole run, written even when dying
+	OPTIONAL_PARAM( OPTION_TRACE, s4cli_trace_path, MAX_FILE_PATH, "" );
+	if( '\0'!=s4cli_trace_path[0] ) {
+		trace_enable();
+		trace_thread_name( "4s-cli" );
+		atexit( s4cli_write_trace );
+	}
+
 	// Getting the common parameters
 	REQUIRE_PARAM( OPTION_ROOT_DIR, s4c->pki_params.root_dir , MAX_FILE_PATH);
 	int n=0;
@@ -224,6 +441,19 @@ int main( int argc, char** argv)
 		die( -1, "Not enough path for share secrets provided:%d", n);
 	}			
 
+	// Measuring the steps of the operation
+	char metrics_format[16];
+	OPTIONAL_PARAM(OPTION_METRICS, metrics_format, sizeof(metrics_format)-1, "" );
+	if( '\0'!=metrics_format[0] && strcmp( metrics_format, METRICS_FORMAT_JSON ) && strcmp( metrics_format, METRICS_FORMAT_TEXT ) ) {
+		FREE_CTX(s4c);
+		die( -1, "Unknown metrics format %s (expected %s or %s)", metrics_format, METRICS_FORMAT_JSON, METRICS_FORMAT_TEXT );
+	}
+	s_metrics_t          metrics;
+	s_s4eventhandlers_t *evt = &s4evt;
+	if( '\0'!=metrics_format[0] ) {
+		evt = metrics_start( &metrics, &s4evt, "loading shares and unlocking" );
+	}
+
 	// Processing by mode
 	switch ( opt_mode ){
 		case CLIModeInit:   
@@ -235,7 +465,7 @@ int main( int argc, char** argv)
 			OPTIONAL_UINT_PARAM(OPTION_QUORUM,   s4c->quorum,                 DEFAULT_QUORUM);
 			OPTIONAL_UINT_PARAM(OPTION_NB_SHARE, s4c->nb_share,               DEFAULT_NB_SHARE);	
 			OPTIONAL_BOOL_PARAM(OPTION_PAUSED,   s4c->should_pause_for_secrets, 0  );
-			s4cli_init( s4c, &s4evt );
+			s4cli_init( s4c, evt );
 			break;
 
 		case CLIModeSign:   
@@ -243,16 +473,62 @@ int main( int argc, char** argv)
 			DEBUG_PRN("SubCA signature mode");	
 			REQUIRE_PARAM(OPTION_CSR,  s4c->csr_path,  MAX_FILE_PATH );
 			REQUIRE_PARAM(OPTION_CERT, s4c->cert_path, MAX_FILE_PATH );
-			s4cli_sign( s4c, &s4evt );
+			s4cli_sign( s4c, evt );
 			break;
 
-		case CLIModeRevoke: 
+		case CLIModeRevoke: {
 			// Sub CA revocation mode
 			DEBUG_PRN("SubCA revocation mode");
 			REQUIRE_PARAM(OPTION_CRL,  s4c->crl_path,  MAX_FILE_PATH );
-			REQUIRE_PARAM(OPTION_CERT, s4c->cert_path, MAX_FILE_PATH );
-			s4cli_revoke( s4c, &s4evt );
+			unsigned nb_revocations = 0;
+			s_revocation_request_t *revocations = load_revocations( s4c, options, opt_count, &nb_revocations );
+			s4cli_revoke( s4c, evt, revocations, nb_revocations );
+			break;
+		}
+
+		case CLIModeCRLBundle: 
+			// Pre-signed CRL bundle mode
+			DEBUG_PRN("CRL bundle mode");
+			OPTIONAL_UINT_PARAM(OPTION_COUNT,  s4c->crl_bundle_size,   DEFAULT_CRL_BUNDLE_SIZE );
+			OPTIONAL_UINT_PARAM(OPTION_PERIOD, s4c->crl_bundle_period, DEFAULT_CRL_BUNDLE_PERIOD );
+			s4cli_crl_bundle( s4c, evt );
+			break;
+
+		case CLIModeOCSPSign: 
+			// Pre-signed OCSP responses mode
+			DEBUG_PRN("OCSP signature mode");
+			OPTIONAL_UINT_PARAM(OPTION_PERIOD, s4c->ocsp_period, DEFAULT_OCSP_PERIOD );
+			s4cli_ocsp_sign( s4c, evt );
+			break;
+
+		case CLIModeServe: {
+			// Unlocked service mode
+			DEBUG_PRN("service mode");
+			char     socket_path[MAX_FILE_PATH+1];
+			unsigned timeout    = 0;
+			unsigned queue_size = 0;
+			REQUIRE_PARAM(OPTION_SOCKET,        socket_path, MAX_FILE_PATH );
+			OPTIONAL_UINT_PARAM(OPTION_TIMEOUT, timeout,     DEFAULT_SERVICE_TIMEOUT );
+			OPTIONAL_UINT_PARAM(OPTION_QUEUE,   queue_size,  DEFAULT_SERVICE_QUEUE );
+			s4cli_serve( s4c, options, opt_count, socket_path, timeout, queue_size );
 			break;
+		}
+
+		case CLIModeJobs: {
+			// Job file mode
+			DEBUG_PRN("job file mode");
+			char jobs_path[MAX_FILE_PATH+1];
+			char result_path[MAX_FILE_PATH+1];
+			char default_result[MAX_FILE_PATH+1];
+			REQUIRE_PARAM(OPTION_FILE, jobs_path, MAX_FILE_PATH );
+			// a truncated default is refused only when it is the one used
+			const int truncated = snprintf( default_result, sizeof(default_result), "%s.result", jobs_path ) >= (int)sizeof(default_result);
+			if( OPTIONAL_PARAM(OPTION_RESULT, result_path, MAX_FILE_PATH, default_result ) && truncated ) {
+				die( -1, "the path of the default result file is too long, use the --%s option", OPTION_RESULT );
+			}
+			s4cli_jobs( s4c, evt, jobs_path, result_path );
+			break;
+		}
 
 		default: 
 			// We should never get there (dying before in cli_parse_params)
@@ -262,6 +538,19 @@ int main( int argc, char** argv)
 	};
 	printf("done.\n");
 
+	if( '\0'!=metrics_format[0] ) {
+		metrics_stop( &metrics );
+		if( 0 == strcmp( metrics_format, METRICS_FORMAT_JSON ) ) {
+			metrics_write_json( &metrics, stdout );
+		} else {
+			char text[MAX_METRICS_STAGES*128];
+			if( metrics_format_text( &metrics, text, sizeof(text) ) < 0 ) {
+				warn("metrics table truncated");
+			}
+			fputs( text, stdout );
+		}
+	}
+
 	// cleanup
 	FREE_CTX(s4c);
 	cli_destroy_options(options, opt_count);
@@ -32,6 +32,13 @@
 
 int main(void)
 {
+    // before any GMP integer: the shares are computed in the secure arenas
+    secure_arena_init();
+
+    if( log_configure( getenv( LOG_ENV_VAR ) ) ) {
+        warn("Ignoring the invalid %s variable", LOG_ENV_VAR);
+    }
+    log_start( stderr );
 
     // context init
     s_s4context *s4c = s4_init_context();
@@ -51,10 +58,10 @@ int main(void)
 	uiMain();
 
     // cleanup
-    secure_memzero( s4c, sizeof(s_s4context) );
+    pthread_mutex_destroy( &(s4w->job.lock) );
     secure_memzero( s4w, sizeof(s_s4widgets) );
     
-    free(s4c);
+    s4_destroy_context(s4c);
     free(s4w);
 
 	return 0;
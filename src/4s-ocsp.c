@@ -0,0 +1,557 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file 4s-ocsp.c
+ *
+ * \brief 4s-ocsp: local OCSP responder serving pre-signed responses, and its load-test client
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <openssl/ocsp.h>
+
+#include "utils.h"
+#include "pki.h"
+#include "ca_store.h"
+#include "ocsp.h"
+
+#define MAX_OCSP_RESPONSE  (65536)
+#define MAX_THREADS        (64)
+
+// seconds before an idle keep-alive connection gives its thread back
+#define CONNECTION_TIMEOUT (5)
+
+// seconds between two checks of the ocsp/ directory for new responses
+#define RELOAD_CHECK_PERIOD (1)
+
+#define DEFAULT_THREADS      (4)
+#define DEFAULT_CONNECTIONS  (4)
+#define DEFAULT_REQUESTS     (10000)
+
+static const char *usage_fmt =
+"%s\t-\tLocal OCSP responder serving the responses pre-signed with '4s-cli --ocspsign'\n"
+"\n"
+"USAGE:\n"
+"\n"
+"    %s <mode> <mode parameters>\n"
+"\n"
+"MODES\n"
+"    --help     show this screen\n"
+"    --serve    answer OCSP requests (HTTP POST or GET) on 127.0.0.1\n"
+"    --bench    send OCSP requests to a responder and measure the responses per second\n"
+"\n"
+"COMMON PARAMETERS\n"
+"    --rootdir=<path>   - [required] path to the PKI root directory\n"
+"    --port=<n>         - [optional] TCP port on 127.0.0.1 (default:8080)\n"
+"    --log=<levels>     - [optional] diagnostic levels, such as warn or warn,ocsp=debug (default: $S4_LOG)\n"
+"\n"
+"SERVE MODE PARAMETERS\n"
+"    --threads=<n>      - [optional] number of connection handling threads (default:4)\n"
+"    Each thread serves one keep-alive connection at a time, idle connections are closed after 5 seconds.\n"
+"    The responses are loaded again when the ocsp/ directory changes or on SIGHUP.\n"
+"\n"
+"BENCH MODE PARAMETERS\n"
+"    --serial=<hex>     - [required] serial number of the certificate to query\n"
+"    --requests=<n>     - [optional] total number of requests (default:10000)\n"
+"    --connections=<n>  - [optional] number of concurrent keep-alive connections (default:4)\n"
+"\n"
+"EXAMPLES\n"
+"\n"
+"    %s --serve --rootdir=/home/pki --port=8080\n"
+"    %s --bench --rootdir=/home/pki --port=8080 --serial=02 --requests=100000\n"
+"\n"
+"---\n"
+"Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016\n"
+"\n";
+
+static void usage( const char *exe_name )
+{
+	printf( usage_fmt, exe_name, exe_name, exe_name, exe_name );
+}//eo usage
+
+// value of a --name=value parameter, NULL if absent
+static const char* find_param( int argc, char **argv, const char *name )
+{
+	size_t len = strlen( name );
+	for( int i=2; i<argc; i++ ) {
+		if( 0==strncmp( argv[i], "--", 2 ) && 0==strncmp( argv[i]+2, name, len ) && '='==argv[i][2+len] ) {
+			return argv[i]+3+len;
+		}
+	}
+	return NULL;
+}//eo find_param
+
+static int uint_param( int argc, char **argv, const char *name, unsigned dfl, unsigned min, unsigned max )
+{
+	const char *val = find_param( argc, argv, name );
+	int ival = 0;
+	if( NULL == val ) {
+		return (int)dfl;
+	}
+	if( strtoint( val, &ival ) || ival < (int)min || ival > (int)max ) {
+		die( -1, "invalid value for --%s: %s (%u to %u)", name, val, min, max );
+	}
+	return ival;
+}//eo uint_param
+
+//////////////////////////////////////////////////////////// Responder
+
+// one generation of the pre-signed responses, freed by the last of its users
+typedef struct SResponderCache {
+	s_ocsp_cache_t cache;
+	unsigned       refs;           // the responder and the connections served from it, protected by the responder lock
+} s_responder_cache_t;
+
+typedef struct SResponder {
+	const char          *root_dir;
+	int                  listen_fd;
+	pthread_mutex_t      lock;
+	s_responder_cache_t *current;  // generation given to new connections, protected by lock
+	struct timespec      mtime;    // of the ocsp/ directory before current was loaded
+} s_responder_t;
+
+// set by SIGHUP, handled by the reload thread
+static volatile sig_atomic_t reload_requested = 0;
+
+static void on_sighup( int sig )
+{
+	reload_requested = 1;
+}//eo on_sighup
+
+static void responder_release( s_responder_t *rsp, s_responder_cache_t *gen )
+{
+	pthread_mutex_lock( &(rsp->lock) );
+	int last = 0 == --(gen->refs);
+	pthread_mutex_unlock( &(rsp->lock) );
+	if( last ) {
+		ocsp_cache_free( &(gen->cache) );
+		free( gen );
+	}
+}//eo responder_release
+
+static s_responder_cache_t* responder_acquire( s_responder_t *rsp )
+{
+	pthread_mutex_lock( &(rsp->lock) );
+	s_responder_cache_t *gen = rsp->current;
+	gen->refs++;
+	pthread_mutex_unlock( &(rsp->lock) );
+	return gen;
+}//eo responder_acquire
+
+// modification time of the ocsp/ directory, zero if it cannot be read
+static struct timespec responses_mtime( const char *root_dir )
+{
+	char ocsp_dir[MAX_FILE_PATH+1];
+	struct stat st;
+	struct timespec res = { 0, 0 };
+
+	if( snprintf( ocsp_dir, sizeof(ocsp_dir), "%s/%s", root_dir, OCSP_DIR ) < (int)sizeof(ocsp_dir) && 0 == stat( ocsp_dir, &st ) ) {
+		res = st.st_mtim;
+	}
+	return res;
+}//eo responses_mtime
+
+// load a new generation of responses, the connections in progress keep the previous one
+static int responder_load( s_responder_t *rsp )
+{
+	// taken before the load: a change during the load triggers another one
+	struct timespec mtime = responses_mtime( rsp->root_dir );
+
+	s_responder_cache_t *gen = calloc( 1, sizeof(s_responder_cache_t) );
+	if( NULL == gen ) {
+		return -1;
+	}
+	if( ocsp_cache_load( rsp->root_dir, &(gen->cache) ) ) {
+		free( gen );
+		return -1;
+	}
+	gen->refs = 1;
+
+	pthread_mutex_lock( &(rsp->lock) );
+	s_responder_cache_t *previous = rsp->current;
+	rsp->current = gen;
+	rsp->mtime   = mtime;
+	pthread_mutex_unlock( &(rsp->lock) );
+
+	if( NULL != previous ) {
+		responder_release( rsp, previous );
+	}
+	printf("%u pre-signed responses loaded\n", gen->cache.nb_entries);
+	fflush( stdout );
+	return 0;
+}//eo responder_load
+
+static void* responder_reloader( void *arg )
+{
+	s_responder_t *rsp = (s_responder_t*)arg;
+
+	for(;;) {
+		sleep( RELOAD_CHECK_PERIOD );
+
+		struct timespec mtime = responses_mtime( rsp->root_dir );
+		pthread_mutex_lock( &(rsp->lock) );
+		int changed = mtime.tv_sec != rsp->mtime.tv_sec || mtime.tv_nsec != rsp->mtime.tv_nsec;
+		pthread_mutex_unlock( &(rsp->lock) );
+
+		if( !changed && !reload_requested ) {
+			continue;
+		}
+		reload_requested = 0;
+		if( responder_load( rsp ) ) {
+			// the previous responses are still served, a new change retries
+			warn("Failed to reload the pre-signed OCSP responses of %s", rsp->root_dir);
+			pthread_mutex_lock( &(rsp->lock) );
+			rsp->mtime = mtime;
+			pthread_mutex_unlock( &(rsp->lock) );
+		}
+	}
+	return NULL;
+}//eo responder_reloader
+
+static void* responder_worker( void *arg )
+{
+	s_responder_t *rsp = (s_responder_t*)arg;
+	struct timeval timeout = { CONNECTION_TIMEOUT, 0 };
+	int one = 1;
+
+	for(;;) {
+		int fd = accept( rsp->listen_fd, NULL, NULL );
+		if( fd < 0 ) {
+			if( EINTR == errno || ECONNABORTED == errno ) {
+				continue;
+			}
+			warn("accept failed: %s", strerror(errno));
+			return NULL;
+		}
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) );
+		setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+		setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout) );
+
+		// a keep-alive connection is served from the responses of its start
+		s_responder_cache_t *gen = responder_acquire( rsp );
+		ocsp_http_serve( &(gen->cache), fd );
+		responder_release( rsp, gen );
+		close( fd );
+	}
+	return NULL;
+}//eo responder_worker
+
+static int ocsp_serve( const char *root_dir, unsigned port, unsigned nb_threads )
+{
+	s_responder_t rsp;
+	pthread_t     threads[MAX_THREADS];
+	pthread_t     reloader;
+	int one = 1;
+
+	memset( &rsp, 0, sizeof(rsp) );
+	rsp.root_dir = root_dir;
+	pthread_mutex_init( &(rsp.lock), NULL );
+	if( responder_load( &rsp ) ) {
+		warn("Failed to load the pre-signed OCSP responses of %s", root_dir);
+		pthread_mutex_destroy( &(rsp.lock) );
+		return -1;
+	}
+
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons( port );
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	rsp.listen_fd = socket( AF_INET, SOCK_STREAM, 0 );
+	if( rsp.listen_fd < 0
+	 || setsockopt( rsp.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) )
+	 || bind( rsp.listen_fd, (struct sockaddr*)&addr, sizeof(addr) )
+	 || listen( rsp.listen_fd, 128 ) ) {
+		warn("Failed to listen on 127.0.0.1:%u: %s", port, strerror(errno));
+		responder_release( &rsp, rsp.current );
+		pthread_mutex_destroy( &(rsp.lock) );
+		return -1;
+	}
+	printf("OCSP responder listening on http://127.0.0.1:%u/\n", port);
+	fflush( stdout );
+
+	// new responses signed by a ceremony are served without a restart
+	struct sigaction sa;
+	memset( &sa, 0, sizeof(sa) );
+	sa.sa_handler = on_sighup;
+	sa.sa_flags   = SA_RESTART;
+	sigemptyset( &sa.sa_mask );
+	sigaction( SIGHUP, &sa, NULL );
+	if( pthread_create( &reloader, NULL, responder_reloader, &rsp ) ) {
+		warn("Failed to start the reload thread, the responses will not be reloaded");
+	}
+
+	unsigned started = 0;
+	for( ; started<nb_threads; started++ ) {
+		if( pthread_create( &threads[started], NULL, responder_worker, &rsp ) ) {
+			break;
+		}
+	}
+	for( unsigned i=0; i<started; i++ ) {
+		pthread_join( threads[i], NULL );
+	}
+
+	// the reload thread never ends: the process exits with it
+	close( rsp.listen_fd );
+	return started ? 0 : -1;
+}//eo ocsp_serve
+
+
+//////////////////////////////////////////////////////////// Load-test client
+
+typedef struct SBenchJob {
+	unsigned             port;
+	const unsigned char *post;        // complete HTTP request
+	size_t               post_len;
+	unsigned             nb_requests; // per connection
+	unsigned             nb_ok;
+	unsigned char       *first_resp;  // copy of the first response of the connection
+	size_t               first_len;
+} s_bench_job_t;
+
+static void* bench_worker( void *arg )
+{
+	s_bench_job_t *job = (s_bench_job_t*)arg;
+	char           hdr[MAX_HTTP_HEADER];
+	unsigned char  body[MAX_OCSP_RESPONSE];
+	int one = 1;
+
+	struct sockaddr_in addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons( job->port );
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+
+	int fd = socket( AF_INET, SOCK_STREAM, 0 );
+	if( fd < 0 || connect( fd, (struct sockaddr*)&addr, sizeof(addr) ) ) {
+		warn("Failed to connect to 127.0.0.1:%u: %s", job->port, strerror(errno));
+		if( fd >= 0 ) close( fd );
+		return NULL;
+	}
+	setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) );
+
+	for( unsigned i=0; i<job->nb_requests; i++ ) {
+		size_t hdr_len = 0;
+		if( ocsp_http_write( fd, job->post, job->post_len ) ) {
+			break;
+		}
+		ssize_t len = ocsp_http_read_header( fd, hdr, sizeof(hdr), 0, &hdr_len );
+		if( len <= 0 || 0 != strncmp( hdr, "HTTP/1.1 200", 12 ) ) {
+			break;
+		}
+		size_t body_len = ocsp_http_content_length( hdr );
+		size_t already  = len - hdr_len;
+		if( body_len > sizeof(body) || already > body_len ) {
+			break;
+		}
+		memcpy( body, hdr+hdr_len, already );
+		if( body_len > already && ocsp_http_read( fd, body+already, body_len-already ) < 0 ) {
+			break;
+		}
+		if( 0 == i ) {
+			job->first_resp = malloc( body_len );
+			if( NULL != job->first_resp ) {
+				memcpy( job->first_resp, body, body_len );
+				job->first_len = body_len;
+			}
+		}
+		job->nb_ok++;
+	}
+
+	close( fd );
+	return NULL;
+}//eo bench_worker
+
+// print the status carried by a response
+static void print_response_status( const unsigned char *der, size_t len )
+{
+	const unsigned char *p = der;
+	OCSP_RESPONSE  *resp = d2i_OCSP_RESPONSE( NULL, &p, (long)len );
+	OCSP_BASICRESP *bs   = NULL;
+
+	if( NULL == resp ) {
+		printf("response: unparsable\n");
+		return;
+	}
+	int status = OCSP_response_status( resp );
+	printf("response: %s", OCSP_response_status_str( status ) );
+	if( OCSP_RESPONSE_STATUS_SUCCESSFUL == status && NULL != (bs = OCSP_response_get1_basic( resp )) ) {
+		OCSP_SINGLERESP *single = OCSP_resp_get0( bs, 0 );
+		int reason = -1;
+		if( NULL != single ) {
+			int cert_status = OCSP_single_get0_status( single, &reason, NULL, NULL, NULL );
+			printf(", certificate %s", OCSP_cert_status_str( cert_status ) );
+			if( reason >= 0 ) {
+				printf(" (%s)", OCSP_crl_reason_str( reason ) );
+			}
+		}
+		OCSP_BASICRESP_free( bs );
+	}
+	printf("\n");
+	OCSP_RESPONSE_free( resp );
+}//eo print_response_status
+
+static int ocsp_bench( const char *root_dir, unsigned port, const char *serial, unsigned nb_requests, unsigned nb_connections )
+{
+	s_bench_job_t jobs[MAX_THREADS];
+	pthread_t     threads[MAX_THREADS];
+	int res = -1;
+
+	X509 *cacert = ca_load_root_cert( root_dir );
+	if( NULL == cacert ) {
+		warn("Failed to load the root certificate of %s", root_dir);
+		return -1;
+	}
+
+	// OCSP request for the serial, SHA-1 CertID as the pre-signed responses
+	BIGNUM        *bn   = NULL;
+	ASN1_INTEGER  *sn   = NULL;
+	OCSP_REQUEST  *req  = OCSP_REQUEST_new();
+	OCSP_CERTID   *id   = NULL;
+	unsigned char *der  = NULL;
+	unsigned char *post = NULL;
+	int der_len = -1;
+
+	if( 0 != BN_hex2bn( &bn, serial ) && NULL != (sn = BN_to_ASN1_INTEGER( bn, NULL )) ) {
+		id = OCSP_cert_id_new( EVP_sha1(), X509_get_subject_name(cacert), X509_get0_pubkey_bitstr(cacert), sn );
+	}
+	if( NULL != req && NULL != id && NULL != OCSP_request_add0_id( req, id ) ) {
+		id = NULL; // owned by the request
+		der_len = i2d_OCSP_REQUEST( req, &der );
+	}
+	if( der_len <= 0 ) {
+		warn("Failed to build the OCSP request for serial %s", serial);
+		goto cleanup;
+	}
+
+	char head[256];
+	int head_len = snprintf( head, sizeof(head),
+		"POST / HTTP/1.1\r\nHost: 127.0.0.1:%u\r\nContent-Type: application/ocsp-request\r\nContent-Length: %d\r\n\r\n",
+		port, der_len );
+	post = malloc( head_len + der_len );
+	if( NULL == post ) {
+		goto cleanup;
+	}
+	memcpy( post, head, head_len );
+	memcpy( post+head_len, der, der_len );
+
+	if( nb_connections > nb_requests ) {
+		nb_connections = nb_requests;
+	}
+
+	struct timespec start, stop;
+	clock_gettime( CLOCK_MONOTONIC, &start );
+
+	unsigned started = 0;
+	for( ; started<nb_connections; started++ ) {
+		memset( &jobs[started], 0, sizeof(s_bench_job_t) );
+		jobs[started].port        = port;
+		jobs[started].post        = post;
+		jobs[started].post_len    = head_len + der_len;
+		jobs[started].nb_requests = nb_requests/nb_connections + ( started < nb_requests%nb_connections ? 1 : 0 );
+		if( pthread_create( &threads[started], NULL, bench_worker, &jobs[started] ) ) {
+			break;
+		}
+	}
+
+	unsigned nb_ok = 0;
+	for( unsigned i=0; i<started; i++ ) {
+		pthread_join( threads[i], NULL );
+		nb_ok += jobs[i].nb_ok;
+	}
+	clock_gettime( CLOCK_MONOTONIC, &stop );
+
+	double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec)/1e9;
+	if( started > 0 && NULL != jobs[0].first_resp ) {
+		print_response_status( jobs[0].first_resp, jobs[0].first_len );
+	}
+	printf("%u/%u responses in %.3f s over %u connections: %.0f responses/s\n",
+		nb_ok, nb_requests, elapsed, started, elapsed > 0 ? nb_ok/elapsed : 0.0 );
+
+	for( unsigned i=0; i<started; i++ ) {
+		free( jobs[i].first_resp );
+	}
+	res = ( nb_ok == nb_requests ) ? 0 : -1;
+
+cleanup:
+	free( post );
+	OPENSSL_free( der );
+	OCSP_CERTID_free( id );
+	OCSP_REQUEST_free( req );
+	ASN1_INTEGER_free( sn );
+	BN_free( bn );
+	X509_free( cacert );
+	return res;
+}//eo ocsp_bench
+
+
+/**
+ * Program entry point
+ */
+int main( int argc, char** argv )
+{
+	if( argc < 2 || 0 == strcmp( argv[1], "--help" ) ) {
+		usage( argv[0] );
+		return argc < 2 ? -1 : 0;
+	}
+
+	const char *root_dir = find_param( argc, argv, "rootdir" );
+	if( NULL == root_dir ) {
+		usage( argv[0] );
+		die( -1, "missing --rootdir parameter" );
+	}
+	unsigned port = uint_param( argc, argv, "port", DEFAULT_OCSP_PORT, 1, 65535 );
+
+	// diagnostics are written by a background thread, off the request path
+	if( log_configure( getenv( LOG_ENV_VAR ) ) || log_configure( find_param( argc, argv, "log" ) ) ) {
+		die( -1, "invalid --log parameter or %s variable", LOG_ENV_VAR );
+	}
+	log_start( stderr );
+
+	// a client closing early must not kill the responder
+	signal( SIGPIPE, SIG_IGN );
+
+	if( 0 == strcmp( argv[1], "--serve" ) ) {
+		unsigned nb_threads = uint_param( argc, argv, "threads", DEFAULT_THREADS, 1, MAX_THREADS );
+		return ocsp_serve( root_dir, port, nb_threads ) ? -1 : 0;
+	}
+
+	if( 0 == strcmp( argv[1], "--bench" ) ) {
+		const char *serial = find_param( argc, argv, "serial" );
+		if( NULL == serial ) {
+			usage( argv[0] );
+			die( -1, "missing --serial parameter" );
+		}
+		unsigned nb_requests    = uint_param( argc, argv, "requests",    DEFAULT_REQUESTS,    1, 100000000 );
+		unsigned nb_connections = uint_param( argc, argv, "connections", DEFAULT_CONNECTIONS, 1, MAX_THREADS );
+		return ocsp_bench( root_dir, port, serial, nb_requests, nb_connections ) ? -1 : 0;
+	}
+
+	usage( argv[0] );
+	die( -1, "unknown mode %s", argv[1] );
+	return -1;
+}//eo main
+
+//eof
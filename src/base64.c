@@ -6,6 +6,11 @@
  *
  * \brief Base64 encoding / decoding
  *
+ * Scalar code with constant tables, plus SSSE3 and AVX2 kernels selected
+ * once at run time. The vector kernels only handle the bulk of the data,
+ * the scalar code always does the edges (padding, last quantum) and the
+ * validation error reporting.
+ *
  *
  * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
  *
@@ -14,7 +19,6 @@
  */
 
 
-//#define DEEPDEBUG 1
 
 #include <errno.h>
 #include <stdio.h>
@@ -23,47 +27,338 @@
 #include <assert.h>
 #include <string.h>
 #include <sys/types.h>
+#include <pthread.h>
 
 #include "utils.h"
+#include "trace.h"
 
-static uint8_t encoding_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
+#define B64_INVALID (0xFF)
 
-ssize_t base64_encode(char *encoded, const size_t max_size, const uint8_t *data, size_t input_length )
+static const char encoding_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 6 bits value of each character, B64_INVALID out of the alphabet ('=' included)
+static const uint8_t decoding_table[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/**
+ * \brief Bulk encoding kernel: encodes a prefix of the input made of whole
+ *        triplets and returns the number of input bytes consumed
+ */
+typedef size_t (*b64_encode_kernel_t)( char *out, const uint8_t *in, const size_t len );
+
+/**
+ * \brief Bulk decoding kernel: decodes a prefix of the input made of whole
+ *        valid quantums, stops before any invalid one, and returns the number
+ *        of characters consumed
+ */
+typedef size_t (*b64_decode_kernel_t)( uint8_t *out, const size_t max_out, const char *in, const size_t len );
+
+
+//////////////////////////////////////////////////////////////// Scalar
+
+static size_t encode_scalar( char *out, const uint8_t *in, const size_t len )
+{
+    size_t i;
+    for( i=0; i+3<=len; i+=3 ) {
+        const uint32_t triple = ((uint32_t)in[i] << 16) | ((uint32_t)in[i+1] << 8) | in[i+2];
+        *out++ = encoding_table[ (triple >> 18) & 0x3F ];
+        *out++ = encoding_table[ (triple >> 12) & 0x3F ];
+        *out++ = encoding_table[ (triple >>  6) & 0x3F ];
+        *out++ = encoding_table[  triple        & 0x3F ];
+    }
+    return i;
+}//eo encode_scalar
+
+static size_t decode_scalar( uint8_t *out, const size_t max_out, const char *in, const size_t len )
+{
+    const uint8_t *p = (const uint8_t*)in;
+    size_t i, j = 0;
+
+    for( i=0; i+4<=len && j+3<=max_out; i+=4 ) {
+        const uint32_t a = decoding_table[ p[i]   ];
+        const uint32_t b = decoding_table[ p[i+1] ];
+        const uint32_t c = decoding_table[ p[i+2] ];
+        const uint32_t d = decoding_table[ p[i+3] ];
+        if( (a | b | c | d) & 0x80 ) {
+            break;
+        }
+        const uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+        out[j++] = (triple >> 16) & 0xFF;
+        out[j++] = (triple >>  8) & 0xFF;
+        out[j++] =  triple        & 0xFF;
+    }
+    return i;
+}//eo decode_scalar
+
+
+//////////////////////////////////////////////////////////////// SIMD
+
+#if defined(BASE64_X86_SIMD)
+
+/*
+ * Vector algorithms from W. Mula and D. Lemire, "Faster Base64 Encoding and
+ * Decoding Using AVX2 Instructions": the 6 bits indices are split with
+ * multiplications, translated to ASCII with a pshufb offsets table, and the
+ * decoder checks the characters with two pshufb bitmaps indexed by nibbles.
+ */
+
+#define B64_ENCODE_SPLIT(in, set1_32, and, mulhi, mullo, or)                \
+    or( mulhi( and( (in), set1_32(0x0fc0fc00) ), set1_32(0x04000040) ),      \
+        mullo( and( (in), set1_32(0x003f03f0) ), set1_32(0x01000010) ) )
+
+__attribute__ ((target("ssse3")))
+static inline __m128i enc_translate_128( const __m128i idx )
+{
+    const __m128i shift_lut = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0 );
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+    __m128i r = _mm_subs_epu8( idx, _mm_set1_epi8(51) );
+    r = _mm_or_si128( r, _mm_and_si128( _mm_cmpgt_epi8( _mm_set1_epi8(26), idx ), _mm_set1_epi8(13) ) );
+    return _mm_add_epi8( _mm_shuffle_epi8( shift_lut, r ), idx );
+}//eo enc_translate_128
+
+__attribute__ ((target("ssse3")))
+static size_t encode_ssse3( char *out, const uint8_t *in, const size_t len )
+{
+    const __m128i shuf = _mm_set_epi8( 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1 );
+    size_t i = 0;
+
+    // 16 bytes loaded, 12 encoded
+    for( ; i+16<=len; i+=12, out+=16 ) {
+        const __m128i v   = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*)(in+i) ), shuf );
+        const __m128i idx = B64_ENCODE_SPLIT( v, _mm_set1_epi32, _mm_and_si128, _mm_mulhi_epu16, _mm_mullo_epi16, _mm_or_si128 );
+        _mm_storeu_si128( (__m128i*)out, enc_translate_128( idx ) );
+    }
+    return i;
+}//eo encode_ssse3
+
+__attribute__ ((target("ssse3")))
+static inline int dec_translate_128( const __m128i v, __m128i *values )
 {
-    static const char encoding_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    char *ptr = encoded;
+    const __m128i shift_lut = _mm_setr_epi8(
+        0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+    const __m128i mask_lut  = _mm_setr_epi8(
+        (char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8,
+        (char)0xF8, (char)0xF8, (char)0xF0, 0x54, 0x50, 0x50, 0x50, 0x54 );
+    const __m128i bit_lut   = _mm_setr_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0 );
 
-    size_t output_length = 4 * ( (input_length + 2) / 3);
-    if( max_size < output_length) {
-        DEBUG_PRN("base64_encode: destination buffer is too small (%u<%u)", max_size, output_length );
+    const __m128i hi = _mm_and_si128( _mm_srli_epi32( v, 4 ), _mm_set1_epi8(0x0F) );
+    const __m128i lo = _mm_and_si128( v, _mm_set1_epi8(0x0F) );
+
+    // a character is valid when its high nibble bit is set in the mask of its low nibble
+    const __m128i ok = _mm_and_si128( _mm_shuffle_epi8( mask_lut, lo ), _mm_shuffle_epi8( bit_lut, hi ) );
+    if( _mm_movemask_epi8( _mm_cmpeq_epi8( ok, _mm_setzero_si128() ) ) ) {
         return -1;
     }
 
-    unsigned i;
-    for( i=0; i<(input_length-2); i+=3 ) {
-        *ptr++ = encoding_table[ (data[i] >> 2) & 0x3F];
-        *ptr++ = encoding_table[ ( (data[i] & 0x3) << 4)   | ( (int)(data[i+1] & 0xF0) >> 4) ];
-        *ptr++ = encoding_table[ ( (data[i+1] & 0xF) << 2) | ( (int)(data[i+2] & 0xC0) >> 6) ];
-        *ptr++ = encoding_table[ data[i+2] & 0x3F ];
+    // '+' and '/' share the high nibble 2: 19 for '+', 16 for '/'
+    const __m128i slash = _mm_and_si128( _mm_cmpeq_epi8( v, _mm_set1_epi8('/') ), _mm_set1_epi8(-3) );
+    *values = _mm_add_epi8( v, _mm_add_epi8( _mm_shuffle_epi8( shift_lut, hi ), slash ) );
+    return 0;
+}//eo dec_translate_128
+
+__attribute__ ((target("ssse3")))
+static inline __m128i dec_pack_128( const __m128i values )
+{
+    const __m128i ab_bc = _mm_maddubs_epi16( values, _mm_set1_epi32(0x01400140) );
+    const __m128i abc   = _mm_madd_epi16( ab_bc, _mm_set1_epi32(0x00011000) );
+    return _mm_shuffle_epi8( abc, _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 ) );
+}//eo dec_pack_128
+
+__attribute__ ((target("ssse3")))
+static size_t decode_ssse3( uint8_t *out, const size_t max_out, const char *in, const size_t len )
+{
+    size_t i = 0, j = 0;
+
+    // 16 characters decoded to 12 bytes, 16 stored
+    for( ; i+16<=len && j+16<=max_out; i+=16, j+=12 ) {
+        __m128i values;
+        if( dec_translate_128( _mm_loadu_si128( (const __m128i*)(in+i) ), &values ) ) {
+            break;
+        }
+        _mm_storeu_si128( (__m128i*)(out+j), dec_pack_128( values ) );
     }
+    return i;
+}//eo decode_ssse3
 
-    if( i<input_length ) {
-        *ptr++ = encoding_table[ (data[i] >> 2) & 0x3F ];
-        if( i == (input_length-1) ) {
-            *ptr++ = encoding_table[((data[i] & 0x3) << 4)];
-            *ptr++ = '=';
-        } else {
-            *ptr++ = encoding_table[((data[i] & 0x3) << 4) 
-                | ((int)(data[i+1] & 0xF0) >> 4)];
-            *ptr++ = encoding_table[((data[i+1] & 0xF) << 2)];
+__attribute__ ((target("avx2")))
+static size_t encode_avx2( char *out, const uint8_t *in, const size_t len )
+{
+    const __m256i shuf = _mm256_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1 );
+    const __m256i shift_lut = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0 );
+    size_t i = 0;
+
+    // 2 x 16 bytes loaded, 24 encoded
+    for( ; i+28<=len; i+=24, out+=32 ) {
+        const __m128i lo = _mm_loadu_si128( (const __m128i*)(in+i) );
+        const __m128i hi = _mm_loadu_si128( (const __m128i*)(in+i+12) );
+        const __m256i v  = _mm256_shuffle_epi8( _mm256_inserti128_si256( _mm256_castsi128_si256(lo), hi, 1 ), shuf );
+        const __m256i idx = B64_ENCODE_SPLIT( v, _mm256_set1_epi32, _mm256_and_si256, _mm256_mulhi_epu16, _mm256_mullo_epi16, _mm256_or_si256 );
+        __m256i r = _mm256_subs_epu8( idx, _mm256_set1_epi8(51) );
+        r = _mm256_or_si256( r, _mm256_and_si256( _mm256_cmpgt_epi8( _mm256_set1_epi8(26), idx ), _mm256_set1_epi8(13) ) );
+        _mm256_storeu_si256( (__m256i*)out, _mm256_add_epi8( _mm256_shuffle_epi8( shift_lut, r ), idx ) );
+    }
+    return i + encode_ssse3( out, in+i, len-i );
+}//eo encode_avx2
+
+__attribute__ ((target("avx2")))
+static size_t decode_avx2( uint8_t *out, const size_t max_out, const char *in, const size_t len )
+{
+    const __m256i shift_lut = _mm256_setr_epi8(
+        0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+    const __m256i mask_lut  = _mm256_setr_epi8(
+        (char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8,
+        (char)0xF8, (char)0xF8, (char)0xF0, 0x54, 0x50, 0x50, 0x50, 0x54,
+        (char)0xA8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8, (char)0xF8,
+        (char)0xF8, (char)0xF8, (char)0xF0, 0x54, 0x50, 0x50, 0x50, 0x54 );
+    const __m256i bit_lut   = _mm256_setr_epi8(
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0 );
+    const __m256i pack_shuf = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 );
+    const __m256i pack_perm = _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, 3, 7 );
+    size_t i = 0, j = 0;
+
+    // 32 characters decoded to 24 bytes, 32 stored
+    for( ; i+32<=len && j+32<=max_out; i+=32, j+=24 ) {
+        const __m256i v  = _mm256_loadu_si256( (const __m256i*)(in+i) );
+        const __m256i hi = _mm256_and_si256( _mm256_srli_epi32( v, 4 ), _mm256_set1_epi8(0x0F) );
+        const __m256i lo = _mm256_and_si256( v, _mm256_set1_epi8(0x0F) );
+        const __m256i ok = _mm256_and_si256( _mm256_shuffle_epi8( mask_lut, lo ), _mm256_shuffle_epi8( bit_lut, hi ) );
+        if( _mm256_movemask_epi8( _mm256_cmpeq_epi8( ok, _mm256_setzero_si256() ) ) ) {
+            break;
         }
+        const __m256i slash  = _mm256_and_si256( _mm256_cmpeq_epi8( v, _mm256_set1_epi8('/') ), _mm256_set1_epi8(-3) );
+        const __m256i values = _mm256_add_epi8( v, _mm256_add_epi8( _mm256_shuffle_epi8( shift_lut, hi ), slash ) );
+        const __m256i ab_bc  = _mm256_maddubs_epi16( values, _mm256_set1_epi32(0x01400140) );
+        const __m256i abc    = _mm256_madd_epi16( ab_bc, _mm256_set1_epi32(0x00011000) );
+        const __m256i packed = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8( abc, pack_shuf ), pack_perm );
+        _mm256_storeu_si256( (__m256i*)(out+j), packed );
+    }
+    return i + decode_ssse3( out+j, max_out-j, in+i, len-i );
+}//eo decode_avx2
+
+#endif // BASE64_X86_SIMD
+
+
+//////////////////////////////////////////////////////////////// Dispatch
+
+static b64_encode_kernel_t encode_kernel = NULL;
+static b64_decode_kernel_t decode_kernel = NULL;
+static const char         *kernel_name   = NULL;
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Select the kernels for this CPU
+ */
+static void select_kernels_once( void )
+{
+    b64_encode_kernel_t enc = encode_scalar;
+    b64_decode_kernel_t dec = decode_scalar;
+    const char *name = "scalar";
+
+#if defined(BASE64_X86_SIMD)
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports("avx2") ) {
+        enc  = encode_avx2;
+        dec  = decode_avx2;
+        name = "AVX2";
+    } else if( __builtin_cpu_supports("ssse3") ) {
+        enc  = encode_ssse3;
+        dec  = decode_ssse3;
+        name = "SSSE3";
+    }
+#endif
+
+    DEBUG_PRN("base64: using %s kernels", name);
+    encode_kernel = enc;
+    decode_kernel = dec;
+    kernel_name   = name;
+}//eo select_kernels_once
+
+/**
+ * \brief Select the kernels for this CPU, once whatever the number of threads
+ */
+static void select_kernels()
+{
+    pthread_once( &kernels_once, select_kernels_once );
+}//eo select_kernels
+
+const char* base64_engine()
+{
+    select_kernels();
+    return kernel_name;
+}//eo base64_engine
+
+
+//////////////////////////////////////////////////////////////// API
+
+ssize_t base64_encode(char *encoded, const size_t max_size, const uint8_t *data, size_t input_length )
+{
+    assert( NULL != encoded );
+    assert( NULL != data || 0 == input_length );
+    TRACE_SPAN( span, "base64 encode", NULL );
+
+    const size_t output_length = 4 * ( (input_length + 2) / 3);
+    if( max_size < output_length + 1 ) {
+        DEBUG_PRN("base64_encode: destination buffer is too small (%zu<%zu)", max_size, output_length+1 );
+        return -1;
+    }
+
+    select_kernels();
+
+    // bulk
+    size_t i = encode_kernel( encoded, data, input_length );
+    char *ptr = encoded + (i / 3) * 4;
+    i += encode_scalar( ptr, data+i, input_length-i );
+    ptr = encoded + (i / 3) * 4;
+
+    // last 1 or 2 bytes, padded
+    if( i<input_length ) {
+        const uint32_t b0 = data[i];
+        const uint32_t b1 = (i+1 < input_length) ? data[i+1] : 0;
+        *ptr++ = encoding_table[ b0 >> 2 ];
+        *ptr++ = encoding_table[ ((b0 & 0x3) << 4) | (b1 >> 4) ];
+        *ptr++ = (i+1 < input_length) ? encoding_table[ (b1 & 0xF) << 2 ] : '=';
         *ptr++ = '=';
     }
 
     *ptr++ = '\0';
-    
-    DDEBUG_PRN("base64_encode finished [%s]", encoded );
+
+    DDEBUG_PRN("base64_encode finished (%zu bytes)", input_length );
     return ptr - encoded;
 }//eo base64_encode
 
@@ -72,70 +367,70 @@ ssize_t base64_decode( uint8_t *decoded, const size_t max_size, const char *enco
 {
     assert( NULL != encoded  );
     assert( NULL != decoded  );
-    assert( max_size > 1     );
+    TRACE_SPAN( span, "base64 decode", NULL );
 
-    const uint8_t * ptr = (uint8_t*)encoded;
+    const uint8_t *ptr = (const uint8_t*)encoded;
+    const size_t input_length = strlen(encoded);
 
-    size_t input_length = strlen(encoded);
     if ( input_length % 4 != 0 ) {
         DEBUG_PRN("base64_decode: invalid content size for base64");
         return -1;
     }
+    if( 0 == input_length ) {
+        return 0;
+    }
 
-    // init decoding table
-    static uint8_t decoding_table[256];
-    for (unsigned i = 0; i < 64; i++) {
-        decoding_table[ encoding_table[i] ] = i;
+    // '=' is only allowed as the last one or two characters
+    size_t pad = 0;
+    if( '=' == encoded[input_length-1] ) {
+        pad = ( '=' == encoded[input_length-2] ) ? 2 : 1;
     }
 
-    size_t output_length = input_length / 4 * 3;
-    if (encoded[input_length - 1] == '=') output_length--;
-    if (encoded[input_length - 2] == '=') output_length--;
+    const size_t output_length = input_length / 4 * 3 - pad;
+    if( max_size < output_length ) {
+        DEBUG_PRN("base64_decode: destination buffer is too small (%zu<%zu)", max_size, output_length);
+        return -1;
+    }
 
-    if( max_size < output_length) {
-        DEBUG_PRN("base64_decode: destination buffer is too small (%u<%u)", max_size, output_length);
+    select_kernels();
+
+    // every quantum but the last one: bulk then scalar, an invalid
+    // character stops both
+    const size_t body = input_length - 4;
+    size_t i = decode_kernel( decoded, output_length, encoded, body );
+    i += decode_scalar( decoded + (i / 4) * 3, output_length - (i / 4) * 3, encoded+i, body-i );
+    if( i != body ) {
+        DEBUG_PRN("base64_decode: invalid character in quantum at %u", (unsigned)i);
         return -1;
     }
 
-    uint32_t i = 0, j = 0; 
-    while( i < input_length ) {
-        uint32_t a = 
-            ( encoded[i] == '=' )? 
-            (0 & i++ ): 
-            decoding_table[ ptr[i++] ];
-        uint32_t b = 
-            ( encoded[i] == '=' )? 
-            (0 & i++ ): 
-            decoding_table[ ptr[i++] ];
-        uint32_t c = 
-            ( encoded[i] == '=' )? 
-            (0 & i++ ): 
-            decoding_table[ ptr[i++] ];
-        uint32_t d = 
-            ( encoded[i] == '=' )? 
-            (0 & i++ ): 
-            decoding_table[ ptr[i++] ];
-
-        uint32_t triple = 
-              (a << 3 * 6)
-            + (b << 2 * 6)
-            + (c << 1 * 6)
-            + (d << 0 * 6);
-
-        if ( j<output_length ) { 
-            decoded[j++] = (triple >> 2 * 8) & 0xFF; 
-        }
-        if ( j<output_length ) { 
-            decoded[j++] = (triple >> 1 * 8) & 0xFF; 
-        }
-        if ( j<output_length ) { 
-            decoded[j++] = (triple >> 0 * 8) & 0xFF; 
-        }
+    // last quantum, with its padding: the unused bits must be zero
+    const uint32_t a = decoding_table[ ptr[i]   ];
+    const uint32_t b = decoding_table[ ptr[i+1] ];
+    const uint32_t c = ( pad > 1 ) ? 0 : decoding_table[ ptr[i+2] ];
+    const uint32_t d = ( pad > 0 ) ? 0 : decoding_table[ ptr[i+3] ];
+    if( (a | b | c | d) & 0x80 ) {
+        DEBUG_PRN("base64_decode: invalid character in last quantum");
+        return -1;
+    }
+    if( ( 2 == pad && (b & 0x0F) ) || ( 1 == pad && (c & 0x03) ) ) {
+        DEBUG_PRN("base64_decode: non canonical padding");
+        return -1;
     }
 
+    const uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+    size_t j = (i / 4) * 3;
+    decoded[j++] = (triple >> 16) & 0xFF;
+    if( pad < 2 ) {
+        decoded[j++] = (triple >> 8) & 0xFF;
+    }
+    if( pad < 1 ) {
+        decoded[j++] = triple & 0xFF;
+    }
+    assert( j == output_length );
+
     DDEBUG_PRN("base64_decode finished");
 
     return output_length;
 }//eo base64_decode
 
-
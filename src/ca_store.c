@@ -0,0 +1,717 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file ca_store.c
+ *
+ * \brief In-process access to the PKI root material and certificate index
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include "utils.h"
+#include "ca_store.h"
+
+#define MAX_INDEX_LINE     (MAX_PKI_SUBJECT_LEN+256)
+#define INDEX_INITIAL_SIZE (16)
+
+#define DER_MAX_HEADER     (6)    // tag + length up to 2^32
+
+// Reason names as written by "openssl ca -revoke -crl_reason", indexed by code
+static const char * crl_reason_names[] = {
+	"unspecified",
+	"keyCompromise",
+	"CACompromise",
+	"affiliationChanged",
+	"superseded",
+	"cessationOfOperation",
+	"certificateHold",
+	NULL,
+	"removeFromCRL"
+};
+
+int ca_reason_from_name( const char *name )
+{
+	assert( NULL!=name );
+
+	for( unsigned i=0; i<sizeof(crl_reason_names)/sizeof(crl_reason_names[0]); i++ ) {
+		if( NULL!=crl_reason_names[i] && 0==strcasecmp( name, crl_reason_names[i] ) ) {
+			return (int)i;
+		}
+	}
+	return CRL_REASON_UNSET;
+}//eo ca_reason_from_name
+
+const char* ca_reason_to_name( const int reason )
+{
+	if( reason < 0 || reason >= (int)(sizeof(crl_reason_names)/sizeof(crl_reason_names[0])) ) {
+		return NULL;
+	}
+	return crl_reason_names[reason];
+}//eo ca_reason_to_name
+
+
+// split one cert.idx line: status \t expiry \t revocation[,reason] \t serial \t file \t subject
+static int parse_index_line( char *line, s_ca_index_entry_t *entry )
+{
+	char *fields[6];
+	char *ptr = line;
+
+	for( unsigned i=0; i<6; i++ ) {
+		fields[i] = ptr;
+		if( i<5 ) {
+			ptr = strchr( ptr, '\t' );
+			if( NULL == ptr ) {
+				return -1;
+			}
+			*ptr++ = '\0';
+		}
+	}
+	chomp( fields[5] );
+
+	secure_memzero( entry, sizeof(s_ca_index_entry_t) );
+	entry->status = fields[0][0];
+	entry->reason = CRL_REASON_UNSET;
+
+	strlcpy( entry->expiry,  fields[1], sizeof(entry->expiry) );
+	strlcpy( entry->serial,  fields[3], sizeof(entry->serial) );
+	strlcpy( entry->file,    fields[4], sizeof(entry->file) );
+	strlcpy( entry->subject, fields[5], sizeof(entry->subject) );
+
+	char *reason = strchr( fields[2], ',' );
+	if( NULL != reason ) {
+		*reason++ = '\0';
+		entry->reason = ca_reason_from_name( reason );
+	}
+	strlcpy( entry->revocation, fields[2], sizeof(entry->revocation) );
+
+	return 0;
+}//eo parse_index_line
+
+// make room for one more entry
+static int index_reserve( s_ca_index_t *idx )
+{
+	if( idx->nb_entries < idx->capacity ) {
+		return 0;
+	}
+	unsigned capacity = idx->capacity ? 2*idx->capacity : INDEX_INITIAL_SIZE;
+	s_ca_index_entry_t *entries = realloc( idx->entries, capacity*sizeof(s_ca_index_entry_t) );
+	if( NULL == entries ) {
+		warn("Failed to allocate memory for the certificate index");
+		return -1;
+	}
+	idx->entries  = entries;
+	idx->capacity = capacity;
+	return 0;
+}//eo index_reserve
+
+int ca_index_load( const char *dir, s_ca_index_t *idx )
+{
+	assert( NULL!=dir );
+	assert( NULL!=idx );
+
+	char filename[MAX_FILE_PATH+1];
+	char line[MAX_INDEX_LINE+1];
+
+	secure_memzero( idx, sizeof(s_ca_index_t) );
+	snprintf( filename, sizeof(filename), "%s/%s", dir, CERT_INDEX_FNAME );
+
+	FILE *fp = fopen( filename, "r" );
+	if( NULL == fp ) {
+		DEBUG_PRN("ca_index_load: failed to open '%s'", filename);
+		return -1;
+	}
+
+	while( NULL != fgets( line, sizeof(line), fp ) ) {
+		if( line[0]=='\0' || line[0]=='\n' ) {
+			continue;
+		}
+
+		if( index_reserve( idx ) ) {
+			fclose(fp);
+			ca_index_free(idx);
+			return -1;
+		}
+
+		if( parse_index_line( line, &(idx->entries[idx->nb_entries]) ) ) {
+			DEBUG_PRN("ca_index_load: skipping malformed line %u of '%s'", idx->nb_entries+1, filename);
+			continue;
+		}
+		idx->nb_entries++;
+	}
+
+	fclose(fp);
+	DDEBUG_PRN("ca_index_load: %u entries loaded from '%s'", idx->nb_entries, filename);
+	return 0;
+}//eo ca_index_load
+
+int ca_index_save( const char *dir, const s_ca_index_t *idx, s_atomic_group_t *grp )
+{
+	assert( NULL!=dir );
+	assert( NULL!=idx );
+
+	char filename[MAX_FILE_PATH+1];
+	s_atomic_group_t own;
+
+	snprintf( filename, sizeof(filename), "%s/%s", dir, CERT_INDEX_FNAME );
+
+	if( NULL == grp ) {
+		atomic_group_init( &own );
+	}
+	FILE *fp = atomic_group_open( NULL != grp ? grp : &own, filename );
+	if( NULL == fp ) {
+		DEBUG_PRN("ca_index_save: failed to open '%s'", filename);
+		if( NULL == grp ) {
+			atomic_group_abort( &own );
+		}
+		return -1;
+	}
+
+	int res = 0;
+	for( unsigned i=0; i<idx->nb_entries && 0==res; i++ ) {
+		const s_ca_index_entry_t *entry = &(idx->entries[i]);
+		const char *reason = ca_reason_to_name( entry->reason );
+
+		if( fprintf( fp, "%c\t%s\t%s%s%s\t%s\t%s\t%s\n",
+					entry->status, entry->expiry,
+					entry->revocation, reason ? "," : "", reason ? reason : "",
+					entry->serial, entry->file, entry->subject ) < 0 ) {
+			res = -1;
+		}
+	}
+
+	// a group of the caller is committed, or aborted, by the caller
+	if( NULL == grp ) {
+		if( res ) {
+			atomic_group_abort( &own );
+		} else {
+			res = atomic_group_commit( &own );
+		}
+	}
+	if( res ) {
+		DEBUG_PRN("ca_index_save: failed to write '%s'", filename);
+		return -1;
+	}
+
+	DDEBUG_PRN("ca_index_save: %u entries saved to '%s'", idx->nb_entries, filename);
+	return 0;
+}//eo ca_index_save
+
+int ca_index_append( s_ca_index_t *idx, const s_ca_index_entry_t *entry )
+{
+	assert( NULL!=idx );
+	assert( NULL!=entry );
+
+	if( index_reserve( idx ) ) {
+		return -1;
+	}
+	idx->entries[idx->nb_entries++] = *entry;
+	return 0;
+}//eo ca_index_append
+
+// compare two hexadecimal serials regardless of case and leading zeros
+static int serial_equals( const char *a, const char *b )
+{
+	while( *a=='0' && a[1]!='\0' ) a++;
+	while( *b=='0' && b[1]!='\0' ) b++;
+	return 0==strcasecmp( a, b );
+}//eo serial_equals
+
+s_ca_index_entry_t* ca_index_find( const s_ca_index_t *idx, const char *serial )
+{
+	assert( NULL!=idx );
+	assert( NULL!=serial );
+
+	for( unsigned i=0; i<idx->nb_entries; i++ ) {
+		if( serial_equals( idx->entries[i].serial, serial ) ) {
+			return &(idx->entries[i]);
+		}
+	}
+	return NULL;
+}//eo ca_index_find
+
+void ca_index_free( s_ca_index_t *idx )
+{
+	if( NULL == idx ) {
+		return;
+	}
+	free( idx->entries );
+	idx->entries    = NULL;
+	idx->nb_entries = 0;
+	idx->capacity   = 0;
+}//eo ca_index_free
+
+// identity of cert.idx: a save replaces the file, an external edit changes its time or size
+static int index_file_stat( const char *dir, struct stat *st )
+{
+	char filename[MAX_FILE_PATH+1];
+	snprintf( filename, sizeof(filename), "%s/%s", dir, CERT_INDEX_FNAME );
+	if( stat( filename, st ) ) {
+		DEBUG_PRN("index_file_stat: failed to stat '%s': %s", filename, strerror(errno));
+		return -1;
+	}
+	return 0;
+}//eo index_file_stat
+
+static void index_cache_record( s_ca_index_cache_t *cache, const struct stat *st )
+{
+	cache->dev    = st->st_dev;
+	cache->ino    = st->st_ino;
+	cache->size   = st->st_size;
+	cache->mtime  = st->st_mtim;
+	cache->loaded = 1;
+}//eo index_cache_record
+
+void ca_index_cache_init( s_ca_index_cache_t *cache )
+{
+	assert( NULL!=cache );
+
+	memset( cache, 0, sizeof(s_ca_index_cache_t) );
+	pthread_mutex_init( &(cache->lock), NULL );
+}//eo ca_index_cache_init
+
+void ca_index_cache_destroy( s_ca_index_cache_t *cache )
+{
+	if( NULL == cache ) {
+		return;
+	}
+	ca_index_cache_drop( cache );
+	pthread_mutex_destroy( &(cache->lock) );
+}//eo ca_index_cache_destroy
+
+s_ca_index_t* ca_index_cache_get( const char *dir, s_ca_index_cache_t *cache )
+{
+	assert( NULL!=dir );
+	assert( NULL!=cache );
+
+	// taken before reading: a change during the load is seen by the next call
+	struct stat st;
+	if( index_file_stat( dir, &st ) ) {
+		ca_index_cache_drop( cache );
+		return NULL;
+	}
+
+	if( cache->loaded && cache->dev == st.st_dev && cache->ino == st.st_ino && cache->size == st.st_size
+	 && cache->mtime.tv_sec == st.st_mtim.tv_sec && cache->mtime.tv_nsec == st.st_mtim.tv_nsec ) {
+		DDEBUG_PRN("ca_index_cache_get: %u cached entries for '%s'", cache->index.nb_entries, dir);
+		return &(cache->index);
+	}
+
+	ca_index_cache_drop( cache );
+	if( ca_index_load( dir, &(cache->index) ) ) {
+		return NULL;
+	}
+	index_cache_record( cache, &st );
+	return &(cache->index);
+}//eo ca_index_cache_get
+
+int ca_index_cache_save( const char *dir, s_ca_index_cache_t *cache )
+{
+	assert( NULL!=dir );
+	assert( NULL!=cache );
+
+	struct stat st;
+	if( ca_index_save( dir, &(cache->index), NULL ) || index_file_stat( dir, &st ) ) {
+		ca_index_cache_drop( cache );
+		return -1;
+	}
+	index_cache_record( cache, &st );
+	return 0;
+}//eo ca_index_cache_save
+
+void ca_index_cache_drop( s_ca_index_cache_t *cache )
+{
+	assert( NULL!=cache );
+
+	ca_index_free( &(cache->index) );
+	cache->loaded = 0;
+}//eo ca_index_cache_drop
+
+
+// parse a PEM certificate straight from the mapped file
+static X509* ca_read_cert_file( const char *filename )
+{
+	s_file_view_t view;
+	if( file_view_open( filename, &view ) ) {
+		return NULL;
+	}
+
+	X509 *cert = NULL;
+	BIO *in = view.size <= INT_MAX ? BIO_new_mem_buf( view.data, (int)view.size ) : NULL;
+	if( NULL != in ) {
+		cert = PEM_read_bio_X509( in, NULL, NULL, NULL );
+	}
+	BIO_free( in );
+	file_view_close( &view, 0 );
+	return cert;
+}//eo ca_read_cert_file
+
+int ca_cert_file_serial( const char *filename, char *serial, size_t max_size )
+{
+	assert( NULL!=filename );
+	assert( NULL!=serial );
+
+	X509 *cert = ca_read_cert_file( filename );
+	if( NULL == cert ) {
+		DEBUG_PRN("ca_cert_file_serial: failed to load '%s'", filename);
+		return -1;
+	}
+
+	int res = -1;
+	BIGNUM *bn = ASN1_INTEGER_to_BN( X509_get_serialNumber(cert), NULL );
+	char *hex = bn ? BN_bn2hex(bn) : NULL;
+	if( NULL != hex && strlcpy( serial, hex, max_size ) < max_size ) {
+		res = 0;
+	}
+
+	OPENSSL_free(hex);
+	BN_free(bn);
+	X509_free(cert);
+	return res;
+}//eo ca_cert_file_serial
+
+X509* ca_load_root_cert( const char *dir )
+{
+	assert( NULL!=dir );
+
+	char filename[MAX_FILE_PATH+1];
+	snprintf( filename, sizeof(filename), "%s/cacert/%s", dir, ROOT_CERT_FNAME );
+
+	X509 *cert = ca_read_cert_file( filename );
+	if( NULL == cert ) {
+		DEBUG_PRN("ca_load_root_cert: failed to load '%s'", filename);
+	}
+	return cert;
+}//eo ca_load_root_cert
+
+EVP_PKEY* ca_load_root_key( const char *dir, const char *password )
+{
+	assert( NULL!=dir );
+	assert( NULL!=password );
+
+	char filename[MAX_FILE_PATH+1];
+	snprintf( filename, sizeof(filename), "%s/private/%s", dir, ROOT_KEY_FNAME );
+
+	s_file_view_t view;
+	if( file_view_open( filename, &view ) ) {
+		DEBUG_PRN("ca_load_root_key: failed to open '%s'", filename);
+		return NULL;
+	}
+	EVP_PKEY *key = NULL;
+	BIO *in = view.size <= INT_MAX ? BIO_new_mem_buf( view.data, (int)view.size ) : NULL;
+	if( NULL != in ) {
+		key = PEM_read_bio_PrivateKey( in, NULL, NULL, (void*)password );
+	}
+	BIO_free(in);
+	file_view_close( &view, FILE_VIEW_WIPE );
+
+	if( NULL == key ) {
+		DEBUG_PRN("ca_load_root_key: failed to decrypt '%s'", filename);
+	}
+	return key;
+}//eo ca_load_root_key
+
+
+// append the DER encoding of a PEM certificate file to the chain being built
+static int chain_append_cert( BIO *chain, const char *cert_filename )
+{
+	X509 *cert = ca_read_cert_file( cert_filename );
+	if( NULL == cert ) {
+		DEBUG_PRN("chain_append_cert: failed to load '%s'", cert_filename);
+		return -1;
+	}
+
+	unsigned char *der = NULL;
+	int len = i2d_X509( cert, &der );
+	X509_free(cert);
+
+	int res = ( len > 0 && BIO_write( chain, der, len ) == len ) ? 0 : -1;
+	OPENSSL_free(der);
+	return res;
+}//eo chain_append_cert
+
+// rebuild the chain from the root certificate and the valid certificates of the index
+static int chain_bootstrap( const char *dir, const s_ca_index_t *index, BIO *chain )
+{
+	char filename[MAX_FILE_PATH+1];
+
+	snprintf( filename, sizeof(filename), "%s/cacert/%s", dir, ROOT_CERT_FNAME );
+	int res = chain_append_cert( chain, filename );
+
+	for( unsigned i=0; i<index->nb_entries && 0==res; i++ ) {
+		// a revoked or expired CA is no more a trust path
+		if( 'V' != index->entries[i].status ) {
+			continue;
+		}
+		snprintf( filename, sizeof(filename), "%s/certs/%s.pem", dir, index->entries[i].serial );
+		res = chain_append_cert( chain, filename );
+	}
+
+	if( res ) {
+		DEBUG_PRN("chain_bootstrap: failed to rebuild the chain of '%s'", dir);
+	}
+	return res;
+}//eo chain_bootstrap
+
+// write a DER tag and length, return the number of bytes written
+static size_t der_put_header( unsigned char *out, unsigned char tag, size_t len )
+{
+	size_t n = 0;
+	out[n++] = tag;
+	if( len < 0x80 ) {
+		out[n++] = (unsigned char)len;
+		return n;
+	}
+
+	unsigned nb_bytes = 0;
+	for( size_t l=len; l; l>>=8 ) {
+		nb_bytes++;
+	}
+	out[n++] = 0x80 | nb_bytes;
+	while( nb_bytes-- ) {
+		out[n++] = (unsigned char)(len >> (8*nb_bytes));
+	}
+	return n;
+}//eo der_put_header
+
+static size_t der_header_len( size_t len )
+{
+	unsigned char tmp[DER_MAX_HEADER];
+	return der_put_header( tmp, 0, len );
+}//eo der_header_len
+
+// degenerate PKCS#7 signed-data (certificates only, as "openssl crl2pkcs7 -nocrl")
+static int chain_write_p7( s_atomic_group_t *grp, const unsigned char *certs, const size_t certs_len, const char *p7_filename )
+{
+	static const unsigned char oid_signed_data[] = { 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x07, 0x02 };
+	static const unsigned char sd_prefix[] = {
+		0x02, 0x01, 0x01,                                                          // version 1
+		0x31, 0x00,                                                                // digestAlgorithms
+		0x30, 0x0B, 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x07, 0x01 // contentInfo: data
+	};
+	static const unsigned char sd_suffix[] = { 0x31, 0x00 };                     // signerInfos
+
+	if( 0 == certs_len ) {
+		DEBUG_PRN("chain_write_p7: empty chain for '%s'", p7_filename);
+		return -1;
+	}
+
+	size_t sd_len   = sizeof(sd_prefix) + der_header_len(certs_len) + certs_len + sizeof(sd_suffix);
+	size_t expl_len = der_header_len(sd_len) + sd_len;
+	size_t ci_len   = sizeof(oid_signed_data) + der_header_len(expl_len) + expl_len;
+	size_t total    = der_header_len(ci_len) + ci_len;
+
+	unsigned char *der = malloc( total );
+	if( NULL == der ) {
+		return -1;
+	}
+
+	size_t n = 0;
+	n += der_put_header( der+n, 0x30, ci_len );
+	memcpy( der+n, oid_signed_data, sizeof(oid_signed_data) );
+	n += sizeof(oid_signed_data);
+	n += der_put_header( der+n, 0xA0, expl_len );
+	n += der_put_header( der+n, 0x30, sd_len );
+	memcpy( der+n, sd_prefix, sizeof(sd_prefix) );
+	n += sizeof(sd_prefix);
+	n += der_put_header( der+n, 0xA0, certs_len );   // [0] IMPLICIT certificates
+
+	memcpy( der+n, certs, certs_len );
+	n += certs_len;
+	memcpy( der+n, sd_suffix, sizeof(sd_suffix) );
+	n += sizeof(sd_suffix);
+	assert( n == total );
+
+	int res = -1;
+	FILE *out = atomic_group_open( grp, p7_filename );
+	if( NULL != out && PEM_write( out, PEM_STRING_PKCS7, "", der, (long)total ) > 0 ) {
+		res = 0;
+	} else {
+		DEBUG_PRN("chain_write_p7: failed to write '%s'", p7_filename);
+	}
+
+	free( der );
+	return res;
+}//eo chain_write_p7
+
+// add the cache and the envelope of a chain to a write group
+static int chain_save( s_atomic_group_t *grp, const char *dir, BIO *chain )
+{
+	char cache_filename[MAX_FILE_PATH+1];
+	char p7_filename[MAX_FILE_PATH+1];
+	snprintf( cache_filename, sizeof(cache_filename), "%s/p7/%s", dir, CHAIN_CACHE_FNAME );
+	snprintf( p7_filename,    sizeof(p7_filename),    "%s/p7/%s", dir, CHAIN_P7_FNAME );
+
+	// the cache and the envelope are replaced in the same commit, each one atomically
+	unsigned char *certs = NULL;
+	long certs_len = BIO_get_mem_data( chain, &certs );
+	if( atomic_group_write( grp, cache_filename, certs, (size_t)certs_len )
+		|| chain_write_p7( grp, certs, (size_t)certs_len, p7_filename ) ) {
+		return -1;
+	}
+	return 0;
+}//eo chain_save
+
+int ca_chain_append( const char *dir, const char *cert_filename )
+{
+	assert( NULL!=dir );
+	assert( NULL!=cert_filename );
+
+	char cache_filename[MAX_FILE_PATH+1];
+	s_file_view_t view;
+	s_atomic_group_t grp;
+
+	snprintf( cache_filename, sizeof(cache_filename), "%s/p7/%s", dir, CHAIN_CACHE_FNAME );
+
+	BIO *chain = BIO_new( BIO_s_mem() );
+	if( NULL == chain ) {
+		return -1;
+	}
+
+	int res = -1;
+	if( 0 != access( cache_filename, F_OK ) ) {
+		// the index already lists the new certificate
+		s_ca_index_t index;
+		if( 0 == ca_index_load( dir, &index ) ) {
+			res = chain_bootstrap( dir, &index, chain );
+			ca_index_free( &index );
+		}
+	} else if( 0 == file_view_open( cache_filename, &view ) ) {
+		if( view.size <= INT_MAX && BIO_write( chain, view.data, (int)view.size ) == (int)view.size ) {
+			res = chain_append_cert( chain, cert_filename );
+		}
+		file_view_close( &view, 0 );
+	}
+	if( res ) {
+		DEBUG_PRN("ca_chain_append: failed to append '%s'", cert_filename);
+		BIO_free( chain );
+		return -1;
+	}
+
+	atomic_group_init( &grp );
+	res = chain_save( &grp, dir, chain ) || atomic_group_commit( &grp ) ? -1 : 0;
+	atomic_group_abort( &grp );
+
+	BIO_free( chain );
+	return res;
+}//eo ca_chain_append
+
+int ca_chain_rebuild( const char *dir, const s_ca_index_t *index, s_atomic_group_t *grp )
+{
+	assert( NULL!=dir );
+	assert( NULL!=index );
+	assert( NULL!=grp );
+
+	BIO *chain = BIO_new( BIO_s_mem() );
+	if( NULL == chain ) {
+		return -1;
+	}
+
+	int res = chain_bootstrap( dir, index, chain ) || chain_save( grp, dir, chain ) ? -1 : 0;
+	if( res ) {
+		DEBUG_PRN("ca_chain_rebuild: failed to rebuild the chain of '%s'", dir);
+	}
+	BIO_free( chain );
+	return res;
+}//eo ca_chain_rebuild
+
+// read a counter written by openssl: hexadecimal digits and a new line
+static int read_hex_counter( const char *filename, unsigned long *number )
+{
+	char value[MAX_SERIAL_LEN+1];
+
+	secure_memzero( value, sizeof(value) );
+	ssize_t res = file_slurp( filename, (uint8_t*)value, MAX_SERIAL_LEN );
+	if( res <= 0 ) {
+		DEBUG_PRN("read_hex_counter: failed to read '%s'", filename);
+		return -1;
+	}
+
+	errno = 0;
+	char *end = NULL;
+	unsigned long v = strtoul( value, &end, 16 );
+	if( errno || end == value ) {
+		DEBUG_PRN("read_hex_counter: invalid number '%s' in '%s'", value, filename);
+		return -1;
+	}
+
+	*number = v;
+	return 0;
+}//eo read_hex_counter
+
+static int write_hex_counter( const char *filename, const unsigned long number, s_atomic_group_t *grp )
+{
+	char value[MAX_SERIAL_LEN+1];
+
+	// openssl expects an even number of hex digits
+	int len = snprintf( value, sizeof(value), "%lX", number );
+	if( len % 2 ) {
+		len = snprintf( value, sizeof(value), "0%lX", number );
+	}
+	value[len++] = '\n';
+
+	int res = ( NULL != grp ) ? atomic_group_write( grp, filename, value, len ) : ( write_to_file( filename, len, value ) < 0 ? -1 : 0 );
+	if( res ) {
+		DEBUG_PRN("write_hex_counter: failed to write '%s'", filename);
+		return -1;
+	}
+	return 0;
+}//eo write_hex_counter
+
+int ca_read_crl_number( const char *dir, unsigned long *number )
+{
+	assert( NULL!=dir );
+	assert( NULL!=number );
+
+	char filename[MAX_FILE_PATH+1];
+	snprintf( filename, sizeof(filename), "%s/crl/%s", dir, CRL_SERIAL_FNAME );
+	return read_hex_counter( filename, number );
+}//eo ca_read_crl_number
+
+int ca_write_crl_number( const char *dir, const unsigned long number, s_atomic_group_t *grp )
+{
+	assert( NULL!=dir );
+
+	char filename[MAX_FILE_PATH+1];
+	snprintf( filename, sizeof(filename), "%s/crl/%s", dir, CRL_SERIAL_FNAME );
+	return write_hex_counter( filename, number, grp );
+}//eo ca_write_crl_number
+
+int ca_read_cert_serial( const char *dir, unsigned long *serial )
+{
+	assert( NULL!=dir );
+	assert( NULL!=serial );
+
+	char filename[MAX_FILE_PATH+1];
+	snprintf( filename, sizeof(filename), "%s/%s", dir, CERT_SERIAL_FNAME );
+	return read_hex_counter( filename, serial );
+}//eo ca_read_cert_serial
+
+int ca_write_cert_serial( const char *dir, const unsigned long serial, s_atomic_group_t *grp )
+{
+	assert( NULL!=dir );
+
+	char filename[MAX_FILE_PATH+1];
+	snprintf( filename, sizeof(filename), "%s/%s", dir, CERT_SERIAL_FNAME );
+	return write_hex_counter( filename, serial, grp );
+}//eo ca_write_cert_serial
+
+//eof
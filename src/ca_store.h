@@ -0,0 +1,294 @@
+/**
+ *
+ * \file ca_store.h
+ *
+ * \brief In-process access to the PKI root material and certificate index
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#if !defined( _S4_CA_STORE_H_ )
+#define _S4_CA_STORE_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#include "utils.h"
+#include "pki.h"
+
+#define ROOT_CERT_FNAME   ("root.crt")
+#define ROOT_KEY_FNAME    ("root.key")
+#define CERT_INDEX_FNAME  ("cert.idx")
+#define CERT_SERIAL_FNAME ("serial")
+#define CRL_SERIAL_FNAME  ("crl_serial")
+#define CHAIN_P7_FNAME    ("CAs.p7b")
+#define CHAIN_CACHE_FNAME ("CAs.der")
+
+#define MAX_ASN1_TIME_LEN (32)
+
+/**
+ * \brief One line of the OpenSSL "ca" certificate index (cert.idx)
+ */
+typedef struct SCAIndexEntry {
+    char status;                              // 'V'alid, 'R'evoked or 'E'xpired
+    char expiry[MAX_ASN1_TIME_LEN+1];         // YYMMDDHHMMSSZ
+    char revocation[MAX_ASN1_TIME_LEN+1];     // YYMMDDHHMMSSZ, empty when not revoked
+    int  reason;                              // CRL reason code, CRL_REASON_UNSET if none
+    char serial[MAX_SERIAL_LEN+1];            // upper case hexadecimal
+    char file[MAX_FILE_PATH+1];               // certificate file name, "unknown" for openssl
+    char subject[MAX_PKI_SUBJECT_LEN+1];
+} s_ca_index_entry_t;
+
+/**
+ * \brief Whole certificate index loaded in memory
+ */
+typedef struct SCAIndex {
+    s_ca_index_entry_t *entries;
+    unsigned            nb_entries;
+    unsigned            capacity;
+} s_ca_index_t;
+
+/**
+ * \brief Certificate index shared by the concurrent operations of a PKI
+ *
+ * Every writer of the index holds lock. The entries read or written last
+ * stay in memory and are used again as long as cert.idx is unchanged on disk.
+ */
+typedef struct SCAIndexCache {
+    pthread_mutex_t lock;
+    s_ca_index_t    index;
+    int             loaded;
+    // cert.idx the entries come from
+    dev_t           dev;
+    ino_t           ino;
+    off_t           size;
+    struct timespec mtime;
+} s_ca_index_cache_t;
+
+
+/**
+ * Load the certificate index of a PKI
+ *
+ * \param dir  root directory of the PKI
+ * \param idx  pointer to an allocated index structure, to release with ca_index_free
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_index_load( const char *dir, s_ca_index_t *idx );
+
+/**
+ * Save the certificate index of a PKI
+ *
+ * The index is written to a temporary file, made durable and renamed over 
+ * cert.idx, so that the whole set of changes is applied at once.
+ *
+ * \param dir  root directory of the PKI
+ * \param idx  index to save
+ * \param grp  atomic write group to add the file to, NULL to write it at once
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_index_save( const char *dir, const s_ca_index_t *idx, s_atomic_group_t *grp );
+
+/**
+ * Append an entry to an index loaded in memory
+ *
+ * \param idx    index to grow
+ * \param entry  entry to copy at the end of the index
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_index_append( s_ca_index_t *idx, const s_ca_index_entry_t *entry );
+
+/**
+ * Find an entry of the index by serial number
+ *
+ * \param idx     index to search
+ * \param serial  hexadecimal serial number (case and leading zeros independant)
+ *
+ * \return a pointer to the entry, NULL if not found
+ */
+s_ca_index_entry_t* ca_index_find( const s_ca_index_t *idx, const char *serial );
+
+/**
+ * Release the memory held by an index
+ *
+ * \param idx  index to cleanup
+ */
+void ca_index_free( s_ca_index_t *idx );
+
+/**
+ * Initialise an empty index cache
+ *
+ * \param cache  cache to initialise, to release with ca_index_cache_destroy
+ */
+void ca_index_cache_init( s_ca_index_cache_t *cache );
+
+/**
+ * Release the entries and the lock of an index cache
+ */
+void ca_index_cache_destroy( s_ca_index_cache_t *cache );
+
+/**
+ * Get the certificate index of a PKI, reloaded only if cert.idx changed
+ *
+ * The caller holds the lock of the cache, and drops the cache with
+ * ca_index_cache_drop if it modifies the entries without saving them.
+ *
+ * \param dir    root directory of the PKI
+ * \param cache  index cache of the PKI
+ *
+ * \return the index on success, owned by the cache, NULL on error
+ */
+s_ca_index_t* ca_index_cache_get( const char *dir, s_ca_index_cache_t *cache );
+
+/**
+ * Save the cached index of a PKI, see ca_index_save
+ *
+ * The caller holds the lock of the cache. The cache is dropped on failure.
+ *
+ * \param dir    root directory of the PKI
+ * \param cache  index cache of the PKI
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_index_cache_save( const char *dir, s_ca_index_cache_t *cache );
+
+/**
+ * Forget the cached entries, the next ca_index_cache_get reloads cert.idx
+ */
+void ca_index_cache_drop( s_ca_index_cache_t *cache );
+
+/**
+ * Convert a CRL reason name as written in cert.idx (ex: keyCompromise) to its code
+ *
+ * \param name  reason name (case independant)
+ *
+ * \return the reason code on success, CRL_REASON_UNSET if the name is unknown
+ */
+int ca_reason_from_name( const char *name );
+
+/**
+ * Get the name of a CRL reason code as written in cert.idx
+ *
+ * \param reason  reason code
+ *
+ * \return the name, NULL if the code is unknown
+ */
+const char* ca_reason_to_name( const int reason );
+
+/**
+ * Get the serial number of a certificate file
+ *
+ * \param filename  path to the PEM certificate
+ * \param serial    allocated buffer for the upper case hexadecimal serial
+ * \param max_size  size of the buffer
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_cert_file_serial( const char *filename, char *serial, size_t max_size );
+
+/**
+ * Load the PKI root certificate
+ *
+ * \param dir  root directory of the PKI
+ *
+ * \return the certificate on success (to free with X509_free), NULL on error
+ */
+X509* ca_load_root_cert( const char *dir );
+
+/**
+ * Load and decrypt the PKI root private key
+ *
+ * \param dir       root directory of the PKI
+ * \param password  passphrase of the root private key
+ *
+ * \return the key on success (to free with EVP_PKEY_free), NULL on error
+ */
+EVP_PKEY* ca_load_root_key( const char *dir, const char *password );
+
+/**
+ * Add a newly issued certificate to the PKCS#7 chain of CAs (p7/CAs.p7b)
+ *
+ * The DER encoded certificates of the chain are kept in p7/CAs.der in issuance
+ * order: a new certificate is appended to it and the PKCS#7 envelope is written
+ * around the cached bytes, no certificate of the chain is parsed again. Both
+ * files are still written whole, in a single atomic write group: the cost of an
+ * append grows with the size of the chain, in copies only.
+ * When the cache does not exist yet, it is rebuilt from the root certificate and
+ * the valid certificates of the index (certs/<serial>.pem), the new one included.
+ *
+ * \param dir            root directory of the PKI
+ * \param cert_filename  path to the new PEM certificate
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_chain_append( const char *dir, const char *cert_filename );
+
+/**
+ * Rebuild the PKCS#7 chain of CAs from an index, after a revocation
+ *
+ * The chain is made of the root certificate and the certificates with the
+ * status 'V' in the index. Its cache and envelope are added to a write group,
+ * committed or aborted by the caller with the index.
+ *
+ * \param dir    root directory of the PKI
+ * \param index  certificate index, as it will be saved
+ * \param grp    write group of the index
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_chain_rebuild( const char *dir, const s_ca_index_t *index, s_atomic_group_t *grp );
+
+/**
+ * Read the next CRL number from crl/crl_serial
+ *
+ * \param dir     root directory of the PKI
+ * \param number  pointer to an allocated unsigned long for the result
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_read_crl_number( const char *dir, unsigned long *number );
+
+/**
+ * Write the next CRL number to crl/crl_serial
+ *
+ * \param dir     root directory of the PKI
+ * \param number  next CRL number to use
+ * \param grp     atomic write group to add the file to, NULL to write it at once
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_write_crl_number( const char *dir, const unsigned long number, s_atomic_group_t *grp );
+
+/**
+ * Read the serial number of the next certificate from the serial file
+ *
+ * \param dir     root directory of the PKI
+ * \param serial  pointer to an allocated unsigned long for the result
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_read_cert_serial( const char *dir, unsigned long *serial );
+
+/**
+ * Write the serial number of the next certificate to the serial file
+ *
+ * \param dir     root directory of the PKI
+ * \param serial  next serial number to use
+ * \param grp     atomic write group to add the file to, NULL to write it at once
+ *
+ * \return 0 on success, -1 on error
+ */
+int ca_write_cert_serial( const char *dir, const unsigned long serial, s_atomic_group_t *grp );
+
+#endif
+//eof
@@ -27,12 +27,20 @@ static const char * cliopt_usage_str =
 "    --help     show this screen\n"
 "    --init     initialise a new PKI\n"
 "    --sign     sign a subca CSR\n"
-"    --revoke   revoke a subca\n"   
+"    --revoke   revoke one or more subca\n"   
+"    --crlbundle  sign a bundle of future CRL in one session\n"
+"    --ocspsign   sign the OCSP responses of every certificate for the 4s-ocsp responder\n"
+"    --serve      unlock once, then execute the requests of local clients on a Unix socket\n"
+"    --jobs       unlock once, then execute the sign, revoke and crl jobs of a file\n"
 "\n"
 "COMMON PARAMETERS\n"
 "    --rootdir=<path>  - [required] path to the PKI root directory\n"
 "    --secret=<path>   - [required] path to a secret. Must be specified for each shamir secret\n"
 "    --paused=<yes|no> - [optional] specifies wether the user should be prompted between secret file selection (default:no)\n"
+"    --metrics=<json|text> - [optional] print the time, CPU, memory and subprocesses of each step on success\n"
+"    --trace=<path>    - [optional] write a Chrome trace of the run, to open in Perfetto or chrome://tracing\n"
+"    --log=<levels>    - [optional] diagnostic levels: off, error, warn, info, debug or trace, for all the\n"
+"                        modules or per module, such as warn,pki=debug (default: $S4_LOG)\n"
 "\n"
 "INIT MODE PARAMETERS\n"
 "    --quorum=<n>      - [required] minimum number of secrets holders required to authorize operations\n"
@@ -45,8 +53,44 @@ static const char * cliopt_usage_str =
 "    --cert=<path>    - [required] path where to save the sub-CA certificate\n"
 "\n"
 "REVOKE MODE PARAMETERS\n"
-"    --cert=<certificate> - [required] path to certificate file to revoke\n"
-"    --crl=<path>         - [required] path where to write CRL\n"
+"    --cert=<certificate>[,<reason>] - [required] path to a certificate file to revoke. May be repeated\n"
+"    --serial=<hex>[,<reason>]       - [optional] serial number of a certificate to revoke. May be repeated\n"
+"    --crl=<path>                    - [required] path where to write CRL\n"
+"    The optional reason is a CRL reason name (keyCompromise, superseded, ...) or its code.\n"
+"    The index is updated once for all the certificates and a single CRL is signed.\n"
+"\n"
+"CRLBUNDLE MODE PARAMETERS\n"
+"    --count=<n>       - [optional] number of CRL to sign (default:52)\n"
+"    --period=<days>   - [optional] validity of each CRL in days (default:7)\n"
+"\n"
+"OCSPSIGN MODE PARAMETERS\n"
+"    --period=<days>   - [optional] validity of the OCSP responses in days (default:7)\n"
+"\n";
+
+// in two parts, C99 compilers only have to support 4095 characters long strings
+static const char * cliopt_usage_end_str = 
+"SERVE MODE PARAMETERS\n"
+"    --socket=<path>   - [required] path of the Unix domain socket to create\n"
+"    --timeout=<s>     - [optional] idle seconds before the service locks itself (default:600)\n"
+"    --queue=<n>       - [optional] number of requests waiting for execution (default:64)\n"
+"    --pki=<id>,<rootdir>,<secret>,<secret>[,...] - [optional] another PKI to serve. May be repeated\n"
+"    The PKI of --rootdir is served as \"default\". Each PKI is opened and unlocked once,\n"
+"    its configuration, root certificate and certificate index are kept in memory.\n"
+"    Only the processes of the service user may connect. Each request and response is\n"
+"    a frame: a 4 bytes big endian length, then the text. A request is the operation\n"
+"    (sign, revoke, crl, status or lock) on the first line, then key=value lines with\n"
+"    the parameters of the matching mode (csr, cert, serial, crl), an optional id and an\n"
+"    optional pki, the id of the PKI of the request (default: the PKI of --rootdir).\n"
+"    A response starts with an ok or error line, followed by key=value lines.\n"
+"\n"
+"JOBS MODE PARAMETERS\n"
+"    --file=<path>     - [required] job file, one JSON object per line\n"
+"    --result=<path>   - [optional] where to write the outcome of each job (default:<file>.result)\n"
+"    A job has an \"id\", an \"op\" (sign, revoke or crl), the parameters of the matching mode\n"
+"    (csr, cert, serial, crl; a list for several values) and an optional \"after\" list of ids.\n"
+"    The whole file is checked before the unlock. A revocation of a certificate signed by\n"
+"    the file waits for its signature, the revoke and crl jobs run in the order of the file,\n"
+"    independent signatures run in parallel.\n"
 "\n"
 "RETURN VALUES\n"
 "  0 on success\n"
@@ -57,12 +101,24 @@ static const char * cliopt_usage_str =
 "#Creating a new PKI with 5 secrets holders\n"
 "    %s --init --rootdir=/home/pki --subject=\"/CN=mypki/OU=it/O=company/C=FR\" --quorum=3 --nbshares=5\n"
 "\n"
-"#Revocation of a certificate\n"
-"    %s --revoke --rootdir=/home/pki --secret=secret1.smr --secret=secret2.smr --secret=secret3.smr --cert=subcacert.pem --crl=rootca.crl\n"
+"#Revocation of two certificates\n"
+"    %s --revoke --rootdir=/home/pki --secret=secret1.smr --secret=secret2.smr --secret=secret3.smr --cert=subcacert.pem,keyCompromise --serial=03,superseded --crl=rootca.crl\n"
 "\n"
 "#Signature of a sub-ca certificate\n"
 "    %s --sign --rootdir=/home/pki --secret=secret1.smr --secret=secret3.smr --secret=secret5.smr --csr=subcacsr.pem\n"
 "\n"
+"#One year of weekly CRL signed in one session\n"
+"    %s --crlbundle --rootdir=/home/pki --secret=secret1.smr --secret=secret2.smr --secret=secret3.smr --count=52 --period=7\n"
+"\n"
+"#OCSP responses valid for a week, then served by 4s-ocsp\n"
+"    %s --ocspsign --rootdir=/home/pki --secret=secret1.smr --secret=secret2.smr --secret=secret3.smr --period=7\n"
+"\n"
+"#One unlock for an hour of automated operations\n"
+"    %s --serve --rootdir=/home/pki --secret=secret1.smr --secret=secret2.smr --secret=secret3.smr --socket=/run/4s/pki.sock --timeout=3600\n"
+"\n"
+"#A whole ceremony under one unlock\n"
+"    %s --jobs --rootdir=/home/pki --secret=secret1.smr --secret=secret2.smr --secret=secret3.smr --file=ceremony.jsonl\n"
+"\n"
 "---\n"
 "Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016\n"
 "\n";
@@ -144,6 +200,10 @@ s_clioption* cli_parse_params( int argc, char *argv[], e_climodes *mode,  unsign
     if( strcmp( CLI_MODE_INIT_STR, mode_arg+2 ) == 0 )        { *mode = CLIModeInit;   } 
     else if( strcmp( CLI_MODE_SIGN_STR, mode_arg+2 ) == 0 )   { *mode = CLIModeSign;   } 
     else if( strcmp( CLI_MODE_REVOKE_STR, mode_arg+2 ) == 0 ) { *mode = CLIModeRevoke; } 
+    else if( strcmp( CLI_MODE_CRL_BUNDLE_STR, mode_arg+2 ) == 0 ) { *mode = CLIModeCRLBundle; } 
+    else if( strcmp( CLI_MODE_OCSP_SIGN_STR,  mode_arg+2 ) == 0 ) { *mode = CLIModeOCSPSign; } 
+    else if( strcmp( CLI_MODE_SERVE_STR,      mode_arg+2 ) == 0 ) { *mode = CLIModeServe; } 
+    else if( strcmp( CLI_MODE_JOBS_STR,       mode_arg+2 ) == 0 ) { *mode = CLIModeJobs; } 
     else {
    	    warn("'%s' is not a recognized mode", mode_arg);
    	    return NULL;
@@ -174,7 +234,8 @@ s_clioption* cli_parse_params( int argc, char *argv[], e_climodes *mode,  unsign
 
 void cli_usage( const char* exec_name )
 {
-	printf(cliopt_usage_str, exec_name, exec_name, exec_name, exec_name, exec_name);
+	printf(cliopt_usage_str, exec_name, exec_name);
+	printf(cliopt_usage_end_str, exec_name, exec_name, exec_name, exec_name, exec_name, exec_name, exec_name);
 }//eo usage
 
 
@@ -223,6 +284,18 @@ void cli_print_mode( e_climodes mode)
 		case CLIModeRevoke: 
 			str = CLI_MODE_REVOKE_STR;
 			break;
+		case CLIModeCRLBundle: 
+			str = CLI_MODE_CRL_BUNDLE_STR;
+			break;
+		case CLIModeOCSPSign: 
+			str = CLI_MODE_OCSP_SIGN_STR;
+			break;
+		case CLIModeServe: 
+			str = CLI_MODE_SERVE_STR;
+			break;
+		case CLIModeJobs: 
+			str = CLI_MODE_JOBS_STR;
+			break;
 		default: 
 			str = "Unknown mode";
 	}
@@ -244,7 +317,7 @@ void cli_require_option( const char* opt_name, const char* exe_name, s_clioption
 
     const char* res = NULL;
     find_required_opt( opt_name, exe_name, options_list, nb_options, &res );
-    DDEBUG_PRN("copying option result(%s): [%x]=> [%x] = %s", opt_name, res, dest, res);
+    DDEBUG_PRN("copying option result(%s): [%p]=> [%p] = %s", opt_name, (const void*)res, (void*)dest, res);
     size_t r = strlcpy(dest,res,max_len);
    	if( r > max_len ) {
    		die( -1, "option [%s] is too long", opt_name);
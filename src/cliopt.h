@@ -27,13 +27,21 @@ typedef enum ECLIModes  {
     CLIModeUnknown = 0,
     CLIModeInit    = 1,
     CLIModeSign    = 2,
-    CLIModeRevoke  = 3
+    CLIModeRevoke  = 3,
+    CLIModeCRLBundle = 4,
+    CLIModeOCSPSign  = 5,
+    CLIModeServe     = 6,
+    CLIModeJobs      = 7
 } e_climodes;
 
 
 #define CLI_MODE_INIT_STR   ("init")
 #define CLI_MODE_SIGN_STR   ("sign")
 #define CLI_MODE_REVOKE_STR ("revoke")
+#define CLI_MODE_CRL_BUNDLE_STR ("crlbundle")
+#define CLI_MODE_OCSP_SIGN_STR  ("ocspsign")
+#define CLI_MODE_SERVE_STR      ("serve")
+#define CLI_MODE_JOBS_STR       ("jobs")
 
 #define OPTION_ROOT_DIR ("rootdir")
 #define OPTION_SECRET   ("secret")
@@ -45,6 +53,21 @@ typedef enum ECLIModes  {
 #define OPTION_CERT     ("cert")
 #define OPTION_CSR      ("csr") 
 #define OPTION_CRL      ("crl") 
+#define OPTION_SERIAL   ("serial")
+#define OPTION_COUNT    ("count")
+#define OPTION_PERIOD   ("period")
+#define OPTION_SOCKET   ("socket")
+#define OPTION_TIMEOUT  ("timeout")
+#define OPTION_QUEUE    ("queue")
+#define OPTION_FILE     ("file")
+#define OPTION_RESULT   ("result")
+#define OPTION_METRICS  ("metrics")
+#define OPTION_TRACE    ("trace")
+#define OPTION_LOG      ("log")
+#define OPTION_PKI      ("pki")
+
+#define METRICS_FORMAT_JSON ("json")
+#define METRICS_FORMAT_TEXT ("text")
 
 /**
  *
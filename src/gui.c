@@ -27,8 +27,24 @@
 #include "gui_strings.h"
 
 
+// the running job is cancelled first, the window is closed once it is over
+static int gui_defer_quit( s_s4widgets *s4w )
+{
+	if( !s4w->job.running ) {
+		return 0;
+	}
+	s4w->job.quit_pending = 1;
+	gui_job_cancel( s4w );
+	return 1;
+}//eo gui_defer_quit
+
 static int onClosing(uiWindow *w, void *data)
 {
+	assert( NULL!=data );
+
+	if( gui_defer_quit( (s_s4widgets*)data ) ) {
+		return 0;
+	}
 	uiQuit();
 	return 1;
 }//eo onClosing
@@ -38,6 +54,9 @@ static int onShouldQuit(void *data)
 	assert( NULL!=data );
 
 	s_s4widgets *s4w = (s_s4widgets*)data;
+	if( gui_defer_quit( s4w ) ) {
+		return 0;
+	}
 	uiControlDestroy(uiControl(s4w->mainwin));
 	return 1;
 }//eo onShouldQuit
@@ -87,6 +106,7 @@ s_s4widgets* s4_init_widgets(const char * title, int w, int l, s_s4context * ctx
     secure_memzero( (void*)s4w, sizeof(s_s4widgets));
 
 	s4w->ctx=ctx;
+	pthread_mutex_init( &(s4w->job.lock), NULL );
 
     uiInitOptions options;
    	memset(&options, 0, sizeof (uiInitOptions));
@@ -122,6 +142,9 @@ void on_pki_locked ( s_s4widgets* s4w )
 
     uiControlDisable( uiControl(s4w->tab_pki_operations.txt_revoq_cert_file));
     uiControlDisable( uiControl(s4w->tab_pki_operations.btn_revoq_cert_file));
+    uiControlDisable( uiControl(s4w->tab_pki_operations.cbx_revoq_reason));
+    uiControlDisable( uiControl(s4w->tab_pki_operations.btn_revoq_add));
+    uiControlDisable( uiControl(s4w->tab_pki_operations.txt_revoq_list));
     uiControlDisable( uiControl(s4w->tab_pki_operations.btn_revocate));
 
     uiControlDisable( uiControl(s4w->tab_pki_operations.txt_csr_file));
@@ -150,6 +173,9 @@ void on_pki_unlocked ( s_s4widgets* s4w )
 
     uiControlEnable( uiControl(s4w->tab_pki_operations.txt_revoq_cert_file ));
     uiControlEnable( uiControl(s4w->tab_pki_operations.btn_revoq_cert_file ));
+    uiControlEnable( uiControl(s4w->tab_pki_operations.cbx_revoq_reason));
+    uiControlEnable( uiControl(s4w->tab_pki_operations.btn_revoq_add));
+    uiControlEnable( uiControl(s4w->tab_pki_operations.txt_revoq_list));
     uiControlEnable( uiControl(s4w->tab_pki_operations.btn_revocate ));
 
     uiControlEnable( uiControl(s4w->tab_pki_operations.txt_csr_file));
@@ -195,6 +221,9 @@ void s4_build_gui( s_s4widgets* s4w )
 	uiTabAppend( tab, "Create a new PKI",   create_pki_page(s4w) );
 	uiTabSetMargined( tab, 3, 1);
 
+	uiTabAppend( tab, "Operation details",  create_details_page(s4w) );
+	uiTabSetMargined( tab, 4, 1);
+
 	uiControlShow( uiControl( s4w->mainwin ) );
 
 	s4w->tab_create_pki.on_pki_uninitialized( s4w );	
@@ -14,6 +14,10 @@
 #if !defined( _S4_GUI_H_ )
 #define _S4_GUI_H_
 
+#include <pthread.h>
+
+#include "metrics.h"
+
 
 #define LIFE_LEN_STEP (5)
 
@@ -31,6 +35,38 @@ typedef void (*gui_entry_change_handler_t)   ( uiEntry   *s, void *data );
 
 typedef void (*gui_state_transition_handler_t) ( struct SS4Widgets* w );
 
+typedef int  (*gui_job_run_t)  ( struct SS4Widgets* w, s_s4eventhandlers_t *evt_handlers, void *arg );
+typedef void (*gui_job_done_t) ( struct SS4Widgets* w, void *arg, int result );
+
+// result given to the job completion handler when the operation was cancelled
+#define GUI_JOB_CANCELLED (-2)
+
+/**
+ * \brief PKI operation running on the worker thread
+ *
+ * Only one job runs at a time. The PKI events raised by the worker are queued
+ * to the main thread, where the usual pki_events_handlers process them.
+ */
+typedef struct SGuiJob {
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    int                 cancelled;     // protected by lock
+    int                 result;        // written by the worker, read once joined
+
+    // main thread only
+    int                 running;
+    int                 quit_pending;  // the window was closed during the job
+    uiButton           *btn;           // button which started the job, acting as cancel button meanwhile
+    const char         *btn_label;
+    gui_job_run_t       run;
+    gui_job_done_t      done;
+    void               *arg;
+
+    s_s4eventhandlers_t evt_handlers;  // handlers receiving the PKI events of the worker
+    s_metrics_t         metrics;       // measures of the steps, wrapping evt_handlers
+    s_s4eventhandlers_t *run_handlers; // handlers given to the PKI functions on the worker
+} s_gui_job_t;
+
 #define NEW_ROWBOX(box)                  \
     uiBox *(box) = uiNewHorizontalBox(); \
     uiBoxSetPadded( (box), 1)
@@ -190,7 +226,10 @@ typedef struct SS4Widgets
     Subject: <subject text>            | [ txt keyfile 2  ] [k2 btn]
     Nb Key holders: <lbl_num_holders>  | [ txt keyfile 3  ] [k3 btn]
     Quorum: <lbl_quorum>               | [ txt keyfile 4  ] [k4 btn]
-    -----------------------------------| [ txt keyfile 5  ] [k5 btn]
+    Root key size: <lbl_root_key>      | [ txt keyfile 5  ] [k5 btn]
+    Valid until: <lbl_root_validity>   |
+    SHA-256: <lbl_root_fingerprint>    |
+    -----------------------------------|
      [unlock btn]     [lock btn]       |
                                        |
 
@@ -201,6 +240,9 @@ typedef struct SS4Widgets
         uiLabel          *lbl_pki_subject;
         uiLabel          *lbl_nb_holders;
         uiLabel          *lbl_quorum;
+        uiLabel          *lbl_root_key;
+        uiLabel          *lbl_root_validity;
+        uiLabel          *lbl_root_fingerprint;
         uiLabel          *lbl_loaded_shares;
         uiButton         *btn_unlock;
         uiButton         *btn_lock;
@@ -221,7 +263,9 @@ typedef struct SS4Widgets
     Subject: <subject text>              |
     -------------------------------------|  Revoke sub-CA
                                          | [ certificate file ] [cert_ btn]
-    Nb sub-CA emitted: <lbl subca count> |                  [ publish CRL ]
+                                         | [ reason      ]        [ add ]
+                                         | [ revocation list             ]
+    Nb sub-CA emitted: <lbl subca count> |                     [ revoke ]
     Nb sub-CA revocated: <lbl>           |--------------------------------------
     Last CRL:                            | Sign sub-CA     
     -------------------------------------| [CSR file           ]  [CSR btn]
@@ -237,6 +281,9 @@ typedef struct SS4Widgets
 
         uiEntry          *txt_revoq_cert_file;
         uiButton         *btn_revoq_cert_file;
+        uiCombobox       *cbx_revoq_reason;
+        uiButton         *btn_revoq_add;
+        uiMultilineEntry *txt_revoq_list;
         uiButton         *btn_revocate;
 
         uiEntry          *txt_csr_file;
@@ -252,17 +299,35 @@ typedef struct SS4Widgets
 
         gui_button_click_handler_t    on_csr_sel_click;        
         gui_button_click_handler_t    on_cert_sel_click;   
+        gui_button_click_handler_t    on_revoke_add_click;
  
         gui_state_transition_handler_t  on_pki_loaded; 
 
     } tab_pki_operations;
 
+    struct {
+    /*
+    Last operation details
+    <lbl_operation>
+    +---------------------------------------------------------+
+    | stage    count  wall(s)  cpu(s)  child(s)  rss(kB) exec |
+    | ...                                                     |
+    +---------------------------------------------------------+
+    */
+        uiLabel          *lbl_operation;
+        uiMultilineEntry *txt_metrics;
+
+    } tab_details;
+
     // global events handlers
     gui_state_transition_handler_t  on_pki_unlocked;     
     gui_state_transition_handler_t  on_pki_locked;    
 
     // PKI event handlers
     s_s4eventhandlers_t pki_events_handlers;
+
+    // running PKI operation
+    s_gui_job_t job;
     
 } s_s4widgets;
 
@@ -288,6 +353,44 @@ s_s4widgets* s4_init_widgets(const char * title, int w, int l, s_s4context * ctx
  */
 void s4_build_gui( s_s4widgets* w );
 
+/**
+ * Run a PKI operation on the worker thread
+ *
+ * While the job runs, btn is labelled LABEL_BTN_CANCEL and cancels it. The
+ * done handler is called on the main thread with the result of run, or
+ * GUI_JOB_CANCELLED, and owns arg.
+ *
+ * \param s4w    user interface context
+ * \param btn    button which started the operation
+ * \param label  label to give back to btn once the job is over
+ * \param run    the operation, called on the worker thread
+ * \param done   completion handler, called on the main thread
+ * \param arg    operation data, given to run and done
+ *
+ * \return 0 if the job is started, -1 otherwise (done is not called)
+ */
+int gui_job_start( s_s4widgets *s4w, uiButton *btn, const char *label, gui_job_run_t run, gui_job_done_t done, void *arg );
+
+/**
+ * Filter the operation buttons clicks while a job runs
+ *
+ * A click on the button of the running job cancels it, a click on another
+ * operation button is refused.
+ *
+ * \param s4w    user interface context
+ * \param s      the clicked button
+ *
+ * \return 1 if a job is running and the click must be ignored, 0 otherwise
+ */
+int gui_job_busy( s_s4widgets *s4w, uiButton *s );
+
+/**
+ * Ask the running job, if any, to stop at its next step
+ *
+ * \param s4w    user interface context
+ */
+void gui_job_cancel( s_s4widgets *s4w );
+
 /**
  * create the pki creation tab
  */ 
@@ -308,6 +411,21 @@ uiControl *create_unlock_page( s_s4widgets * s4w );
  */
 uiControl *create_rekey_page( s_s4widgets * s4w );
 
+/**
+ * create the operation details page
+ */
+uiControl *create_details_page( s_s4widgets * s4w );
+
+/**
+ * Show the metrics of the last operation on the details page
+ *
+ * \param s4w        user interface context
+ * \param operation  name of the operation
+ * \param result     result of the operation, as given to the job completion handler
+ * \param m          stopped metrics of the operation
+ */
+void details_show_metrics( s_s4widgets * s4w, const char *operation, const int result, const s_metrics_t *m );
+
 #endif
 //eof
 
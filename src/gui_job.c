@@ -0,0 +1,240 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file gui_job.c
+ *
+ * \brief Worker thread running the PKI operations of the user interface
+ *
+ * libui is not thread safe: the worker never touches a widget, every PKI
+ * event it raises is copied and queued to the main thread with uiQueueMain.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+#include <ui.h>
+
+#include "shamir.h"
+#include "utils.h"
+#include "shared_secret.h"
+#include "gui.h"
+#include "gui_strings.h"
+#include "ui_ext.h"
+#include "metrics.h"
+
+/**
+ * PKI event raised by the worker, waiting for the main thread
+ */
+typedef struct SGuiJobEvent {
+    s_s4widgets *s4w;
+    int          pct;      // progress percentage, -1 for a warning
+    char         text[MAX_MESSAGE_SIZE+1];
+} s_gui_job_event_t;
+
+////////////////////////////////////////////// main thread side
+
+static void gui_job_dispatch_event( void *data )
+{
+    s_gui_job_event_t *evt = (s_gui_job_event_t*)data;
+    s_s4eventhandlers_t *handlers = &(evt->s4w->pki_events_handlers);
+
+    if( evt->pct < 0 ) {
+        if( NULL != handlers->on_warning ) {
+            handlers->on_warning( handlers->data, "%s", evt->text );
+        }
+    } else if( NULL != handlers->on_progress ) {
+        handlers->on_progress( handlers->data, evt->pct, evt->text );
+    }
+
+    free( evt );
+}//eo gui_job_dispatch_event
+
+static void gui_job_finished( void *data )
+{
+    s_s4widgets *s4w = (s_s4widgets*)data;
+    s_gui_job_t *job = &(s4w->job);
+
+    pthread_join( job->thread, NULL );
+
+    pthread_mutex_lock( &(job->lock) );
+    int cancelled = job->cancelled;
+    pthread_mutex_unlock( &(job->lock) );
+
+    // an operation cancelled after its last step has nonetheless succeeded
+    int result = ( cancelled && job->result ) ? GUI_JOB_CANCELLED : job->result;
+    DDEBUG_PRN("gui_job_finished: result=%d, cancelled=%d", job->result, cancelled);
+
+    job->running = 0;
+    uiButtonSetText( job->btn, job->btn_label );
+
+    metrics_stop( &(job->metrics) );
+    details_show_metrics( s4w, job->btn_label, result, &(job->metrics) );
+
+    if( GUI_JOB_CANCELLED == result && !job->quit_pending ) {
+        uiMsgBox( s4w->mainwin, "Operation cancelled", "The operation was cancelled, the PKI is left as it was before its last step." );
+    }
+
+    void *arg = job->arg;
+    job->arg = NULL;
+    job->done( s4w, arg, result );
+
+    if( job->quit_pending ) {
+        uiControlDestroy( uiControl(s4w->mainwin) );
+        uiQuit();
+    }
+}//eo gui_job_finished
+
+////////////////////////////////////////////// worker side
+
+static void gui_job_post( s_s4widgets *s4w, int pct, const char *fmt, va_list args )
+{
+    s_gui_job_event_t *evt = malloc( sizeof(s_gui_job_event_t) );
+    if( NULL == evt ) {
+        DEBUG_PRN("gui_job_post: event dropped, out of memory");
+        return;
+    }
+    evt->s4w = s4w;
+    evt->pct = pct;
+    vsnprintf( evt->text, sizeof(evt->text), fmt, args );
+
+    uiQueueMain( gui_job_dispatch_event, evt );
+}//eo gui_job_post
+
+static void gui_job_progress_handler( void *data, int pct, const char *msg )
+{
+    s_gui_job_event_t *evt = malloc( sizeof(s_gui_job_event_t) );
+    if( NULL == evt ) {
+        DEBUG_PRN("gui_job_progress_handler: event dropped, out of memory");
+        return;
+    }
+    evt->s4w = (s_s4widgets*)data;
+    evt->pct = pct < 0 ? 0 : pct;
+    strlcpy( evt->text, msg, sizeof(evt->text) );
+
+    uiQueueMain( gui_job_dispatch_event, evt );
+}//eo gui_job_progress_handler
+
+static void gui_job_warning_handler( void *data, const char *fmt, ... )
+{
+    va_list args;
+    va_start( args, fmt );
+    gui_job_post( (s_s4widgets*)data, -1, fmt, args );
+    va_end( args );
+}//eo gui_job_warning_handler
+
+static int gui_job_cancel_handler( void *data )
+{
+    s_gui_job_t *job = &(((s_s4widgets*)data)->job);
+
+    pthread_mutex_lock( &(job->lock) );
+    int cancelled = job->cancelled;
+    pthread_mutex_unlock( &(job->lock) );
+
+    return cancelled;
+}//eo gui_job_cancel_handler
+
+static void* gui_job_worker( void *data )
+{
+    s_s4widgets *s4w = (s_s4widgets*)data;
+    s_gui_job_t *job = &(s4w->job);
+
+    job->result = job->run( s4w, job->run_handlers, job->arg );
+
+    // queued after all the events of the job: the main thread sees them first
+    uiQueueMain( gui_job_finished, s4w );
+    return NULL;
+}//eo gui_job_worker
+
+///////////////////////////////// Exported functions
+
+int gui_job_start( s_s4widgets *s4w, uiButton *btn, const char *label, gui_job_run_t run, gui_job_done_t done, void *arg )
+{
+    assert( NULL!=s4w );
+    assert( NULL!=btn );
+    assert( NULL!=run );
+    assert( NULL!=done );
+
+    s_gui_job_t *job = &(s4w->job);
+    if( job->running ) {
+        uiMsgBox( s4w->mainwin, "Operation in progress", "Wait for the running operation to end, or cancel it." );
+        return -1;
+    }
+
+    pthread_mutex_lock( &(job->lock) );
+    job->cancelled = 0;
+    pthread_mutex_unlock( &(job->lock) );
+
+    job->result    = -1;
+    job->btn       = btn;
+    job->btn_label = label;
+    job->run       = run;
+    job->done      = done;
+    job->arg       = arg;
+
+    job->evt_handlers.data           = (void*)s4w;
+    job->evt_handlers.on_progress    = gui_job_progress_handler;
+    job->evt_handlers.on_warning     = gui_job_warning_handler;
+    job->evt_handlers.do_message     = NULL;
+    job->evt_handlers.do_file_prompt = NULL;
+    job->evt_handlers.is_cancelled   = gui_job_cancel_handler;
+    job->run_handlers = metrics_start( &(job->metrics), &(job->evt_handlers), label );
+
+    int err = pthread_create( &(job->thread), NULL, gui_job_worker, s4w );
+    if( err ) {
+        warn("gui_job_start: failed to start the worker thread: %s", strerror(err));
+        uiErrorBoxPrintf( s4w->mainwin, "Operation failed", "Unable to start the operation: %s", strerror(err) );
+        job->arg = NULL;
+        metrics_stop( &(job->metrics) );
+        return -1;
+    }
+
+    job->running = 1;
+    uiButtonSetText( btn, LABEL_BTN_CANCEL );
+    return 0;
+}//eo gui_job_start
+
+int gui_job_busy( s_s4widgets *s4w, uiButton *s )
+{
+    assert( NULL!=s4w );
+
+    s_gui_job_t *job = &(s4w->job);
+    if( !job->running ) {
+        return 0;
+    }
+
+    if( s == job->btn ) {
+        gui_job_cancel( s4w );
+    } else {
+        uiMsgBox( s4w->mainwin, "Operation in progress", "Wait for the running operation to end, or cancel it." );
+    }
+    return 1;
+}//eo gui_job_busy
+
+void gui_job_cancel( s_s4widgets *s4w )
+{
+    assert( NULL!=s4w );
+
+    s_gui_job_t *job = &(s4w->job);
+    if( !job->running ) {
+        return;
+    }
+
+    pthread_mutex_lock( &(job->lock) );
+    job->cancelled = 1;
+    pthread_mutex_unlock( &(job->lock) );
+
+    uiButtonSetText( job->btn, LABEL_BTN_CANCELLING );
+}//eo gui_job_cancel
+
+//eof
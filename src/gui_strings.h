@@ -18,6 +18,7 @@
 #define DEFAULT_ROOT_CDP             ("http://revocation.pki.orgationsation.org/crl/org-pki.crl")
 #define DEFAULT_CERT_CONTENT         ("\n\n< PKI root certificate >\n\n") 
 #define DEFAULT_NUM                  ("0")
+#define DEFAULT_UNKNOWN              ("-")
 #define DEFAULT_TIMESTAMP            ("01/01/2016 00:00")
 #define DEFAULT_PKI_DIR              ("/where to find the PKI")
 #define DEFAULT_INPUT_FILE           ("/where to find the file")
@@ -32,6 +33,9 @@
 #define LABEL_ROOT_KEYSIZE           ("RSA root key size (bits):")
 #define LABEL_SHARE_COUNT            ("Number of share holders:")
 #define LABEL_QUORUM_SIZE            ("quorum size:")
+#define LABEL_ROOT_KEY               ("Root key size:")
+#define LABEL_ROOT_VALIDITY          ("Root certificate valid until:")
+#define LABEL_ROOT_FINGERPRINT       ("Root certificate SHA-256:")
 
 #define LABEL_OP_STATUS              ("Operations status:")
 #define LABEL_CERT_FNAME             ("Root certificate (PEM):")
@@ -52,11 +56,15 @@
 #define LABEL_BTN_EXPORT_RESET       ("Restart shares export")
 #define LABEL_BTN_SEL_CERT           ("Select the certificate")
 #define LABEL_BTN_REVOKE             ("Revocate")
+#define LABEL_BTN_REVOKE_ADD         ("Add to the list")
+#define LABEL_REVOKE_NO_REASON       ("No revocation reason")
 #define LABEL_BTN_REKEY              ("Regenerate secret share")
 #define LABEL_BTN_SEL_CSR            ("Select the request")
 #define LABEL_BTN_SIGN               ("Sign")
 #define LABEL_BTN_SHARE_LOAD         ("Load share %u")
 #define LABEL_BTN_GEN_CRL            ("Generate CRL")
+#define LABEL_BTN_CANCEL             ("Cancel")
+#define LABEL_BTN_CANCELLING         ("Cancelling...")
 
 #define LABEL_GROUP_PKI_PARAMETERS   ("PKI parameters")
 #define LABEL_GROUP_SHARE_PARAMETERS ("Shamir Share parameters")
@@ -67,12 +75,19 @@
 #define LABEL_GROUP_SIGNATURE        ("Sign a sub-CA")
 #define LABEL_GROUP_SHARES           ("Shamir shares")
 #define LABEL_GROUP_CRL              ("Generate CRL")
+#define LABEL_GROUP_DETAILS          ("Last operation details")
 #define LABEL_SHARE_LOADED_INIT      ("0/0 shares loaded / pki locked")
 #define LABEL_SHARE_LOADED           ("%u/%u shares loaded / pki %s")
 
 #define LABEL_PKI_STATUS_LOCKED      (" - LOCKED - ")
 #define LABEL_PKI_STATUS_UNLOCKED    (" - UNLOCKED - ")
 
+#define LABEL_DETAILS_NONE           ("No operation run yet")
+#define LABEL_DETAILS_OPERATION      ("%s: %s in %.3f s")
+#define LABEL_DETAILS_SUCCEEDED      ("succeeded")
+#define LABEL_DETAILS_FAILED         ("failed")
+#define LABEL_DETAILS_CANCELLED      ("cancelled")
+
 #define HASH_SHA256                  ("sha256")
 #define HASH_SHA512                  ("sha512")
 
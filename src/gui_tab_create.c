@@ -13,7 +13,6 @@
  *
  */
 
-#define DEEPDEBUG 1
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -197,6 +196,67 @@ static void onOpenPKISelDirClicked( uiButton * s, void * data )
 
 }//eo onOpenPKISelDirClicked
 
+/**
+ * PKI creation parameters, copied for the worker thread
+ */
+typedef struct SCreateJob {
+    s_pki_parameters_t params;
+    char               passphrase[MAX_B64_ENC_PASS_SIZE+1];
+    unsigned           nb_share;
+    unsigned           quorum;
+} s_create_job_t;
+
+static void free_create_job( s_create_job_t *job )
+{
+    secure_memzero( job, sizeof(s_create_job_t) );
+    free( job );
+}//eo free_create_job
+
+/**
+ * PKI creation, on the worker thread
+ */
+static int run_create_job( s_s4widgets * s4w, s_s4eventhandlers_t * evt_handlers, void * arg )
+{
+    s_create_job_t *job = (s_create_job_t*)arg;
+    return gen_self_signed( job->params.root_dir, &(job->params), job->passphrase, job->nb_share, job->quorum, evt_handlers );
+}//eo run_create_job
+
+/**
+ * End of the PKI creation, back on the main thread
+ */
+static void on_create_done( s_s4widgets * s4w, void * arg, int result )
+{
+    s_s4context * s4c = s4w->ctx;
+    s_create_job_t *job = (s_create_job_t*)arg;
+
+    if( result ) {
+        if( GUI_JOB_CANCELLED != result ) {
+            uiErrorBoxPrintf(s4w->mainwin, "PKI Generation failed", "Unable to initialize the PKI");
+        }
+        free_create_job( job );
+        return;
+    }
+
+    s4c->secret_unlocked=1;
+    
+    // loading cert description
+    const s_ca_cert_infos_t *infos = s4_load_root_cert_infos( s4c, job->params.root_dir );
+    if( NULL != infos ) {
+        DDEBUG_PRN("onCreateClicked: root certificate: %s", infos->text);
+        uiMultilineEntrySetText( CURRENT_TAB.txt_root_cert, infos->text);
+    } else {
+        warn("onCreateClicked: failed to read CA cert infos from '%s'", job->params.root_dir);
+    }
+    free_create_job( job );
+
+    CURRENT_TAB.on_pki_initialized(s4w);
+    
+    if( s4_split( s4c, &(s4w->pki_events_handlers) ) ) {
+        uiErrorBoxPrintf(s4w->mainwin, "Secret splitting failed","Unable to perform Shamir secret splitting");
+        return;        
+    }    
+}//eo on_create_done
+
 /**
  * Event handler for when PKI creation button is clicked
  */
@@ -208,6 +268,10 @@ static void onCreateClicked( uiButton * s, void * data )
     s_s4widgets * s4w = (s_s4widgets*)data;
     s_s4context * s4c = s4w->ctx;
     assert( NULL != s4c );
+
+    if( gui_job_busy( s4w, s ) ) {
+        return;
+    }
     
     CTX_CPY( pki_params.subject, uiEntryText( CURRENT_TAB.txt_pki_subject ), MAX_PKI_SUBJECT_LEN );     
 
@@ -226,33 +290,22 @@ static void onCreateClicked( uiButton * s, void * data )
     }
     
     gen_pass( s4c->passphrase, MAX_B64_ENC_PASS_SIZE);
-    printf("Pass : %s\n",s4c->passphrase);
 
-    if( gen_self_signed( rootdir, &(s4c->pki_params), s4c->passphrase, s4c->nb_share, s4c->quorum,  &(s4w->pki_events_handlers)) ) {
-        uiErrorBoxPrintf(s4w->mainwin, "PKI Generation failed", "Unable to initialize the PKI");
+    // the worker gets its own copy: the widgets may change the context meanwhile
+    s_create_job_t *job = calloc( 1, sizeof(s_create_job_t) );
+    if( NULL == job ) {
+        uiErrorBoxPrintf(s4w->mainwin, "PKI Generation failed", "Failed to allocate memory for the PKI creation");
         return;
     }
+    memcpy( &(job->params), &(s4c->pki_params), sizeof(s_pki_parameters_t) );
+    strlcpy( job->passphrase, s4c->passphrase, sizeof(job->passphrase) );
+    job->nb_share = s4c->nb_share;
+    job->quorum   = s4c->quorum;
 
-    s4c->secret_unlocked=1;
-    
-    // loading cert description
-    char cert_buffer[16384];
-    secure_memzero(cert_buffer, sizeof(cert_buffer));
-    ssize_t  res = read_ca_cert_infos( rootdir, cert_buffer, sizeof(cert_buffer) );
-    if( res > 0 ) {
-        DDEBUG_PRN("onCreateClicked: root certificate: %s", cert_buffer);
-        uiMultilineEntrySetText( CURRENT_TAB.txt_root_cert, cert_buffer);
-    } else {
-        warn("onCreateClicked: failed to read CA cert infos from '%s' (res:%d)", rootdir, res);
+    if( gui_job_start( s4w, s, LABEL_BTN_CREATE, run_create_job, on_create_done, job ) ) {
+        free_create_job( job );
     }
 
-    CURRENT_TAB.on_pki_initialized(s4w);
-    
-    if( s4_split( s4c, &(s4w->pki_events_handlers) ) ) {
-        uiErrorBoxPrintf(s4w->mainwin, "Secret splitting failed","Unable to perform Shamir secret splitting");
-        return;        
-    }    
-
 }//eo onRunClicked
 
 static void onExportShareClicked( uiButton * s, void * data )
@@ -274,6 +327,11 @@ static void onExportShareClicked( uiButton * s, void * data )
     if( s4c->nb_share_exported == s4c->nb_share ) {
         s4c->nb_share_exported = 0;
     }
+    if( s4c->nb_share_exported >= s4c->nb_share_slots ) {
+        uiErrorBoxPrintf( s4w->mainwin, "Export failed", "No Shamir share to export: split the secret first" );
+        uiFreeText(filename);
+        return;
+    }
     //Export next share
     int res = save_shamir_secret( filename, &(s4c->shares[s4c->nb_share_exported]));
     if( res ) {
@@ -284,7 +342,8 @@ static void onExportShareClicked( uiButton * s, void * data )
             s4c->nb_share_exported+1, filename 
         );
     } else {
-        uiMsgBoxPrintf( s4w->mainwin, "Export succedeed", "%uth Shamir share saved to '%s'", s4c->nb_share_exported, filename);
+        uiMsgBoxPrintf( s4w->mainwin, "Export succedeed", "%uth Shamir share saved to '%s'\nFingerprint: %s",
+            s4c->nb_share_exported, filename, s4c->share_fingerprints[s4c->nb_share_exported] );
         s4c->nb_share_exported++;
         
         int pct = INTPCT(s4c->nb_share, s4c->nb_share_exported); 
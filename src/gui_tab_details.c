@@ -0,0 +1,79 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file gui_tab_details.c
+ *
+ * \brief Details of the last PKI operation: time and resources of each step
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+
+#include <ui.h>
+
+#include "shamir.h"
+#include "utils.h"
+#include "shared_secret.h"
+#include "gui.h"
+#include "gui_strings.h"
+#include "ui_ext.h"
+#include "metrics.h"
+
+#define CURRENT_TAB s4w->tab_details
+
+// size of the metrics table shown
+#define MAX_DETAILS_TEXT (MAX_METRICS_STAGES*128)
+
+void details_show_metrics( s_s4widgets * s4w, const char *operation, const int result, const s_metrics_t *m )
+{
+    assert( NULL!=s4w );
+    assert( NULL!=operation );
+    assert( NULL!=m );
+
+    char title[MAX_MESSAGE_SIZE];
+    const char *outcome = ( 0 == result )                 ? LABEL_DETAILS_SUCCEEDED
+                        : ( GUI_JOB_CANCELLED == result ) ? LABEL_DETAILS_CANCELLED
+                        :                                   LABEL_DETAILS_FAILED;
+    snprintf( title, sizeof(title), LABEL_DETAILS_OPERATION, operation, outcome, m->total.wall );
+    uiLabelSetText( CURRENT_TAB.lbl_operation, title );
+
+    char *text = malloc( MAX_DETAILS_TEXT );
+    if( NULL == text ) {
+        DEBUG_PRN("details_show_metrics: out of memory");
+        return;
+    }
+    if( metrics_format_text( m, text, MAX_DETAILS_TEXT ) < 0 ) {
+        DEBUG_PRN("details_show_metrics: metrics table truncated");
+    }
+    uiMultilineEntrySetText( CURRENT_TAB.txt_metrics, text );
+    free( text );
+}//eo details_show_metrics
+
+uiControl *create_details_page( s_s4widgets * s4w )
+{
+    assert( NULL!=s4w );
+
+    NEW_GROUP( group_details, vbox_details, LABEL_GROUP_DETAILS );
+
+    CURRENT_TAB.lbl_operation = uiNewLabel( LABEL_DETAILS_NONE );
+    CURRENT_TAB.txt_metrics   = uiNewNonWrappingMultilineEntry();
+    uiMultilineEntrySetReadOnly( CURRENT_TAB.txt_metrics, 1 );
+
+    BOX_APPEND( vbox_details, CURRENT_TAB.lbl_operation, 0 );
+    BOX_APPEND( vbox_details, CURRENT_TAB.txt_metrics,   1 );
+
+    return uiControl( group_details );
+}//eo create_details_page
+
+//eof
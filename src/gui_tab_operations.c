@@ -29,6 +29,7 @@
 #include "gui_strings.h"
 #include "ui_ext.h"
 #include "pki.h"
+#include "ca_store.h"
 
 #define CURRENT_TAB s4w->tab_pki_operations
 #define CTX_CPY(var,val,max) if(1) { strlcpy( (s4w->ctx->var), (val), (max)); }
@@ -90,6 +91,59 @@ static void on_csr_file_sel_clicked( uiButton * s, void * data )
     uiFreeText(filename);
 }//eo onOpenPKISelDirClicked
 
+/**
+ * PKI operation parameters, copied for the worker thread
+ */
+typedef struct SOperationJob {
+    char                    dir[MAX_FILE_PATH+1];
+    char                    in_path[MAX_FILE_PATH+1];
+    char                    out_path[MAX_FILE_PATH+1];
+    char                    passphrase[MAX_B64_ENC_PASS_SIZE+1];
+    s_revocation_request_t *requests;
+    unsigned                nb_requests;
+} s_operation_job_t;
+
+static s_operation_job_t* new_operation_job( s_s4widgets * s4w )
+{
+    s_operation_job_t *job = calloc( 1, sizeof(s_operation_job_t) );
+    if( NULL == job ) {
+        uiErrorBoxPrintf(s4w->mainwin, "Operation failed", "Failed to allocate memory for the operation" );
+        return NULL;
+    }
+    strlcpy( job->dir,        s4w->ctx->pki_params.root_dir, sizeof(job->dir) );
+    strlcpy( job->passphrase, s4w->ctx->passphrase,          sizeof(job->passphrase) );
+    return job;
+}//eo new_operation_job
+
+static void free_operation_job( s_operation_job_t *job )
+{
+    free( job->requests );
+    secure_memzero( job, sizeof(s_operation_job_t) );
+    free( job );
+}//eo free_operation_job
+
+static void start_operation_job( s_s4widgets * s4w, uiButton * s, const char * label, gui_job_run_t run, gui_job_done_t done, s_operation_job_t *job )
+{
+    if( gui_job_start( s4w, s, label, run, done, job ) ) {
+        free_operation_job( job );
+    }
+}//eo start_operation_job
+
+static int run_sign_job( s_s4widgets * s4w, s_s4eventhandlers_t * evt_handlers, void * arg )
+{
+    s_operation_job_t *job = (s_operation_job_t*)arg;
+    return sign_subca( job->dir, job->in_path, job->out_path, job->passphrase, evt_handlers );
+}//eo run_sign_job
+
+static void on_sign_done( s_s4widgets * s4w, void * arg, int result )
+{
+    s_operation_job_t *job = (s_operation_job_t*)arg;
+    if( result && GUI_JOB_CANCELLED != result ) {
+        uiErrorBoxPrintf(s4w->mainwin, "Signature failed", "Failed to sign CSR: %s", job->in_path ); 
+    }
+    free_operation_job( job );
+}//eo on_sign_done
+
 static void on_sign_clicked( uiButton * s, void * data )
 {
     assert(NULL!=s);
@@ -99,22 +153,80 @@ static void on_sign_clicked( uiButton * s, void * data )
     s_s4context * s4c = s4w->ctx;
     assert( NULL!=s4c );
 
+    if( gui_job_busy( s4w, s ) ) {
+        return;
+    }
+
     char *filename = uiSaveFile(s4w->mainwin);
     if ( NULL == filename ) {        
         return;
     }
     CTX_CPY( cert_path, filename, MAX_FILE_PATH);
+    uiFreeText( filename );
 
     DDEBUG_PRN(  "on_sign_clicked: signing('%s') => '%s' ", s4c->csr_path, s4c->cert_path );
 
     // Do the sub CA signing
-    if( sign_subca( s4c->pki_params.root_dir, s4c->csr_path, s4c->cert_path, s4c->passphrase,  &(s4w->pki_events_handlers) ) != 0 ) {
-        uiErrorBoxPrintf(s4w->mainwin, "Signature failed", "Failed to sign CSR: %s", s4c->csr_path ); 
-        return;        
+    s_operation_job_t *job = new_operation_job( s4w );
+    if( NULL == job ) {
+        return;
     }
+    strlcpy( job->in_path,  s4c->csr_path,  sizeof(job->in_path) );
+    strlcpy( job->out_path, s4c->cert_path, sizeof(job->out_path) );
+    start_operation_job( s4w, s, LABEL_BTN_SIGN, run_sign_job, on_sign_done, job );
 
 }//eo on_sign_clicked
 
+static void on_revoke_add_clicked( uiButton * s, void * data )
+{
+	assert(NULL!=s);
+	assert(NULL!=data);
+
+    s_s4widgets * s4w = (s_s4widgets*)data;
+
+    char line[MAX_FILE_PATH+64];
+    char *target = uiEntryText( CURRENT_TAB.txt_revoq_cert_file );
+    int   choice = uiComboboxSelected( CURRENT_TAB.cbx_revoq_reason );
+
+    // first choice of the list is "no reason", then the reason codes in order
+    const char *reason = choice > 0 ? ca_reason_to_name( choice-1 ) : NULL;
+    snprintf( line, sizeof(line), "%s%s%s\n", target, reason ? "," : "", reason ? reason : "" );
+    uiFreeText( target );
+
+    s_revocation_request_t req;
+    if( parse_revocation_request( line, &req ) ) {
+        uiErrorBoxPrintf(s4w->mainwin, "Revocation", "Neither a certificate file nor a serial number: %s", line );
+        return;
+    }
+
+    uiMultilineEntryAppend( CURRENT_TAB.txt_revoq_list, line );
+    uiEntrySetText( CURRENT_TAB.txt_revoq_cert_file, DEFAULT_INPUT_FILE );
+}//eo on_revoke_add_clicked
+
+static int run_revoke_job( s_s4widgets * s4w, s_s4eventhandlers_t * evt_handlers, void * arg )
+{
+    s_operation_job_t *job = (s_operation_job_t*)arg;
+    return revoke_subca_batch( job->dir, job->requests, job->nb_requests, job->out_path, job->passphrase, NULL, evt_handlers );
+}//eo run_revoke_job
+
+static void on_revoke_done( s_s4widgets * s4w, void * arg, int result )
+{
+    s_operation_job_t *job = (s_operation_job_t*)arg;
+    if( result ) {
+        if( GUI_JOB_CANCELLED != result ) {
+            uiErrorBoxPrintf(s4w->mainwin, "Revocation failed", "Failed to revoke the %u listed certificate(s)", job->nb_requests );
+        }
+        free_operation_job( job );
+        return;
+    }
+
+    s4w->ctx->nb_revoqued += job->nb_requests;
+    free_operation_job( job );
+
+    on_pki_loaded( s4w );
+    uiMultilineEntrySetText( CURRENT_TAB.txt_revoq_list, "" );
+}//eo on_revoke_done
+
 static void on_revoke_clicked( uiButton * s, void * data )
 {
 	assert(NULL!=s);
@@ -124,17 +236,80 @@ static void on_revoke_clicked( uiButton * s, void * data )
     s_s4context * s4c = s4w->ctx;
     assert( NULL!=s4c );
 
-    DDEBUG_PRN( "on_revoke_clicked: revocating('%s')", s4c->cert_path );
+    if( gui_job_busy( s4w, s ) ) {
+        return;
+    }
+
+    s_revocation_request_t *requests = calloc( MAX_REVOCATION_BATCH, sizeof(s_revocation_request_t) );
+    if( NULL == requests ) {
+        uiErrorBoxPrintf(s4w->mainwin, "Revocation failed", "Failed to allocate memory for the revocation list" );
+        return;
+    }
+
+    // one "<certificate or serial>[,<reason>]" per line
+    unsigned nb_requests = 0;
+    char *list = uiMultilineEntryText( CURRENT_TAB.txt_revoq_list );
+    char *saveptr = NULL;
+    for( char *line = strtok_r( list, "\n", &saveptr ); NULL != line; line = strtok_r( NULL, "\n", &saveptr ) ) {
+        if( '\0' == line[strspn( line, " \t\r" )] ) {
+            continue;
+        }
+        if( nb_requests == MAX_REVOCATION_BATCH || parse_revocation_request( line, &(requests[nb_requests]) ) ) {
+            uiErrorBoxPrintf(s4w->mainwin, "Revocation failed", "Invalid revocation list entry: %s", line );
+            uiFreeText( list );
+            free( requests );
+            return;
+        }
+        nb_requests++;
+    }
+    uiFreeText( list );
+
+    if( 0 == nb_requests ) {
+        uiErrorBoxPrintf(s4w->mainwin, "Revocation failed", "The revocation list is empty" );
+        free( requests );
+        return;
+    }
+
+    // a single CRL is emitted for the whole list
+    char *filename = uiSaveFile(s4w->mainwin);
+    if ( NULL == filename ) {        
+        free( requests );
+        return;
+    }
+    CTX_CPY( crl_path, filename, MAX_FILE_PATH);
+    uiFreeText( filename );
+
+    DDEBUG_PRN( "on_revoke_clicked: revocating %u certificate(s), crl='%s'", nb_requests, s4c->crl_path );
 
-    if( revoke_subca( s4c->pki_params.root_dir, s4c->cert_path, s4c->passphrase, &(s4w->pki_events_handlers)) != 0 ) {
-        uiErrorBoxPrintf(s4w->mainwin, "Revocation failed", "Failed to revoke cert:%s", s4c->cert_path );          
+    s_operation_job_t *job = new_operation_job( s4w );
+    if( NULL == job ) {
+        free( requests );
         return;
     }
+    job->requests    = requests;
+    job->nb_requests = nb_requests;
+    strlcpy( job->out_path, s4c->crl_path, sizeof(job->out_path) );
+    start_operation_job( s4w, s, LABEL_BTN_REVOKE, run_revoke_job, on_revoke_done, job );
 
 }//eo on_revoke_clicked
 
 
 
+static int run_gen_crl_job( s_s4widgets * s4w, s_s4eventhandlers_t * evt_handlers, void * arg )
+{
+    s_operation_job_t *job = (s_operation_job_t*)arg;
+    return generate_crl( job->dir, job->out_path, job->passphrase, evt_handlers );
+}//eo run_gen_crl_job
+
+static void on_gen_crl_done( s_s4widgets * s4w, void * arg, int result )
+{
+    s_operation_job_t *job = (s_operation_job_t*)arg;
+    if( result && GUI_JOB_CANCELLED != result ) {
+        uiErrorBoxPrintf(s4w->mainwin, "CRL generation failed", "Failed to generate the CRL: %s", job->out_path );          
+    }
+    free_operation_job( job );
+}//eo on_gen_crl_done
+
 static void on_gen_crl_clicked( uiButton *s, void * data )
 {
     assert(NULL!=s);
@@ -144,18 +319,25 @@ static void on_gen_crl_clicked( uiButton *s, void * data )
     s_s4context * s4c = s4w->ctx;
     assert( NULL!=s4c );
 
+    if( gui_job_busy( s4w, s ) ) {
+        return;
+    }
+
     char *filename = uiSaveFile(s4w->mainwin);
     if ( NULL == filename ) {        
         return;
     }
     CTX_CPY( crl_path, filename, MAX_FILE_PATH);
+    uiFreeText( filename );
 
     DDEBUG_PRN(  "on_gen_crl_clicked: generating_crl('%s')", s4c->crl_path );
 
-    if( generate_crl( s4c->pki_params.root_dir, s4c->crl_path, s4c->passphrase, &(s4w->pki_events_handlers)) != 0 ) {
-        uiErrorBoxPrintf(s4w->mainwin, "Revocation failed", "Failed to revoke cert:%s", s4c->cert_path );          
+    s_operation_job_t *job = new_operation_job( s4w );
+    if( NULL == job ) {
         return;
     }
+    strlcpy( job->out_path, s4c->crl_path, sizeof(job->out_path) );
+    start_operation_job( s4w, s, LABEL_BTN_GEN_CRL, run_gen_crl_job, on_gen_crl_done, job );
 
 }//eo on_gen_crl_clicked
 
@@ -169,7 +351,9 @@ uiControl *create_operations_page( s_s4widgets * s4w )
     Subject: <subject text>              |
     -------------------------------------|  Revoke sub-CA
                                          | [ certificate file ] [cert_ btn]
-    Nb sub-CA emitted: <lbl subca count> |                  [ publish CRL ]
+                                         | [ reason      ]        [ add ]
+                                         | [ revocation list             ]
+    Nb sub-CA emitted: <lbl subca count> |                     [ revoke ]
     Nb sub-CA revocated: <lbl>           |--------------------------------------
     Last CRL:                            | Sign sub-CA     
     -------------------------------------| [CSR file           ]  [CSR btn]
@@ -183,6 +367,7 @@ uiControl *create_operations_page( s_s4widgets * s4w )
     CURRENT_TAB.on_revoke_click=on_revoke_clicked;        
     CURRENT_TAB.on_csr_sel_click=on_csr_file_sel_clicked;        
     CURRENT_TAB.on_cert_sel_click=on_cert_2_revoke_file_sel_clicked;    
+    CURRENT_TAB.on_revoke_add_click=on_revoke_add_clicked;
     CURRENT_TAB.on_gen_crl_click=on_gen_crl_clicked;
 
 
@@ -195,11 +380,22 @@ uiControl *create_operations_page( s_s4widgets * s4w )
     CURRENT_TAB.lbl_revoq_count   = uiNewLabel(DEFAULT_NUM);
     CURRENT_TAB.lbl_last_CRL_date = uiNewLabel(DEFAULT_TIMESTAMP);
 
+    // editable: a serial number may be typed instead of selecting a file
     CURRENT_TAB.txt_revoq_cert_file = uiNewEntry();
     uiEntrySetText(CURRENT_TAB.txt_revoq_cert_file , DEFAULT_INPUT_FILE);
-	uiEntrySetReadOnly(CURRENT_TAB.txt_revoq_cert_file, 1);
     
     NEW_BUTTON( CURRENT_TAB.btn_revoq_cert_file, LABEL_BTN_SEL_CERT, CURRENT_TAB.on_cert_sel_click );
+
+    CURRENT_TAB.cbx_revoq_reason = uiNewCombobox();
+    uiComboboxAppend( CURRENT_TAB.cbx_revoq_reason, LABEL_REVOKE_NO_REASON );
+    for( int reason=0; NULL!=ca_reason_to_name(reason); reason++ ) {
+        uiComboboxAppend( CURRENT_TAB.cbx_revoq_reason, ca_reason_to_name(reason) );
+    }
+    uiComboboxSetSelected( CURRENT_TAB.cbx_revoq_reason, 0 );
+
+    NEW_BUTTON( CURRENT_TAB.btn_revoq_add, LABEL_BTN_REVOKE_ADD, CURRENT_TAB.on_revoke_add_click );
+
+    CURRENT_TAB.txt_revoq_list = uiNewMultilineEntry();
   
     NEW_BUTTON( CURRENT_TAB.btn_revocate, LABEL_BTN_REVOKE, CURRENT_TAB.on_revoke_click );
         
@@ -281,6 +477,10 @@ uiControl *create_operations_page( s_s4widgets * s4w )
     BOX_APPEND( certsel_box, CURRENT_TAB.txt_revoq_cert_file, 1);
     BOX_APPEND( certsel_box, CURRENT_TAB.btn_revoq_cert_file, 0);
 
+    NEW_ROWBOX( reason_box );
+    BOX_APPEND( reason_box, CURRENT_TAB.cbx_revoq_reason, 1);
+    BOX_APPEND( reason_box, CURRENT_TAB.btn_revoq_add,    0);
+
     NEW_ROWBOX( revoke_box );
     BOX_APPEND( revoke_box, uiNewLabel("     "), 1);
     BOX_APPEND( revoke_box, CURRENT_TAB.btn_revocate, 0);
@@ -289,6 +489,8 @@ uiControl *create_operations_page( s_s4widgets * s4w )
     NEW_GROUP( group_rev,  vbox_revocation, LABEL_GROUP_REVOCATION );
 
     BOX_APPEND( vbox_revocation, certsel_box, 0);
+    BOX_APPEND( vbox_revocation, reason_box,  0);
+    BOX_APPEND( vbox_revocation, CURRENT_TAB.txt_revoq_list, 1);
     BOX_APPEND( vbox_revocation, revoke_box,  0);
     BOX_APPEND( vbox_revocation, uiNewHorizontalSeparator(), 0);
 
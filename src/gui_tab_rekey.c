@@ -22,7 +22,6 @@
 
 #include <ui.h>
 
-#define DEEPDEBUG 1
 
 #include "shamir.h"
 #include "utils.h"
@@ -103,6 +102,10 @@ static void onExportShareClicked( uiButton * s, void * data )
     s_s4context * s4c = s4w->ctx;
     assert( NULL!=s4c );
 
+    if( gui_job_busy( s4w, s ) ) {
+        return;
+    }
+
     char *filename = uiSaveFile(s4w->mainwin);
     if ( NULL == filename ) {        
         return;
@@ -113,6 +116,11 @@ static void onExportShareClicked( uiButton * s, void * data )
     if( s4c->nb_share_exported == s4c->nb_share ) {
         s4c->nb_share_exported = 0;
     }
+    if( s4c->nb_share_exported >= s4c->nb_share_slots ) {
+        uiErrorBoxPrintf( s4w->mainwin, "Export failed", "No Shamir share to export: split the secret first" );
+        uiFreeText(filename);
+        return;
+    }
     //Export next share
     int res = save_shamir_secret( filename, &(s4c->shares[s4c->nb_share_exported]));
     if( res ) {
@@ -123,7 +131,8 @@ static void onExportShareClicked( uiButton * s, void * data )
             s4c->nb_share_exported+1, filename 
         );
     } else {
-        uiMsgBoxPrintf( s4w->mainwin, "Export succedeed", "%uth Shamir share saved to '%s'", s4c->nb_share_exported, filename);
+        uiMsgBoxPrintf( s4w->mainwin, "Export succedeed", "%uth Shamir share saved to '%s'\nFingerprint: %s",
+            s4c->nb_share_exported, filename, s4c->share_fingerprints[s4c->nb_share_exported] );
         s4c->nb_share_exported++;
         
         int pct = INTPCT(s4c->nb_share, s4c->nb_share_exported); 
@@ -149,6 +158,10 @@ static void onRekeyClicked( uiButton * s, void * data )
     s_s4widgets * s4w = (s_s4widgets*)data;
     s_s4context * s4c = s4w->ctx;
     assert( NULL != s4c );
+
+    if( gui_job_busy( s4w, s ) ) {
+        return;
+    }
     
     // TODO check that we are unloacked
     
@@ -22,7 +22,6 @@
 
 #include <ui.h>
 
-#define DEEPDEBUG 1
 
 #include "shamir.h"
 #include "utils.h"
@@ -75,6 +74,21 @@ static void update_pki_descr (s_s4widgets * s4w)
 	
 	uiLabelSetText( CURRENT_TAB.lbl_pki_subject, s4w->ctx->pki_params.subject );
 
+	// root certificate, parsed once and cached in the context
+	const s_ca_cert_infos_t *infos = s4_load_root_cert_infos( s4w->ctx, s4w->ctx->pki_params.root_dir );
+	if( NULL == infos ) {
+		uiLabelSetText( CURRENT_TAB.lbl_root_key,         DEFAULT_UNKNOWN );
+		uiLabelSetText( CURRENT_TAB.lbl_root_validity,    DEFAULT_UNKNOWN );
+		uiLabelSetText( CURRENT_TAB.lbl_root_fingerprint, DEFAULT_UNKNOWN );
+		return;
+	}
+
+	char str_key_size[10];
+	snprintf( str_key_size, sizeof(str_key_size), "%u", infos->key_size );
+	uiLabelSetText( CURRENT_TAB.lbl_root_key,         str_key_size );
+	uiLabelSetText( CURRENT_TAB.lbl_root_validity,    infos->not_after );
+	uiLabelSetText( CURRENT_TAB.lbl_root_fingerprint, infos->fingerprint_sha256 );
+
 }//eo update_pki_gui
 
 /**
@@ -93,6 +107,10 @@ static void on_share_file_sel( uiButton * s, void * data )
 	assert( NULL!=s4c );
 
 	unsigned num = sd->num;
+	if( num >= s4c->nb_share_slots ) {
+		DEBUG_PRN("on_share_file_sel(%u): only %u shares reserved", num, s4c->nb_share_slots );
+		return;
+	}
 	
 	//TODO on_share_file_sel: select secret / try to load it / check if it is the last of the quorum / if it is enable unlock button
 
@@ -103,7 +121,7 @@ static void on_share_file_sel( uiButton * s, void * data )
 		return;
 	}
 	
-	DDEBUG_PRN("on_share_file_sel(%u): file '%s' selected for share %u", num, filename );
+	DDEBUG_PRN("on_share_file_sel(%u): file '%s' selected", num, filename );
 
     if( load_shamir_secret(  filename, &(s4c->shares[num]) ) ) {
         uiErrorBoxPrintf(  s4w->mainwin, "Error reading the share", "Loading share secret from %s failed", filename );
@@ -223,17 +241,21 @@ static void on_lock_clicked( uiButton * s, void * data )
 	s_s4widgets * s4w = (s_s4widgets*)data;
 	s_s4context *s4c = s4w->ctx;
 
+	// the running job still uses the passphrase
+	if( gui_job_busy( s4w, s ) ) {
+		return;
+	}
+
 	//erase all secrets
 	if( s4c->secret_unlocked ) {
 		s4c->secret_unlocked = 0;
 		s4c->passphrase_len=0;
 		secure_memzero( s4c->passphrase,  MAX_B64_ENC_PASS_SIZE );
-		for( unsigned i=0; i<s4c->quorum; i++ ) {
-			secure_memzero( &(s4c->shares[i]), sizeof(s_share_t) );			
+		if( s4_reserve_shares( s4c, s4c->nb_share ) ) {
+			warn("on_lock_clicked: failed to reserve the shares again");
 		}
 		s4c->nb_share_loaded = 0;
 		s4c->nb_share_provided = 0;
-		secure_memzero( s4c->shares_loaded, sizeof(int)*MAX_SHAMIR_SHARE_NUMBER );
 
 		create_share_loaders(s4w, s4c->quorum );		
 
@@ -255,9 +277,6 @@ static void on_unlock_clicked( uiButton * s, void * data )
 	assert(NULL!=s);
 	assert(NULL!=data);
 
-    size_t  secret_max_size = MAX_HEX_ENC_PASS_SIZE+1;
-    uint8_t secret[secret_max_size];
-
 	s_s4widgets *s4w = (s_s4widgets*)data;
 	s_s4context *s4c = s4w->ctx;
 
@@ -269,18 +288,11 @@ static void on_unlock_clicked( uiButton * s, void * data )
 	}
 
 	//Recontruct secret
-    int r1 = do_shamir_recovery( s4c->nb_share_provided, s4c->shares, secret, secret_max_size );
+    int r1 = s4_recover_passphrase( s4c );
 	if( r1 != EXIT_SUCCESS ) {
         uiErrorBoxPrintf( s4w->mainwin, "Shamir recovery failed","Failed to recoved the splitted secret");
 		return;
 	}
-
-	//base64_ encode the pass phrase 
-    ssize_t r2 = base64_encode( s4c->passphrase, MAX_B64_ENC_PASS_SIZE, secret, PASS_SIZE);
-	if( r2 <0 ) {
-        die( -1, "base64 encoding of the passphrase failed");
-    }    
-    s4c->passphrase_len = r2;
     s4c->secret_unlocked = 1;
 
 	if( NULL!=s4w->on_pki_unlocked ) {
@@ -304,6 +316,10 @@ static void on_pki_sel_dir_clicked( uiButton * s, void * data )
 
     s_s4widgets * s4w = (s_s4widgets*)data;
 
+	// the running job still works on the current PKI
+	if( gui_job_busy( s4w, s ) ) {
+		return;
+	}
 
 	char *dirname = uiSelectDir(s4w->mainwin);
 	if ( NULL == dirname ) {
@@ -349,7 +365,10 @@ uiControl *create_unlock_page( s_s4widgets * s4w )
     Subject: <subject text>            | [ file key 2        ] [k2 btn]
     Nb Key holders: <lbl_num_holders>  | [ file key 3        ] [k3 btn]
     Quorum: <lbl_quorum>               | [ file key 4        ] [k4 btn]
-    -----------------------------------| [ file key 5        ] [k5 btn]
+    Root key size: <lbl_root_key>      | [ file key 5        ] [k5 btn]
+    Valid until: <lbl_root_validity>   |
+    SHA-256: <lbl_root_fingerprint>    |
+    -----------------------------------|
      [unlock btn]     [lock btn]       |
                                        |
 
@@ -368,6 +387,9 @@ uiControl *create_unlock_page( s_s4widgets * s4w )
 	NEW_ROWBOX(subj_box);
 	NEW_ROWBOX(count_box);
 	NEW_ROWBOX(quorum_box);
+	NEW_ROWBOX(key_box);
+	NEW_ROWBOX(validity_box);
+	NEW_ROWBOX(fingerprint_box);
 
 	NEW_GROUP(group_infos, vbox_pki_infos, LABEL_GROUP_PKI_PARAMETERS);
 
@@ -384,6 +406,9 @@ uiControl *create_unlock_page( s_s4widgets * s4w )
     CURRENT_TAB.lbl_pki_subject = uiNewLabel(DEFAULT_ROOT_SUBJECT);
     CURRENT_TAB.lbl_nb_holders  = uiNewLabel(DEFAULT_NUM);
     CURRENT_TAB.lbl_quorum      = uiNewLabel(DEFAULT_NUM);
+    CURRENT_TAB.lbl_root_key         = uiNewLabel(DEFAULT_UNKNOWN);
+    CURRENT_TAB.lbl_root_validity    = uiNewLabel(DEFAULT_UNKNOWN);
+    CURRENT_TAB.lbl_root_fingerprint = uiNewLabel(DEFAULT_UNKNOWN);
 
 	NEW_BUTTON( CURRENT_TAB.btn_unlock, LABEL_BTN_UNLOCK, CURRENT_TAB.on_unlock_click );
 
@@ -399,6 +424,15 @@ uiControl *create_unlock_page( s_s4widgets * s4w )
 	BOX_APPEND( quorum_box, uiNewLabel(LABEL_QUORUM_SIZE),  1);
     BOX_APPEND( quorum_box, CURRENT_TAB.lbl_quorum,         0);
 
+	BOX_APPEND( key_box,         uiNewLabel(LABEL_ROOT_KEY),         1);
+    BOX_APPEND( key_box,         CURRENT_TAB.lbl_root_key,           0);
+
+	BOX_APPEND( validity_box,    uiNewLabel(LABEL_ROOT_VALIDITY),    1);
+    BOX_APPEND( validity_box,    CURRENT_TAB.lbl_root_validity,      0);
+
+	BOX_APPEND( fingerprint_box, uiNewLabel(LABEL_ROOT_FINGERPRINT), 1);
+    BOX_APPEND( fingerprint_box, CURRENT_TAB.lbl_root_fingerprint,   0);
+
 	BOX_APPEND( btn_box,    CURRENT_TAB.btn_unlock,        1);
 	BOX_APPEND( btn_box,    CURRENT_TAB.btn_lock,          1);
 
@@ -408,6 +442,9 @@ uiControl *create_unlock_page( s_s4widgets * s4w )
  	BOX_APPEND( vbox_pki_infos, subj_box,                   0);    
     BOX_APPEND( vbox_pki_infos, count_box,                  0);
     BOX_APPEND( vbox_pki_infos, quorum_box,                 0);
+    BOX_APPEND( vbox_pki_infos, key_box,                    0);
+    BOX_APPEND( vbox_pki_infos, validity_box,               0);
+    BOX_APPEND( vbox_pki_infos, fingerprint_box,            0);
     BOX_APPEND( vbox_pki_infos, uiNewHorizontalSeparator(), 0);
 	BOX_APPEND( vbox_pki_infos, btn_box,                    0);
 
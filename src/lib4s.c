@@ -0,0 +1,521 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file lib4s.c
+ *
+ * \brief Embeddable PKI library: one opaque handle per PKI root directory
+ *
+ * A handle wraps an application context. The warnings raised by the PKI
+ * functions during a call are redirected, for the calling thread only, to
+ * the errors of that call.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "shared_secret.h"
+#include "pki_request.h"
+#include "ca_store.h"
+#include "lib4s.h"
+
+struct S4Pki {
+    s_s4context       *ctx;
+    pthread_rwlock_t   state_lock;   // written by unlock and lock, read by the operations
+    s_ca_index_cache_t index;        // certificate index, shared by the concurrent operations
+    pthread_mutex_t    error_lock;
+    char               error[LIB4S_MAX_ERROR+1];
+};
+
+struct S4Manager {
+    pthread_rwlock_t lock;           // written by s4_manager_open
+    unsigned         nb_pkis;
+    s4_pki_t        *pkis[LIB4S_MAX_PKIS];
+    char             ids[LIB4S_MAX_PKIS][LIB4S_MAX_PKI_ID+1];
+    char             dirs[LIB4S_MAX_PKIS][PATH_MAX];   // canonical root directories
+};
+
+/**
+ * \brief Warnings of one call
+ */
+typedef struct SLib4sErrors {
+    char text[LIB4S_MAX_ERROR+1];
+} s_lib4s_errors_t;
+
+static void lib4s_collect( void *data, const char *message )
+{
+	s_lib4s_errors_t *errs = (s_lib4s_errors_t*)data;
+	const size_t len = strlen( errs->text );
+	if( len < sizeof(errs->text)-1 ) {
+		const int written = snprintf( errs->text+len, sizeof(errs->text)-len, "%s%s", len ? "\n" : "", message );
+		if( written < 0 ) {
+			errs->text[len] = '\0';
+		} else if( (size_t)written >= sizeof(errs->text)-len ) {
+			// keep what fits, but show the caller the messages were cut
+			memcpy( errs->text+sizeof(errs->text)-4, "...", 4 );
+		}
+	}
+}//eo lib4s_collect
+
+static void lib4s_begin( s_lib4s_errors_t *errs )
+{
+	errs->text[0] = '\0';
+	warn_redirect( lib4s_collect, errs );
+}//eo lib4s_begin
+
+/**
+ * \brief End of a call: keep its warnings as the last error of the handle if it failed
+ *
+ * \return res
+ */
+static int lib4s_end( s4_pki_t *pki, const s_lib4s_errors_t *errs, const int res )
+{
+	warn_redirect( NULL, NULL );
+	if( res ) {
+		pthread_mutex_lock( &(pki->error_lock) );
+		strlcpy( pki->error, '\0' != errs->text[0] ? errs->text : "unknown error", sizeof(pki->error) );
+		pthread_mutex_unlock( &(pki->error_lock) );
+	}
+	return res;
+}//eo lib4s_end
+
+/**
+ * \brief Wipe the shares, the state lock held for writing
+ */
+static void lib4s_wipe_shares( s4_pki_t *pki )
+{
+	pki->ctx->nb_share_loaded = 0;
+	s4_reserve_shares( pki->ctx, pki->ctx->nb_share );
+}//eo lib4s_wipe_shares
+
+/**
+ * \brief Wipe the passphrase and the shares, the state lock held for writing
+ */
+static void lib4s_wipe( s4_pki_t *pki )
+{
+	s_s4context *ctx = pki->ctx;
+
+	secure_memzero( ctx->passphrase, sizeof(ctx->passphrase) );
+	ctx->passphrase_len  = 0;
+	ctx->secret_unlocked = 0;
+	lib4s_wipe_shares( pki );
+}//eo lib4s_wipe
+
+/**
+ * \brief Execute a request with the passphrase of an unlocked handle
+ */
+static int lib4s_run( s4_pki_t *pki, s_pki_request_t *req, char *result, const size_t max )
+{
+	s_lib4s_errors_t       errs;
+	s_pki_request_result_t res;
+
+	lib4s_begin( &errs );
+
+	pthread_rwlock_rdlock( &(pki->state_lock) );
+	if( pki->ctx->secret_unlocked ) {
+		pki_request_execute( pki->ctx->pki_params.root_dir, pki->ctx->passphrase, req, &(pki->index), &res );
+	} else {
+		res.status = -1;
+		snprintf( res.message, sizeof(res.message), "warning=the PKI %s is locked\n", pki->ctx->pki_params.root_dir );
+	}
+	pthread_rwlock_unlock( &(pki->state_lock) );
+
+	if( NULL != result && max > 0 ) {
+		strlcpy( result, res.message, max );
+	}
+	if( res.status ) {
+		lib4s_collect( &errs, res.message );
+	}
+	return lib4s_end( pki, &errs, res.status );
+}//eo lib4s_run
+
+///////////////////////////////// Exported functions
+
+const char* lib4s_version( void )
+{
+	return LIB4S_VERSION;
+}//eo lib4s_version
+
+void lib4s_init( void )
+{
+	secure_arena_init();
+}//eo lib4s_init
+
+s4_pki_t* s4_pki_open( const char *root_dir, char *err, const size_t max )
+{
+	assert( NULL!=root_dir );
+
+	s_lib4s_errors_t errs;
+	lib4s_begin( &errs );
+
+	s4_pki_t *pki = calloc( 1, sizeof(s4_pki_t) );
+	if( NULL == pki ) {
+		warn("Failed to allocate memory for the PKI handle");
+	} else if( check_pki_root_dir( root_dir ) ) {
+		free( pki );
+		pki = NULL;
+	} else if( NULL == (pki->ctx = s4_init_context()) ) {
+		free( pki );
+		pki = NULL;
+	} else if( try_to_open_pki_info( pki->ctx, root_dir ) ) {
+		warn("No valid PKI found in '%s'", root_dir);
+		s4_destroy_context( pki->ctx );
+		free( pki );
+		pki = NULL;
+	} else if( NULL == s4_load_root_cert_infos( pki->ctx, root_dir ) ) {
+		// described without its root certificate
+		DEBUG_PRN("s4_pki_open: no root certificate in %s", root_dir);
+	}
+	warn_redirect( NULL, NULL );
+
+	if( NULL == pki ) {
+		if( NULL != err && max > 0 ) {
+			strlcpy( err, errs.text, max );
+		}
+		return NULL;
+	}
+
+	pthread_rwlock_init( &(pki->state_lock), NULL );
+	ca_index_cache_init( &(pki->index) );
+	pthread_mutex_init( &(pki->error_lock), NULL );
+
+	// read once here, then again only when cert.idx changes
+	if( NULL == ca_index_cache_get( pki->ctx->pki_params.root_dir, &(pki->index) ) ) {
+		DEBUG_PRN("s4_pki_open: no certificate index in %s yet", root_dir);
+	}
+	DEBUG_PRN("s4_pki_open: %s, quorum %u of %u", root_dir, pki->ctx->quorum, pki->ctx->nb_share);
+	return pki;
+}//eo s4_pki_open
+
+void s4_pki_close( s4_pki_t *pki )
+{
+	if( NULL == pki ) {
+		return;
+	}
+	pthread_rwlock_destroy( &(pki->state_lock) );
+	ca_index_cache_destroy( &(pki->index) );
+	pthread_mutex_destroy( &(pki->error_lock) );
+	s4_destroy_context( pki->ctx );
+	secure_memzero( pki, sizeof(s4_pki_t) );
+	free( pki );
+}//eo s4_pki_close
+
+int s4_pki_unlock( s4_pki_t *pki, const char *const *share_paths, const unsigned nb_shares )
+{
+	assert( NULL!=pki );
+	assert( NULL!=share_paths || 0==nb_shares );
+
+	s_lib4s_errors_t    errs;
+	s_s4eventhandlers_t evt;
+	memset( &evt, 0, sizeof(evt) );
+
+	lib4s_begin( &errs );
+	pthread_rwlock_wrlock( &(pki->state_lock) );
+
+	s_s4context *ctx = pki->ctx;
+	lib4s_wipe( pki );
+	ctx->should_pause_for_secrets = 0;
+
+	int res = s4_set_share_sources( ctx, share_paths, nb_shares );
+	if( 0 == res ) {
+		res = s4_reconstruct( ctx, &evt );
+	}
+	s4_set_share_sources( ctx, NULL, 0 );
+
+	if( 0 == res ) {
+		// the passphrase is all the operations need
+		lib4s_wipe_shares( pki );
+		ctx->secret_unlocked = 1;
+	} else {
+		lib4s_wipe( pki );
+	}
+	pthread_rwlock_unlock( &(pki->state_lock) );
+
+	return lib4s_end( pki, &errs, res ? -1 : 0 );
+}//eo s4_pki_unlock
+
+void s4_pki_lock( s4_pki_t *pki )
+{
+	assert( NULL!=pki );
+
+	pthread_rwlock_wrlock( &(pki->state_lock) );
+	lib4s_wipe( pki );
+	pthread_rwlock_unlock( &(pki->state_lock) );
+}//eo s4_pki_lock
+
+int s4_pki_is_unlocked( s4_pki_t *pki )
+{
+	assert( NULL!=pki );
+
+	pthread_rwlock_rdlock( &(pki->state_lock) );
+	int unlocked = pki->ctx->secret_unlocked;
+	pthread_rwlock_unlock( &(pki->state_lock) );
+	return unlocked;
+}//eo s4_pki_is_unlocked
+
+unsigned s4_pki_quorum( const s4_pki_t *pki )
+{
+	assert( NULL!=pki );
+	return pki->ctx->quorum;
+}//eo s4_pki_quorum
+
+int s4_pki_sign( s4_pki_t *pki, const char *csr_path, const char *cert_path, char *result, const size_t max )
+{
+	assert( NULL!=pki );
+	assert( NULL!=csr_path );
+	assert( NULL!=cert_path );
+
+	s_pki_request_t req;
+	memset( &req, 0, sizeof(req) );
+	req.op = PKIRequestSign;
+	if( pki_request_set( &req, "csr", csr_path ) || pki_request_set( &req, "cert", cert_path ) ) {
+		s_lib4s_errors_t errs;
+		lib4s_begin( &errs );
+		warn("Path too long for a signature request");
+		return lib4s_end( pki, &errs, -1 );
+	}
+	return lib4s_run( pki, &req, result, max );
+}//eo s4_pki_sign
+
+int s4_pki_crl( s4_pki_t *pki, const char *crl_path, char *result, const size_t max )
+{
+	assert( NULL!=pki );
+	assert( NULL!=crl_path );
+
+	s_pki_request_t req;
+	memset( &req, 0, sizeof(req) );
+	req.op = PKIRequestCRL;
+	if( pki_request_set( &req, "crl", crl_path ) ) {
+		s_lib4s_errors_t errs;
+		lib4s_begin( &errs );
+		warn("Path too long for a CRL request");
+		return lib4s_end( pki, &errs, -1 );
+	}
+	return lib4s_run( pki, &req, result, max );
+}//eo s4_pki_crl
+
+int s4_pki_execute( s4_pki_t *pki, const char *request, char *result, const size_t max )
+{
+	assert( NULL!=pki );
+	assert( NULL!=request );
+
+	s_pki_request_t req;
+	char            reason[MAX_REQUEST_MESSAGE];
+	if( pki_request_parse( request, &req, reason, sizeof(reason) ) ) {
+		s_lib4s_errors_t errs;
+		lib4s_begin( &errs );
+		warn("Invalid request: %s", reason);
+		if( NULL != result && max > 0 ) {
+			snprintf( result, max, "warning=invalid request: %s\n", reason );
+		}
+		return lib4s_end( pki, &errs, -1 );
+	}
+
+	int res = lib4s_run( pki, &req, result, max );
+	pki_request_free( &req );
+	return res;
+}//eo s4_pki_execute
+
+int s4_pki_describe( s4_pki_t *pki, char *buf, const size_t max )
+{
+	assert( NULL!=pki );
+	assert( NULL!=buf );
+
+	const s_s4context       *ctx   = pki->ctx;
+	const s_ca_cert_infos_t *infos = ctx->root_cert_infos;
+	unsigned nb_valid   = 0;
+	unsigned nb_revoked = 0;
+
+	pthread_mutex_lock( &(pki->index.lock) );
+	const s_ca_index_t *idx = ca_index_cache_get( ctx->pki_params.root_dir, &(pki->index) );
+	for( unsigned i=0; NULL!=idx && i<idx->nb_entries; i++ ) {
+		nb_valid   += 'V' == idx->entries[i].status;
+		nb_revoked += 'R' == idx->entries[i].status;
+	}
+	pthread_mutex_unlock( &(pki->index.lock) );
+
+	int n = snprintf( buf, max, "root_dir=%s\nsubject=%s\nquorum=%u\nshares=%u\nstate=%s\n",
+		ctx->pki_params.root_dir, ctx->pki_params.subject, ctx->quorum, ctx->nb_share,
+		s4_pki_is_unlocked( pki ) ? "unlocked" : "locked" );
+	if( NULL != idx && n >= 0 && (size_t)n < max ) {
+		n += snprintf( buf+n, max-n, "certificates=%u\nrevoked=%u\n", nb_valid, nb_revoked );
+	}
+	if( NULL != infos && infos->loaded && n >= 0 && (size_t)n < max ) {
+		snprintf( buf+n, max-n, "root_not_after=%s\nroot_sha256=%s\n", infos->not_after, infos->fingerprint_sha256 );
+	}
+	return NULL != idx ? 0 : -1;
+}//eo s4_pki_describe
+
+const char* s4_pki_last_error( s4_pki_t *pki, char *buf, const size_t max )
+{
+	assert( NULL!=pki );
+	assert( NULL!=buf );
+
+	pthread_mutex_lock( &(pki->error_lock) );
+	strlcpy( buf, pki->error, max );
+	pthread_mutex_unlock( &(pki->error_lock) );
+	return buf;
+}//eo s4_pki_last_error
+
+///////////////////////////////// Manager
+
+// letters, digits, '.', '_' and '-': an id is written in key=value lines
+static int manager_valid_id( const char *id )
+{
+	const size_t len = strlen( id );
+	if( 0 == len || len > LIB4S_MAX_PKI_ID ) {
+		return 0;
+	}
+	for( size_t i=0; i<len; i++ ) {
+		const char c = id[i];
+		if( !( (c>='a' && c<='z') || (c>='A' && c<='Z') || (c>='0' && c<='9') || '.'==c || '_'==c || '-'==c ) ) {
+			return 0;
+		}
+	}
+	return 1;
+}//eo manager_valid_id
+
+// why a PKI cannot be added, NULL if it can; the manager lock held
+static const char* manager_conflict( const s4_manager_t *mgr, const char *id, const char *dir )
+{
+	if( mgr->nb_pkis == LIB4S_MAX_PKIS ) {
+		return "too many PKIs";
+	}
+	for( unsigned i=0; i<mgr->nb_pkis; i++ ) {
+		if( 0 == strcmp( mgr->ids[i], id ) ) {
+			return "id already used";
+		}
+		if( 0 == strcmp( mgr->dirs[i], dir ) ) {
+			return "directory already opened";
+		}
+	}
+	return NULL;
+}//eo manager_conflict
+
+s4_manager_t* s4_manager_create( void )
+{
+	s4_manager_t *mgr = calloc( 1, sizeof(s4_manager_t) );
+	if( NULL == mgr ) {
+		DEBUG_PRN("s4_manager_create: out of memory");
+		return NULL;
+	}
+	pthread_rwlock_init( &(mgr->lock), NULL );
+	return mgr;
+}//eo s4_manager_create
+
+void s4_manager_destroy( s4_manager_t *mgr )
+{
+	if( NULL == mgr ) {
+		return;
+	}
+	for( unsigned i=0; i<mgr->nb_pkis; i++ ) {
+		s4_pki_close( mgr->pkis[i] );
+	}
+	pthread_rwlock_destroy( &(mgr->lock) );
+	free( mgr );
+}//eo s4_manager_destroy
+
+s4_pki_t* s4_manager_open( s4_manager_t *mgr, const char *id, const char *root_dir, char *err, const size_t max )
+{
+	assert( NULL!=mgr );
+	assert( NULL!=id );
+	assert( NULL!=root_dir );
+
+	char        dir[PATH_MAX];
+	const char *reason = NULL;
+	if( !manager_valid_id( id ) ) {
+		reason = "invalid id";
+	} else if( NULL == realpath( root_dir, dir ) ) {
+		reason = "directory not found";
+	} else {
+		pthread_rwlock_rdlock( &(mgr->lock) );
+		reason = manager_conflict( mgr, id, dir );
+		pthread_rwlock_unlock( &(mgr->lock) );
+	}
+	if( NULL != reason ) {
+		if( NULL != err && max > 0 ) {
+			snprintf( err, max, "Cannot open the PKI '%s' in %s: %s", id, root_dir, reason );
+		}
+		return NULL;
+	}
+
+	// parsed outside of the lock, the other PKIs stay available meanwhile
+	s4_pki_t *pki = s4_pki_open( dir, err, max );
+	if( NULL == pki ) {
+		return NULL;
+	}
+
+	pthread_rwlock_wrlock( &(mgr->lock) );
+	reason = manager_conflict( mgr, id, dir );
+	if( NULL == reason ) {
+		strlcpy( mgr->ids[mgr->nb_pkis],  id,  sizeof(mgr->ids[0]) );
+		strlcpy( mgr->dirs[mgr->nb_pkis], dir, sizeof(mgr->dirs[0]) );
+		mgr->pkis[mgr->nb_pkis] = pki;
+		mgr->nb_pkis++;
+	}
+	pthread_rwlock_unlock( &(mgr->lock) );
+
+	if( NULL != reason ) {
+		if( NULL != err && max > 0 ) {
+			snprintf( err, max, "Cannot open the PKI '%s' in %s: %s", id, root_dir, reason );
+		}
+		s4_pki_close( pki );
+		return NULL;
+	}
+	DEBUG_PRN("s4_manager_open: PKI '%s' in %s", id, dir);
+	return pki;
+}//eo s4_manager_open
+
+s4_pki_t* s4_manager_get( s4_manager_t *mgr, const char *id )
+{
+	assert( NULL!=mgr );
+
+	s4_pki_t *pki = NULL;
+	pthread_rwlock_rdlock( &(mgr->lock) );
+	if( NULL == id || '\0' == id[0] ) {
+		pki = mgr->nb_pkis > 0 ? mgr->pkis[0] : NULL;
+	} else {
+		for( unsigned i=0; i<mgr->nb_pkis && NULL==pki; i++ ) {
+			if( 0 == strcmp( mgr->ids[i], id ) ) {
+				pki = mgr->pkis[i];
+			}
+		}
+	}
+	pthread_rwlock_unlock( &(mgr->lock) );
+	return pki;
+}//eo s4_manager_get
+
+unsigned s4_manager_count( s4_manager_t *mgr )
+{
+	assert( NULL!=mgr );
+
+	pthread_rwlock_rdlock( &(mgr->lock) );
+	unsigned n = mgr->nb_pkis;
+	pthread_rwlock_unlock( &(mgr->lock) );
+	return n;
+}//eo s4_manager_count
+
+const char* s4_manager_id( s4_manager_t *mgr, const unsigned n )
+{
+	assert( NULL!=mgr );
+
+	const char *id = NULL;
+	pthread_rwlock_rdlock( &(mgr->lock) );
+	if( n < mgr->nb_pkis ) {
+		id = mgr->ids[n];
+	}
+	pthread_rwlock_unlock( &(mgr->lock) );
+	return id;
+}//eo s4_manager_id
+
+//eof
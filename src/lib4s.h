@@ -0,0 +1,235 @@
+/**
+ *
+ * \file lib4s.h
+ *
+ * \brief Embeddable PKI library: one opaque handle per PKI root directory
+ *
+ * A handle holds the configuration of a PKI, its shares and, once unlocked,
+ * the passphrase of its root key, in its own secure arena. Nothing is shared
+ * between two handles: a process may open any number of PKIs and use them
+ * from any number of threads.
+ *
+ * Thread safety:
+ *  - different handles may be used concurrently without restriction;
+ *  - on one handle, s4_pki_sign, s4_pki_crl and s4_pki_execute may be called
+ *    concurrently: signatures run in parallel and only serialise the update
+ *    of the certificate index, revocations and CRLs run one at a time;
+ *  - s4_pki_unlock and s4_pki_lock wait for the running operations of the
+ *    handle, and the operations started meanwhile wait for them;
+ *  - s4_pki_close must not be called while another call uses the handle.
+ *
+ * A manager holds the handles of several PKIs, each opened once under an id:
+ * their configuration, root certificate and certificate index stay in
+ * memory, and switching from one PKI to another is a lookup by id. The
+ * handles of a manager follow the rules above; s4_manager_open and
+ * s4_manager_get may be called concurrently, s4_manager_destroy may not.
+ *
+ * Errors are reported per handle: the warnings of a failed call are kept as
+ * its last error, see s4_pki_last_error, and those of an operation are also
+ * returned in its result. The library never prints on stderr nor exits,
+ * except when the memory is exhausted. The diagnostic log (S4_LOG) and the
+ * trace are process-wide settings of the embedding program.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#if !defined( _S4_LIB4S_H_ )
+#define _S4_LIB4S_H_
+
+#include <stddef.h>
+
+#define LIB4S_VERSION        "1.0"
+
+// size of the last error of a handle, truncated beyond
+#define LIB4S_MAX_ERROR      (2048)
+
+// PKIs of a manager, and length of their ids (letters, digits, '.', '_' and '-')
+#define LIB4S_MAX_PKIS       (64)
+#define LIB4S_MAX_PKI_ID     (32)
+
+typedef struct S4Pki     s4_pki_t;
+typedef struct S4Manager s4_manager_t;
+
+/**
+ * \brief Version of the library
+ */
+const char* lib4s_version( void );
+
+/**
+ * \brief Keep the big integers of the secrets in the locked memory of the handles
+ *
+ * Replaces the memory functions of GMP for the whole process, so that the
+ * integers of the share computations live in the secure arena of their
+ * handle. To call once, first thing in main(), while no GMP integer exists,
+ * the host's included: an integer allocated by GMP before the call must not
+ * be released or resized after it. A host which sets its own GMP memory
+ * functions does not call it; the library then works with the integers on
+ * the heap.
+ */
+void lib4s_init( void );
+
+/**
+ * \brief Open the PKI of a root directory, locked
+ *
+ * \param root_dir  root directory of the PKI, holding its pki.ini
+ * \param err       destination of the reason of a failure, may be NULL
+ * \param max       size of err
+ *
+ * \return NULL on error, the handle otherwise, to release with s4_pki_close
+ */
+s4_pki_t* s4_pki_open( const char *root_dir, char *err, const size_t max );
+
+/**
+ * \brief Wipe every secret of a handle and release it
+ *
+ * \param pki  handle, may be NULL
+ */
+void s4_pki_close( s4_pki_t *pki );
+
+/**
+ * \brief Rebuild the passphrase of the root key from a quorum of shares
+ *
+ * \param pki          handle
+ * \param share_paths  files of the shares, only read during the call
+ * \param nb_shares    number of files, at least the quorum of the PKI
+ *
+ * \return 0 on success, -1 on error
+ */
+int s4_pki_unlock( s4_pki_t *pki, const char *const *share_paths, const unsigned nb_shares );
+
+/**
+ * \brief Wipe the passphrase and the shares of a handle
+ */
+void s4_pki_lock( s4_pki_t *pki );
+
+/**
+ * \brief Whether the handle is unlocked
+ */
+int s4_pki_is_unlocked( s4_pki_t *pki );
+
+/**
+ * \brief Number of shares required to unlock the PKI
+ */
+unsigned s4_pki_quorum( const s4_pki_t *pki );
+
+/**
+ * \brief Sign a sub-CA CSR
+ *
+ * \param pki        unlocked handle
+ * \param csr_path   CSR to sign
+ * \param cert_path  where to copy the certificate
+ * \param result     destination of the "key=value" lines of the outcome (cert, serial, warning), may be NULL
+ * \param max        size of result
+ *
+ * \return 0 on success, -1 on error
+ */
+int s4_pki_sign( s4_pki_t *pki, const char *csr_path, const char *cert_path, char *result, const size_t max );
+
+/**
+ * \brief Generate a CRL
+ *
+ * \param pki       unlocked handle
+ * \param crl_path  where to write the CRL
+ * \param result    destination of the "key=value" lines of the outcome, may be NULL
+ * \param max       size of result
+ *
+ * \return 0 on success, -1 on error
+ */
+int s4_pki_crl( s4_pki_t *pki, const char *crl_path, char *result, const size_t max );
+
+/**
+ * \brief Execute a request in its text form
+ *
+ * The operation (sign, revoke or crl) on the first line, then one
+ * "key=value" parameter per line, as accepted by the 4s-cli service.
+ *
+ * \param pki      unlocked handle
+ * \param request  text of the request
+ * \param result   destination of the "key=value" lines of the outcome, may be NULL
+ * \param max      size of result
+ *
+ * \return 0 on success, -1 on error
+ */
+int s4_pki_execute( s4_pki_t *pki, const char *request, char *result, const size_t max );
+
+/**
+ * \brief Describe a PKI
+ *
+ * "key=value" lines: root_dir, subject, quorum, shares, state (locked or
+ * unlocked), certificates and revoked counts, root_not_after and root_sha256.
+ *
+ * \param pki  handle
+ * \param buf  destination of the description
+ * \param max  size of buf
+ *
+ * \return 0 on success, -1 if the certificate index could not be read
+ */
+int s4_pki_describe( s4_pki_t *pki, char *buf, const size_t max );
+
+/**
+ * \brief Warnings of the last failed call on a handle
+ *
+ * \param pki  handle
+ * \param buf  destination of the error, empty if none
+ * \param max  size of buf
+ *
+ * \return buf
+ */
+const char* s4_pki_last_error( s4_pki_t *pki, char *buf, const size_t max );
+
+/**
+ * \brief Create an empty manager
+ *
+ * \return NULL on error, the manager otherwise, to release with s4_manager_destroy
+ */
+s4_manager_t* s4_manager_create( void );
+
+/**
+ * \brief Close every PKI of a manager and release it
+ *
+ * \param mgr  manager, may be NULL
+ */
+void s4_manager_destroy( s4_manager_t *mgr );
+
+/**
+ * \brief Open the PKI of a root directory in a manager, see s4_pki_open
+ *
+ * A directory is opened once per manager, whatever the path leading to it.
+ *
+ * \param mgr       manager
+ * \param id        id of the PKI, unique in the manager
+ * \param root_dir  root directory of the PKI
+ * \param err       destination of the reason of a failure, may be NULL
+ * \param max       size of err
+ *
+ * \return NULL on error, the handle otherwise, owned by the manager
+ */
+s4_pki_t* s4_manager_open( s4_manager_t *mgr, const char *id, const char *root_dir, char *err, const size_t max );
+
+/**
+ * \brief Handle of a PKI of a manager
+ *
+ * \param mgr  manager
+ * \param id   id of the PKI, NULL or empty for the first PKI opened
+ *
+ * \return NULL if unknown, the handle otherwise, valid until s4_manager_destroy
+ */
+s4_pki_t* s4_manager_get( s4_manager_t *mgr, const char *id );
+
+/**
+ * \brief Number of PKIs of a manager
+ */
+unsigned s4_manager_count( s4_manager_t *mgr );
+
+/**
+ * \brief Id of the nth PKI of a manager, in opening order
+ *
+ * \return NULL if n is out of range, the id otherwise, valid until s4_manager_destroy
+ */
+const char* s4_manager_id( s4_manager_t *mgr, const unsigned n );
+
+#endif
+//eof
@@ -0,0 +1,275 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file metrics.c
+ *
+ * \brief Timing and resource usage of the steps of a PKI operation
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "utils.h"
+#include "shared_secret.h"
+#include "metrics.h"
+
+// name of the stage accumulating the stages beyond MAX_METRICS_STAGES
+#define METRICS_OTHER_STAGE ("other steps")
+
+/**
+ * \brief Resident memory of the process in kB, the peak when unknown
+ */
+static long metrics_rss_kb( void )
+{
+#if defined(__linux__)
+	FILE *fp = fopen( "/proc/self/statm", "r" );
+	if( NULL != fp ) {
+		unsigned long size = 0, resident = 0;
+		int n = fscanf( fp, "%lu %lu", &size, &resident );
+		fclose( fp );
+		if( 2 == n ) {
+			return (long)( resident * (unsigned long)sysconf(_SC_PAGESIZE) / 1024 );
+		}
+	}
+#endif
+	struct rusage usage;
+	if( getrusage( RUSAGE_SELF, &usage ) ) {
+		return 0;
+	}
+	return usage.ru_maxrss;
+}//eo metrics_rss_kb
+
+static void metrics_sample( s_metrics_sample_t *sample )
+{
+	clock_gettime( CLOCK_MONOTONIC, &(sample->wall) );
+
+	struct rusage usage;
+	if( 0 == getrusage( RUSAGE_SELF, &usage ) ) {
+		sample->cpu = (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+		            + (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+	} else {
+		sample->cpu = 0.0;
+	}
+
+	s_exec_stats_t stats;
+	exec_get_stats( &stats );
+	sample->cpu_children = stats.cpu_time;
+	sample->nb_exec      = stats.nb_spawned;
+	sample->rss_kb       = metrics_rss_kb();
+}//eo metrics_sample
+
+/**
+ * \brief Account the interval between two samples to a stage
+ */
+static void metrics_account( s_metrics_stage_t *stage, const s_metrics_sample_t *from, const s_metrics_sample_t *to )
+{
+	stage->wall         += (double)(to->wall.tv_sec - from->wall.tv_sec)
+	                     + (double)(to->wall.tv_nsec - from->wall.tv_nsec) / 1e9;
+	stage->cpu          += to->cpu - from->cpu;
+	stage->cpu_children += to->cpu_children - from->cpu_children;
+	stage->rss_delta_kb += to->rss_kb - from->rss_kb;
+	stage->nb_exec      += to->nb_exec - from->nb_exec;
+}//eo metrics_account
+
+/**
+ * \brief Find the stage of a given name, or add it
+ *
+ * Must be called with the lock held.
+ *
+ * \return the index of the stage
+ */
+static int metrics_stage( s_metrics_t *m, const char *name, const int pct )
+{
+	for( unsigned i=0; i<m->nb_stages; i++ ) {
+		if( 0 == strcmp( m->stages[i].name, name ) ) {
+			return (int)i;
+		}
+	}
+
+	if( m->nb_stages == MAX_METRICS_STAGES ) {
+		DDEBUG_PRN("metrics_stage: stage [%s] accounted in the last one", name);
+		strlcpy( m->stages[MAX_METRICS_STAGES-1].name, METRICS_OTHER_STAGE, MAX_METRICS_NAME_LEN+1 );
+		return MAX_METRICS_STAGES-1;
+	}
+
+	s_metrics_stage_t *stage = &(m->stages[m->nb_stages]);
+	memset( stage, 0, sizeof(s_metrics_stage_t) );
+	strlcpy( stage->name, name, sizeof(stage->name) );
+	stage->pct = pct;
+	return (int)(m->nb_stages++);
+}//eo metrics_stage
+
+////////////////////////////////////////////// wrapping event handlers
+
+static void metrics_progress_handler( void *data, int pct, const char *msg )
+{
+	s_metrics_t *m = (s_metrics_t*)data;
+
+	s_metrics_sample_t now;
+	metrics_sample( &now );
+
+	pthread_mutex_lock( &(m->lock) );
+	if( m->current >= 0 ) {
+		int next = metrics_stage( m, NULL!=msg ? msg : "", pct );
+		if( next != m->current ) {
+			metrics_account( &(m->stages[m->current]), &(m->last), &now );
+			m->last    = now;
+			m->current = next;
+			m->stages[next].count++;
+		}
+	}
+	pthread_mutex_unlock( &(m->lock) );
+
+	if( NULL != m->next->on_progress ) {
+		m->next->on_progress( m->next->data, pct, msg );
+	}
+}//eo metrics_progress_handler
+
+static void metrics_warning_handler( void *data, const char *fmt, ... )
+{
+	s_metrics_t *m = (s_metrics_t*)data;
+	char message[MAX_METRICS_NAME_LEN*8];
+
+	va_list args;
+	va_start( args, fmt );
+	vsnprintf( message, sizeof(message), fmt, args );
+	va_end( args );
+
+	m->next->on_warning( m->next->data, "%s", message );
+}//eo metrics_warning_handler
+
+static int metrics_fileprompt_handler( void *data, const char *prompt, char *filepath, size_t filepath_max )
+{
+	s_metrics_t *m = (s_metrics_t*)data;
+	return m->next->do_file_prompt( m->next->data, prompt, filepath, filepath_max );
+}//eo metrics_fileprompt_handler
+
+static void metrics_message_handler( void *data, const char *title, const char *message )
+{
+	s_metrics_t *m = (s_metrics_t*)data;
+	m->next->do_message( m->next->data, title, message );
+}//eo metrics_message_handler
+
+static int metrics_cancel_handler( void *data )
+{
+	s_metrics_t *m = (s_metrics_t*)data;
+	return m->next->is_cancelled( m->next->data );
+}//eo metrics_cancel_handler
+
+///////////////////////////////// Exported functions
+
+s_s4eventhandlers_t* metrics_start( s_metrics_t *m, s_s4eventhandlers_t *next, const char *first_stage )
+{
+	assert( NULL!=m );
+	assert( NULL!=next );
+	assert( NULL!=first_stage );
+
+	memset( m, 0, sizeof(s_metrics_t) );
+	pthread_mutex_init( &(m->lock), NULL );
+	m->next = next;
+
+	// only the handlers the operation would have found are wrapped
+	m->handlers.data           = (void*)m;
+	m->handlers.on_progress    = metrics_progress_handler;
+	m->handlers.on_warning     = NULL!=next->on_warning     ? metrics_warning_handler    : NULL;
+	m->handlers.do_file_prompt = NULL!=next->do_file_prompt ? metrics_fileprompt_handler : NULL;
+	m->handlers.do_message     = NULL!=next->do_message     ? metrics_message_handler    : NULL;
+	m->handlers.is_cancelled   = NULL!=next->is_cancelled   ? metrics_cancel_handler     : NULL;
+
+	metrics_sample( &(m->start) );
+	m->last    = m->start;
+	m->current = metrics_stage( m, first_stage, 0 );
+	m->stages[m->current].count = 1;
+
+	return &(m->handlers);
+}//eo metrics_start
+
+void metrics_stop( s_metrics_t *m )
+{
+	assert( NULL!=m );
+
+	s_metrics_sample_t now;
+	metrics_sample( &now );
+
+	pthread_mutex_lock( &(m->lock) );
+	if( m->current >= 0 ) {
+		metrics_account( &(m->stages[m->current]), &(m->last), &now );
+		m->current = -1;
+
+		memset( &(m->total), 0, sizeof(s_metrics_stage_t) );
+		strlcpy( m->total.name, "total", sizeof(m->total.name) );
+		m->total.pct   = 100;
+		m->total.count = 1;
+		metrics_account( &(m->total), &(m->start), &now );
+
+		struct rusage usage;
+		m->rss_peak_kb = getrusage( RUSAGE_SELF, &usage ) ? 0 : usage.ru_maxrss;
+	}
+	pthread_mutex_unlock( &(m->lock) );
+	pthread_mutex_destroy( &(m->lock) );
+}//eo metrics_stop
+
+int metrics_write_json( const s_metrics_t *m, FILE *fp )
+{
+	assert( NULL!=m );
+	assert( NULL!=fp );
+
+	char name[(MAX_METRICS_NAME_LEN+1)*6];   // worst case: every byte escaped on 6 characters
+
+	fprintf( fp, "{\"wall\":%.6f,\"cpu\":%.6f,\"cpu_children\":%.6f,\"rss_delta_kb\":%ld,\"rss_peak_kb\":%ld,\"subprocesses\":%lu,\"stages\":[",
+		m->total.wall, m->total.cpu, m->total.cpu_children, m->total.rss_delta_kb, m->rss_peak_kb, m->total.nb_exec );
+
+	for( unsigned i=0; i<m->nb_stages; i++ ) {
+		const s_metrics_stage_t *stage = &(m->stages[i]);
+		if( json_escape( name, sizeof(name), stage->name ) < 0 ) {
+			strlcpy( name, "?", sizeof(name) );
+		}
+		fprintf( fp, "%s{\"name\":\"%s\",\"pct\":%d,\"count\":%u,\"wall\":%.6f,\"cpu\":%.6f,\"cpu_children\":%.6f,\"rss_delta_kb\":%ld,\"subprocesses\":%lu}",
+			i ? "," : "", name, stage->pct, stage->count, stage->wall, stage->cpu, stage->cpu_children, stage->rss_delta_kb, stage->nb_exec );
+	}
+	fprintf( fp, "]}\n" );
+
+	return ferror( fp ) ? -1 : 0;
+}//eo metrics_write_json
+
+ssize_t metrics_format_text( const s_metrics_t *m, char *buf, const size_t max )
+{
+	assert( NULL!=m );
+	assert( NULL!=buf );
+	assert( max>0 );
+
+	size_t len = 0;
+	int    n   = snprintf( buf, max, "%-40s %5s %9s %9s %9s %9s %5s\n", "stage", "count", "wall(s)", "cpu(s)", "child(s)", "rss(kB)", "exec" );
+
+	for( unsigned i=0; i<=m->nb_stages && n>=0 && len+n<max; i++ ) {
+		len += n;
+		const s_metrics_stage_t *stage = (i<m->nb_stages) ? &(m->stages[i]) : &(m->total);
+		n = snprintf( buf+len, max-len, "%-40.40s %5u %9.3f %9.3f %9.3f %+9ld %5lu\n",
+			stage->name, stage->count, stage->wall, stage->cpu, stage->cpu_children, stage->rss_delta_kb, stage->nb_exec );
+	}
+	if( n<0 || len+n>=max ) {
+		return -1;
+	}
+	len += n;
+
+	n = snprintf( buf+len, max-len, "peak resident memory: %ld kB\n", m->rss_peak_kb );
+	if( n<0 || len+n>=max ) {
+		return -1;
+	}
+	return (ssize_t)(len+n);
+}//eo metrics_format_text
+
+//eof
@@ -0,0 +1,113 @@
+/**
+ *
+ * \file metrics.h
+ *
+ * \brief Timing and resource usage of the steps of a PKI operation
+ *
+ * The metrics wrap the event handlers given to a PKI operation: every
+ * progress event closes the running stage and opens the one named by its
+ * message. Each stage records its wall clock time (monotonic), the CPU time
+ * of the process and of the openssl children, the resident memory variation
+ * and the number of subprocesses started. Stages with the same message are
+ * accumulated.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#if !defined( _S4_METRICS_H_ )
+#define _S4_METRICS_H_
+
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "shared_secret.h"
+
+#define MAX_METRICS_STAGES    (64)
+#define MAX_METRICS_NAME_LEN  (127)
+
+/**
+ * \brief Resource counters at a given instant
+ */
+typedef struct SMetricsSample {
+    struct timespec wall;           // CLOCK_MONOTONIC
+    double          cpu;            // user and system time of the process, in seconds
+    double          cpu_children;   // user and system time of the exec_argv children, in seconds
+    long            rss_kb;         // resident memory
+    unsigned long   nb_exec;        // subprocesses started
+} s_metrics_sample_t;
+
+/**
+ * \brief Measures of one stage, between two progress events
+ */
+typedef struct SMetricsStage {
+    char            name[MAX_METRICS_NAME_LEN+1];
+    int             pct;            // progress announced when the stage started
+    unsigned        count;          // number of times the stage was entered
+    double          wall;
+    double          cpu;
+    double          cpu_children;
+    long            rss_delta_kb;
+    unsigned long   nb_exec;
+} s_metrics_stage_t;
+
+/**
+ * \brief Metrics of an operation
+ */
+typedef struct SMetrics {
+    pthread_mutex_t      lock;
+    s_s4eventhandlers_t  handlers;       // handlers to give to the operation
+    s_s4eventhandlers_t *next;           // handlers the events are forwarded to
+
+    s_metrics_sample_t   start;
+    s_metrics_sample_t   last;           // beginning of the running stage
+    int                  current;        // index of the running stage, -1 once stopped
+
+    s_metrics_stage_t    stages[MAX_METRICS_STAGES];
+    unsigned             nb_stages;
+    s_metrics_stage_t    total;
+    long                 rss_peak_kb;
+} s_metrics_t;
+
+/**
+ * \brief Start measuring an operation
+ *
+ * \param m           metrics to initialise
+ * \param next        handlers receiving the events, after measurement
+ * \param first_stage name of the stage running until the first progress event
+ *
+ * \return the handlers to give to the operation, valid until metrics_stop
+ */
+s_s4eventhandlers_t* metrics_start( s_metrics_t *m, s_s4eventhandlers_t *next, const char *first_stage );
+
+/**
+ * \brief Close the running stage and compute the totals
+ *
+ * To call once, after the last event of the operation.
+ */
+void metrics_stop( s_metrics_t *m );
+
+/**
+ * \brief Write the metrics of a stopped operation as a JSON object
+ *
+ * \return 0 on success, -1 on write error
+ */
+int metrics_write_json( const s_metrics_t *m, FILE *fp );
+
+/**
+ * \brief Format the metrics of a stopped operation as a text table
+ *
+ * \param m    stopped metrics
+ * \param buf  destination, NUL terminated, truncated if too small
+ * \param max  size of buf
+ *
+ * \return the length of the text, -1 if it was truncated
+ */
+ssize_t metrics_format_text( const s_metrics_t *m, char *buf, const size_t max );
+
+#endif
+//eof
@@ -0,0 +1,702 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file ocsp.c
+ *
+ * \brief Pre-signed OCSP responses: ceremony side signing and responder side cache
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+// strcasestr() and memmem(), for the HTTP messages of the responder
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+#include <openssl/ocsp.h>
+
+#include "utils.h"
+#include "pki.h"
+#include "ca_store.h"
+#include "shared_secret.h"
+#include "ocsp.h"
+
+#define SECONDS_PER_DAY (24*3600)
+
+#define STEP(p,m) if( evt_handlers->on_progress ) { evt_handlers->on_progress( evt_handlers->data, (p), (m) ); }
+#define WARN(...) if( evt_handlers->on_warning)   { evt_handlers->on_warning( evt_handlers->data, __VA_ARGS__ ); }
+
+// normalize an hexadecimal serial (upper case, no leading zero) through a BIGNUM
+static int normalize_serial( const char *serial, char *out, size_t max_size )
+{
+	BIGNUM *bn = NULL;
+	if( 0 == BN_hex2bn( &bn, serial ) ) {
+		return -1;
+	}
+	char *hex = BN_bn2hex( bn );
+	int res = ( NULL!=hex && strlcpy( out, hex, max_size ) < max_size ) ? 0 : -1;
+	OPENSSL_free( hex );
+	BN_free( bn );
+	return res;
+}//eo normalize_serial
+
+// CertID of a certificate issued by the root, SHA-1 hashes as RFC 5019 requires
+static OCSP_CERTID* root_cert_id( X509 *cacert, const char *serial )
+{
+	BIGNUM       *bn  = NULL;
+	ASN1_INTEGER *sn  = NULL;
+	OCSP_CERTID  *id  = NULL;
+
+	if( NULL != serial ) {
+		if( 0 == BN_hex2bn( &bn, serial ) || NULL == (sn = BN_to_ASN1_INTEGER( bn, NULL )) ) {
+			BN_free( bn );
+			return NULL;
+		}
+	}
+	id = OCSP_cert_id_new( EVP_sha1(), X509_get_subject_name(cacert), X509_get0_pubkey_bitstr(cacert), sn );
+
+	ASN1_INTEGER_free( sn );
+	BN_free( bn );
+	return id;
+}//eo root_cert_id
+
+// nextUpdate of the single response of a DER encoded OCSPResponse, 0 if invalid or
+// of unknown status; *der_len is set to the size of the DER encoding
+static time_t response_next_update( const unsigned char *der, const size_t size, size_t *der_len )
+{
+	const unsigned char *p = der;
+	OCSP_RESPONSE  *resp = size > 0 && size <= LONG_MAX ? d2i_OCSP_RESPONSE( NULL, &p, (long)size ) : NULL;
+	OCSP_BASICRESP *bs   = resp ? OCSP_response_get1_basic( resp ) : NULL;
+	OCSP_SINGLERESP *single = bs ? OCSP_resp_get0( bs, 0 ) : NULL;
+	ASN1_GENERALIZEDTIME *nextupd = NULL;
+	struct tm tm;
+	int ok = single
+		&& V_OCSP_CERTSTATUS_UNKNOWN != OCSP_single_get0_status( single, NULL, NULL, NULL, &nextupd )
+		&& NULL != nextupd && ASN1_TIME_to_tm( nextupd, &tm );
+	OCSP_BASICRESP_free( bs );
+	OCSP_RESPONSE_free( resp );
+
+	*der_len = p - der;
+	return ok ? timegm( &tm ) : 0;
+}//eo response_next_update
+
+// sign the response of one index entry and add ocsp/<serial>.der to the group
+static int presign_entry( s_atomic_group_t *grp, const char *ocsp_dir, X509 *cacert, EVP_PKEY *key, const s_ca_index_entry_t *entry, const time_t next_update )
+{
+	int res = -1;
+	OCSP_BASICRESP *bs      = OCSP_BASICRESP_new();
+	OCSP_CERTID    *id      = root_cert_id( cacert, entry->serial );
+	ASN1_TIME      *thisupd = X509_gmtime_adj( NULL, 0 );
+	ASN1_TIME      *nextupd = ASN1_TIME_set( NULL, next_update );
+	ASN1_TIME      *revtime = NULL;
+	OCSP_RESPONSE  *resp    = NULL;
+	unsigned char  *der     = NULL;
+
+	if( NULL==bs || NULL==id || NULL==thisupd || NULL==nextupd ) {
+		goto cleanup;
+	}
+
+	int status = V_OCSP_CERTSTATUS_GOOD;
+	int reason = OCSP_REVOKED_STATUS_NOSTATUS;
+	if( 'R' == entry->status ) {
+		status  = V_OCSP_CERTSTATUS_REVOKED;
+		reason  = CRL_REASON_UNSET == entry->reason ? OCSP_REVOKED_STATUS_NOSTATUS : entry->reason;
+		revtime = ASN1_TIME_new();
+		if( NULL==revtime || !ASN1_TIME_set_string( revtime, entry->revocation ) ) {
+			goto cleanup;
+		}
+	}
+
+	if( NULL == OCSP_basic_add1_status( bs, id, status, reason, revtime, thisupd, nextupd ) ) {
+		goto cleanup;
+	}
+	// the root is the responder: the verifier already has its certificate
+	if( !OCSP_basic_sign( bs, cacert, key, EVP_sha256(), NULL, OCSP_NOCERTS ) ) {
+		goto cleanup;
+	}
+	resp = OCSP_response_create( OCSP_RESPONSE_STATUS_SUCCESSFUL, bs );
+	int der_len = resp ? i2d_OCSP_RESPONSE( resp, &der ) : -1;
+	if( der_len <= 0 ) {
+		goto cleanup;
+	}
+
+	char filename[MAX_FILE_PATH+1];
+	snprintf( filename, sizeof(filename), "%s/%s%s", ocsp_dir, entry->serial, OCSP_RESPONSE_EXT );
+	if( atomic_group_write( grp, filename, der, der_len ) ) {
+		DEBUG_PRN("presign_entry: failed to write '%s'", filename);
+		goto cleanup;
+	}
+	res = 0;
+
+cleanup:
+	OPENSSL_free( der );
+	OCSP_RESPONSE_free( resp );
+	ASN1_TIME_free( revtime );
+	ASN1_TIME_free( nextupd );
+	ASN1_TIME_free( thisupd );
+	OCSP_CERTID_free( id );
+	OCSP_BASICRESP_free( bs );
+	return res;
+}//eo presign_entry
+
+// remove the responses of the serials which are neither valid nor revoked in the index
+static void remove_stale_responses( const char *ocsp_dir, const s_ca_index_t *index )
+{
+	char filename[MAX_FILE_PATH+1];
+	char serial[MAX_SERIAL_LEN+1];
+	size_t ext_len = strlen( OCSP_RESPONSE_EXT );
+
+	DIR *d = opendir( ocsp_dir );
+	if( NULL == d ) {
+		return;
+	}
+	struct dirent *de;
+	while( NULL != (de = readdir(d)) ) {
+		size_t name_len = strlen( de->d_name );
+		if( name_len <= ext_len || name_len-ext_len > MAX_SERIAL_LEN || 0 != strcmp( de->d_name+name_len-ext_len, OCSP_RESPONSE_EXT ) ) {
+			continue;
+		}
+		strlcpy( serial, de->d_name, name_len-ext_len+1 );
+
+		const s_ca_index_entry_t *entry = ca_index_find( index, serial );
+		if( NULL != entry && ( 'V' == entry->status || 'R' == entry->status ) ) {
+			continue;
+		}
+		if( snprintf( filename, sizeof(filename), "%s/%s", ocsp_dir, de->d_name ) >= (int)sizeof(filename) ) {
+			LOG_PRN( LogWarn, "remove_stale_responses: path too long for '%s'", de->d_name );
+			continue;
+		}
+		if( unlink( filename ) ) {
+			DEBUG_PRN("remove_stale_responses: failed to remove '%s': %s", filename, strerror(errno));
+		} else {
+			DDEBUG_PRN("remove_stale_responses: '%s' removed", filename);
+		}
+	}
+	closedir( d );
+}//eo remove_stale_responses
+
+int ocsp_presign( const char *dir, const unsigned period_days, const char *password, struct SS4EventHandlers* evt_handlers )
+{
+	DDEBUG_PRN("ocsp_presign(dir=\"%s\", period=%u, evt_h=%p)", dir, period_days, (void*)evt_handlers);
+	assert( NULL!=dir );
+	assert( NULL!=password );
+
+	if( period_days < 1 || period_days > MAX_OCSP_PERIOD ) {
+		WARN("Invalid OCSP response validity: %u days (1 to %d)", period_days, MAX_OCSP_PERIOD);
+		return -1;
+	}
+
+	char ocsp_dir[MAX_FILE_PATH+1];
+	snprintf( ocsp_dir, sizeof(ocsp_dir), "%s/%s", dir, OCSP_DIR );
+	if( mkdir( ocsp_dir, 0755 ) && errno!=EEXIST ) {
+		WARN("Failed to create the OCSP responses directory %s", ocsp_dir);
+		return -1;
+	}
+
+	STEP( 10, "Loading the root key and certificate index");
+	s_ca_index_t index;
+	if( ca_index_load( dir, &index ) ) {
+		WARN("Failed to load the certificate index of the PKI.");
+		return -1;
+	}
+
+	int res = -1;
+	X509     *cacert = ca_load_root_cert( dir );
+	EVP_PKEY *key    = ca_load_root_key( dir, password );
+	if( NULL==cacert || NULL==key ) {
+		WARN("Failed to load the root certificate and key.");
+		goto cleanup;
+	}
+
+	STEP( 20, "Signing the OCSP responses");
+	const time_t next_update = time(NULL) + (time_t)period_days*SECONDS_PER_DAY;
+	// all the responses are replaced behind a single durability barrier
+	s_atomic_group_t grp;
+	atomic_group_init( &grp );
+	unsigned nb_signed = 0;
+	for( unsigned i=0; i<index.nb_entries; i++ ) {
+		const s_ca_index_entry_t *entry = &(index.entries[i]);
+		// expired certificates are no more answered
+		if( 'V' != entry->status && 'R' != entry->status ) {
+			continue;
+		}
+		if( presign_entry( &grp, ocsp_dir, cacert, key, entry, next_update ) ) {
+			WARN("Failed to sign the OCSP response of the certificate %s", entry->serial);
+			atomic_group_abort( &grp );
+			goto cleanup;
+		}
+		nb_signed++;
+		STEP( 20 + INTPCT( index.nb_entries, i+1 )*3/4, "Signing the OCSP responses");
+	}
+
+	if( atomic_group_commit( &grp ) ) {
+		WARN("Failed to save the OCSP responses in %s", ocsp_dir);
+		goto cleanup;
+	}
+
+	// a response left from an earlier ceremony must not keep answering for an
+	// expired, or removed, certificate
+	remove_stale_responses( ocsp_dir, &index );
+
+	DEBUG_PRN("ocsp_presign: %u responses signed in %s", nb_signed, ocsp_dir);
+	STEP( 100, "OCSP responses signed");
+	res = 0;
+
+cleanup:
+	EVP_PKEY_free( key );
+	X509_free( cacert );
+	ca_index_free( &index );
+	return res;
+}//eo ocsp_presign
+
+int ocsp_presign_revoked( s_atomic_group_t *grp, const char *dir, X509 *cacert, EVP_PKEY *key, s_ca_index_entry_t *const *entries, const unsigned nb_entries )
+{
+	assert( NULL!=grp );
+	assert( NULL!=dir );
+	assert( NULL!=entries || 0==nb_entries );
+
+	char ocsp_dir[MAX_FILE_PATH+1];
+	char filename[MAX_FILE_PATH+1];
+	snprintf( ocsp_dir, sizeof(ocsp_dir), "%s/%s", dir, OCSP_DIR );
+
+	const time_t now = time(NULL);
+	for( unsigned i=0; i<nb_entries; i++ ) {
+		s_file_view_t view;
+		size_t der_len = 0;
+
+		// only the certificates answered by the responder
+		if( snprintf( filename, sizeof(filename), "%s/%s%s", ocsp_dir, entries[i]->serial, OCSP_RESPONSE_EXT ) >= (int)sizeof(filename) ) {
+			LOG_PRN( LogWarn, "ocsp_presign_revoked: path too long for the response of %s", entries[i]->serial );
+			return -1;
+		}
+		if( file_view_open( filename, &view ) ) {
+			continue;
+		}
+		time_t next_update = response_next_update( view.data, view.size, &der_len );
+		file_view_close( &view, 0 );
+
+		// a stale response is already refused by the responder
+		if( next_update <= now ) {
+			continue;
+		}
+		if( presign_entry( grp, ocsp_dir, cacert, key, entries[i], next_update ) ) {
+			DEBUG_PRN("ocsp_presign_revoked: failed to sign the response of %s", entries[i]->serial);
+			return -1;
+		}
+	}
+	return 0;
+}//eo ocsp_presign_revoked
+
+
+//////////////////////////////////////////////////////////// Responder cache
+
+// FNV-1a
+static unsigned serial_hash( const char *serial )
+{
+	unsigned h = 2166136261u;
+	for( const char *p=serial; *p; p++ ) {
+		h = ( h ^ (unsigned char)*p ) * 16777619u;
+	}
+	return h;
+}//eo serial_hash
+
+static s_ocsp_cache_entry_t* cache_slot( const s_ocsp_cache_t *cache, const char *serial )
+{
+	unsigned mask = cache->nb_slots - 1;
+	unsigned i    = serial_hash( serial ) & mask;
+
+	while( NULL != cache->slots[i].der && 0 != strcmp( cache->slots[i].serial, serial ) ) {
+		i = (i+1) & mask;
+	}
+	return &(cache->slots[i]);
+}//eo cache_slot
+
+static int encode_status_response( int status, unsigned char **der, size_t *der_len )
+{
+	OCSP_RESPONSE *resp = OCSP_response_create( status, NULL );
+	int len = resp ? i2d_OCSP_RESPONSE( resp, der ) : -1;
+	OCSP_RESPONSE_free( resp );
+	if( len <= 0 ) {
+		return -1;
+	}
+	*der_len = (size_t)len;
+	return 0;
+}//eo encode_status_response
+
+// load ocsp/<serial>.der into the slot of its normalized serial, a file that
+// cannot be used is skipped: the responder answers 'unauthorized' for it
+static int cache_load_file( s_ocsp_cache_t *cache, const char *ocsp_dir, const char *name )
+{
+	char filename[MAX_FILE_PATH+1];
+	char serial[MAX_SERIAL_LEN+1];
+	s_file_view_t view;
+
+	size_t name_len = strlen( name );
+	size_t ext_len  = strlen( OCSP_RESPONSE_EXT );
+	if( name_len <= ext_len || name_len-ext_len > MAX_SERIAL_LEN || 0 != strcmp( name+name_len-ext_len, OCSP_RESPONSE_EXT ) ) {
+		return 0;
+	}
+	strlcpy( serial, name, name_len-ext_len+1 );
+	if( normalize_serial( serial, serial, sizeof(serial) ) ) {
+		DEBUG_PRN("cache_load_file: ignoring '%s'", name);
+		return 0;
+	}
+
+	if( snprintf( filename, sizeof(filename), "%s/%s", ocsp_dir, name ) >= (int)sizeof(filename) ) {
+		LOG_PRN( LogWarn, "cache_load_file: path too long for '%s', skipped", name );
+		return 0;
+	}
+	if( file_view_open( filename, &view ) ) {
+		LOG_PRN( LogWarn, "cache_load_file: cannot read '%s', skipped", filename );
+		return 0;
+	}
+
+	// keep the validity to refuse stale responses
+	size_t der_len = 0;
+	time_t next_update = response_next_update( view.data, view.size, &der_len );
+	if( 0 == next_update ) {
+		file_view_close( &view, 0 );
+		LOG_PRN( LogWarn, "cache_load_file: invalid response '%s', skipped", filename );
+		return 0;
+	}
+	// the cache outlives the view: keep a copy of the response only
+	unsigned char *der = malloc( der_len );
+	if( NULL != der ) {
+		memcpy( der, view.data, der_len );
+	}
+	file_view_close( &view, 0 );
+	if( NULL == der ) {
+		DEBUG_PRN("cache_load_file: failed to allocate %zu bytes for '%s'", der_len, filename);
+		return -1;
+	}
+
+	s_ocsp_cache_entry_t *slot = cache_slot( cache, serial );
+	if( NULL == slot->der ) {
+		cache->nb_entries++;
+	}
+	free( slot->der );
+	strlcpy( slot->serial, serial, sizeof(slot->serial) );
+	slot->der         = der;
+	slot->der_len     = der_len;
+	slot->next_update = next_update;
+	return 0;
+}//eo cache_load_file
+
+int ocsp_cache_load( const char *dir, s_ocsp_cache_t *cache )
+{
+	assert( NULL!=dir );
+	assert( NULL!=cache );
+
+	char ocsp_dir[MAX_FILE_PATH+1];
+	secure_memzero( cache, sizeof(s_ocsp_cache_t) );
+	snprintf( ocsp_dir, sizeof(ocsp_dir), "%s/%s", dir, OCSP_DIR );
+
+	X509 *cacert = ca_load_root_cert( dir );
+	if( NULL == cacert ) {
+		return -1;
+	}
+	cache->issuer_id = root_cert_id( cacert, NULL );
+	X509_free( cacert );
+
+	if( NULL == cache->issuer_id
+	 || encode_status_response( OCSP_RESPONSE_STATUS_MALFORMEDREQUEST, &(cache->malformed_der),    &(cache->malformed_len) )
+	 || encode_status_response( OCSP_RESPONSE_STATUS_UNAUTHORIZED,     &(cache->unauthorized_der), &(cache->unauthorized_len) )
+	 || encode_status_response( OCSP_RESPONSE_STATUS_TRYLATER,         &(cache->try_later_der),    &(cache->try_later_len) ) ) {
+		ocsp_cache_free( cache );
+		return -1;
+	}
+
+	DIR *d = opendir( ocsp_dir );
+	if( NULL == d ) {
+		DEBUG_PRN("ocsp_cache_load: failed to open '%s'", ocsp_dir);
+		ocsp_cache_free( cache );
+		return -1;
+	}
+
+	// table sized for a load factor under 1/2
+	unsigned nb_files = 0;
+	struct dirent *de;
+	while( NULL != (de = readdir(d)) ) {
+		nb_files++;
+	}
+	cache->nb_slots = 16;
+	while( cache->nb_slots < 2*nb_files ) {
+		cache->nb_slots <<= 1;
+	}
+	cache->slots = calloc( cache->nb_slots, sizeof(s_ocsp_cache_entry_t) );
+	if( NULL == cache->slots ) {
+		closedir( d );
+		ocsp_cache_free( cache );
+		return -1;
+	}
+
+	int res = 0;
+	rewinddir( d );
+	while( 0 == res && NULL != (de = readdir(d)) ) {
+		res = cache_load_file( cache, ocsp_dir, de->d_name );
+	}
+	closedir( d );
+
+	if( res ) {
+		ocsp_cache_free( cache );
+		return -1;
+	}
+	DEBUG_PRN("ocsp_cache_load: %u responses loaded from '%s'", cache->nb_entries, ocsp_dir);
+	return 0;
+}//eo ocsp_cache_load
+
+const s_ocsp_cache_entry_t* ocsp_cache_find( const s_ocsp_cache_t *cache, const char *serial )
+{
+	assert( NULL!=cache );
+	assert( NULL!=serial );
+
+	char key[MAX_SERIAL_LEN+1];
+	if( NULL == cache->slots || normalize_serial( serial, key, sizeof(key) ) ) {
+		return NULL;
+	}
+	const s_ocsp_cache_entry_t *slot = cache_slot( cache, key );
+	return slot->der ? slot : NULL;
+}//eo ocsp_cache_find
+
+size_t ocsp_cache_respond( const s_ocsp_cache_t *cache, const unsigned char *req, const size_t req_len, const unsigned char **resp )
+{
+	assert( NULL!=cache );
+	assert( NULL!=resp );
+
+	*resp = cache->malformed_der;
+	size_t resp_len = cache->malformed_len;
+
+	const unsigned char *p = req;
+	OCSP_REQUEST *request = d2i_OCSP_REQUEST( NULL, &p, (long)req_len );
+	OCSP_ONEREQ  *one     = request && OCSP_request_onereq_count( request ) > 0 ? OCSP_request_onereq_get0( request, 0 ) : NULL;
+	OCSP_CERTID  *id      = one ? OCSP_onereq_get0_id( one ) : NULL;
+	ASN1_INTEGER *sn      = NULL;
+
+	if( NULL == id || !OCSP_id_get0_info( NULL, NULL, NULL, &sn, id ) ) {
+		goto done;
+	}
+
+	*resp    = cache->unauthorized_der;
+	resp_len = cache->unauthorized_len;
+	if( 0 != OCSP_id_issuer_cmp( cache->issuer_id, id ) ) {
+		goto done;
+	}
+
+	BIGNUM *bn  = ASN1_INTEGER_to_BN( sn, NULL );
+	char   *hex = bn ? BN_bn2hex( bn ) : NULL;
+	const s_ocsp_cache_entry_t *entry = NULL;
+	if( NULL != hex && strlen(hex) <= MAX_SERIAL_LEN ) {
+		const s_ocsp_cache_entry_t *slot = cache_slot( cache, hex );
+		entry = slot->der ? slot : NULL;
+	}
+	OPENSSL_free( hex );
+	BN_free( bn );
+
+	if( NULL != entry ) {
+		if( entry->next_update > time(NULL) ) {
+			*resp    = entry->der;
+			resp_len = entry->der_len;
+		} else {
+			// a new ceremony is required
+			*resp    = cache->try_later_der;
+			resp_len = cache->try_later_len;
+		}
+	}
+
+done:
+	OCSP_REQUEST_free( request );
+	return resp_len;
+}//eo ocsp_cache_respond
+
+void ocsp_cache_free( s_ocsp_cache_t *cache )
+{
+	if( NULL == cache ) {
+		return;
+	}
+	for( unsigned i=0; NULL!=cache->slots && i<cache->nb_slots; i++ ) {
+		free( cache->slots[i].der );
+	}
+	free( cache->slots );
+	OCSP_CERTID_free( cache->issuer_id );
+	OPENSSL_free( cache->malformed_der );
+	OPENSSL_free( cache->unauthorized_der );
+	OPENSSL_free( cache->try_later_der );
+	secure_memzero( cache, sizeof(s_ocsp_cache_t) );
+}//eo ocsp_cache_free
+
+
+//////////////////////////////////////////////////////////// Responder HTTP transport
+
+ssize_t ocsp_http_read( int fd, unsigned char *buf, const size_t len )
+{
+	size_t done = 0;
+	while( done < len ) {
+		ssize_t r = read( fd, buf+done, len-done );
+		if( r < 0 && EINTR == errno ) {
+			continue;
+		}
+		if( r <= 0 ) {
+			return -1;
+		}
+		done += r;
+	}
+	return done;
+}//eo ocsp_http_read
+
+int ocsp_http_write( int fd, const unsigned char *buf, size_t len )
+{
+	while( len > 0 ) {
+		ssize_t w = write( fd, buf, len );
+		if( w < 0 && EINTR == errno ) {
+			continue;
+		}
+		if( w <= 0 ) {
+			return -1;
+		}
+		buf += w;
+		len -= w;
+	}
+	return 0;
+}//eo ocsp_http_write
+
+ssize_t ocsp_http_read_header( int fd, char *buf, const size_t max, const size_t kept, size_t *hdr_len )
+{
+	assert( NULL!=buf && kept < max );
+	assert( NULL!=hdr_len );
+
+	size_t len = kept;
+	for(;;) {
+		char *end = memmem( buf, len, "\r\n\r\n", 4 );
+		if( NULL != end ) {
+			*hdr_len = end+4 - buf;
+			// the fields are then searched in this header only, not in the body or the next request
+			end[2] = '\0';
+			return len;
+		}
+		if( len >= max ) {
+			return -1;
+		}
+		ssize_t r = read( fd, buf+len, max-len );
+		if( r < 0 && EINTR == errno ) {
+			continue;
+		}
+		if( r <= 0 ) {
+			return len ? -1 : 0;
+		}
+		len += r;
+	}
+}//eo ocsp_http_read_header
+
+size_t ocsp_http_content_length( const char *hdr )
+{
+	const char *p = strcasestr( hdr, "\r\ncontent-length:" );
+	return p ? strtoul( p+17, NULL, 10 ) : 0;
+}//eo ocsp_http_content_length
+
+// decode the base64 (possibly URL encoded) request of a GET path
+static ssize_t decode_get_request( const char *path, unsigned char *der, size_t max )
+{
+	char b64[MAX_OCSP_REQUEST];
+	size_t n = 0;
+
+	while( '/' == *path ) {
+		path++;
+	}
+	for( const char *p=path; *p && ' '!=*p && n<sizeof(b64)-1; p++ ) {
+		if( '%'==*p && p[1] && p[2] ) {
+			char hex[3] = { p[1], p[2], '\0' };
+			b64[n++] = (char)strtol( hex, NULL, 16 );
+			p += 2;
+		} else {
+			b64[n++] = *p;
+		}
+	}
+	b64[n] = '\0';
+	return base64_decode( der, max, b64 );
+}//eo decode_get_request
+
+void ocsp_http_serve( const s_ocsp_cache_t *cache, int fd )
+{
+	assert( NULL!=cache );
+
+	char          hdr[MAX_HTTP_HEADER];
+	unsigned char req[MAX_OCSP_REQUEST];
+	char          out_hdr[256];
+
+	size_t kept = 0;
+	for(;;) {
+		size_t  hdr_len = 0;
+		ssize_t len = ocsp_http_read_header( fd, hdr, sizeof(hdr), kept, &hdr_len );
+		if( len <= 0 ) {
+			return;
+		}
+
+		ssize_t req_len  = -1;
+		size_t  consumed = hdr_len;
+		if( 0 == strncmp( hdr, "POST ", 5 ) ) {
+			size_t body_len = ocsp_http_content_length( hdr );
+			size_t already  = len - hdr_len;
+			if( body_len > sizeof(req) ) {
+				// invalid request
+			} else if( already >= body_len ) {
+				memcpy( req, hdr+hdr_len, body_len );
+				consumed += body_len;
+				req_len   = body_len;
+			} else {
+				memcpy( req, hdr+hdr_len, already );
+				consumed = len;
+				if( ocsp_http_read( fd, req+already, body_len-already ) >= 0 ) {
+					req_len = body_len;
+				}
+			}
+		} else if( 0 == strncmp( hdr, "GET ", 4 ) ) {
+			req_len = decode_get_request( hdr+4, req, sizeof(req) );
+		}
+
+		if( req_len < 0 ) {
+			const char *bad = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+			ocsp_http_write( fd, (const unsigned char*)bad, strlen(bad) );
+			return;
+		}
+
+		// O(1): hash lookup of a response signed during the ceremony
+		const unsigned char *resp = NULL;
+		size_t resp_len = ocsp_cache_respond( cache, req, req_len, &resp );
+
+		int close_after = NULL != strcasestr( hdr, "\r\nconnection: close" );
+		int n = snprintf( out_hdr, sizeof(out_hdr),
+			"HTTP/1.1 200 OK\r\nContent-Type: application/ocsp-response\r\nContent-Length: %zu\r\n%s\r\n",
+			resp_len, close_after ? "Connection: close\r\n" : "" );
+
+		if( ocsp_http_write( fd, (const unsigned char*)out_hdr, n ) || ocsp_http_write( fd, resp, resp_len ) || close_after ) {
+			return;
+		}
+
+		// the beginning of a pipelined request may already be in the buffer
+		kept = len - consumed;
+		memmove( hdr, hdr+consumed, kept );
+	}
+}//eo ocsp_http_serve
+
+#undef WARN
+#undef STEP
+
+//eof
@@ -0,0 +1,207 @@
+/**
+ *
+ * \file ocsp.h
+ *
+ * \brief Pre-signed OCSP responses: ceremony side signing and responder side cache
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#if !defined( _S4_OCSP_H_ )
+#define _S4_OCSP_H_
+
+#include <time.h>
+#include <sys/types.h>
+#include <openssl/ocsp.h>
+
+#include "utils.h"
+#include "pki.h"
+#include "ca_store.h"
+
+#define OCSP_DIR              ("ocsp")
+#define OCSP_RESPONSE_EXT     (".der")
+
+#define DEFAULT_OCSP_PORT     (8080)
+
+#define MAX_HTTP_HEADER       (8192)
+#define MAX_OCSP_REQUEST      (8192)
+
+/**
+ * \brief One pre-signed response, keyed by the certificate serial number
+ */
+typedef struct SOCSPCacheEntry {
+    char           serial[MAX_SERIAL_LEN+1];   // upper case hexadecimal, no leading zero
+    unsigned char *der;                        // DER encoded OCSPResponse, NULL for an empty slot
+    size_t         der_len;
+    time_t         next_update;
+} s_ocsp_cache_entry_t;
+
+/**
+ * \brief Pre-signed responses of a PKI, loaded in memory
+ *
+ * The cache is read-only once loaded and may be shared between threads.
+ */
+typedef struct SOCSPCache {
+    s_ocsp_cache_entry_t *slots;       // open addressing hash table
+    unsigned              nb_slots;    // power of 2
+    unsigned              nb_entries;
+
+    OCSP_CERTID          *issuer_id;   // CertID of the root, to check the requests issuer hashes
+
+    // unsigned error responses, encoded once
+    unsigned char        *malformed_der;
+    size_t                malformed_len;
+    unsigned char        *unauthorized_der;
+    size_t                unauthorized_len;
+    unsigned char        *try_later_der;
+    size_t                try_later_len;
+} s_ocsp_cache_t;
+
+struct SS4EventHandlers;
+
+/**
+ * \brief Sign an OCSP response for every certificate of the index
+ *
+ * The responses are signed by the root key, valid for period_days from now,
+ * and saved as <dir>/ocsp/<serial>.der for the responder. The responses of the
+ * certificates no more valid nor revoked (expired, removed from the index)
+ * are deleted.
+ *
+ * \param dir            root directory of the PKI
+ * \param period_days    validity of the responses in days
+ * \param password       password of the root private key
+ * \param evt_handlers   structure of application events (progress, errors) handlers
+ *
+ * \return 0 on success, -1 on error
+ */
+int ocsp_presign( const char *dir, const unsigned period_days, const char *password, struct SS4EventHandlers* evt_handlers );
+
+/**
+ * \brief Sign again, as revoked, the pre-signed responses of newly revoked certificates
+ *
+ * Only the certificates with a response in <dir>/ocsp are signed again, with
+ * the validity of that response, so that the responder never answers good
+ * for a revoked certificate. The responses are added to the write group of
+ * the revocation, to reach the disk with the certificate index.
+ *
+ * \param grp         atomic write group of the revocation
+ * \param dir         root directory of the PKI
+ * \param cacert      root certificate
+ * \param key         root private key
+ * \param entries     index entries, already marked as revoked
+ * \param nb_entries  number of entries
+ *
+ * \return 0 on success, -1 on error
+ */
+int ocsp_presign_revoked( s_atomic_group_t *grp, const char *dir, X509 *cacert, EVP_PKEY *key, s_ca_index_entry_t *const *entries, const unsigned nb_entries );
+
+/**
+ * \brief Load the pre-signed responses of a PKI
+ *
+ * A response file that cannot be read or decoded is skipped with a warning.
+ *
+ * \param dir    root directory of the PKI
+ * \param cache  pointer to an allocated cache, to release with ocsp_cache_free
+ *
+ * \return 0 on success, -1 on error
+ */
+int ocsp_cache_load( const char *dir, s_ocsp_cache_t *cache );
+
+/**
+ * \brief Find the pre-signed response of a certificate
+ *
+ * \param cache   loaded cache
+ * \param serial  hexadecimal serial number
+ *
+ * \return the entry, NULL if the serial is unknown
+ */
+const s_ocsp_cache_entry_t* ocsp_cache_find( const s_ocsp_cache_t *cache, const char *serial );
+
+/**
+ * \brief Answer a DER encoded OCSP request from the cache
+ *
+ * Only the first certificate of the request is answered. No signature is
+ * computed: the response is the pre-signed one (so without nonce), or an
+ * unsigned error status.
+ *
+ * \param cache    loaded cache
+ * \param req      DER encoded OCSPRequest
+ * \param req_len  size of the request
+ * \param resp     set to the DER encoded response, owned by the cache
+ *
+ * \return the size of the response
+ */
+size_t ocsp_cache_respond( const s_ocsp_cache_t *cache, const unsigned char *req, const size_t req_len, const unsigned char **resp );
+
+/**
+ * \brief Release the memory held by a cache
+ *
+ * \param cache  cache to cleanup
+ */
+void ocsp_cache_free( s_ocsp_cache_t *cache );
+
+/**
+ * \brief Read exactly len bytes
+ *
+ * \param fd   connected socket
+ * \param buf  destination buffer
+ * \param len  number of bytes to read
+ *
+ * \return len, -1 on error or early connection close
+ */
+ssize_t ocsp_http_read( int fd, unsigned char *buf, const size_t len );
+
+/**
+ * \brief Write the whole buffer
+ *
+ * \param fd   connected socket
+ * \param buf  data to write
+ * \param len  size of the data
+ *
+ * \return 0 on success, -1 on error
+ */
+int ocsp_http_write( int fd, const unsigned char *buf, size_t len );
+
+/**
+ * \brief Read an HTTP header block
+ *
+ * The header is NUL terminated in place of its final empty line, the bytes
+ * read past it (body, next pipelined message) follow at buf+hdr_len.
+ *
+ * \param fd       connected socket
+ * \param buf      buffer for the header and the beginning of the body
+ * \param max      size of the buffer
+ * \param kept     number of bytes already in the buffer, kept from the previous message
+ * \param hdr_len  set to the size of the header, final empty line included
+ *
+ * \return the number of bytes in the buffer, 0 on connection close, -1 on error
+ */
+ssize_t ocsp_http_read_header( int fd, char *buf, const size_t max, const size_t kept, size_t *hdr_len );
+
+/**
+ * \brief Content-Length of an HTTP header
+ *
+ * \param hdr  header block, as read by ocsp_http_read_header
+ *
+ * \return the length of the body, 0 if absent
+ */
+size_t ocsp_http_content_length( const char *hdr );
+
+/**
+ * \brief Answer the OCSP requests (HTTP POST or GET) of a connection from the cache
+ *
+ * The connection is kept alive until the client closes it, asks for its
+ * closing, or sends an invalid request. Pipelined requests are answered
+ * in order. A read timeout of the socket ends an idle connection.
+ *
+ * \param cache  loaded cache
+ * \param fd     connected socket, left open
+ */
+void ocsp_http_serve( const s_ocsp_cache_t *cache, int fd );
+
+#endif
+//eof
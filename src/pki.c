@@ -13,26 +13,35 @@
  *
  */
 
-//#define DEEPDEBUG 1
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 
 #include <openssl/rand.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
 #include <errno.h>
 #include <gmp.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include "iniparser.h"
 #include "utils.h"
 #include "pki.h"
 #include "openssl_conf.h"
 #include "shared_secret.h"
+#include "ca_store.h"
+#include "sha3.h"
+#include "ocsp.h"
 
-#define ROOT_CERT_FNAME ("root.crt")
 #define INI_FILENAME    ("pki.ini")
-#define MAX_COMMAND_LINE_SIZE (1024)
 
 #define INI_VAR_SUBJECT     ("pki:subject")
 #define INI_VAR_NB_SHARE    ("pki:nb_share")
@@ -47,6 +56,7 @@
 
 #define STEP(p,m) if( evt_handlers->on_progress ) { evt_handlers->on_progress( evt_handlers->data, (p), (m) ); }
 #define WARN(...) if( evt_handlers->on_warning)   { evt_handlers->on_warning( evt_handlers->data, __VA_ARGS__ ); }
+#define CANCELLED() ( NULL!=evt_handlers->is_cancelled && evt_handlers->is_cancelled( evt_handlers->data ) )
 
 
 
@@ -76,19 +86,25 @@ int write_ca_infos(
 		"quorum=%u\n"      \
 		"nb_share=%u\n";
 
-	FILE * fh_ini = fopen(filename,"w");
+	// a crash while rewriting pki.ini must not leave a truncated one
+	s_atomic_group_t grp;
+	atomic_group_init( &grp );
+
+	FILE * fh_ini = atomic_group_open( &grp, filename );
 	if( NULL  == fh_ini ) {
 		DEBUG_PRN("write_ca_infos: error while opening '%s'", filename );
+		atomic_group_abort( &grp );
 		return -1;
 	}
 	int res = fprintf( fh_ini, ini_fmt, subject, nb_emitted, nb_revoqued, quorum, nb_holders);
 	if( res < 0 ) {
 		DEBUG_PRN("write_ca_infos: error while writing to '%s'", filename);
+		atomic_group_abort( &grp );
 		return -1;
 	}
 
-	if( fclose(fh_ini) ) {
-		DEBUG_PRN("write_ca_infos: error while closing file '%s'", filename);
+	if( atomic_group_commit( &grp ) ) {
+		DEBUG_PRN("write_ca_infos: error while committing file '%s'", filename);
 		return -1;
 	}
 
@@ -112,8 +128,8 @@ int read_ca_infos(
 	assert(NULL!=pnb_emitted);
 
 	DDEBUG_PRN(
-		"read_ca_infos: (dir:'%s',subj:%p, subj_sze:%u, pnb_share:%p, pquorum:%p, pnb_certs:%p, pnb_revoqued;%p)",
-						dirname,  subject, subject_max, pnb_holders,  pquorum, pnb_emitted, pnb_revoqued
+		"read_ca_infos: (dir:'%s',subj:%p, subj_sze:%zu, pnb_share:%p, pquorum:%p, pnb_certs:%p, pnb_revoqued;%p)",
+						dirname,  subject, subject_max, (void*)pnb_holders, (void*)pquorum, (void*)pnb_emitted, (void*)pnb_revoqued
 	);
 
 	char filename[MAX_FILE_PATH+1];
@@ -125,8 +141,7 @@ int read_ca_infos(
 		return 1;
 	}
 
-	iniparser_dump(ini, stdout );
-
+	DEBUG_PRN("read_ca_infos: '%s' loaded", filename);
 
 	const char * subj = iniparser_getstring(ini, INI_VAR_SUBJECT, NULL);
 	DDEBUG_PRN("read_ca_infos: [%s]=%s", INI_VAR_SUBJECT, subj );
@@ -180,7 +195,7 @@ int read_ca_infos(
 ////
 ssize_t gen_pass(char *out, const size_t max_size )
 {
-	DDEBUG_PRN("gen_pass(out=%p,size=%d) pass_size:%d", out, max_size, PASS_SIZE);
+	DDEBUG_PRN("gen_pass(out=%p,size=%zu) pass_size:%d", out, max_size, PASS_SIZE);
 
 	size_t strength = PASS_SIZE;
 	uint8_t pass_bytes[PASS_SIZE+1]; 
@@ -198,13 +213,14 @@ ssize_t gen_pass(char *out, const size_t max_size )
 		return -1;
 	}
 
-	DEBUG_PRN("gen_pass(%d) => %s", result_size, out );	
+	DEBUG_PRN("gen_pass: %zd characters generated", result_size );	
 	return result_size;
 }//eo genpass
 
 
 
 static int generate_openssl_config(
+	s_atomic_group_t *grp,
 	const char    *dir, 
 	const char    *crl_distribution_point, 
 	const unsigned ca_life_len,
@@ -217,7 +233,7 @@ static int generate_openssl_config(
 	const unsigned default_cert_ksize     = DEFAULT_CERT_KEY_SIZE; 
 
 	sprintf( conf_filename, "%s/openssl.conf", dir);
-	FILE * fp_out = fopen(conf_filename,"w");	
+	FILE * fp_out = atomic_group_open( grp, conf_filename );
 	if( NULL==fp_out  ) {
 		warn("Error encountered opening %s", conf_filename );
 		return -1;
@@ -231,8 +247,7 @@ static int generate_openssl_config(
 	fprintf( fp_out, "califelen=%u\n",        ca_life_len  );
 	fprintf( fp_out, "\n" );
 	fprintf( fp_out,"%s", OPENSSL_DEFAULT_CONF );
-	fclose( fp_out );
-	// TODO check return values
+	// write errors are reported by the commit of the group
 
 	return 0;
 }//eo generate_openssl_config
@@ -240,22 +255,20 @@ static int generate_openssl_config(
 ////
 int gen_self_signed( const char *dir, const s_pki_parameters_t *params, const char *password, const unsigned nb_share, const unsigned quorum, struct SS4EventHandlers* evt_handlers )
 {
-	DDEBUG_PRN("gen_self_signed(dir=\"%s\", params=\"%p\", password=\"%s\", nb_share=%u, quorum=%u, evt_h=%p", dir, params, password, nb_share, quorum, evt_handlers );
+	DDEBUG_PRN("gen_self_signed(dir=\"%s\", params=\"%p\", nb_share=%u, quorum=%u, evt_h=%p", dir, (void*)params, nb_share, quorum, (void*)evt_handlers );
 
-	char cmd[MAX_COMMAND_LINE_SIZE];
+	char fpath[MAX_FILE_PATH+1];
 
     STEP( 1, "initializing PKI creation");
 	
     STEP( 10, "Building PKI directory tree");
-	int dir_create_res = 0;
-	dir_create_res &= call_command("mkdir %s/cacert   2>/dev/null", dir);
-	dir_create_res &= call_command("mkdir %s/private  2>/dev/null", dir);
-	dir_create_res &= call_command("mkdir %s/certs    2>/dev/null", dir);
-	dir_create_res &= call_command("mkdir %s/p7       2>/dev/null", dir);
-	dir_create_res &= call_command("mkdir %s/crl      2>/dev/null", dir);
-	if( dir_create_res ) {
-		warn("Error encountered on PKI directories creation.");
-		return -1;
+	const char *subdirs[] = { "cacert", "private", "certs", "p7", "crl" };
+	for( unsigned i=0; i<sizeof(subdirs)/sizeof(subdirs[0]); i++ ) {
+		snprintf( fpath, sizeof(fpath), "%s/%s", dir, subdirs[i] );
+		if( mkdir( fpath, 0755 ) && errno!=EEXIST ) {
+			warn("Error encountered on PKI directories creation (%s).", fpath);
+			return -1;
+		}
 	}
  
 	/** prepare PKI directory 
@@ -263,57 +276,68 @@ int gen_self_signed( const char *dir, const s_pki_parameters_t *params, const ch
 	 - cert.idx
 	 - cacert/  --> root certificate
 	 - certs/   --> certificate output
-	 - p7/      --> PKCS#7 certification chain
+	 - p7/      --> PKCS#7 certification chain (CAs.p7b) and its DER cache (CAs.der)
 	 - private/ --> private key
 	 - crl/     --> crl output
 	***/
+    // the initial PKI files are made durable together, before openssl uses them
+	s_atomic_group_t grp;
+	atomic_group_init( &grp );
+
     STEP(20, "Initializing certificate counter");
-	secure_memzero(cmd,MAX_COMMAND_LINE_SIZE);
-	sprintf(cmd,"%s/serial",dir);
-	FILE * fp_out = fopen(cmd,"w");
-	if( fp_out == NULL ) {
-		WARN("Error encountered opening %s", cmd);
-		return -1;
-	}
-	fwrite("01",sizeof(char),3,fp_out);
-	fclose(fp_out);
+	sprintf(fpath,"%s/serial",dir);
+	atomic_group_write( &grp, fpath, "01\n", 3 );
 
     STEP(30, "Initializing certificate index");
-	secure_memzero(cmd,MAX_COMMAND_LINE_SIZE);
-	sprintf(cmd,"%s/cert.idx",dir);
-	fp_out = fopen(cmd,"w");
-	if( fp_out == NULL ) {
-		WARN("Error encountered opening %s", cmd);
-		return -1;
-	}
-	fclose(fp_out);
+	sprintf(fpath,"%s/cert.idx",dir);
+	atomic_group_write( &grp, fpath, "", 0 );
 
     STEP(40, "Initializing certificate serial numbers registry");
-	secure_memzero(cmd,MAX_COMMAND_LINE_SIZE);
-	sprintf(cmd,"%s/crl/crl_serial",dir);
-	fp_out = fopen(cmd,"w");
-	if( fp_out == NULL ) {
-		WARN("Error encountered opening %s", cmd);
-		return -1;
-	}
-	fwrite("01",sizeof(char),3,fp_out);
-	fclose(fp_out);
+	sprintf(fpath,"%s/crl/crl_serial",dir);
+	atomic_group_write( &grp, fpath, "01\n", 3 );
 
     STEP(50, "Generating OpenSSL configuration");
-    if( generate_openssl_config(dir,
+    if( generate_openssl_config( &grp, dir,
      	params->cdp_url, 
      	params->ca_life_len, 
      	params->crl_life_len
     ) ) {
     	WARN("failed to creation openssl configuration");
+    	atomic_group_abort( &grp );
     	return -1;
     }
 
+    // last point where a cancellation leaves nothing but empty directories
+    if( CANCELLED() ) {
+    	DEBUG_PRN("gen_self_signed: cancelled before writing the PKI files");
+    	atomic_group_abort( &grp );
+    	return -1;
+    }
+
+    if( atomic_group_commit( &grp ) ) {
+		WARN("Error encountered writing the PKI files in %s", dir);
+		return -1;
+    }
+
 	/** genkey
 		openssl genrsa -aes256 -out $dir/root.key -passout pass:$pass  4096
 	***/
+    if( CANCELLED() ) {
+    	DEBUG_PRN("gen_self_signed: cancelled before the root key generation");
+    	return -1;
+    }
     STEP(60, "Creating root private key");
-	int err = call_openssl("genrsa -aes256 -out %s/private/root.key -passout pass:%s 4096 ", dir, password);
+	char key_fpath[MAX_FILE_PATH+1];
+	char cert_fpath[MAX_FILE_PATH+1];
+	char conf_fpath[MAX_FILE_PATH+1];
+	char crl_fpath[MAX_FILE_PATH+1];
+	snprintf( key_fpath,  sizeof(key_fpath),  "%s/private/root.key", dir );
+	snprintf( cert_fpath, sizeof(cert_fpath), "%s/cacert/%s", dir, ROOT_CERT_FNAME );
+	snprintf( conf_fpath, sizeof(conf_fpath), "%s/openssl.conf", dir );
+	snprintf( crl_fpath,  sizeof(crl_fpath),  "%s/crl/root.crl", dir );
+
+	const char *genrsa_args[] = { "genrsa", "-aes256", "-out", key_fpath, "-passout", OPENSSL_SECRET_ARG, "4096", NULL };
+	int err = call_openssl( genrsa_args, password );
 	if( err ) {
 		WARN("Failed to generate RSA keypair");
 		return -1;
@@ -322,9 +346,16 @@ int gen_self_signed( const char *dir, const s_pki_parameters_t *params, const ch
 	/** gen x509
 	 openssl req -new -x509 -key $dir/root.key -out $dir/root.crt -subj "$subj" -passin pass:$pass
 	***/
+    if( CANCELLED() ) {
+    	DEBUG_PRN("gen_self_signed: cancelled before the root certificate creation");
+    	return -1;
+    }
     STEP(80, "Creating root certificate");
-	err = call_openssl("req -new -x509 -extensions v3_ca_root -days 7300 -key %s/private/root.key -out %s/cacert/%s  -subj \"%s\" -config %s/openssl.conf -passin pass:%s", 
-		dir, dir, ROOT_CERT_FNAME, params->subject, dir, password);
+	const char *req_args[] = { 
+		"req", "-new", "-x509", "-extensions", "v3_ca_root", "-days", "7300", "-key", key_fpath, "-out", cert_fpath,
+		"-subj", params->subject, "-config", conf_fpath, "-passin", OPENSSL_SECRET_ARG, NULL
+	};
+	err = call_openssl( req_args, password );
 	if( err ) {
 		WARN("Failed to generate Root certificate");
 		return -1;
@@ -334,10 +365,11 @@ int gen_self_signed( const char *dir, const s_pki_parameters_t *params, const ch
 	openssl ca -gencrl -crlexts crl_ext -config ./openssl.conf -crldays 7300 -cert CAcerts/rootCA.pem -keyfile private/rootCA.key -out crl/root.crl
 	****/
     STEP(90, "Creating initial CRL");
-	err = call_openssl(
-		"ca -gencrl -crlexts crl_ext -crldays 7300 -config"
-		" %s/openssl.conf -cert %s/cacert/%s              -keyfile %s/private/root.key -out %s/crl/root.crl -passin pass:%s", 
-		  dir, dir, ROOT_CERT_FNAME, dir, dir, password );
+	const char *gencrl_args[] = {
+		"ca", "-gencrl", "-crlexts", "crl_ext", "-crldays", "7300", "-config", conf_fpath,
+		"-cert", cert_fpath, "-keyfile", key_fpath, "-out", crl_fpath, "-passin", OPENSSL_SECRET_ARG, NULL
+	};
+	err = call_openssl( gencrl_args, password );
 	if( err ) {
 		WARN("Failed to generate Root CRL");
 		return -1;
@@ -362,7 +394,7 @@ int gen_self_signed( const char *dir, const s_pki_parameters_t *params, const ch
 //////
 int sign_subca(const char *dir, const char *csr_filename, const char * cert_copy, const char *password, struct SS4EventHandlers* evt_handlers )
 {
-	DDEBUG_PRN("sign_subca(dir=\"%s\", csr=\"%s\", pwd=\"%s\", evt_h=%p", dir, csr_filename, password, evt_handlers );	
+	DDEBUG_PRN("sign_subca(dir=\"%s\", csr=\"%s\", evt_h=%p", dir, csr_filename, (void*)evt_handlers );	
 
 	char cert_fpath[MAX_FILE_PATH];
 	char dir_output[MAX_FILE_PATH];	
@@ -384,11 +416,25 @@ int sign_subca(const char *dir, const char *csr_filename, const char * cert_copy
 	}
 	snprintf( cert_fpath, sizeof(cert_fpath), "%s/certs/%s.%s", dir,        base_fname, "crt"); //TODO check results	
 
+	// once signed, the certificate is in the index: no way back
+	if( CANCELLED() ) {
+		DEBUG_PRN("sign_subca: cancelled before signing %s", csr_filename);
+		return -1;
+	}
+
 	STEP( 40, "Signing the CSR");
-	int err = call_openssl(
-		"ca -config %s/openssl.conf -batch -extensions v3_subca1 -in %s -out %s          -cert %s/cacert/root.crt -keyfile %s/private/root.key -passin pass:%s",
-		            dir,                             csr_filename,   cert_fpath,       dir,                       dir,                      password
-	);
+	char conf_fpath[MAX_FILE_PATH+1];
+	char root_fpath[MAX_FILE_PATH+1];
+	char key_fpath[MAX_FILE_PATH+1];
+	snprintf( conf_fpath, sizeof(conf_fpath), "%s/openssl.conf", dir );
+	snprintf( root_fpath, sizeof(root_fpath), "%s/cacert/%s", dir, ROOT_CERT_FNAME );
+	snprintf( key_fpath,  sizeof(key_fpath),  "%s/private/root.key", dir );
+
+	const char *sign_args[] = {
+		"ca", "-config", conf_fpath, "-batch", "-extensions", "v3_subca1", "-in", csr_filename, "-out", cert_fpath,
+		"-cert", root_fpath, "-keyfile", key_fpath, "-passin", OPENSSL_SECRET_ARG, NULL
+	};
+	int err = call_openssl( sign_args, password );
 	if( err ) {
 		WARN("Failed to sign the Sub CA csr.");
 		return -1;
@@ -396,16 +442,15 @@ int sign_subca(const char *dir, const char *csr_filename, const char * cert_copy
 
 	if( NULL!=cert_copy && *cert_copy!='\0' ) {
 		STEP( 70, "Copying the certificate");
-		if( file_copy( cert_fpath, cert_copy ) <0 ) {
+		if( file_copy( cert_fpath, cert_copy, FILE_COPY_SYNC ) <0 ) {
 			WARN("Failed to copy the resulting certificate from '%s' to '%s'", cert_fpath, cert_copy );
 			return -1;
 		}
 	}
 
 	STEP( 80, "Creation of the PKCS7 chain CA");
-	/** Create the PKCS7 Chain CA ***/
-	err = call_openssl("crl2pkcs7 -nocrl -certfile %s/cacert/root.crt -out %s/p7/CAs.p7b -certfile %s", dir, dir, cert_fpath);
-	if( err ) {
+	/** Append to the PKCS7 Chain CA ***/
+	if( ca_chain_append( dir, cert_fpath ) ) {
 		WARN("Failed to create the pkcs7 of CAs.");
 		return -1;
 	}
@@ -416,32 +461,625 @@ int sign_subca(const char *dir, const char *csr_filename, const char * cert_copy
 }//eo sign_subCA
 
 
+// remove the private database of a concurrent signature and everything openssl wrote in it
+static void remove_sign_workdir( const char *workdir )
+{
+	DIR *d = opendir( workdir );
+	if( NULL != d ) {
+		struct dirent *ent;
+		char fpath[MAX_FILE_PATH+1];
+		while( NULL != (ent = readdir( d )) ) {
+			if( 0 == strcmp( ent->d_name, "." ) || 0 == strcmp( ent->d_name, ".." ) ) {
+				continue;
+			}
+			if( snprintf( fpath, sizeof(fpath), "%s/%s", workdir, ent->d_name ) >= (int)sizeof(fpath) ) {
+				DEBUG_PRN("remove_sign_workdir: path too long for '%s'", ent->d_name);
+				continue;
+			}
+			unlink( fpath );
+		}
+		closedir( d );
+	}
+	if( rmdir( workdir ) ) {
+		DEBUG_PRN("remove_sign_workdir: failed to remove '%s': %s", workdir, strerror(errno));
+	}
+}//eo remove_sign_workdir
+
+/*
+ * openssl.conf of the PKI whose CA section points to a private serial and
+ * index: openssl merges the members of a section declared twice, the last
+ * value of a member wins. The private index holds the valid certificates of
+ * the PKI, for openssl to apply its unique_subject policy, and the attributes
+ * of the PKI index are copied along. Called with the lock of the index held.
+ */
+static int write_sign_workdir( const char *dir, const char *workdir, const unsigned long serial, const s_ca_index_t *index )
+{
+	char conf_fpath[MAX_FILE_PATH+1];
+	char work_fpath[MAX_FILE_PATH+1];
+
+	if( snprintf( conf_fpath, sizeof(conf_fpath), "%s/openssl.conf", dir ) >= (int)sizeof(conf_fpath)
+	 || snprintf( work_fpath, sizeof(work_fpath), "%s/openssl.conf", workdir ) >= (int)sizeof(work_fpath) ) {
+		DEBUG_PRN("write_sign_workdir: path too long in '%s'", workdir);
+		return -1;
+	}
+	if( file_copy( conf_fpath, work_fpath, 0 ) ) {
+		return -1;
+	}
+	FILE *fp = fopen( work_fpath, "a" );
+	if( NULL == fp ) {
+		return -1;
+	}
+	int res = fprintf( fp, "\n[ CA_default ]\nserial = %s/%s\ndatabase = %s/%s\n", workdir, CERT_SERIAL_FNAME, workdir, CERT_INDEX_FNAME );
+	if( fclose( fp ) || res < 0 ) {
+		return -1;
+	}
+
+	if( snprintf( conf_fpath, sizeof(conf_fpath), "%s/%s.attr", dir, CERT_INDEX_FNAME ) >= (int)sizeof(conf_fpath)
+	 || snprintf( work_fpath, sizeof(work_fpath), "%s/%s.attr", workdir, CERT_INDEX_FNAME ) >= (int)sizeof(work_fpath) ) {
+		DEBUG_PRN("write_sign_workdir: path too long in '%s'", workdir);
+		return -1;
+	}
+	if( 0 == access( conf_fpath, F_OK ) && file_copy( conf_fpath, work_fpath, 0 ) ) {
+		return -1;
+	}
+
+	// a scratch copy: no durability needed
+	if( snprintf( work_fpath, sizeof(work_fpath), "%s/%s", workdir, CERT_INDEX_FNAME ) >= (int)sizeof(work_fpath) ) {
+		DEBUG_PRN("write_sign_workdir: path too long in '%s'", workdir);
+		return -1;
+	}
+	fp = fopen( work_fpath, "w" );
+	if( NULL == fp ) {
+		return -1;
+	}
+	res = 0;
+	for( unsigned i=0; i<index->nb_entries && res>=0; i++ ) {
+		const s_ca_index_entry_t *entry = &(index->entries[i]);
+		if( 'V' == entry->status ) {
+			res = fprintf( fp, "V\t%s\t\t%s\t%s\t%s\n", entry->expiry, entry->serial, entry->file, entry->subject );
+		}
+	}
+	if( fclose( fp ) || res < 0 ) {
+		return -1;
+	}
+	return ca_write_cert_serial( workdir, serial, NULL );
+}//eo write_sign_workdir
+
+// unique_subject policy applied by openssl to a signature, as saved in the attributes of its index
+static int sign_unique_subject( const char *workdir )
+{
+	char  attr_fpath[MAX_FILE_PATH+1];
+	char  line[256];
+	int   unique = 1;
+
+	if( snprintf( attr_fpath, sizeof(attr_fpath), "%s/%s.attr", workdir, CERT_INDEX_FNAME ) >= (int)sizeof(attr_fpath) ) {
+		DEBUG_PRN("sign_unique_subject: path too long in '%s'", workdir);
+		return unique;
+	}
+	FILE *fp = fopen( attr_fpath, "r" );
+	if( NULL == fp ) {
+		return unique;
+	}
+	while( NULL != fgets( line, sizeof(line), fp ) ) {
+		char value[8];
+		if( 1 == sscanf( line, " unique_subject = %7s", value ) ) {
+			unique = 0 != strcasecmp( value, "no" );
+		}
+	}
+	fclose( fp );
+	return unique;
+}//eo sign_unique_subject
+
+int sign_subca_shared(const char *dir, const char *csr_filename, const char *cert_copy, const char *password, s_ca_index_cache_t *index, struct SS4EventHandlers* evt_handlers )
+{
+	DDEBUG_PRN("sign_subca_shared(dir=\"%s\", csr=\"%s\", evt_h=%p", dir, csr_filename, (void*)evt_handlers );
+	assert( NULL!=dir );
+	assert( NULL!=index );
+
+	char cert_fpath[MAX_FILE_PATH+1];
+	char base_fname[MAX_FILE_PATH/2];
+	char workdir[MAX_FILE_PATH+1];
+
+	STEP( 10, "Certificate name initialisation");
+	if( filename_base( csr_filename, base_fname, sizeof(base_fname) ) <0 ) {
+		WARN("Failed to extract name from CSR filename: %s", csr_filename );
+		return -1;
+	}
+	if( snprintf( cert_fpath, sizeof(cert_fpath), "%s/certs/%s.%s", dir, base_fname, "crt") >= (int)sizeof(cert_fpath) ) {
+		WARN("The certificate path is too long for %s", csr_filename );
+		return -1;
+	}
+
+	if( CANCELLED() ) {
+		DEBUG_PRN("sign_subca_shared: cancelled before signing %s", csr_filename);
+		return -1;
+	}
+
+	if( snprintf( workdir, sizeof(workdir), "%s/sign.XXXXXX", dir ) >= (int)sizeof(workdir) ) {
+		WARN("The working directory path is too long in %s", dir);
+		return -1;
+	}
+	if( NULL == mkdtemp( workdir ) ) {
+		WARN("Failed to create a working directory in %s: %s", dir, strerror(errno));
+		return -1;
+	}
+
+	int res = -1;
+	s_ca_index_t issued;
+	secure_memzero( &issued, sizeof(issued) );
+
+	// the serial is reserved at once: a failed signature only leaves a gap
+	STEP( 20, "Reserving a serial number");
+	unsigned long serial = 0;
+	pthread_mutex_lock( &(index->lock) );
+	s_ca_index_t *idx = ca_index_cache_get( dir, index );
+	int err = NULL == idx || ca_read_cert_serial( dir, &serial ) || ca_write_cert_serial( dir, serial+1, NULL );
+	if( err ) {
+		pthread_mutex_unlock( &(index->lock) );
+		WARN("Failed to reserve a serial number in %s", dir);
+		goto cleanup;
+	}
+	err = write_sign_workdir( dir, workdir, serial, idx );
+	pthread_mutex_unlock( &(index->lock) );
+	if( err ) {
+		WARN("Failed to prepare the signature of %s", csr_filename);
+		goto cleanup;
+	}
+
+	STEP( 40, "Signing the CSR");
+	char conf_fpath[MAX_FILE_PATH+1];
+	char root_fpath[MAX_FILE_PATH+1];
+	char key_fpath[MAX_FILE_PATH+1];
+	if( snprintf( conf_fpath, sizeof(conf_fpath), "%s/openssl.conf", workdir ) >= (int)sizeof(conf_fpath)
+	 || snprintf( root_fpath, sizeof(root_fpath), "%s/cacert/%s", dir, ROOT_CERT_FNAME ) >= (int)sizeof(root_fpath)
+	 || snprintf( key_fpath,  sizeof(key_fpath),  "%s/private/root.key", dir ) >= (int)sizeof(key_fpath) ) {
+		WARN("The paths of the PKI %s are too long to sign %s", dir, csr_filename);
+		goto cleanup;
+	}
+
+	const char *sign_args[] = {
+		"ca", "-config", conf_fpath, "-batch", "-extensions", "v3_subca1", "-in", csr_filename, "-out", cert_fpath,
+		"-cert", root_fpath, "-keyfile", key_fpath, "-passin", OPENSSL_SECRET_ARG, NULL
+	};
+	if( call_openssl( sign_args, password ) ) {
+		WARN("Failed to sign the Sub CA csr.");
+		goto cleanup;
+	}
+	char serial_hex[MAX_SERIAL_LEN+1];
+	snprintf( serial_hex, sizeof(serial_hex), "%lX", serial );
+	const s_ca_index_entry_t *entry = NULL;
+	if( ca_index_load( workdir, &issued ) || NULL == (entry = ca_index_find( &issued, serial_hex )) ) {
+		WARN("Failed to read the certificate issued for %s", csr_filename);
+		goto cleanup;
+	}
+
+	// the index and the chain are shared with the other signatures
+	STEP( 60, "Recording the certificate");
+	const int unique = sign_unique_subject( workdir );
+	int duplicate = 0;
+	pthread_mutex_lock( &(index->lock) );
+	idx = ca_index_cache_get( dir, index );
+	err = NULL == idx;
+	// a concurrent signature may have issued the same subject since the private index was written
+	for( unsigned i=0; !err && unique && i<idx->nb_entries; i++ ) {
+		if( 'V' == idx->entries[i].status && 0 == strcmp( idx->entries[i].subject, entry->subject ) ) {
+			duplicate = err = 1;
+		}
+	}
+	if( !err && ca_index_append( idx, entry ) ) {
+		ca_index_cache_drop( index );
+		err = 1;
+	}
+	err = err || ca_index_cache_save( dir, index );
+	if( !err ) {
+		STEP( 80, "Creation of the PKCS7 chain CA");
+		err = ca_chain_append( dir, cert_fpath );
+	}
+	pthread_mutex_unlock( &(index->lock) );
+	if( duplicate ) {
+		WARN("A valid certificate already exists for the subject %s", entry->subject);
+		char issued_fpath[MAX_FILE_PATH+1];
+		snprintf( issued_fpath, sizeof(issued_fpath), "%s/certs/%s.pem", dir, entry->serial );
+		unlink( issued_fpath );
+		unlink( cert_fpath );
+		goto cleanup;
+	}
+	if( err ) {
+		WARN("Failed to record the certificate %s in the PKI.", cert_fpath);
+		goto cleanup;
+	}
+
+	if( NULL!=cert_copy && *cert_copy!='\0' ) {
+		STEP( 90, "Copying the certificate");
+		if( file_copy( cert_fpath, cert_copy, FILE_COPY_SYNC ) <0 ) {
+			WARN("Failed to copy the resulting certificate from '%s' to '%s'", cert_fpath, cert_copy );
+			goto cleanup;
+		}
+	}
+
+	STEP(100, "sub-CA signature done.")
+	res = 0;
+
+cleanup:
+	ca_index_free( &issued );
+	remove_sign_workdir( workdir );
+	return res;
+}//eo sign_subca_shared
+
+
+//////////////////////////////////////////////////////////// CRL signing
+
+#define CRL_AKID_VALUE       ("keyid:always,issuer:always")
+#define SECONDS_PER_DAY      (24*3600)
+
+// validity of the CRL of a revocation, as 'openssl ca -gencrl -crldays'
+#define REVOCATION_CRL_DAYS  (7300)
+
+static int add_revoked_entry( X509_CRL *crl, const s_ca_index_entry_t *entry )
+{
+	int res = -1;
+	BIGNUM       *bn     = NULL;
+	ASN1_INTEGER *serial = NULL;
+	ASN1_TIME    *rtime  = NULL;
+	X509_REVOKED *rev    = X509_REVOKED_new();
+
+	if( NULL==rev || 0==BN_hex2bn( &bn, entry->serial ) ) {
+		goto cleanup;
+	}
+	serial = BN_to_ASN1_INTEGER( bn, NULL );
+	rtime  = ASN1_TIME_new();
+	if( NULL==serial || NULL==rtime || !ASN1_TIME_set_string( rtime, entry->revocation ) ) {
+		goto cleanup;
+	}
+	if( !X509_REVOKED_set_serialNumber( rev, serial ) || !X509_REVOKED_set_revocationDate( rev, rtime ) ) {
+		goto cleanup;
+	}
+
+	if( entry->reason != CRL_REASON_UNSET ) {
+		ASN1_ENUMERATED *reason = ASN1_ENUMERATED_new();
+		int ok = ( NULL!=reason )
+		      && ASN1_ENUMERATED_set( reason, entry->reason )
+		      && X509_REVOKED_add1_ext_i2d( rev, NID_crl_reason, reason, 0, 0 );
+		ASN1_ENUMERATED_free( reason );
+		if( !ok ) {
+			goto cleanup;
+		}
+	}
+
+	if( X509_CRL_add0_revoked( crl, rev ) ) {
+		rev = NULL; // now owned by the CRL
+		res = 0;
+	}
+
+cleanup:
+	X509_REVOKED_free( rev );
+	ASN1_TIME_free( rtime );
+	ASN1_INTEGER_free( serial );
+	BN_free( bn );
+	return res;
+}//eo add_revoked_entry
+
+// build and sign the CRL of the revoked entries of an index, PEM encoded to out
+static int sign_index_crl( X509 *cacert, EVP_PKEY *key, const EVP_MD *md, const s_ca_index_t *index, const unsigned long crl_number, const time_t this_update, const time_t next_update, BIO *out )
+{
+	int res = -1;
+	X509_CRL     *crl    = X509_CRL_new();
+	ASN1_TIME    *tm     = NULL;
+	ASN1_INTEGER *number = NULL;
+
+	if( NULL == crl ) {
+		return -1;
+	}
+
+	if( !X509_CRL_set_version( crl, 1 ) || !X509_CRL_set_issuer_name( crl, X509_get_subject_name(cacert) ) ) {
+		goto cleanup;
+	}
+
+	tm = ASN1_TIME_set( NULL, this_update );
+	if( NULL==tm || !X509_CRL_set1_lastUpdate( crl, tm ) ) {
+		goto cleanup;
+	}
+	if( NULL==ASN1_TIME_set( tm, next_update ) || !X509_CRL_set1_nextUpdate( crl, tm ) ) {
+		goto cleanup;
+	}
+
+	for( unsigned i=0; i<index->nb_entries; i++ ) {
+		const s_ca_index_entry_t *entry = &(index->entries[i]);
+		if( entry->status=='R' && add_revoked_entry( crl, entry ) ) {
+			DEBUG_PRN("sign_index_crl: invalid revoked entry for serial %s", entry->serial);
+			goto cleanup;
+		}
+	}
+	X509_CRL_sort( crl );
+
+	// crl_ext section of the OpenSSL configuration
+	X509V3_CTX v3ctx;
+	X509V3_set_ctx( &v3ctx, cacert, NULL, NULL, crl, 0 );
+	X509_EXTENSION *akid = X509V3_EXT_conf_nid( NULL, &v3ctx, NID_authority_key_identifier, (char*)CRL_AKID_VALUE );
+	if( NULL == akid ) {
+		goto cleanup;
+	}
+	int akid_added = X509_CRL_add_ext( crl, akid, -1 );
+	X509_EXTENSION_free( akid );
+	if( !akid_added ) {
+		goto cleanup;
+	}
+
+	number = ASN1_INTEGER_new();
+	if( NULL==number || !ASN1_INTEGER_set_uint64( number, crl_number ) ) {
+		goto cleanup;
+	}
+	if( !X509_CRL_add1_ext_i2d( crl, NID_crl_number, number, 0, 0 ) ) {
+		goto cleanup;
+	}
+
+	if( 0 >= X509_CRL_sign( crl, key, md ) ) {
+		DEBUG_PRN("sign_index_crl: signature of CRL %lu failed", crl_number);
+		goto cleanup;
+	}
+	if( !PEM_write_bio_X509_CRL( out, crl ) ) {
+		goto cleanup;
+	}
+	res = 0;
+
+cleanup:
+	ASN1_INTEGER_free( number );
+	ASN1_TIME_free( tm );
+	X509_CRL_free( crl );
+	return res;
+}//eo sign_index_crl
+
+
 //////////////////
 int revoke_subca(const char *dir, const char *cert_filename, const char *password, struct SS4EventHandlers* evt_handlers )
 {	
-	DDEBUG_PRN("revoke_subca(dir=\"%s\", cert=\"%s\", pwd=\"%s\", evt_h=%p)",dir, cert_filename, password, evt_handlers);
-
-	STEP( 10, "revocating sub-CA");
-	int err = call_openssl(
-		"ca -config %s/openssl.conf -revoke %s -out %s/crl/crl.idx	-cert %s/cacert/root.crt -keyfile %s/private/root.key -passin pass:%s",
-		dir,cert_filename,dir,dir,dir,password
-	);
-	if( err ) {
+	DDEBUG_PRN("revoke_subca(dir=\"%s\", cert=\"%s\", evt_h=%p)",dir, cert_filename, (void*)evt_handlers);
+	assert( NULL!=cert_filename );
+
+	// a batch of one, so that the chain and the OCSP responses follow the index
+	s_revocation_request_t req;
+	secure_memzero( &req, sizeof(req) );
+	req.reason = CRL_REASON_UNSET;
+	if( strlcpy( req.cert_path, cert_filename, sizeof(req.cert_path) ) >= sizeof(req.cert_path) ) {
 		WARN("Failed to revoke the certificate %s",cert_filename);
 		return -1;
 	}
+	return revoke_subca_batch( dir, &req, 1, NULL, password, NULL, evt_handlers );
+}//eo revoke_subca
+
+int parse_revocation_request( const char *spec, s_revocation_request_t *req )
+{
+	assert( NULL!=spec );
+	assert( NULL!=req );
+
+	char target[MAX_FILE_PATH+1];
+
+	secure_memzero( req, sizeof(s_revocation_request_t) );
+	req->reason = CRL_REASON_UNSET;
+
+	if( strlcpy( target, spec, sizeof(target) ) >= sizeof(target) ) {
+		DEBUG_PRN("parse_revocation_request: '%s' is too long", spec);
+		return -1;
+	}
+	chomp( target );
+
+	char *reason = strrchr( target, ',' );
+	if( NULL != reason ) {
+		*reason++ = '\0';
+		if( isdigit( (unsigned char)*reason ) ) {
+			req->reason = atoi( reason );
+			if( NULL == ca_reason_to_name( req->reason ) ) {
+				req->reason = CRL_REASON_UNSET;
+			}
+		} else {
+			req->reason = ca_reason_from_name( reason );
+		}
+		// removeFromCRL only applies to delta CRL
+		if( CRL_REASON_UNSET == req->reason || 8 == req->reason ) {
+			DEBUG_PRN("parse_revocation_request: invalid reason '%s'", reason);
+			return -1;
+		}
+	}
+
+	if( '\0' == target[0] ) {
+		return -1;
+	}
+
+	if( 0 == access( target, R_OK ) ) {
+		strlcpy( req->cert_path, target, sizeof(req->cert_path) );
+		return 0;
+	}
+
+	const char *serial = target;
+	if( 0 == strncasecmp( serial, "0x", 2 ) ) {
+		serial += 2;
+	}
+	if( '\0' == *serial || strlen(serial) > MAX_SERIAL_LEN || strspn( serial, "0123456789abcdefABCDEF" ) != strlen(serial) ) {
+		DEBUG_PRN("parse_revocation_request: '%s' is neither a readable file nor a serial number", target);
+		return -1;
+	}
+	strlcpy( req->serial, serial, sizeof(req->serial) );
 	return 0;
-}
+}//eo parse_revocation_request
+
+int revoke_subca_batch(const char *dir, s_revocation_request_t *requests, const unsigned nb_requests, const char *crl_filename, const char *password, s_ca_index_cache_t *cache, struct SS4EventHandlers* evt_handlers )
+{
+	DDEBUG_PRN("revoke_subca_batch(dir=\"%s\", nb=%u, crl=\"%s\", evt_h=%p)", dir, nb_requests, crl_filename ? crl_filename : "", (void*)evt_handlers);
+	assert( NULL!=dir );
+	assert( NULL!=requests || 0==nb_requests );
+
+	if( 0 == nb_requests ) {
+		WARN("No certificate to revoke.");
+		return -1;
+	}
+
+	STEP( 10, "loading the certificate index");
+	s_ca_index_t  local;
+	s_ca_index_t *index = &local;
+	secure_memzero( &local, sizeof(local) );
+	if( NULL != cache ) {
+		index = ca_index_cache_get( dir, cache );
+	} else if( ca_index_load( dir, &local ) ) {
+		index = NULL;
+	}
+	if( NULL == index ) {
+		WARN("Failed to load the certificate index of the PKI.");
+		return -1;
+	}
+
+	// check every request before touching the index
+	STEP( 20, "checking the certificates to revoke");
+	s_ca_index_entry_t **entries = calloc( nb_requests, sizeof(s_ca_index_entry_t*) );
+	if( NULL == entries ) {
+		WARN("Failed to allocate memory for the revocation.");
+		ca_index_free( &local );
+		return -1;
+	}
+
+	int res = -1;
+	int modified = 0;
+	X509     *cacert = NULL;
+	EVP_PKEY *key    = NULL;
+	BIO      *mem    = NULL;
+	s_atomic_group_t grp;
+	atomic_group_init( &grp );
+
+	for( unsigned i=0; i<nb_requests; i++ ) {
+		s_revocation_request_t *req = &(requests[i]);
+
+		if( '\0' != req->cert_path[0] && ca_cert_file_serial( req->cert_path, req->serial, sizeof(req->serial) ) ) {
+			WARN("Failed to read the serial number of the certificate %s", req->cert_path);
+			goto cleanup;
+		}
+
+		const char *name = '\0' != req->cert_path[0] ? req->cert_path : req->serial;
+		entries[i] = ca_index_find( index, req->serial );
+		if( NULL == entries[i] ) {
+			WARN("The certificate %s was not issued by this PKI.", name);
+			goto cleanup;
+		}
+		if( 'V' != entries[i]->status ) {
+			WARN("The certificate %s is not valid (status '%c').", name, entries[i]->status);
+			goto cleanup;
+		}
+		for( unsigned j=0; j<i; j++ ) {
+			if( entries[j] == entries[i] ) {
+				WARN("The certificate %s is listed twice.", name);
+				goto cleanup;
+			}
+		}
+	}
+
+	// the root key is needed, a wrong password must fail before any change
+	STEP( 30, "loading the root certificate and key");
+	const EVP_MD *md = EVP_get_digestbyname( DEFAULT_HASH_ALGORITHM );
+	cacert = ca_load_root_cert( dir );
+	key    = ca_load_root_key( dir, password );
+	if( NULL==md || NULL==cacert || NULL==key ) {
+		WARN("Failed to load the root certificate and private key from %s", dir);
+		goto cleanup;
+	}
+
+	const int with_crl = NULL != crl_filename && '\0' != *crl_filename;
+	unsigned long crl_number = 0;
+	if( with_crl && ca_read_crl_number( dir, &crl_number ) ) {
+		WARN("Failed to read the CRL number of %s", dir);
+		goto cleanup;
+	}
+
+	if( CANCELLED() ) {
+		DEBUG_PRN("revoke_subca_batch: cancelled before updating the index");
+		goto cleanup;
+	}
+
+	char now[MAX_ASN1_TIME_LEN+1];
+	time_t t = time(NULL);
+	struct tm tm;
+	gmtime_r( &t, &tm );
+	strftime( now, sizeof(now), "%y%m%d%H%M%SZ", &tm );
+
+	for( unsigned i=0; i<nb_requests; i++ ) {
+		entries[i]->status = 'R';
+		entries[i]->reason = requests[i].reason;
+		strlcpy( entries[i]->revocation, now, sizeof(entries[i]->revocation) );
+	}
+	modified = 1;
+
+	// the CRL is signed from the updated index in memory; the index, the CRL
+	// and the CRL number are then each replaced atomically, one after the other
+	if( with_crl ) {
+		STEP( 50, "generating the new CRL");
+		mem = BIO_new( BIO_s_mem() );
+		if( NULL==mem || sign_index_crl( cacert, key, md, index, crl_number, t, t + (time_t)REVOCATION_CRL_DAYS*SECONDS_PER_DAY, mem ) ) {
+			WARN("Failed to generate CRL");
+			goto cleanup;
+		}
+		char *pem = NULL;
+		long  pem_len = BIO_get_mem_data( mem, &pem );
+		if( atomic_group_write( &grp, crl_filename, pem, pem_len ) || ca_write_crl_number( dir, crl_number+1, &grp ) ) {
+			WARN("Failed to write the CRL %s", crl_filename);
+			goto cleanup;
+		}
+	}
+
+	// a pre-signed 'good' response must not outlive the revocation
+	STEP( 70, "signing the OCSP responses of the revoked certificates");
+	if( ocsp_presign_revoked( &grp, dir, cacert, key, entries, nb_requests ) ) {
+		WARN("Failed to sign the OCSP responses of the revoked certificates");
+		goto cleanup;
+	}
+
+	// the revoked CAs leave the chain with the index update
+	STEP( 75, "rebuilding the PKCS7 chain CA");
+	if( ca_chain_rebuild( dir, index, &grp ) ) {
+		WARN("Failed to rebuild the PKCS7 chain of %s", dir);
+		goto cleanup;
+	}
+
+	// cert.idx is added last so it is renamed last: a crash in the middle of
+	// the commit leaves the old index, and the revocation can be run again
+	STEP( 80, "updating the certificate index");
+	if( ca_index_save( dir, index, &grp ) || atomic_group_commit( &grp ) ) {
+		WARN("Failed to update the certificate index of the PKI, some of the revocation files may already be replaced.");
+		goto cleanup;
+	}
+	// cert.idx is new on disk: a cache reloads it on its next use
+	modified = 0;
+
+	STEP(100, "sub-CA revocation done.")
+	res = 0;
+
+cleanup:
+	atomic_group_abort( &grp );
+	if( modified && NULL != cache ) {
+		// the revocations only happened in memory
+		ca_index_cache_drop( cache );
+	}
+	BIO_free( mem );
+	EVP_PKEY_free( key );
+	X509_free( cacert );
+	free( entries );
+	ca_index_free( &local );
+	return res;
+}//eo revoke_subca_batch
 
 int generate_crl(const char *dir, const char *crl_filename, const char *password, struct SS4EventHandlers* evt_handlers )
 {
-	DDEBUG_PRN("generate_crl(dir=\"%s\", crl=\"%s\", pwd=\"%s\", evt_h=%p)", dir, crl_filename, password, evt_handlers);
+	DDEBUG_PRN("generate_crl(dir=\"%s\", crl=\"%s\", evt_h=%p)", dir, crl_filename, (void*)evt_handlers);
 
 	STEP( 50, "generating the new CRL");
-	int err = call_openssl(
-		"ca -gencrl -crlexts crl_ext -crldays 7300 -config %s/openssl.conf -cert %s/cacert/root.crt -keyfile %s/private/root.key -out %s -passin pass:%s", 
-		dir, dir, dir, crl_filename, password
-	);
+	char conf_fpath[MAX_FILE_PATH+1];
+	char root_fpath[MAX_FILE_PATH+1];
+	char key_fpath[MAX_FILE_PATH+1];
+	snprintf( conf_fpath, sizeof(conf_fpath), "%s/openssl.conf", dir );
+	snprintf( root_fpath, sizeof(root_fpath), "%s/cacert/%s", dir, ROOT_CERT_FNAME );
+	snprintf( key_fpath,  sizeof(key_fpath),  "%s/private/root.key", dir );
+
+	const char *gencrl_args[] = {
+		"ca", "-gencrl", "-crlexts", "crl_ext", "-crldays", "7300", "-config", conf_fpath,
+		"-cert", root_fpath, "-keyfile", key_fpath, "-out", crl_filename, "-passin", OPENSSL_SECRET_ARG, NULL
+	};
+	int err = call_openssl( gencrl_args, password );
 	if( err ) {
 		WARN("Failed to generate CRL");
 		return -1;
@@ -452,30 +1090,414 @@ int generate_crl(const char *dir, const char *crl_filename, const char *password
 }//eo revokeSubCA
 
 
-ssize_t read_ca_cert_infos( const char *dir,  char *buffer, const size_t max_size )
+//////////////////////////////////////////////////////////// Pre-signed CRL bundle
+
+#define CRL_BUNDLE_DIR       ("bundle")
+#define CRL_BUNDLE_MANIFEST  ("manifest.txt")
+
+/**
+ * Description of one CRL of a bundle, as reported in the manifest
+ */
+typedef struct SCRLBundleItem {
+	char          filename[MAX_FILE_PATH+1];
+	unsigned long crl_number;
+	time_t        this_update;
+	time_t        next_update;
+	char          fingerprint[65];
+	int           done;
+} s_crl_bundle_item_t;
+
+/**
+ * Data shared between the CRL bundle signing threads
+ */
+typedef struct SCRLBundleJob {
+	const char         *dir;
+	EVP_PKEY           *key;
+	X509               *cacert;
+	const s_ca_index_t *index;
+	const EVP_MD       *md;
+
+	s_crl_bundle_item_t *items;
+	unsigned             nb_items;
+
+	pthread_mutex_t      lock;
+	unsigned             next_item;   // next item to sign, protected by lock
+	int                  failed;      // protected by lock
+	s_atomic_group_t     files;       // CRL written so far, committed with the manifest, protected by lock
+} s_crl_bundle_job_t;
+
+
+// build, sign and save the CRL described by item
+static int sign_crl_window( s_crl_bundle_job_t *job, s_crl_bundle_item_t *item )
+{
+	int res = -1;
+	BIO *mem = BIO_new( BIO_s_mem() );
+
+	if( NULL==mem || sign_index_crl( job->cacert, job->key, job->md, job->index, item->crl_number, item->this_update, item->next_update, mem ) ) {
+		goto cleanup;
+	}
+
+	// saving and fingerprinting the PEM encoding
+	char *pem = NULL;
+	long  pem_len = BIO_get_mem_data( mem, &pem );
+	pthread_mutex_lock( &(job->lock) );
+	int written = atomic_group_write( &(job->files), item->filename, pem, pem_len );
+	pthread_mutex_unlock( &(job->lock) );
+	if( written ) {
+		DEBUG_PRN("sign_crl_window: failed to write '%s'", item->filename);
+		goto cleanup;
+	}
+
+	uint8_t digest[SHA3_256_DIGEST_LEN];
+	sha3_256( pem, pem_len, digest );
+	if( hex_encode( item->fingerprint, sizeof(item->fingerprint), digest, sizeof(digest) ) < 0 ) {
+		goto cleanup;
+	}
+
+	item->done = 1;
+	res = 0;
+
+cleanup:
+	BIO_free( mem );
+	return res;
+}//eo sign_crl_window
+
+static void* crl_bundle_worker( void * data )
+{
+	s_crl_bundle_job_t *job = (s_crl_bundle_job_t*)data;
+
+	for(;;) {
+		pthread_mutex_lock( &(job->lock) );
+		unsigned item = job->next_item;
+		int stop = job->failed || item >= job->nb_items;
+		if( !stop ) {
+			job->next_item++;
+		}
+		pthread_mutex_unlock( &(job->lock) );
+
+		if( stop ) {
+			break;
+		}
+
+		if( sign_crl_window( job, &(job->items[item]) ) ) {
+			pthread_mutex_lock( &(job->lock) );
+			job->failed = 1;
+			pthread_mutex_unlock( &(job->lock) );
+		}
+	}
+	return NULL;
+}//eo crl_bundle_worker
+
+// sign all the items of the job spreading them on the available cores
+static void run_crl_bundle_workers( s_crl_bundle_job_t *job )
+{
+	long nb_cpu = sysconf( _SC_NPROCESSORS_ONLN );
+	unsigned nb_workers = ( nb_cpu < 1 ) ? 1 : (unsigned)nb_cpu;
+	if( nb_workers > job->nb_items ) {
+		nb_workers = job->nb_items;
+	}
+
+	pthread_t workers[nb_workers];
+	unsigned  nb_started = 0;
+
+	pthread_mutex_init( &(job->lock), NULL );
+	for( unsigned i=0; i<nb_workers; i++ ) {
+		if( pthread_create( &(workers[i]), NULL, crl_bundle_worker, job ) ) {
+			DEBUG_PRN("run_crl_bundle_workers: failed to start worker %u", i);
+			break;
+		}
+		nb_started++;
+	}
+	if( 0 == nb_started ) {
+		crl_bundle_worker( job );
+	}
+	for( unsigned i=0; i<nb_started; i++ ) {
+		pthread_join( workers[i], NULL );
+	}
+	pthread_mutex_destroy( &(job->lock) );
+}//eo run_crl_bundle_workers
+
+static void format_utc_time( time_t t, char *out, size_t max_size )
+{
+	struct tm tm_utc;
+	gmtime_r( &t, &tm_utc );
+	strftime( out, max_size, "%Y-%m-%dT%H:%M:%SZ", &tm_utc );
+}//eo format_utc_time
+
+static int write_crl_bundle_manifest( s_atomic_group_t *grp, const char *bundle_dir, const s_crl_bundle_item_t *items, unsigned nb_items )
+{
+	char filename[MAX_FILE_PATH+1];
+	char this_update[32];
+	char next_update[32];
+
+	if( snprintf( filename, sizeof(filename), "%s/%s", bundle_dir, CRL_BUNDLE_MANIFEST ) >= (int)sizeof(filename) ) {
+		DEBUG_PRN("write_crl_bundle_manifest: path too long in '%s'", bundle_dir);
+		return -1;
+	}
+	FILE *fp = atomic_group_open( grp, filename );
+	if( NULL == fp ) {
+		DEBUG_PRN("write_crl_bundle_manifest: failed to open '%s'", filename);
+		return -1;
+	}
+
+	int res = fprintf( fp, "# seq\tcrl_number\tthis_update\tnext_update\tsha3-256\tfile\n" );
+	for( unsigned i=0; i<nb_items && res>=0; i++ ) {
+		char bname[MAX_FILE_PATH+1];
+		format_utc_time( items[i].this_update, this_update, sizeof(this_update) );
+		format_utc_time( items[i].next_update, next_update, sizeof(next_update) );
+		filename_base( items[i].filename, bname, sizeof(bname) );
+		res = fprintf( fp, "%04u\t%lu\t%s\t%s\t%s\t%s.crl\n",
+			i+1, items[i].crl_number, this_update, next_update, items[i].fingerprint, bname );
+	}
+
+	if( res < 0 ) {
+		DEBUG_PRN("write_crl_bundle_manifest: failed to write '%s'", filename);
+		return -1;
+	}
+	return 0;
+}//eo write_crl_bundle_manifest
+
+int generate_crl_bundle( const char *dir, const unsigned nb_crl, const unsigned period_days, const char *password, struct SS4EventHandlers* evt_handlers )
+{
+	DDEBUG_PRN("generate_crl_bundle(dir=\"%s\", nb_crl=%u, period=%u, evt_h=%p)", dir, nb_crl, period_days, (void*)evt_handlers);
+
+	assert( NULL!=dir );
+	assert( NULL!=password );
+
+	if( nb_crl<1 || nb_crl>MAX_CRL_BUNDLE_SIZE || period_days<1 ) {
+		WARN("Invalid CRL bundle parameters: %u CRL of %u days", nb_crl, period_days);
+		return -1;
+	}
+
+	int res = -1;
+	char bundle_dir[MAX_FILE_PATH+1];
+	s_ca_index_t index;
+	s_crl_bundle_job_t job;
+
+	secure_memzero( &index, sizeof(index) );
+	secure_memzero( &job,   sizeof(job) );
+	atomic_group_init( &(job.files) );
+
+	STEP( 5, "Loading the root certificate and key");
+	job.dir    = dir;
+	job.md     = EVP_get_digestbyname( DEFAULT_HASH_ALGORITHM );
+	job.cacert = ca_load_root_cert( dir );
+	job.key    = ca_load_root_key( dir, password );
+	if( NULL==job.md || NULL==job.cacert || NULL==job.key ) {
+		WARN("Failed to load the root certificate and private key from %s", dir);
+		goto cleanup;
+	}
+
+	STEP( 10, "Loading the certificate index");
+	if( ca_index_load( dir, &index ) ) {
+		WARN("Failed to load the certificate index of %s", dir);
+		goto cleanup;
+	}
+	job.index = &index;
+
+	unsigned long first_number = 0;
+	if( ca_read_crl_number( dir, &first_number ) ) {
+		WARN("Failed to read the CRL number of %s", dir);
+		goto cleanup;
+	}
+
+	STEP( 15, "Preparing the CRL bundle");
+	if( snprintf( bundle_dir, sizeof(bundle_dir), "%s/crl/%s", dir, CRL_BUNDLE_DIR ) >= (int)sizeof(bundle_dir) ) {
+		WARN("The CRL bundle path is too long for %s", dir);
+		goto cleanup;
+	}
+	if( mkdir( bundle_dir, 0755 ) && errno!=EEXIST ) {
+		WARN("Failed to create the CRL bundle directory %s", bundle_dir);
+		goto cleanup;
+	}
+
+	job.items = (s_crl_bundle_item_t*)calloc( nb_crl, sizeof(s_crl_bundle_item_t) );
+	if( NULL == job.items ) {
+		WARN("Failed to allocate memory for %u CRL", nb_crl);
+		goto cleanup;
+	}
+	job.nb_items = nb_crl;
+
+	const time_t start  = time(NULL);
+	const time_t period = (time_t)period_days * SECONDS_PER_DAY;
+	for( unsigned i=0; i<nb_crl; i++ ) {
+		s_crl_bundle_item_t *item = &(job.items[i]);
+		item->crl_number  = first_number + i;
+		item->this_update = start + i*period;
+		item->next_update = item->this_update + period;
+		if( snprintf( item->filename, sizeof(item->filename), "%s/root-%04u.crl", bundle_dir, i+1 ) >= (int)sizeof(item->filename) ) {
+			WARN("The CRL bundle path is too long in %s", bundle_dir);
+			goto cleanup;
+		}
+	}
+
+	STEP( 20, "Signing the CRL bundle");
+	run_crl_bundle_workers( &job );
+
+	if( job.failed ) {
+		WARN("Failed to sign the CRL bundle");
+		goto cleanup;
+	}
+
+	STEP( 90, "Writing the CRL bundle manifest");
+	if( write_crl_bundle_manifest( &(job.files), bundle_dir, job.items, nb_crl ) ) {
+		WARN("Failed to write the CRL bundle manifest in %s", bundle_dir);
+		goto cleanup;
+	}
+
+	if( ca_write_crl_number( dir, first_number + nb_crl, &(job.files) ) ) {
+		WARN("Failed to update the CRL number of %s", dir);
+		goto cleanup;
+	}
+
+	// each file is replaced atomically, the CRL number last
+	STEP( 95, "Committing the CRL bundle");
+	if( atomic_group_commit( &(job.files) ) ) {
+		WARN("Failed to save the CRL bundle in %s, some of its files may already be replaced", bundle_dir);
+		goto cleanup;
+	}
+
+	STEP(100, "CRL bundle generated.");
+	res = 0;
+
+cleanup:
+	atomic_group_abort( &(job.files) );
+	free( job.items );
+	ca_index_free( &index );
+	EVP_PKEY_free( job.key );
+	X509_free( job.cacert );
+	return res;
+}//eo generate_crl_bundle
+
+
+// "YYYY-MM-DD HH:MM:SS UTC" from an ASN1 time
+static void format_asn1_time( const ASN1_TIME *t, char *out, size_t max_size )
+{
+	struct tm tm;
+	if( ASN1_TIME_to_tm( t, &tm ) ) {
+		strftime( out, max_size, "%Y-%m-%d %H:%M:%S UTC", &tm );
+	} else {
+		strlcpy( out, "?", max_size );
+	}
+}//eo format_asn1_time
+
+// fill the description from the certificate, returns -1 on error
+static int describe_cert( X509 *cert, s_ca_cert_infos_t *infos )
+{
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int  md_len = 0;
+
+	X509_NAME_oneline( X509_get_subject_name(cert), infos->subject, sizeof(infos->subject) );
+	format_asn1_time( X509_get0_notBefore(cert), infos->not_before, sizeof(infos->not_before) );
+	format_asn1_time( X509_get0_notAfter(cert),  infos->not_after,  sizeof(infos->not_after) );
+
+	EVP_PKEY *pkey = X509_get0_pubkey( cert );
+	infos->key_size = pkey ? (unsigned)EVP_PKEY_get_bits( pkey ) : 0;
+
+	if( !X509_digest( cert, EVP_sha256(), md, &md_len )
+	 || hex_encode( infos->fingerprint_sha256, sizeof(infos->fingerprint_sha256), md, md_len ) < 0 ) {
+		return -1;
+	}
+
+	unsigned char *der = NULL;
+	int der_len = i2d_X509( cert, &der );
+	if( der_len <= 0 ) {
+		return -1;
+	}
+	uint8_t digest[SHA3_256_DIGEST_LEN];
+	sha3_256( der, der_len, digest );
+	OPENSSL_free( der );
+	if( hex_encode( infos->fingerprint_sha3, sizeof(infos->fingerprint_sha3), digest, sizeof(digest) ) < 0 ) {
+		return -1;
+	}
+
+	BIO *mem = BIO_new( BIO_s_mem() );
+	if( NULL == mem || !X509_print( mem, cert ) ) {
+		BIO_free( mem );
+		return -1;
+	}
+	int len = BIO_read( mem, infos->text, MAX_CERT_DESCR_LEN );
+	infos->text[ len > 0 ? len : 0 ] = '\0';
+	BIO_free( mem );
+
+	return 0;
+}//eo describe_cert
+
+int load_ca_cert_infos( const char *dir, s_ca_cert_infos_t *infos )
 {
-	char infofilepath[MAX_FILE_PATH+1];
+	assert( NULL!=dir );
+	assert( NULL!=infos );
+
 	char certfilepath[MAX_FILE_PATH+1];
+	struct stat st;
 
-	snprintf( infofilepath, sizeof(infofilepath), "%s/cacert/root.txt", dir );
 	snprintf( certfilepath, sizeof(certfilepath), "%s/cacert/%s", dir, ROOT_CERT_FNAME );
+	if( stat( certfilepath, &st ) ) {
+		DEBUG_PRN("load_ca_cert_infos: no root certificate '%s'", certfilepath );
+		infos->loaded = 0;
+		return -1;
+	}
 
-	int err = call_openssl(
-		"x509 -in %s -noout -text > %s",
-		certfilepath, infofilepath
-	);
-	if( err ) {
-		DEBUG_PRN("read_ca_cert_infos: failed to dump certificate description for %s ", certfilepath );
+	if( infos->loaded && 0==strcmp( infos->cert_path, certfilepath ) 
+	 && infos->mtime == st.st_mtime && infos->size == st.st_size ) {
+		DDEBUG_PRN("load_ca_cert_infos: cached description of '%s'", certfilepath );
+		return 0;
+	}
+
+	X509 *cert = ca_load_root_cert( dir );
+	if( NULL == cert ) {
+		infos->loaded = 0;
 		return -1;
-	}	
+	}
 
-	ssize_t res = file_slurp(infofilepath, (uint8_t*)buffer,max_size);
-	if( res < 0 ) {
-		DEBUG_PRN("read_ca_cert_infos: failed to read info file: '%s'", infofilepath );
+	// a touched but unchanged certificate keeps its description
+	char sha256[FINGERPRINT_HEX_LEN+1];
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int  md_len = 0;
+	if( infos->loaded && 0==strcmp( infos->cert_path, certfilepath )
+	 && X509_digest( cert, EVP_sha256(), md, &md_len )
+	 && hex_encode( sha256, sizeof(sha256), md, md_len ) > 0
+	 && 0==strcmp( sha256, infos->fingerprint_sha256 ) ) {
+		DDEBUG_PRN("load_ca_cert_infos: '%s' touched but unchanged", certfilepath );
+		infos->mtime = st.st_mtime;
+		infos->size  = st.st_size;
+		X509_free( cert );
+		return 0;
+	}
+
+	secure_memzero( infos, sizeof(s_ca_cert_infos_t) );
+	int res = describe_cert( cert, infos );
+	X509_free( cert );
+	if( res ) {
+		DEBUG_PRN("load_ca_cert_infos: failed to describe '%s'", certfilepath );
 		return -1;
 	}
-	buffer[res]='\0';
 
+	strlcpy( infos->cert_path, certfilepath, sizeof(infos->cert_path) );
+	infos->mtime  = st.st_mtime;
+	infos->size   = st.st_size;
+	infos->loaded = 1;
+	return 0;
+}//eo load_ca_cert_infos
+
+ssize_t read_ca_cert_infos( const char *dir,  char *buffer, const size_t max_size )
+{
+	s_ca_cert_infos_t *infos = calloc( 1, sizeof(s_ca_cert_infos_t) );
+	if( NULL == infos ) {
+		return -1;
+	}
+
+	ssize_t res = -1;
+	if( 0 == load_ca_cert_infos( dir, infos ) ) {
+		res = (ssize_t)strlcpy( buffer, infos->text, max_size );
+		if( (size_t)res >= max_size ) {
+			res = max_size-1;
+		}
+	} else {
+		DEBUG_PRN("read_ca_cert_infos: failed to describe the root certificate of %s", dir );
+	}
+
+	free( infos );
 	return res;
 }//eo read ca cert infos
 
@@ -14,9 +14,17 @@
 #if !defined( _S4_PKI_H_ )
 #define _S4_PKI_H_
 
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
 #define MAX_PKI_SUBJECT_LEN (512)
 #define MAX_URL_LEN         (256)
 #define MAX_CRYPTO_ALG_LEN  (128)
+#define MAX_SERIAL_LEN      (64)
+#define MAX_CERT_DESCR_LEN  (16384)
+#define MAX_CERT_TIME_LEN   (32)
+#define FINGERPRINT_HEX_LEN (64)
 
 #define MIN_CERT_LIFE_DAYS        (365)
 #define MAX_CERT_LIFE_DAYS        (365*20)
@@ -27,6 +35,13 @@
 #define MAX_CRL_LIFE_DAYS     (365*20)
 #define DEFAULT_CRL_LIFE_DAYS (365)
 
+#define MAX_CRL_BUNDLE_SIZE          (1024)
+#define DEFAULT_CRL_BUNDLE_SIZE      (52)
+#define DEFAULT_CRL_BUNDLE_PERIOD    (7)
+
+#define MAX_OCSP_PERIOD              (365)
+#define DEFAULT_OCSP_PERIOD          (7)
+
 #define MAX_SHAMIR_SHARE_NUMBER (15)
 
 #define DEFAULT_QUORUM    (3)
@@ -36,6 +51,13 @@
 #define MAX_KEY_SIZE     (32768)
 #define DEFAULT_KEY_SIZE (2048)
 
+#define MAX_REVOCATION_BATCH (1024)
+
+/**
+ * CRL reason code value used when no reason is recorded
+ */
+#define CRL_REASON_UNSET  (-1)
+
 typedef struct SPKIParameters {
 
     char        subject[MAX_PKI_SUBJECT_LEN+1]; 
@@ -52,8 +74,39 @@ typedef struct SPKIParameters {
 
 } s_pki_parameters_t;
 
+/**
+ * \brief One certificate to revoke, designated by its file or its serial number
+ */
+typedef struct SRevocationRequest {
+    char cert_path[MAX_FILE_PATH+1];   // certificate file, empty when revoked by serial
+    char serial[MAX_SERIAL_LEN+1];     // hexadecimal serial, resolved from cert_path if needed
+    int  reason;                       // CRL reason code, CRL_REASON_UNSET if none
+} s_revocation_request_t;
+
+/**
+ * \brief Description of the PKI root certificate, parsed in-process
+ *
+ * The description is cached: it is only parsed again when the certificate file
+ * modification time or size changed, and its content hash differs.
+ */
+typedef struct SCACertInfos {
+    char      subject[MAX_PKI_SUBJECT_LEN+1];
+    char      not_before[MAX_CERT_TIME_LEN+1];            // YYYY-MM-DD HH:MM:SS UTC
+    char      not_after[MAX_CERT_TIME_LEN+1];
+    unsigned  key_size;                                   // in bits
+    char      fingerprint_sha256[FINGERPRINT_HEX_LEN+1];  // of the DER encoding, hexadecimal
+    char      fingerprint_sha3[FINGERPRINT_HEX_LEN+1];
+    char      text[MAX_CERT_DESCR_LEN+1];                 // as "openssl x509 -noout -text"
+
+    // cache validation
+    char      cert_path[MAX_FILE_PATH+1];
+    time_t    mtime;
+    off_t     size;
+    int       loaded;
+} s_ca_cert_infos_t;
 
 struct SS4EventHandlers;
+struct SCAIndexCache;
 /**
  * Generate a strong password
  *
@@ -104,22 +157,81 @@ int gen_self_signed(
  */
 int sign_subca(const char *directory, const char *csr_filename, const char *cert_filename, const char *password, struct SS4EventHandlers* evt_handlers );
 
+/**
+ * \brief Sign a SubCA while other signatures of the same PKI are in progress
+ *
+ * The serial number is reserved under the lock of the index, openssl signs
+ * against a private copy of the serial and index files, then the new
+ * certificate is added to the cached index and to the chain of CAs under the
+ * lock again: the signatures themselves run in parallel.
+ * The private index holds the valid certificates of the PKI, so that openssl
+ * applies the unique_subject policy; a subject issued meanwhile by a
+ * concurrent signature is refused when recording the certificate.
+ *
+ * \param directory      root directory of the PKI
+ * \param csr_filename   path to the CSR file to sign
+ * \param cert_filename  path to an optionnal copy of the certificate (no copy is performed if empty or NULL)
+ * \param password       password of the root private key
+ * \param index          index cache shared by every writer of the index of the PKI
+ * \param evt_handlers   structure of application events (progress, errors) handlers
+ *
+ * \return 0 on success, -1 on error
+ *
+ */
+int sign_subca_shared(const char *directory, const char *csr_filename, const char *cert_filename, const char *password, struct SCAIndexCache *index, struct SS4EventHandlers* evt_handlers );
+
 
 /**
  * \brief Revoke subCA function 
  *
- * Revoke the provided certificate 
+ * Revoke the provided certificate, as a batch of one without CRL: see revoke_subca_batch
  *
  * \param directory      root directory of the PKI
  * \param cert_filename  path to the subca certificate to revoke 
  * \param password       paswword of the root private key
  * \param evt_handlers  structure of application events (progress, errors) handlers
  *
- * \return 0 on success, 1 on error
+ * \return 0 on success, -1 on error
  * 
  */
 int revoke_subca(const char *directory, const char *cert_filename,  const char *password, struct SS4EventHandlers* evt_handlers );
 
+/**
+ * \brief Parse a revocation request
+ *
+ * The request is written "<certificate file or hex serial>[,<reason>]" where the
+ * reason is a CRL reason name (keyCompromise, superseded, ...) or its numeric code.
+ *
+ * \param spec  request to parse
+ * \param req   pointer to an allocated request for the result
+ *
+ * \return 0 on success, -1 on error
+ */
+int parse_revocation_request( const char *spec, s_revocation_request_t *req );
+
+/**
+ * \brief Revoke a batch of sub-CA and emit a single CRL
+ *
+ * All the requests are checked against the certificate index, and the root key
+ * decrypted, before any change. A single CRL is signed from the updated index,
+ * the pre-signed OCSP responses of the revoked certificates are signed again
+ * as revoked and the chain of CAs is rebuilt without them. The CRL, the CRL
+ * number, the responses, the chain and finally the index are then replaced
+ * atomically one by one, after a single durability barrier.
+ *
+ * \param directory      root directory of the PKI
+ * \param requests       certificates to revoke
+ * \param nb_requests    number of requests
+ * \param crl_filename   path of where to save the CRL (no CRL emitted if empty or NULL)
+ * \param password       paswword of the root private key
+ * \param cache          index cache of the PKI, its lock held by the caller; NULL to read cert.idx
+ * \param evt_handlers   structure of application events (progress, errors) handlers
+ *
+ * \return 0 on success, -1 on error (the index is left untouched)
+ *
+ */
+int revoke_subca_batch(const char *dir, s_revocation_request_t *requests, const unsigned nb_requests, const char *crl_filename, const char *password, struct SCAIndexCache *cache, struct SS4EventHandlers* evt_handlers );
+
 /**
  * \brief Emit a new CRL
  *
@@ -135,6 +247,24 @@ int revoke_subca(const char *directory, const char *cert_filename,  const char *
  */
 int generate_crl(const char *dir, const char *crl_filename, const char *password, struct SS4EventHandlers* evt_handlers );
 
+/**
+ * \brief Emit a bundle of pre-signed CRL
+ *
+ * Sign in one session nb_crl CRL covering consecutive windows of period_days days,
+ * starting now. The CRL are signed in parallel on the available cores and written
+ * to crl/bundle/root-NNNN.crl with a manifest.txt describing each of them.
+ *
+ * \param directory      root directory of the PKI
+ * \param nb_crl         number of CRL to sign (1 to MAX_CRL_BUNDLE_SIZE)
+ * \param period_days    validity of each CRL in days
+ * \param password       paswword of the root private key
+ * \param evt_handlers   structure of application events (progress, errors) handlers
+ *
+ * \return 0 on success, -1 on error
+ *
+ */
+int generate_crl_bundle(const char *dir, const unsigned nb_crl, const unsigned period_days, const char *password, struct SS4EventHandlers* evt_handlers );
+
 /**
  * \brief Read CA informations
  *
@@ -182,6 +312,19 @@ int write_ca_infos( const char * directory,
 				   const unsigned nb_revoqued 
 );
 
+/**
+ * \brief Load the description of the PKI root certificate
+ *
+ * The certificate is parsed in-process and no file is written. A description
+ * previously loaded for the same file is kept when the file did not change.
+ *
+ * \param dir    root directory of the PKI
+ * \param infos  pointer to a description, zeroed or previously loaded
+ *
+ * \return 0 on success, -1 on error
+ */
+int load_ca_cert_infos( const char *dir, s_ca_cert_infos_t *infos );
+
 /**
  * Load the textual description of the PKI root certificate
  */
@@ -0,0 +1,680 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file pki_jobs.c
+ *
+ * \brief Batch of PKI operations executed under a single unlock
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "utils.h"
+#include "pki.h"
+#include "shared_secret.h"
+#include "pki_request.h"
+#include "pki_jobs.h"
+#include "trace.h"
+
+#define STEP(p,m) if( evt_handlers->on_progress ) { evt_handlers->on_progress( evt_handlers->data, (p), (m) ); }
+
+/**
+ * State of a job during the execution
+ */
+typedef enum EPKIJobState {
+    PKIJobPending = 0,
+    PKIJobRunning,
+    PKIJobDone,
+    PKIJobFailed,
+    PKIJobSkipped
+} e_pki_job_state;
+
+/**
+ * Data shared by the threads executing the jobs
+ */
+typedef struct SPKIJobsRun {
+    const char              *dir;
+    const char              *password;
+    const s_pki_jobs_t      *jobs;
+    struct SS4EventHandlers *evt_handlers;
+
+    s_ca_index_cache_t       index;        // shared by the writers of the index of the PKI
+
+    pthread_mutex_t          lock;
+    pthread_cond_t           changed;      // a job finished
+    e_pki_job_state         *states;       // protected by lock
+    s_pki_request_result_t  *results;      // written by the thread running the job
+    unsigned                 nb_finished;  // protected by lock
+} s_pki_jobs_run_t;
+
+////////////////////////////////////////////////////////////// Loading
+
+// report a problem of the job file
+static void job_error( int *nb_errors, const char *filename, const unsigned line, const char *fmt, ... )
+{
+	char msg[MAX_REQUEST_MESSAGE+1];
+	va_list args;
+	va_start( args, fmt );
+	vsnprintf( msg, sizeof(msg), fmt, args );
+	va_end( args );
+
+	warn("%s:%u: %s", filename, line, msg);
+	(*nb_errors)++;
+}//eo job_error
+
+static int job_add_string( char ***list, unsigned *nb, const char *value )
+{
+	char **grown = realloc( *list, (*nb+1)*sizeof(char*) );
+	if( NULL == grown ) {
+		return -1;
+	}
+	*list = grown;
+	grown[*nb] = strdup( value );
+	if( NULL == grown[*nb] ) {
+		return -1;
+	}
+	(*nb)++;
+	return 0;
+}//eo job_add_string
+
+// called for each member of a job object
+static int job_member( void *data, const char *key, const char *value )
+{
+	s_pki_job_t *job = (s_pki_job_t*)data;
+
+	if( 0 == strcmp( key, "op" ) ) {
+		job->op = pki_request_op_from_name( value );
+		return 0;
+	}
+	if( 0 == strcmp( key, "id" ) ) {
+		return strlcpy( job->id, value, sizeof(job->id) ) < sizeof(job->id) ? 0 : -1;
+	}
+	if( 0 == strcmp( key, "after" ) ) {
+		return job_add_string( &(job->after), &(job->nb_after), value );
+	}
+
+	s_pki_job_param_t *grown = realloc( job->params, (job->nb_params+1)*sizeof(s_pki_job_param_t) );
+	if( NULL == grown ) {
+		return -1;
+	}
+	job->params = grown;
+	strlcpy( grown[job->nb_params].key, key, sizeof(grown[job->nb_params].key) );
+	grown[job->nb_params].value = strdup( value );
+	if( NULL == grown[job->nb_params].value ) {
+		return -1;
+	}
+	job->nb_params++;
+	return 0;
+}//eo job_member
+
+static void job_release( s_pki_job_t *job )
+{
+	for( unsigned i=0; i<job->nb_params; i++ ) {
+		free( job->params[i].value );
+	}
+	for( unsigned i=0; i<job->nb_after; i++ ) {
+		free( job->after[i] );
+	}
+	free( job->params );
+	free( job->after );
+	free( job->deps );
+	memset( job, 0, sizeof(s_pki_job_t) );
+}//eo job_release
+
+static const char* job_param( const s_pki_job_t *job, const char *key )
+{
+	for( unsigned i=0; i<job->nb_params; i++ ) {
+		if( 0 == strcmp( job->params[i].key, key ) ) {
+			return job->params[i].value;
+		}
+	}
+	return NULL;
+}//eo job_param
+
+static int job_add_dep( s_pki_job_t *job, const unsigned dep )
+{
+	for( unsigned i=0; i<job->nb_deps; i++ ) {
+		if( job->deps[i] == dep ) {
+			return 0;
+		}
+	}
+	unsigned *grown = realloc( job->deps, (job->nb_deps+1)*sizeof(unsigned) );
+	if( NULL == grown ) {
+		return -1;
+	}
+	job->deps = grown;
+	grown[job->nb_deps++] = dep;
+	return 0;
+}//eo job_add_dep
+
+static int job_find( const s_pki_jobs_t *jobs, const char *id )
+{
+	for( unsigned i=0; i<jobs->nb_jobs; i++ ) {
+		if( 0 == strcmp( jobs->jobs[i].id, id ) ) {
+			return (int)i;
+		}
+	}
+	return -1;
+}//eo job_find
+
+// sign job writing the certificate at path, -1 if none
+static int job_find_signer( const s_pki_jobs_t *jobs, const char *path )
+{
+	for( unsigned i=0; i<jobs->nb_jobs; i++ ) {
+		const char *cert = job_param( &(jobs->jobs[i]), "cert" );
+		if( PKIRequestSign == jobs->jobs[i].op && NULL != cert && 0 == strcmp( cert, path ) ) {
+			return (int)i;
+		}
+	}
+	return -1;
+}//eo job_find_signer
+
+/*
+ * Build the request of a job. A certificate signed by the batch does not
+ * exist before its job ran: with deferred set, such a revocation target only
+ * gets its reason checked and a dependency on its signature.
+ */
+static int job_request( const s_pki_jobs_t *jobs, const unsigned j, s_pki_request_t *req, const int deferred, char *err, const size_t max )
+{
+	s_pki_job_t *job = &(jobs->jobs[j]);
+
+	unsigned nb_deferred = 0;
+	memset( req, 0, sizeof(s_pki_request_t) );
+	req->op = job->op;
+	strlcpy( req->id, job->id, sizeof(req->id) );
+
+	for( unsigned i=0; i<job->nb_params; i++ ) {
+		const char *key   = job->params[i].key;
+		const char *value = job->params[i].value;
+
+		if( deferred && PKIRequestRevoke == job->op && 0 == strcmp( key, "cert" ) ) {
+			char target[MAX_FILE_PATH+1];
+			char check[MAX_FILE_PATH+1];
+			s_revocation_request_t rev;
+
+			strlcpy( target, value, sizeof(target) );
+			char *reason = strrchr( target, ',' );
+			if( NULL != reason ) {
+				*reason++ = '\0';
+			}
+			int signer = job_find_signer( jobs, target );
+			if( signer >= 0 ) {
+				// any serial number stands for the certificate to come
+				snprintf( check, sizeof(check), "01%s%s", NULL != reason ? "," : "", NULL != reason ? reason : "" );
+				if( parse_revocation_request( check, &rev ) ) {
+					snprintf( err, max, "invalid revocation reason in '%s'", value );
+					goto error;
+				}
+				if( job_add_dep( job, (unsigned)signer ) ) {
+					snprintf( err, max, "out of memory" );
+					goto error;
+				}
+				nb_deferred++;
+				continue;
+			}
+		}
+
+		if( pki_request_set( req, key, value ) ) {
+			snprintf( err, max, "invalid parameter %s=\"%s\" for %s", key, value, pki_request_op_name( job->op ) );
+			goto error;
+		}
+	}
+
+	if( nb_deferred > 0 && 0 == req->nb_revocations ) {
+		// every target comes from the batch: nothing is missing
+		return 0;
+	}
+	if( pki_request_check( req, err, max ) ) {
+		goto error;
+	}
+	return 0;
+
+error:
+	pki_request_free( req );
+	return -1;
+}//eo job_request
+
+// 1 if following the dependencies from job j leads back to it
+static int job_in_cycle( const s_pki_jobs_t *jobs, const unsigned j, unsigned char *visiting, unsigned char *checked )
+{
+	if( checked[j] ) {
+		return 0;
+	}
+	if( visiting[j] ) {
+		return 1;
+	}
+	visiting[j] = 1;
+	const s_pki_job_t *job = &(jobs->jobs[j]);
+	for( unsigned i=0; i<job->nb_deps; i++ ) {
+		if( job_in_cycle( jobs, job->deps[i], visiting, checked ) ) {
+			return 1;
+		}
+	}
+	visiting[j] = 0;
+	checked[j]  = 1;
+	return 0;
+}//eo job_in_cycle
+
+// check every job and compute the dependencies, once the whole file is read
+static int jobs_validate( const char *filename, s_pki_jobs_t *jobs )
+{
+	int nb_errors = 0;
+	char err[MAX_REQUEST_MESSAGE+1];
+	int last_index_job = -1;
+
+	for( unsigned j=0; j<jobs->nb_jobs; j++ ) {
+		s_pki_job_t *job = &(jobs->jobs[j]);
+
+		if( '\0' == job->id[0] ) {
+			job_error( &nb_errors, filename, job->line, "missing id" );
+		} else if( job_find( jobs, job->id ) != (int)j ) {
+			job_error( &nb_errors, filename, job->line, "duplicate id '%s'", job->id );
+		}
+
+		if( PKIRequestSign != job->op && PKIRequestRevoke != job->op && PKIRequestCRL != job->op ) {
+			job_error( &nb_errors, filename, job->line, "missing or invalid op, expecting sign, revoke or crl" );
+			continue;
+		}
+
+		s_pki_request_t req;
+		if( job_request( jobs, j, &req, 1, err, sizeof(err) ) ) {
+			job_error( &nb_errors, filename, job->line, "%s", err );
+		} else {
+			if( PKIRequestSign == job->op ) {
+				char base[MAX_FILE_PATH+1];
+				if( 0 != access( req.csr_path, R_OK ) ) {
+					job_error( &nb_errors, filename, job->line, "cannot read the CSR '%s'", req.csr_path );
+				}
+				if( job_find_signer( jobs, req.cert_path ) != (int)j ) {
+					job_error( &nb_errors, filename, job->line, "certificate '%s' written by another job", req.cert_path );
+				}
+				// the PKI keeps the certificate under the name of its CSR
+				filename_base( req.csr_path, base, sizeof(base) );
+				for( unsigned k=0; k<j; k++ ) {
+					char other[MAX_FILE_PATH+1];
+					const char *csr = job_param( &(jobs->jobs[k]), "csr" );
+					if( PKIRequestSign == jobs->jobs[k].op && NULL != csr && filename_base( csr, other, sizeof(other) ) >= 0 && 0 == strcmp( base, other ) ) {
+						job_error( &nb_errors, filename, job->line, "CSR named like the one of job '%s'", jobs->jobs[k].id );
+					}
+				}
+			}
+			pki_request_free( &req );
+		}
+
+		for( unsigned i=0; i<job->nb_after; i++ ) {
+			int dep = job_find( jobs, job->after[i] );
+			if( dep < 0 || (unsigned)dep == j ) {
+				job_error( &nb_errors, filename, job->line, "invalid dependency '%s'", job->after[i] );
+			} else if( job_add_dep( job, (unsigned)dep ) ) {
+				job_error( &nb_errors, filename, job->line, "out of memory" );
+			}
+		}
+
+		// the revocations and CRL follow the order of the file
+		if( PKIRequestRevoke == job->op || PKIRequestCRL == job->op ) {
+			if( last_index_job >= 0 && job_add_dep( job, (unsigned)last_index_job ) ) {
+				job_error( &nb_errors, filename, job->line, "out of memory" );
+			}
+			last_index_job = (int)j;
+		}
+	}
+
+	if( 0 == nb_errors ) {
+		unsigned char *visiting = calloc( jobs->nb_jobs, 2 );
+		if( NULL == visiting ) {
+			warn("Failed to allocate memory for the job dependencies");
+			return -1;
+		}
+		for( unsigned j=0; j<jobs->nb_jobs; j++ ) {
+			if( job_in_cycle( jobs, j, visiting, visiting+jobs->nb_jobs ) ) {
+				job_error( &nb_errors, filename, jobs->jobs[j].line, "job '%s' is part of a dependency cycle", jobs->jobs[j].id );
+				break;
+			}
+		}
+		free( visiting );
+	}
+
+	return nb_errors ? -1 : 0;
+}//eo jobs_validate
+
+int pki_jobs_load( const char *filename, s_pki_jobs_t *jobs )
+{
+	assert( NULL!=filename );
+	assert( NULL!=jobs );
+
+	memset( jobs, 0, sizeof(s_pki_jobs_t) );
+
+	FILE *fp = fopen( filename, "r" );
+	if( NULL == fp ) {
+		warn("Failed to open the job file %s", filename);
+		return -1;
+	}
+
+	char *line = malloc( MAX_JOB_LINE+1 );
+	jobs->jobs = calloc( MAX_JOBS, sizeof(s_pki_job_t) );
+	if( NULL == line || NULL == jobs->jobs ) {
+		warn("Failed to allocate memory for the job file");
+		free( line );
+		fclose( fp );
+		pki_jobs_free( jobs );
+		return -1;
+	}
+
+	int nb_errors = 0;
+	unsigned lnum = 0;
+	while( NULL != fgets( line, MAX_JOB_LINE+1, fp ) ) {
+		lnum++;
+		size_t len = strlen( line );
+		if( len == MAX_JOB_LINE && '\n' != line[len-1] ) {
+			job_error( &nb_errors, filename, lnum, "line too long" );
+			break;
+		}
+		chomp( line );
+		if( '\0' == line[strspn( line, " \t\r" )] ) {
+			continue;
+		}
+		if( jobs->nb_jobs == MAX_JOBS ) {
+			job_error( &nb_errors, filename, lnum, "too many jobs (max:%d)", MAX_JOBS );
+			break;
+		}
+
+		// an unreadable job is dropped: the following ones are still checked
+		s_pki_job_t *job = &(jobs->jobs[jobs->nb_jobs++]);
+		job->line = lnum;
+		if( json_object_parse( line, job_member, job ) ) {
+			job_error( &nb_errors, filename, lnum, "not a valid job object" );
+			job_release( job );
+			jobs->nb_jobs--;
+		}
+	}
+	free( line );
+	fclose( fp );
+
+	if( 0 == nb_errors && 0 == jobs->nb_jobs ) {
+		job_error( &nb_errors, filename, lnum, "no job" );
+	}
+	if( jobs_validate( filename, jobs ) || nb_errors ) {
+		pki_jobs_free( jobs );
+		return -1;
+	}
+
+	DEBUG_PRN("pki_jobs_load: %u job(s) loaded from %s", jobs->nb_jobs, filename);
+	return 0;
+}//eo pki_jobs_load
+
+////////////////////////////////////////////////////////////// Execution
+
+/*
+ * Next job whose dependencies are done, -1 if none is ready; the jobs
+ * depending on a failed one are skipped on the way. Called with the lock held.
+ */
+static int jobs_next_ready( s_pki_jobs_run_t *run )
+{
+	const s_pki_jobs_t *jobs = run->jobs;
+	int skipped;
+	do {
+		skipped = 0;
+		for( unsigned j=0; j<jobs->nb_jobs; j++ ) {
+			if( PKIJobPending != run->states[j] ) {
+				continue;
+			}
+			const s_pki_job_t *job = &(jobs->jobs[j]);
+			int ready = 1;
+			for( unsigned i=0; i<job->nb_deps && ready; i++ ) {
+				e_pki_job_state dep = run->states[job->deps[i]];
+				if( PKIJobFailed == dep || PKIJobSkipped == dep ) {
+					snprintf( run->results[j].message, sizeof(run->results[j].message), "warning=not executed, job '%s' did not succeed\n", jobs->jobs[job->deps[i]].id );
+					run->results[j].status = -1;
+					run->states[j] = PKIJobSkipped;
+					run->nb_finished++;
+					skipped = 1;
+					ready = 0;
+				} else if( PKIJobDone != dep ) {
+					ready = 0;
+				}
+			}
+			if( ready ) {
+				return (int)j;
+			}
+		}
+	} while( skipped );
+	return -1;
+}//eo jobs_next_ready
+
+static void jobs_execute( s_pki_jobs_run_t *run, const unsigned j )
+{
+	s_pki_request_result_t *res = &(run->results[j]);
+	s_pki_request_t req;
+	char err[256];
+
+	// the certificates signed by the previous jobs now exist
+	if( job_request( run->jobs, j, &req, 0, err, sizeof(err) ) ) {
+		snprintf( res->message, sizeof(res->message), "warning=%s\n", err );
+		res->status = -1;
+		return;
+	}
+	pki_request_execute( run->dir, run->password, &req, &(run->index), res );
+	pki_request_free( &req );
+}//eo jobs_execute
+
+static void* jobs_worker( void *data )
+{
+	s_pki_jobs_run_t *run = (s_pki_jobs_run_t*)data;
+	struct SS4EventHandlers *evt_handlers = run->evt_handlers;
+	const unsigned nb_jobs = run->jobs->nb_jobs;
+
+	trace_thread_name( "job worker" );
+
+	pthread_mutex_lock( &(run->lock) );
+	for(;;) {
+		// skipping jobs may finish the batch: checked after looking for a job
+		int j = jobs_next_ready( run );
+		while( j < 0 && run->nb_finished < nb_jobs ) {
+			pthread_cond_wait( &(run->changed), &(run->lock) );
+			j = jobs_next_ready( run );
+		}
+		if( j < 0 ) {
+			break;
+		}
+		run->states[j] = PKIJobRunning;
+		pthread_mutex_unlock( &(run->lock) );
+
+		jobs_execute( run, (unsigned)j );
+
+		pthread_mutex_lock( &(run->lock) );
+		run->states[j] = run->results[j].status ? PKIJobFailed : PKIJobDone;
+		run->nb_finished++;
+
+		char msg[MAX_REQUEST_ID_LEN+64];
+		snprintf( msg, sizeof(msg), "job %s: %s", run->jobs->jobs[j].id, run->results[j].status ? "failed" : "done" );
+		STEP( (int)(run->nb_finished*100/nb_jobs), msg );
+		pthread_cond_broadcast( &(run->changed) );
+	}
+	// the last skipped jobs may be the end of the batch
+	pthread_cond_broadcast( &(run->changed) );
+	pthread_mutex_unlock( &(run->lock) );
+	return NULL;
+}//eo jobs_worker
+
+// write the members of a result message, a member given several times as an array
+static int jobs_write_members( FILE *fp, const char *message )
+{
+	char *work = strdup( message );
+	if( NULL == work ) {
+		return -1;
+	}
+
+	char *lines[MAX_REQUEST_MESSAGE/2];
+	unsigned nb_lines = 0;
+	char *saveptr = NULL;
+	for( char *l = strtok_r( work, "\n", &saveptr ); NULL != l && nb_lines < sizeof(lines)/sizeof(lines[0]); l = strtok_r( NULL, "\n", &saveptr ) ) {
+		char *value = strchr( l, '=' );
+		if( NULL == value ) {
+			continue;
+		}
+		*value = '\0';
+		lines[nb_lines++] = l;
+	}
+
+	char esc[6*MAX_REQUEST_MESSAGE+1];
+	int res = 0;
+	for( unsigned i=0; i<nb_lines && res>=0; i++ ) {
+		unsigned first = 0, count = 0;
+		while( 0 != strcmp( lines[first], lines[i] ) ) {
+			first++;
+		}
+		if( first != i || 0 == strcmp( lines[i], "id" ) ) {
+			continue;   // already written with its first occurrence
+		}
+		for( unsigned k=i; k<nb_lines; k++ ) {
+			count += 0 == strcmp( lines[k], lines[i] );
+		}
+
+		json_escape( esc, sizeof(esc), lines[i] );
+		res = fprintf( fp, ",\"%s\":%s", esc, count > 1 ? "[" : "" );
+		for( unsigned k=i, n=0; k<nb_lines && res>=0; k++ ) {
+			if( 0 != strcmp( lines[k], lines[i] ) ) {
+				continue;
+			}
+			json_escape( esc, sizeof(esc), lines[k]+strlen(lines[k])+1 );
+			res = fprintf( fp, "%s\"%s\"", n++ ? "," : "", esc );
+		}
+		if( res >= 0 && count > 1 ) {
+			res = fprintf( fp, "]" );
+		}
+	}
+
+	free( work );
+	return res < 0 ? -1 : 0;
+}//eo jobs_write_members
+
+static int jobs_write_results( const s_pki_jobs_run_t *run, const char *result_filename )
+{
+	static const char *state_names[] = { "pending", "running", "ok", "failed", "skipped" };
+	char esc[6*MAX_REQUEST_ID_LEN+1];
+
+	s_atomic_group_t grp;
+	atomic_group_init( &grp );
+	FILE *fp = atomic_group_open( &grp, result_filename );
+	if( NULL == fp ) {
+		atomic_group_abort( &grp );
+		return -1;
+	}
+
+	int res = 0;
+	for( unsigned j=0; j<run->jobs->nb_jobs && 0==res; j++ ) {
+		const s_pki_job_t *job = &(run->jobs->jobs[j]);
+		json_escape( esc, sizeof(esc), job->id );
+		if( fprintf( fp, "{\"id\":\"%s\",\"op\":\"%s\",\"status\":\"%s\"", esc, pki_request_op_name( job->op ), state_names[run->states[j]] ) < 0
+		 || jobs_write_members( fp, run->results[j].message )
+		 || fprintf( fp, "}\n" ) < 0 ) {
+			res = -1;
+		}
+	}
+
+	if( res ) {
+		atomic_group_abort( &grp );
+		return -1;
+	}
+	return atomic_group_commit( &grp );
+}//eo jobs_write_results
+
+int pki_jobs_run( const char *dir, const char *password, s_pki_jobs_t *jobs, const char *result_filename, struct SS4EventHandlers* evt_handlers )
+{
+	assert( NULL!=dir );
+	assert( NULL!=jobs );
+	assert( NULL!=result_filename );
+	assert( NULL!=evt_handlers );
+
+	s_pki_jobs_run_t run;
+	memset( &run, 0, sizeof(run) );
+	run.dir          = dir;
+	run.password     = password;
+	run.jobs         = jobs;
+	run.evt_handlers = evt_handlers;
+	run.states       = calloc( jobs->nb_jobs, sizeof(e_pki_job_state) );
+	run.results      = calloc( jobs->nb_jobs, sizeof(s_pki_request_result_t) );
+	if( NULL == run.states || NULL == run.results ) {
+		warn("Failed to allocate memory for the execution of the jobs");
+		free( run.states );
+		free( run.results );
+		return -1;
+	}
+
+	ca_index_cache_init( &(run.index) );
+	pthread_mutex_init( &(run.lock), NULL );
+	pthread_cond_init( &(run.changed), NULL );
+
+	long nb_cpu = sysconf( _SC_NPROCESSORS_ONLN );
+	unsigned nb_workers = ( nb_cpu < 1 ) ? 1 : (unsigned)nb_cpu;
+	if( nb_workers > jobs->nb_jobs ) {
+		nb_workers = jobs->nb_jobs;
+	}
+
+	pthread_t workers[nb_workers];
+	unsigned  nb_started = 0;
+	for( unsigned i=0; i<nb_workers; i++ ) {
+		if( pthread_create( &(workers[i]), NULL, jobs_worker, &run ) ) {
+			DEBUG_PRN("pki_jobs_run: failed to start worker %u", i);
+			break;
+		}
+		nb_started++;
+	}
+	if( 0 == nb_started ) {
+		jobs_worker( &run );
+	}
+	for( unsigned i=0; i<nb_started; i++ ) {
+		pthread_join( workers[i], NULL );
+	}
+
+	unsigned nb_ok = 0;
+	for( unsigned j=0; j<jobs->nb_jobs; j++ ) {
+		nb_ok += PKIJobDone == run.states[j];
+	}
+	DEBUG_PRN("pki_jobs_run: %u/%u job(s) succeeded on %u thread(s)", nb_ok, jobs->nb_jobs, nb_started);
+
+	int res = 0;
+	if( jobs_write_results( &run, result_filename ) ) {
+		warn("Failed to write the job results to %s", result_filename);
+		res = -1;
+	}
+	if( nb_ok != jobs->nb_jobs ) {
+		warn("%u job(s) out of %u did not succeed, see %s", jobs->nb_jobs-nb_ok, jobs->nb_jobs, result_filename);
+		res = -1;
+	}
+
+	pthread_cond_destroy( &(run.changed) );
+	pthread_mutex_destroy( &(run.lock) );
+	ca_index_cache_destroy( &(run.index) );
+	free( run.states );
+	free( run.results );
+	return res;
+}//eo pki_jobs_run
+
+void pki_jobs_free( s_pki_jobs_t *jobs )
+{
+	if( NULL == jobs || NULL == jobs->jobs ) {
+		return;
+	}
+	for( unsigned j=0; j<jobs->nb_jobs; j++ ) {
+		job_release( &(jobs->jobs[j]) );
+	}
+	free( jobs->jobs );
+	jobs->jobs    = NULL;
+	jobs->nb_jobs = 0;
+}//eo pki_jobs_free
+
+//eof
@@ -0,0 +1,103 @@
+/**
+ *
+ * \file pki_jobs.h
+ *
+ * \brief Batch of PKI operations executed under a single unlock
+ *
+ * A job file holds one JSON object per line, for example:
+ *
+ *     {"id":"a", "op":"sign", "csr":"sub1.csr", "cert":"sub1.crt"}
+ *     {"id":"b", "op":"sign", "csr":"sub2.csr", "cert":"sub2.crt"}
+ *     {"id":"r", "op":"revoke", "cert":"sub1.crt,superseded", "crl":"root.crl"}
+ *
+ * The members are the parameters of pki_request_set, plus "op", a mandatory
+ * "id" and "after", the ids of the jobs to wait for. Besides the explicit
+ * dependencies, a revocation of a certificate signed by the batch waits for
+ * its signature, and the revoke and crl jobs run in the order of the file.
+ * Independent signatures run in parallel.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#if !defined( _S4_PKI_JOBS_H_ )
+#define _S4_PKI_JOBS_H_
+
+#include "pki_request.h"
+#include "shared_secret.h"
+
+#define MAX_JOBS      (1024)
+#define MAX_JOB_LINE  (65536)
+
+/**
+ * \brief Parameter of a job, as written in the file
+ */
+typedef struct SPKIJobParam {
+    char  key[MAX_JSON_KEY_LEN+1];
+    char *value;
+} s_pki_job_param_t;
+
+/**
+ * \brief One job of the batch
+ */
+typedef struct SPKIJob {
+    unsigned           line;           // line of the job in the file
+    e_pki_request_op   op;
+    char               id[MAX_REQUEST_ID_LEN+1];
+    s_pki_job_param_t *params;         // parameters of the request, "after" excluded
+    unsigned           nb_params;
+    char             **after;          // ids of the explicit dependencies
+    unsigned           nb_after;
+    unsigned          *deps;           // indexes of every job to wait for
+    unsigned           nb_deps;
+} s_pki_job_t;
+
+/**
+ * \brief Jobs of a file, in the order of the file
+ */
+typedef struct SPKIJobs {
+    s_pki_job_t *jobs;
+    unsigned     nb_jobs;
+} s_pki_jobs_t;
+
+/**
+ * \brief Load and validate a job file
+ *
+ * Every job is checked before any is executed: syntax, operations and
+ * their parameters, readable CSR, unique ids and outputs, known and acyclic
+ * dependencies. Each problem found is reported with its line number.
+ *
+ * \param filename  path to the JSON lines job file
+ * \param jobs      jobs to initialise, to release with pki_jobs_free
+ *
+ * \return 0 if the whole file is valid, -1 otherwise
+ */
+int pki_jobs_load( const char *filename, s_pki_jobs_t *jobs );
+
+/**
+ * \brief Execute the jobs in the order of their dependencies
+ *
+ * The jobs whose dependencies succeeded run on as many threads as there
+ * are processors, a job depending on a failed one is skipped. The outcome of
+ * every job is written to result_filename, one JSON object per line in the
+ * order of the job file.
+ *
+ * \param dir              root directory of the PKI
+ * \param password         password of the root private key
+ * \param jobs             jobs loaded by pki_jobs_load
+ * \param result_filename  path of the result file
+ * \param evt_handlers     progress reported after each job
+ *
+ * \return 0 if every job succeeded, -1 otherwise
+ */
+int pki_jobs_run( const char *dir, const char *password, s_pki_jobs_t *jobs, const char *result_filename, struct SS4EventHandlers* evt_handlers );
+
+/**
+ * \brief Release the memory held by the jobs
+ */
+void pki_jobs_free( s_pki_jobs_t *jobs );
+
+#endif
+//eof
@@ -0,0 +1,312 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file pki_request.c
+ *
+ * \brief PKI operations requested once the root key is unlocked
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "utils.h"
+#include "pki.h"
+#include "ca_store.h"
+#include "shared_secret.h"
+#include "pki_request.h"
+#include "trace.h"
+
+static const char *op_names[] = { NULL, "sign", "revoke", "crl", "status", "lock" };
+
+const char* pki_request_op_name( const e_pki_request_op op )
+{
+	if( (unsigned)op >= sizeof(op_names)/sizeof(op_names[0]) ) {
+		return NULL;
+	}
+	return op_names[op];
+}//eo pki_request_op_name
+
+e_pki_request_op pki_request_op_from_name( const char *name )
+{
+	for( unsigned i=1; i<sizeof(op_names)/sizeof(op_names[0]); i++ ) {
+		if( 0 == strcmp( name, op_names[i] ) ) {
+			return (e_pki_request_op)i;
+		}
+	}
+	return PKIRequestUnknown;
+}//eo pki_request_op_from_name
+
+// copy a parameter, refusing truncated values
+#define SET_PARAM(dst,val) ( strlcpy( (dst), (val), sizeof(dst) ) < sizeof(dst) ? 0 : -1 )
+
+int pki_request_set( s_pki_request_t *req, const char *key, const char *value )
+{
+	assert( NULL!=req );
+	assert( NULL!=key );
+	assert( NULL!=value );
+
+	if( 0 == strcmp( key, "id" ) ) {
+		return SET_PARAM( req->id, value );
+	}
+	if( 0 == strcmp( key, "pki" ) ) {
+		return SET_PARAM( req->pki, value );
+	}
+
+	switch( req->op ) {
+		case PKIRequestSign:
+			if( 0 == strcmp( key, "csr" ) ) {
+				return SET_PARAM( req->csr_path, value );
+			}
+			if( 0 == strcmp( key, "cert" ) ) {
+				return SET_PARAM( req->cert_path, value );
+			}
+			break;
+
+		case PKIRequestRevoke:
+			if( 0 == strcmp( key, "cert" ) || 0 == strcmp( key, "serial" ) ) {
+				if( NULL == req->revocations ) {
+					req->revocations = calloc( MAX_REVOCATION_BATCH, sizeof(s_revocation_request_t) );
+					if( NULL == req->revocations ) {
+						return -1;
+					}
+				}
+				if( req->nb_revocations == MAX_REVOCATION_BATCH || parse_revocation_request( value, &(req->revocations[req->nb_revocations]) ) ) {
+					return -1;
+				}
+				req->nb_revocations++;
+				return 0;
+			}
+			if( 0 == strcmp( key, "crl" ) ) {
+				return SET_PARAM( req->crl_path, value );
+			}
+			break;
+
+		case PKIRequestCRL:
+			if( 0 == strcmp( key, "crl" ) ) {
+				return SET_PARAM( req->crl_path, value );
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	DEBUG_PRN("pki_request_set: no parameter '%s' for '%s'", key, pki_request_op_name( req->op ) ? pki_request_op_name( req->op ) : "?" );
+	return -1;
+}//eo pki_request_set
+
+#undef SET_PARAM
+
+int pki_request_check( const s_pki_request_t *req, char *err, const size_t max )
+{
+	assert( NULL!=req );
+
+	const char *missing = NULL;
+	switch( req->op ) {
+		case PKIRequestSign:
+			missing = '\0' == req->csr_path[0] ? "csr" : ( '\0' == req->cert_path[0] ? "cert" : NULL );
+			break;
+		case PKIRequestRevoke:
+			missing = 0 == req->nb_revocations ? "cert or serial" : NULL;
+			break;
+		case PKIRequestCRL:
+			missing = '\0' == req->crl_path[0] ? "crl" : NULL;
+			break;
+		case PKIRequestStatus:
+		case PKIRequestLock:
+			break;
+		default:
+			snprintf( err, max, "unknown operation" );
+			return -1;
+	}
+
+	if( NULL != missing ) {
+		snprintf( err, max, "%s: missing %s parameter", pki_request_op_name( req->op ), missing );
+		return -1;
+	}
+	return 0;
+}//eo pki_request_check
+
+int pki_request_parse( const char *text, s_pki_request_t *req, char *err, const size_t max )
+{
+	assert( NULL!=text );
+	assert( NULL!=req );
+
+	memset( req, 0, sizeof(s_pki_request_t) );
+
+	char *work = strdup( text );
+	if( NULL == work ) {
+		snprintf( err, max, "out of memory" );
+		return -1;
+	}
+
+	char *saveptr = NULL;
+	char *line = strtok_r( work, "\n", &saveptr );
+	if( NULL != line ) {
+		chomp( line );
+		req->op = pki_request_op_from_name( line );
+	}
+	if( PKIRequestUnknown == req->op ) {
+		snprintf( err, max, "unknown operation '%s'", NULL != line ? line : "" );
+		free( work );
+		return -1;
+	}
+
+	while( NULL != (line = strtok_r( NULL, "\n", &saveptr )) ) {
+		chomp( line );
+		if( '\0' == line[0] ) {
+			continue;
+		}
+		char *value = strchr( line, '=' );
+		if( NULL == value ) {
+			snprintf( err, max, "'%s' is not a key=value parameter", line );
+			goto error;
+		}
+		*value++ = '\0';
+		if( pki_request_set( req, line, value ) ) {
+			snprintf( err, max, "invalid parameter '%s' for %s", line, pki_request_op_name( req->op ) );
+			goto error;
+		}
+	}
+	free( work );
+
+	if( pki_request_check( req, err, max ) ) {
+		pki_request_free( req );
+		return -1;
+	}
+	return 0;
+
+error:
+	free( work );
+	pki_request_free( req );
+	return -1;
+}//eo pki_request_parse
+
+// append a line to the result message
+static void result_append( s_pki_request_result_t *res, const char *fmt, ... )
+{
+	size_t len = strlen( res->message );
+	if( len >= sizeof(res->message)-1 ) {
+		return;
+	}
+	va_list args;
+	va_start( args, fmt );
+	vsnprintf( res->message+len, sizeof(res->message)-len, fmt, args );
+	va_end( args );
+}//eo result_append
+
+// the warnings of the PKI functions explain a failure to the requester
+static void request_warning_handler( void *data, const char *fmt, ... )
+{
+	s_pki_request_result_t *res = (s_pki_request_result_t*)data;
+	char line[MAX_REQUEST_MESSAGE];
+
+	va_list args;
+	va_start( args, fmt );
+	vsnprintf( line, sizeof(line), fmt, args );
+	va_end( args );
+
+	result_append( res, "warning=%s\n", line );
+}//eo request_warning_handler
+
+#define LOCK_INDEX()   if( NULL != index ) { pthread_mutex_lock( &(index->lock) ); }
+#define UNLOCK_INDEX() if( NULL != index ) { pthread_mutex_unlock( &(index->lock) ); }
+
+int pki_request_execute( const char *dir, const char *password, s_pki_request_t *req, s_ca_index_cache_t *index, s_pki_request_result_t *res )
+{
+	assert( NULL!=dir );
+	assert( NULL!=req );
+	assert( NULL!=res );
+
+	TRACE_SPAN( span, pki_request_op_name( req->op ), req->id );
+
+	s_s4eventhandlers_t evt;
+	memset( &evt, 0, sizeof(evt) );
+	evt.data       = res;
+	evt.on_warning = request_warning_handler;
+
+	res->status     = -1;
+	res->message[0] = '\0';
+	if( '\0' != req->id[0] ) {
+		result_append( res, "id=%s\n", req->id );
+	}
+
+	switch( req->op ) {
+		case PKIRequestSign: {
+			int err = ( NULL != index ) ? sign_subca_shared( dir, req->csr_path, req->cert_path, password, index, &evt )
+			                                 : sign_subca( dir, req->csr_path, req->cert_path, password, &evt );
+			if( err ) {
+				break;
+			}
+			char serial[MAX_SERIAL_LEN+1];
+			result_append( res, "cert=%s\n", req->cert_path );
+			if( 0 == ca_cert_file_serial( req->cert_path, serial, sizeof(serial) ) ) {
+				result_append( res, "serial=%s\n", serial );
+			}
+			res->status = 0;
+			break;
+		}
+
+		case PKIRequestRevoke: {
+			LOCK_INDEX();
+			int err = revoke_subca_batch( dir, req->revocations, req->nb_revocations, req->crl_path, password, index, &evt );
+			UNLOCK_INDEX();
+			if( err ) {
+				break;
+			}
+			for( unsigned i=0; i<req->nb_revocations; i++ ) {
+				result_append( res, "revoked=%s\n", req->revocations[i].serial );
+			}
+			if( '\0' != req->crl_path[0] ) {
+				result_append( res, "crl=%s\n", req->crl_path );
+			}
+			res->status = 0;
+			break;
+		}
+
+		case PKIRequestCRL: {
+			LOCK_INDEX();
+			int err = generate_crl( dir, req->crl_path, password, &evt );
+			UNLOCK_INDEX();
+			if( err ) {
+				break;
+			}
+			result_append( res, "crl=%s\n", req->crl_path );
+			res->status = 0;
+			break;
+		}
+
+		default:
+			result_append( res, "warning=%s cannot be executed\n", pki_request_op_name( req->op ) ? pki_request_op_name( req->op ) : "unknown operation" );
+			break;
+	}
+
+	DEBUG_PRN("pki_request_execute: %s %s: %s", pki_request_op_name( req->op ), req->id, res->status ? "failed" : "done");
+	return res->status;
+}//eo pki_request_execute
+
+#undef LOCK_INDEX
+#undef UNLOCK_INDEX
+
+void pki_request_free( s_pki_request_t *req )
+{
+	if( NULL == req ) {
+		return;
+	}
+	free( req->revocations );
+	req->revocations    = NULL;
+	req->nb_revocations = 0;
+}//eo pki_request_free
+
+//eof
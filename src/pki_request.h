@@ -0,0 +1,137 @@
+/**
+ *
+ * \file pki_request.h
+ *
+ * \brief PKI operations requested once the root key is unlocked
+ *
+ * A request describes one sign, revoke or CRL operation; it is executed with
+ * the passphrase rebuilt by a single quorum unlock.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#if !defined( _S4_PKI_REQUEST_H_ )
+#define _S4_PKI_REQUEST_H_
+
+#include <pthread.h>
+
+#include "utils.h"
+#include "pki.h"
+#include "ca_store.h"
+
+#define MAX_REQUEST_ID_LEN   (64)
+#define MAX_REQUEST_PKI_LEN  (32)
+#define MAX_REQUEST_MESSAGE  (2048)
+
+/**
+ * \brief Operation of a request
+ */
+typedef enum EPKIRequestOp {
+    PKIRequestUnknown = 0,
+    PKIRequestSign    = 1,
+    PKIRequestRevoke  = 2,
+    PKIRequestCRL     = 3,
+    PKIRequestStatus  = 4,   // service only: state of the service
+    PKIRequestLock    = 5    // service only: wipe the passphrase and stop
+} e_pki_request_op;
+
+/**
+ * \brief One PKI operation
+ */
+typedef struct SPKIRequest {
+    e_pki_request_op        op;
+    char                    id[MAX_REQUEST_ID_LEN+1];  // caller reference, echoed in the result
+    char                    pki[MAX_REQUEST_PKI_LEN+1]; // service: id of the PKI, the first one if empty
+    char                    csr_path[MAX_FILE_PATH+1];
+    char                    cert_path[MAX_FILE_PATH+1]; // sign: where to copy the certificate
+    char                    crl_path[MAX_FILE_PATH+1];
+    s_revocation_request_t *revocations;               // revoke: allocated, see pki_request_free
+    unsigned                nb_revocations;
+} s_pki_request_t;
+
+/**
+ * \brief Outcome of a request
+ */
+typedef struct SPKIRequestResult {
+    int  status;                            // 0 on success, -1 on error
+    char message[MAX_REQUEST_MESSAGE+1];    // "key=value" lines, or the warnings raised
+} s_pki_request_result_t;
+
+/**
+ * \brief Name of an operation, NULL if unknown
+ */
+const char* pki_request_op_name( const e_pki_request_op op );
+
+/**
+ * \brief Operation from its name, PKIRequestUnknown if unknown
+ */
+e_pki_request_op pki_request_op_from_name( const char *name );
+
+/**
+ * \brief Add a parameter to a request
+ *
+ * Parameters: id, pki, csr and cert (sign), cert and serial with an optional
+ * ",<reason>" (revoke, may be repeated), crl (revoke, crl).
+ *
+ * \param req    request, its operation already set
+ * \param key    parameter name
+ * \param value  parameter value
+ *
+ * \return 0 on success, -1 on unknown or invalid parameter
+ */
+int pki_request_set( s_pki_request_t *req, const char *key, const char *value );
+
+/**
+ * \brief Check that a request has the parameters its operation requires
+ *
+ * \param req    request to check
+ * \param err    destination of the reason of a failure
+ * \param max    size of err
+ *
+ * \return 0 if the request is complete, -1 otherwise
+ */
+int pki_request_check( const s_pki_request_t *req, char *err, const size_t max );
+
+/**
+ * \brief Parse a request from its text form
+ *
+ * The operation name on the first line, then one "key=value" parameter per
+ * line, as accepted by pki_request_set.
+ *
+ * \param text   request text
+ * \param req    request to initialise, to release with pki_request_free
+ * \param err    destination of the reason of a failure
+ * \param max    size of err
+ *
+ * \return 0 on success, -1 otherwise
+ */
+int pki_request_parse( const char *text, s_pki_request_t *req, char *err, const size_t max );
+
+/**
+ * \brief Execute a sign, revoke or CRL request
+ *
+ * Without index the requests must be executed one at a time. With it,
+ * requests may run in parallel: the signatures only hold its lock to update
+ * the index, the other operations hold it from start to end. The index is
+ * then read from cert.idx only when it changed since the previous request.
+ *
+ * \param dir         root directory of the PKI
+ * \param password    password of the root private key
+ * \param req         request to execute
+ * \param index       index cache shared by the concurrent requests, or NULL
+ * \param res         outcome of the request
+ *
+ * \return 0 on success, -1 on error
+ */
+int pki_request_execute( const char *dir, const char *password, s_pki_request_t *req, s_ca_index_cache_t *index, s_pki_request_result_t *res );
+
+/**
+ * \brief Release the memory held by a request
+ */
+void pki_request_free( s_pki_request_t *req );
+
+#endif
+//eof
@@ -0,0 +1,287 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file secure_arena.c
+ *
+ * \brief Page locked arena for the secret material
+ *
+ * The descriptor of an arena lives in its first locked bytes, the
+ * allocations follow it. Once secure_arena_init has replaced the GMP memory
+ * functions, each GMP block starts with a small header telling which arena
+ * it comes from, if any, so that blocks allocated outside an arena are
+ * released properly.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <gmp.h>
+
+#include "utils.h"
+#include "secure_arena.h"
+
+#define ARENA_ALIGN         (16)
+#define ARENA_ROUND(n)      ( ((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1) )
+
+struct SSecureArena {
+    uint8_t *data;       // first allocatable byte
+    size_t   size;       // allocatable bytes
+    size_t   used;       // allocated bytes
+    size_t   dirty;      // bytes handed out since the last wipe, >= used
+    size_t   map_len;    // whole mapping, guard pages included
+    size_t   page;
+    int      locked;
+};
+
+#define ARENA_HEADER_SIZE   ARENA_ROUND( sizeof(s_secure_arena_t) )
+
+/**
+ * \brief Header of a GMP block
+ */
+typedef struct SArenaBlock {
+    s_secure_arena_t *arena;   // NULL for a block from the C library
+    size_t            size;
+} __attribute__((aligned(ARENA_ALIGN))) s_arena_block_t;
+
+static __thread s_secure_arena_t *arena_current = NULL;
+
+static pthread_once_t arena_gmp_once     = PTHREAD_ONCE_INIT;
+static int            arena_gmp_overflow = 0;
+
+/**
+ * \brief Bump allocation, the memory returned may hold wiped-on-rewind leftovers
+ */
+static void* arena_bump( s_secure_arena_t *arena, size_t size )
+{
+	const size_t sze = ARENA_ROUND( size );
+	if( sze < size || sze > arena->size - arena->used ) {
+		return NULL;
+	}
+	void *p = arena->data + arena->used;
+	arena->used += sze;
+	if( arena->used > arena->dirty ) {
+		arena->dirty = arena->used;
+	}
+	return p;
+}//eo arena_bump
+
+/**
+ * \brief Whether a block is the last one allocated from its arena
+ */
+static int arena_is_top( const s_arena_block_t *blk )
+{
+	const s_secure_arena_t *arena = blk->arena;
+	return (const uint8_t*)blk + ARENA_ROUND( sizeof(s_arena_block_t) + blk->size ) == arena->data + arena->used;
+}//eo arena_is_top
+
+////////////////////////////////////////////// GMP memory functions
+
+static void* arena_gmp_alloc( size_t size )
+{
+	s_secure_arena_t *arena = arena_current;
+	s_arena_block_t  *blk   = NULL;
+
+	if( NULL != arena ) {
+		blk = arena_bump( arena, sizeof(s_arena_block_t) + size );
+		if( NULL == blk && !__atomic_exchange_n( &arena_gmp_overflow, 1, __ATOMIC_RELAXED ) ) {
+			DEBUG_PRN("arena_gmp_alloc: secure arena exhausted, falling back to the heap");
+		}
+	}
+	if( NULL == blk ) {
+		arena = NULL;
+		blk   = malloc( sizeof(s_arena_block_t) + size );
+		if( NULL == blk ) {
+			die( -1, "GMP allocation of %zu bytes failed", size );
+		}
+	}
+
+	blk->arena = arena;
+	blk->size  = size;
+	return blk + 1;
+}//eo arena_gmp_alloc
+
+static void arena_gmp_free( void *ptr, size_t size )
+{
+	if( NULL == ptr ) {
+		return;
+	}
+	s_arena_block_t *blk = (s_arena_block_t*)ptr - 1;
+
+	if( NULL == blk->arena ) {
+		secure_memzero( blk, sizeof(s_arena_block_t) + blk->size );
+		free( blk );
+	} else if( arena_is_top( blk ) ) {
+		// left dirty: wiped with the rest on rewind
+		blk->arena->used = (uint8_t*)blk - blk->arena->data;
+	}
+	// other arena blocks are reclaimed by the rewind of their arena
+}//eo arena_gmp_free
+
+static void* arena_gmp_realloc( void *ptr, size_t old_size, size_t new_size )
+{
+	s_arena_block_t *blk = (s_arena_block_t*)ptr - 1;
+
+	if( NULL != blk->arena && blk->arena == arena_current && arena_is_top( blk ) ) {
+		s_secure_arena_t *arena = blk->arena;
+		const size_t start = (uint8_t*)blk - arena->data;
+		const size_t sze   = ARENA_ROUND( sizeof(s_arena_block_t) + new_size );
+		if( sze <= arena->size - start ) {
+			arena->used = start + sze;
+			if( arena->used > arena->dirty ) {
+				arena->dirty = arena->used;
+			}
+			blk->size = new_size;
+			return ptr;
+		}
+	}
+
+	void *p = arena_gmp_alloc( new_size );
+	memcpy( p, ptr, blk->size < new_size ? blk->size : new_size );
+	arena_gmp_free( ptr, old_size );
+	return p;
+}//eo arena_gmp_realloc
+
+static void arena_gmp_install( void )
+{
+	mp_set_memory_functions( arena_gmp_alloc, arena_gmp_realloc, arena_gmp_free );
+}//eo arena_gmp_install
+
+///////////////////////////////// Exported functions
+
+void secure_arena_init( void )
+{
+	pthread_once( &arena_gmp_once, arena_gmp_install );
+}//eo secure_arena_init
+
+s_secure_arena_t* secure_arena_create( size_t size )
+{
+	const long psze = sysconf( _SC_PAGESIZE );
+	const size_t page = psze > 0 ? (size_t)psze : 4096;
+
+	const size_t body = ( ARENA_HEADER_SIZE + size + page - 1 ) / page * page;
+	if( body < size ) {
+		DEBUG_PRN("secure_arena_create: size overflow (%zu)", size);
+		return NULL;
+	}
+	const size_t map_len = body + 2*page;
+
+	uint8_t *map = mmap( NULL, map_len, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+	if( MAP_FAILED == map ) {
+		DEBUG_PRN("secure_arena_create: failed to map %zu bytes: %s", map_len, strerror(errno));
+		return NULL;
+	}
+	uint8_t *base = map + page;
+	if( mprotect( base, body, PROT_READ|PROT_WRITE ) ) {
+		DEBUG_PRN("secure_arena_create: failed to unprotect the arena: %s", strerror(errno));
+		munmap( map, map_len );
+		return NULL;
+	}
+#if defined( MADV_DONTDUMP )
+	madvise( base, body, MADV_DONTDUMP );
+#endif
+#if defined( MADV_DONTFORK )
+	madvise( base, body, MADV_DONTFORK );
+#endif
+
+	s_secure_arena_t *arena = (s_secure_arena_t*)base;
+	arena->data    = base + ARENA_HEADER_SIZE;
+	arena->size    = body - ARENA_HEADER_SIZE;
+	arena->used    = 0;
+	arena->dirty   = 0;
+	arena->map_len = map_len;
+	arena->page    = page;
+	arena->locked  = 0 == mlock( base, body );
+	if( !arena->locked ) {
+		DEBUG_PRN("secure_arena_create: %zu bytes left unlocked: %s", body, strerror(errno));
+	}
+
+	DDEBUG_PRN("secure_arena_create: %zu bytes at %p", arena->size, (void*)arena->data);
+	return arena;
+}//eo secure_arena_create
+
+void secure_arena_destroy( s_secure_arena_t *arena )
+{
+	if( NULL == arena ) {
+		return;
+	}
+	assert( arena != arena_current );
+
+	uint8_t     *base    = (uint8_t*)arena;
+	const size_t page    = arena->page;
+	const size_t map_len = arena->map_len;
+	const int    locked  = arena->locked;
+
+	// the descriptor goes with the secrets
+	secure_memzero( arena, ARENA_HEADER_SIZE + arena->dirty );
+	if( locked ) {
+		munlock( base, map_len - 2*page );
+	}
+	munmap( base - page, map_len );
+}//eo secure_arena_destroy
+
+void* secure_arena_alloc( s_secure_arena_t *arena, size_t size )
+{
+	assert( NULL!=arena );
+
+	const size_t dirty = arena->dirty;
+	uint8_t *p = arena_bump( arena, size );
+	if( NULL == p ) {
+		DEBUG_PRN("secure_arena_alloc: %zu bytes requested, %zu available", size, arena->size - arena->used);
+		return NULL;
+	}
+	// pages never handed out are still zero from the mapping
+	const size_t offset = p - arena->data;
+	if( offset < dirty ) {
+		memset( p, 0, ( dirty - offset < size ) ? dirty - offset : size );
+	}
+	return p;
+}//eo secure_arena_alloc
+
+size_t secure_arena_mark( const s_secure_arena_t *arena )
+{
+	assert( NULL!=arena );
+	return arena->used;
+}//eo secure_arena_mark
+
+void secure_arena_rewind( s_secure_arena_t *arena, size_t mark )
+{
+	assert( NULL!=arena );
+	assert( mark <= arena->dirty );
+
+	if( arena->dirty > mark ) {
+		secure_memzero( arena->data + mark, arena->dirty - mark );
+	}
+	arena->used  = mark;
+	arena->dirty = mark;
+}//eo secure_arena_rewind
+
+s_secure_arena_t* secure_arena_enter( s_secure_arena_t *arena )
+{
+	s_secure_arena_t *previous = arena_current;
+	arena_current = arena;
+	return previous;
+}//eo secure_arena_enter
+
+void secure_arena_leave( s_secure_arena_t *previous )
+{
+	arena_current = previous;
+}//eo secure_arena_leave
+
+s_secure_arena_t* secure_arena_current( void )
+{
+	return arena_current;
+}//eo secure_arena_current
+
+//eof
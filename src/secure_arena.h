@@ -0,0 +1,106 @@
+/**
+ *
+ * \file secure_arena.h
+ *
+ * \brief Page locked arena for the secret material
+ *
+ * An arena is one anonymous mapping, locked in memory, excluded from core
+ * dumps and surrounded by inaccessible guard pages. Allocating is a pointer
+ * bump; the secrets are wiped all at once when the arena is rewound to a
+ * mark or destroyed, instead of buffer by buffer.
+ *
+ * Once secure_arena_init has run, while a thread has entered an arena, the
+ * limbs of the GMP integers it creates are taken from it too: an integer
+ * released before the rewind of its arena needs no wiping of its own. Such
+ * an integer must be cleared before the rewind or not at all.
+ *
+ * An arena is not thread safe: one thread at a time enters it.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#if !defined( _S4_SECURE_ARENA_H_ )
+#define _S4_SECURE_ARENA_H_
+
+#include <stddef.h>
+
+typedef struct SSecureArena s_secure_arena_t;
+
+/**
+ * \brief Take the limbs of the GMP integers from the entered arenas
+ *
+ * Replaces the GMP memory functions of the whole process, once: to call
+ * while no GMP integer exists, in the library or in its host, since a block
+ * allocated by GMP before the call cannot be released after it. Without
+ * this call, the GMP integers stay on the heap of the C library.
+ */
+void secure_arena_init( void );
+
+/**
+ * \brief Map a new arena
+ *
+ * A failure to lock the pages, for instance above RLIMIT_MEMLOCK, is logged
+ * and the arena is used unlocked.
+ *
+ * \param size  bytes available for the allocations, rounded up to whole pages
+ *
+ * \return NULL on error, the arena otherwise
+ */
+s_secure_arena_t* secure_arena_create( size_t size );
+
+/**
+ * \brief Wipe, unlock and unmap an arena and everything allocated from it
+ *
+ * \param arena  arena to destroy, may be NULL; must not be entered by any thread
+ */
+void secure_arena_destroy( s_secure_arena_t *arena );
+
+/**
+ * \brief Allocate zeroed memory from an arena, aligned on 16 bytes
+ *
+ * \param arena  arena to allocate from
+ * \param size   bytes to allocate
+ *
+ * \return NULL if the arena is exhausted
+ */
+void* secure_arena_alloc( s_secure_arena_t *arena, size_t size );
+
+/**
+ * \brief Current position of an arena, to rewind to once the secrets allocated after it are over
+ */
+size_t secure_arena_mark( const s_secure_arena_t *arena );
+
+/**
+ * \brief Wipe and release everything allocated since a mark
+ *
+ * \param arena  arena to rewind
+ * \param mark   position returned by secure_arena_mark
+ */
+void secure_arena_rewind( s_secure_arena_t *arena, size_t mark );
+
+/**
+ * \brief Take the GMP integers of the calling thread from an arena
+ *
+ * \param arena  arena entered
+ *
+ * \return the arena entered before, to give back to secure_arena_leave
+ */
+s_secure_arena_t* secure_arena_enter( s_secure_arena_t *arena );
+
+/**
+ * \brief Restore the arena entered before secure_arena_enter
+ *
+ * \param previous  value returned by the matching secure_arena_enter
+ */
+void secure_arena_leave( s_secure_arena_t *previous );
+
+/**
+ * \brief Arena entered by the calling thread, NULL if none
+ */
+s_secure_arena_t* secure_arena_current( void );
+
+#endif
+//eof
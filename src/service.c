@@ -0,0 +1,473 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file service.c
+ *
+ * \brief Unlocked PKI service on a local Unix domain socket
+ *
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+// struct ucred, for the SO_PEERCRED check of the clients
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "utils.h"
+#include "pki.h"
+#include "pki_request.h"
+#include "lib4s.h"
+#include "service.h"
+
+/**
+ * Client connection, released when neither its reader nor a queued request use it
+ */
+typedef struct SServiceClient {
+	int      fd;
+	unsigned refs;      // protected by the service lock
+} s_service_client_t;
+
+/**
+ * Request waiting in the queue
+ */
+typedef struct SServiceItem {
+	s_service_client_t *client;
+	s_pki_request_t     req;
+	char               *text;       // request as received, executed by the handle of its PKI
+	int                 invalid;
+	char                err[256];   // parsing error of an invalid request
+} s_service_item_t;
+
+typedef struct SService {
+	s4_manager_t       *mgr;
+	unsigned            timeout;
+	int                 listen_fd;
+
+	pthread_mutex_t     lock;
+	pthread_cond_t      not_empty;     // a request was queued, or the service is locked
+	pthread_cond_t      not_full;      // a request was taken, or the service is locked
+	pthread_cond_t      no_client;     // a client was released
+
+	// protected by lock
+	s_service_item_t   *queue;         // ring buffer
+	unsigned            capacity;
+	unsigned            head;
+	unsigned            count;
+	s_service_client_t *clients[MAX_SERVICE_CLIENTS];
+	unsigned            nb_clients;
+	int                 locked;
+
+	// executor only
+	unsigned            nb_done;
+	unsigned            nb_failed;
+	struct timespec     started;
+} s_service_t;
+
+typedef struct SServiceReader {
+	s_service_t        *svc;
+	s_service_client_t *client;
+} s_service_reader_t;
+
+// drop a reference on a client, closing it with the last one
+static void client_release( s_service_t *svc, s_service_client_t *client )
+{
+	pthread_mutex_lock( &(svc->lock) );
+	int last = ( 0 == --client->refs );
+	if( last ) {
+		for( unsigned i=0; i<svc->nb_clients; i++ ) {
+			if( svc->clients[i] == client ) {
+				svc->clients[i] = svc->clients[--svc->nb_clients];
+				break;
+			}
+		}
+		pthread_cond_broadcast( &(svc->no_client) );
+	}
+	pthread_mutex_unlock( &(svc->lock) );
+
+	if( last ) {
+		close( client->fd );
+		free( client );
+	}
+}//eo client_release
+
+// queue a request, waiting for room; -1 once the service is locked
+static int service_push( s_service_t *svc, s_service_item_t *item )
+{
+	pthread_mutex_lock( &(svc->lock) );
+	while( svc->count == svc->capacity && !svc->locked ) {
+		pthread_cond_wait( &(svc->not_full), &(svc->lock) );
+	}
+	if( svc->locked ) {
+		pthread_mutex_unlock( &(svc->lock) );
+		return -1;
+	}
+	item->client->refs++;
+	svc->queue[ (svc->head + svc->count) % svc->capacity ] = *item;
+	svc->count++;
+	pthread_cond_signal( &(svc->not_empty) );
+	pthread_mutex_unlock( &(svc->lock) );
+	return 0;
+}//eo service_push
+
+static void* service_reader( void *data )
+{
+	s_service_reader_t *reader = (s_service_reader_t*)data;
+	s_service_t        *svc    = reader->svc;
+	s_service_client_t *client = reader->client;
+	free( reader );
+
+	char *frame = malloc( MAX_FRAME_SIZE+1 );
+	while( NULL != frame && frame_read( client->fd, frame, MAX_FRAME_SIZE+1 ) > 0 ) {
+		s_service_item_t item;
+		memset( &item, 0, sizeof(item) );
+		item.client  = client;
+		item.invalid = pki_request_parse( frame, &(item.req), item.err, sizeof(item.err) );
+		if( !item.invalid && NULL == (item.text = strdup( frame )) ) {
+			item.invalid = 1;
+			strlcpy( item.err, "out of memory", sizeof(item.err) );
+		}
+
+		if( service_push( svc, &item ) ) {
+			pki_request_free( &(item.req) );
+			free( item.text );
+			break;
+		}
+	}
+
+	free( frame );
+	client_release( svc, client );
+	return NULL;
+}//eo service_reader
+
+// same user as the service only
+static int check_peer( int fd )
+{
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	if( getsockopt( fd, SOL_SOCKET, SO_PEERCRED, &cred, &len ) ) {
+		warn("service: failed to get the client credentials: %s", strerror(errno));
+		return -1;
+	}
+	if( cred.uid != geteuid() ) {
+		warn("service: connection of pid %d refused, uid %u is not the service uid", (int)cred.pid, (unsigned)cred.uid);
+		return -1;
+	}
+	DEBUG_PRN("service: client pid %d accepted", (int)cred.pid);
+	return 0;
+}//eo check_peer
+
+static void* service_acceptor( void *data )
+{
+	s_service_t *svc = (s_service_t*)data;
+
+	for(;;) {
+		int fd = accept( svc->listen_fd, NULL, NULL );
+		if( fd < 0 ) {
+			if( EINTR == errno || ECONNABORTED == errno ) {
+				continue;
+			}
+			// shutdown of the listening socket once locked
+			break;
+		}
+		if( check_peer( fd ) ) {
+			close( fd );
+			continue;
+		}
+
+		s_service_client_t *client = calloc( 1, sizeof(s_service_client_t) );
+		s_service_reader_t *reader = malloc( sizeof(s_service_reader_t) );
+		if( NULL == client || NULL == reader ) {
+			free( client );
+			free( reader );
+			close( fd );
+			continue;
+		}
+		client->fd   = fd;
+		client->refs = 1;
+		reader->svc    = svc;
+		reader->client = client;
+
+		pthread_mutex_lock( &(svc->lock) );
+		int refused = svc->locked || svc->nb_clients == MAX_SERVICE_CLIENTS;
+		if( !refused ) {
+			svc->clients[svc->nb_clients++] = client;
+		}
+		pthread_mutex_unlock( &(svc->lock) );
+
+		pthread_t thread;
+		pthread_attr_t attr;
+		pthread_attr_init( &attr );
+		pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED );
+		if( refused ) {
+			warn("service: too many clients, connection refused");
+			free( reader );
+			free( client );
+			close( fd );
+		} else if( pthread_create( &thread, &attr, service_reader, reader ) ) {
+			warn("service: failed to start a client thread");
+			free( reader );
+			client_release( svc, client );
+		}
+		pthread_attr_destroy( &attr );
+	}
+	return NULL;
+}//eo service_acceptor
+
+// answer a request, the response is dropped if the client is gone
+static void service_reply( s_service_client_t *client, int ok, const char *message )
+{
+	size_t len = strlen( message );
+	char  *out = malloc( len + 8 );
+	if( NULL == out ) {
+		return;
+	}
+	int n = sprintf( out, "%s\n", ok ? "ok" : "error" );
+	memcpy( out+n, message, len );
+	if( frame_write( client->fd, out, n+len ) ) {
+		DEBUG_PRN("service: response lost, client gone");
+	}
+	free( out );
+}//eo service_reply
+
+static double elapsed_since( const struct timespec *start )
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}//eo elapsed_since
+
+// execute one request, 1 when the service has to be locked
+static int service_process( s_service_t *svc, s_service_item_t *item, unsigned queued )
+{
+	s_pki_request_result_t res;
+	int lock = 0;
+
+	if( item->invalid ) {
+		snprintf( res.message, sizeof(res.message), "warning=%s\n", item->err );
+		res.status = -1;
+	} else if( PKIRequestStatus == item->req.op ) {
+		const unsigned nb_pkis = s4_manager_count( svc->mgr );
+		int n = snprintf( res.message, sizeof(res.message),
+			"%s%s%sstate=unlocked\nprocessed=%u\nfailed=%u\nqueued=%u\nidle_timeout=%u\nuptime=%.0f\npkis=%u\n",
+			item->req.id[0] ? "id=" : "", item->req.id, item->req.id[0] ? "\n" : "",
+			svc->nb_done, svc->nb_failed, queued, svc->timeout, elapsed_since( &(svc->started) ), nb_pkis );
+		for( unsigned i=0; i<nb_pkis && n>=0 && (size_t)n<sizeof(res.message); i++ ) {
+			n += snprintf( res.message+n, sizeof(res.message)-n, "pki=%s\n", s4_manager_id( svc->mgr, i ) );
+		}
+		res.status = 0;
+	} else if( PKIRequestLock == item->req.op ) {
+		snprintf( res.message, sizeof(res.message), "%s%s%sstate=locked\n",
+			item->req.id[0] ? "id=" : "", item->req.id, item->req.id[0] ? "\n" : "" );
+		res.status = 0;
+		lock = 1;
+	} else {
+		s4_pki_t *pki = s4_manager_get( svc->mgr, item->req.pki );
+		if( NULL == pki ) {
+			snprintf( res.message, sizeof(res.message), "%s%s%swarning=unknown PKI '%s'\n",
+				item->req.id[0] ? "id=" : "", item->req.id, item->req.id[0] ? "\n" : "", item->req.pki );
+			res.status = -1;
+		} else {
+			res.status = s4_pki_execute( pki, item->text, res.message, sizeof(res.message) );
+		}
+		svc->nb_done++;
+		if( res.status ) {
+			svc->nb_failed++;
+		}
+	}
+
+	service_reply( item->client, 0 == res.status, res.message );
+	pki_request_free( &(item->req) );
+	free( item->text );
+	client_release( svc, item->client );
+	return lock;
+}//eo service_process
+
+// wait for a request until the idle deadline, 0 when locked or timed out
+static int service_pop( s_service_t *svc, s_service_item_t *item, unsigned *queued )
+{
+	struct timespec deadline;
+	clock_gettime( CLOCK_MONOTONIC, &deadline );
+	deadline.tv_sec += svc->timeout;
+
+	pthread_mutex_lock( &(svc->lock) );
+	while( 0 == svc->count && !svc->locked ) {
+		if( ETIMEDOUT == pthread_cond_timedwait( &(svc->not_empty), &(svc->lock), &deadline ) && 0 == svc->count ) {
+			printf("service idle for %u seconds\n", svc->timeout);
+			svc->locked = 1;
+		}
+	}
+	if( svc->locked ) {
+		pthread_mutex_unlock( &(svc->lock) );
+		return 0;
+	}
+	*item = svc->queue[svc->head];
+	svc->head = (svc->head + 1) % svc->capacity;
+	svc->count--;
+	*queued = svc->count;
+	pthread_cond_signal( &(svc->not_full) );
+	pthread_mutex_unlock( &(svc->lock) );
+	return 1;
+}//eo service_pop
+
+// stop the acceptor and the readers, answer the requests left in the queue
+static void service_shutdown( s_service_t *svc, pthread_t acceptor )
+{
+	pthread_mutex_lock( &(svc->lock) );
+	svc->locked = 1;
+	pthread_cond_broadcast( &(svc->not_full) );
+	for( unsigned i=0; i<svc->nb_clients; i++ ) {
+		shutdown( svc->clients[i]->fd, SHUT_RD );
+	}
+	pthread_mutex_unlock( &(svc->lock) );
+
+	shutdown( svc->listen_fd, SHUT_RDWR );
+	pthread_join( acceptor, NULL );
+
+	for(;;) {
+		pthread_mutex_lock( &(svc->lock) );
+		if( 0 == svc->count ) {
+			pthread_mutex_unlock( &(svc->lock) );
+			break;
+		}
+		s_service_item_t item = svc->queue[svc->head];
+		svc->head = (svc->head + 1) % svc->capacity;
+		svc->count--;
+		pthread_mutex_unlock( &(svc->lock) );
+
+		service_reply( item.client, 0, "state=locked\n" );
+		pki_request_free( &(item.req) );
+		free( item.text );
+		client_release( svc, item.client );
+	}
+
+	pthread_mutex_lock( &(svc->lock) );
+	while( svc->nb_clients > 0 ) {
+		pthread_cond_wait( &(svc->no_client), &(svc->lock) );
+	}
+	pthread_mutex_unlock( &(svc->lock) );
+}//eo service_shutdown
+
+static int service_listen( const char *socket_path )
+{
+	struct sockaddr_un addr;
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	if( strlcpy( addr.sun_path, socket_path, sizeof(addr.sun_path) ) >= sizeof(addr.sun_path) ) {
+		warn("service: socket path too long: %s", socket_path);
+		return -1;
+	}
+
+	// a stale socket of a previous service is replaced, nothing else
+	struct stat st;
+	if( 0 == lstat( socket_path, &st ) ) {
+		if( !S_ISSOCK( st.st_mode ) ) {
+			warn("service: %s exists and is not a socket", socket_path);
+			return -1;
+		}
+		unlink( socket_path );
+	}
+
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd < 0 ) {
+		warn("service: socket creation failed: %s", strerror(errno));
+		return -1;
+	}
+
+	// the socket file is only reachable by the service user
+	mode_t old_mask = umask( 0077 );
+	int err = bind( fd, (struct sockaddr*)&addr, sizeof(addr) );
+	umask( old_mask );
+	if( err || listen( fd, MAX_SERVICE_CLIENTS ) ) {
+		warn("service: failed to listen on %s: %s", socket_path, strerror(errno));
+		close( fd );
+		return -1;
+	}
+	return fd;
+}//eo service_listen
+
+int service_run( s4_manager_t *mgr, const char *socket_path, const unsigned timeout, const unsigned queue_size )
+{
+	assert( NULL!=mgr );
+	assert( NULL!=socket_path );
+
+	s_service_t svc;
+	memset( &svc, 0, sizeof(svc) );
+	svc.mgr      = mgr;
+	svc.timeout  = timeout > 0 ? timeout : DEFAULT_SERVICE_TIMEOUT;
+	svc.capacity = ( queue_size > 0 && queue_size <= MAX_SERVICE_QUEUE ) ? queue_size : DEFAULT_SERVICE_QUEUE;
+	clock_gettime( CLOCK_MONOTONIC, &(svc.started) );
+
+	svc.queue = calloc( svc.capacity, sizeof(s_service_item_t) );
+	if( NULL == svc.queue ) {
+		warn("service: failed to allocate a queue of %u requests", svc.capacity);
+		return -1;
+	}
+
+	svc.listen_fd = service_listen( socket_path );
+	if( svc.listen_fd < 0 ) {
+		free( svc.queue );
+		return -1;
+	}
+
+	// a client leaving before its response must not kill the service
+	signal( SIGPIPE, SIG_IGN );
+
+	pthread_condattr_t cattr;
+	pthread_condattr_init( &cattr );
+	pthread_condattr_setclock( &cattr, CLOCK_MONOTONIC );
+	pthread_mutex_init( &(svc.lock), NULL );
+	pthread_cond_init( &(svc.not_empty), &cattr );
+	pthread_cond_init( &(svc.not_full), NULL );
+	pthread_cond_init( &(svc.no_client), NULL );
+	pthread_condattr_destroy( &cattr );
+
+	int res = -1;
+	pthread_t acceptor;
+	if( pthread_create( &acceptor, NULL, service_acceptor, &svc ) ) {
+		warn("service: failed to start the connection thread");
+	} else {
+		printf("service listening on %s (PKIs:%u, queue:%u, idle timeout:%us)\n", socket_path, s4_manager_count( mgr ), svc.capacity, svc.timeout);
+		fflush( stdout );
+
+		s_service_item_t item;
+		unsigned queued = 0;
+		while( service_pop( &svc, &item, &queued ) ) {
+			if( service_process( &svc, &item, queued ) ) {
+				break;
+			}
+		}
+
+		service_shutdown( &svc, acceptor );
+		printf("service locked: %u request(s) executed, %u failed\n", svc.nb_done, svc.nb_failed);
+		res = 0;
+	}
+
+	close( svc.listen_fd );
+	unlink( socket_path );
+	pthread_cond_destroy( &(svc.no_client) );
+	pthread_cond_destroy( &(svc.not_full) );
+	pthread_cond_destroy( &(svc.not_empty) );
+	pthread_mutex_destroy( &(svc.lock) );
+	free( svc.queue );
+	return res;
+}//eo service_run
+
+//eof
@@ -0,0 +1,52 @@
+/**
+ *
+ * \file service.h
+ *
+ * \brief Unlocked PKI service on a local Unix domain socket
+ *
+ * Once the quorum rebuilt the root passphrases, the service executes the
+ * requests of local clients on the PKIs of a manager until it is locked or
+ * stays idle too long. A request names its PKI with a "pki" parameter, the
+ * first PKI of the manager is used without it.
+ *
+ * Protocol: each message is a frame (see frame_write). A request is the text
+ * form parsed by pki_request_parse; the response starts with a "ok" or
+ * "error" line followed by "key=value" lines. The requests of all the
+ * clients go through a bounded queue and are executed one at a time, the
+ * responses of a client come in the order of its requests.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#if !defined( _S4_SERVICE_H_ )
+#define _S4_SERVICE_H_
+
+#include "lib4s.h"
+
+#define DEFAULT_SERVICE_TIMEOUT  (600)    // seconds without request before locking
+#define DEFAULT_SERVICE_QUEUE    (64)
+#define MAX_SERVICE_QUEUE        (4096)
+#define MAX_SERVICE_CLIENTS      (16)
+
+/**
+ * \brief Serve the PKI requests until the service is locked
+ *
+ * Only the processes of the same user as the service are accepted. The
+ * service is locked by a "lock" request, or after timeout seconds without
+ * any request.
+ *
+ * \param mgr          manager of the unlocked PKIs to serve
+ * \param socket_path  path of the Unix domain socket to create
+ * \param timeout      idle time before locking, in seconds
+ * \param queue_size   number of requests waiting for execution, the clients
+ *                     beyond are blocked until room is made
+ *
+ * \return 0 once locked, -1 if the service could not start
+ */
+int service_run( s4_manager_t *mgr, const char *socket_path, const unsigned timeout, const unsigned queue_size );
+
+#endif
+//eof
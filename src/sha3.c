@@ -21,6 +21,8 @@
  * Canonical implementation of Init/Update/Finalize for SHA-3 byte input. 
  *
  * SHA3-256, SHA3-384, SHA-512 are implemented. SHA-224 can easily be added.
+ * SHAKE128/256 and cSHAKE128/256 (NIST SP 800-185) extendable output
+ * functions share the same sponge.
  *
  * Based on code from http://keccak.noekeon.org/ .
  *
@@ -37,7 +39,6 @@
 #include <string.h>
 #include <assert.h>
 
-//#define DEEPDEBUG 1
 
 #include "utils.h"
 
@@ -79,6 +80,16 @@ static const uint64_t keccakf_rndc[24] = {
     SHA3_CONST(0x0000000080000001UL), SHA3_CONST(0x8000000080008008UL)
 };
 
+#define KECCAK_ROUNDS 24
+
+/* 4-way multi-buffer SHA3 on AVX2, selected at run time */
+#if !defined(SHA3_KECCAK_REFERENCE) && defined(__GNUC__) && \
+        (defined(__x86_64__) || defined(__i386__))
+#define SHA3_X4_AVX2 1
+#endif
+
+#if defined(SHA3_KECCAK_REFERENCE)
+
 static const unsigned keccakf_rotc[24] = {
     1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62,
     18, 39, 61, 20, 44
@@ -97,8 +108,6 @@ static void keccakf(uint64_t s[25])
     int i, j, round;
     uint64_t t, bc[5];
 
-#define KECCAK_ROUNDS 24
-
     for(round = 0; round < KECCAK_ROUNDS; round++) {
 
         /* Theta */
@@ -131,6 +140,186 @@ static void keccakf(uint64_t s[25])
         /* Iota */
         s[0] ^= keccakf_rndc[round];
     }
+}//eo keccakf (reference)
+
+#else
+
+/*
+ * Optimised Keccak-f[1600]: the 24 rounds are fully unrolled on 50 local
+ * lanes (the state alternates between the A.. and E.. sets, so no copy nor
+ * index arithmetic is needed) and the "lane complementing" transform of the
+ * Keccak team implementation overview replaces most of the NOT of Chi by
+ * OR: lanes 1, 2, 8, 12, 17 and 20 are kept complemented during the
+ * permutation and restored at its end.
+ */
+
+#define KECCAK_ROUND(A,E,i)                                                   \
+    Da = Cu ^ SHA3_ROTL64(Ce, 1);                                             \
+    De = Ca ^ SHA3_ROTL64(Ci, 1);                                             \
+    Di = Ce ^ SHA3_ROTL64(Co, 1);                                             \
+    Do = Ci ^ SHA3_ROTL64(Cu, 1);                                             \
+    Du = Co ^ SHA3_ROTL64(Ca, 1);                                             \
+                                                                              \
+    A##ba ^= Da; Bba = A##ba;                                                 \
+    A##ge ^= De; Bbe = SHA3_ROTL64(A##ge, 44);                                \
+    A##ki ^= Di; Bbi = SHA3_ROTL64(A##ki, 43);                                \
+    A##mo ^= Do; Bbo = SHA3_ROTL64(A##mo, 21);                                \
+    A##su ^= Du; Bbu = SHA3_ROTL64(A##su, 14);                                \
+    E##ba =   Bba ^(  Bbe |  Bbi );                                           \
+    E##ba ^= keccakf_rndc[i];                                                 \
+    Ca = E##ba;                                                               \
+    E##be =   Bbe ^((~Bbi)|  Bbo );  Ce = E##be;                              \
+    E##bi =   Bbi ^(  Bbo &  Bbu );  Ci = E##bi;                              \
+    E##bo =   Bbo ^(  Bbu |  Bba );  Co = E##bo;                              \
+    E##bu =   Bbu ^(  Bba &  Bbe );  Cu = E##bu;                              \
+                                                                              \
+    A##bo ^= Do; Bga = SHA3_ROTL64(A##bo, 28);                                \
+    A##gu ^= Du; Bge = SHA3_ROTL64(A##gu, 20);                                \
+    A##ka ^= Da; Bgi = SHA3_ROTL64(A##ka,  3);                                \
+    A##me ^= De; Bgo = SHA3_ROTL64(A##me, 45);                                \
+    A##si ^= Di; Bgu = SHA3_ROTL64(A##si, 61);                                \
+    E##ga =   Bga ^(  Bge |  Bgi );  Ca ^= E##ga;                             \
+    E##ge =   Bge ^(  Bgi &  Bgo );  Ce ^= E##ge;                             \
+    E##gi =   Bgi ^(  Bgo |(~Bgu));  Ci ^= E##gi;                             \
+    E##go =   Bgo ^(  Bgu |  Bga );  Co ^= E##go;                             \
+    E##gu =   Bgu ^(  Bga &  Bge );  Cu ^= E##gu;                             \
+                                                                              \
+    A##be ^= De; Bka = SHA3_ROTL64(A##be,  1);                                \
+    A##gi ^= Di; Bke = SHA3_ROTL64(A##gi,  6);                                \
+    A##ko ^= Do; Bki = SHA3_ROTL64(A##ko, 25);                                \
+    A##mu ^= Du; Bko = SHA3_ROTL64(A##mu,  8);                                \
+    A##sa ^= Da; Bku = SHA3_ROTL64(A##sa, 18);                                \
+    E##ka =   Bka ^(  Bke |  Bki );  Ca ^= E##ka;                             \
+    E##ke =   Bke ^(  Bki &  Bko );  Ce ^= E##ke;                             \
+    E##ki =   Bki ^((~Bko)&  Bku );  Ci ^= E##ki;                             \
+    E##ko = (~Bko)^(  Bku |  Bka );  Co ^= E##ko;                             \
+    E##ku =   Bku ^(  Bka &  Bke );  Cu ^= E##ku;                             \
+                                                                              \
+    A##bu ^= Du; Bma = SHA3_ROTL64(A##bu, 27);                                \
+    A##ga ^= Da; Bme = SHA3_ROTL64(A##ga, 36);                                \
+    A##ke ^= De; Bmi = SHA3_ROTL64(A##ke, 10);                                \
+    A##mi ^= Di; Bmo = SHA3_ROTL64(A##mi, 15);                                \
+    A##so ^= Do; Bmu = SHA3_ROTL64(A##so, 56);                                \
+    E##ma =   Bma ^(  Bme &  Bmi );  Ca ^= E##ma;                             \
+    E##me =   Bme ^(  Bmi |  Bmo );  Ce ^= E##me;                             \
+    E##mi =   Bmi ^((~Bmo)|  Bmu );  Ci ^= E##mi;                             \
+    E##mo = (~Bmo)^(  Bmu &  Bma );  Co ^= E##mo;                             \
+    E##mu =   Bmu ^(  Bma |  Bme );  Cu ^= E##mu;                             \
+                                                                              \
+    A##bi ^= Di; Bsa = SHA3_ROTL64(A##bi, 62);                                \
+    A##go ^= Do; Bse = SHA3_ROTL64(A##go, 55);                                \
+    A##ku ^= Du; Bsi = SHA3_ROTL64(A##ku, 39);                                \
+    A##ma ^= Da; Bso = SHA3_ROTL64(A##ma, 41);                                \
+    A##se ^= De; Bsu = SHA3_ROTL64(A##se,  2);                                \
+    E##sa =   Bsa ^((~Bse)&  Bsi );  Ca ^= E##sa;                             \
+    E##se = (~Bse)^(  Bsi |  Bso );  Ce ^= E##se;                             \
+    E##si =   Bsi ^(  Bso &  Bsu );  Ci ^= E##si;                             \
+    E##so =   Bso ^(  Bsu |  Bsa );  Co ^= E##so;                             \
+    E##su =   Bsu ^(  Bsa &  Bse );  Cu ^= E##su;
+
+/* The permutation body is shared by the scalar and the multi-buffer
+ * versions: lane_t is either uint64_t or a vector of 64 bits lanes.
+ */
+#define KECCAK_LANES(lane_t)                                                  \
+    lane_t Aba, Abe, Abi, Abo, Abu, Aga, Age, Agi, Ago, Agu, Aka, Ake, Aki;   \
+    lane_t Ako, Aku, Ama, Ame, Ami, Amo, Amu, Asa, Ase, Asi, Aso, Asu;        \
+    lane_t Eba, Ebe, Ebi, Ebo, Ebu, Ega, Ege, Egi, Ego, Egu, Eka, Eke, Eki;   \
+    lane_t Eko, Eku, Ema, Eme, Emi, Emo, Emu, Esa, Ese, Esi, Eso, Esu;        \
+    lane_t Bba, Bbe, Bbi, Bbo, Bbu, Bga, Bge, Bgi, Bgo, Bgu, Bka, Bke, Bki;   \
+    lane_t Bko, Bku, Bma, Bme, Bmi, Bmo, Bmu, Bsa, Bse, Bsi, Bso, Bsu;        \
+    lane_t Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du
+
+#define KECCAK_LOAD(s)                                                        \
+    Aba =  s[ 0]; Abe = ~s[ 1]; Abi = ~s[ 2]; Abo =  s[ 3]; Abu =  s[ 4];     \
+    Aga =  s[ 5]; Age =  s[ 6]; Agi =  s[ 7]; Ago = ~s[ 8]; Agu =  s[ 9];     \
+    Aka =  s[10]; Ake =  s[11]; Aki = ~s[12]; Ako =  s[13]; Aku =  s[14];     \
+    Ama =  s[15]; Ame =  s[16]; Ami = ~s[17]; Amo =  s[18]; Amu =  s[19];     \
+    Asa = ~s[20]; Ase =  s[21]; Asi =  s[22]; Aso =  s[23]; Asu =  s[24];     \
+                                                                              \
+    Ca = Aba ^ Aga ^ Aka ^ Ama ^ Asa;                                         \
+    Ce = Abe ^ Age ^ Ake ^ Ame ^ Ase;                                         \
+    Ci = Abi ^ Agi ^ Aki ^ Ami ^ Asi;                                         \
+    Co = Abo ^ Ago ^ Ako ^ Amo ^ Aso;                                         \
+    Cu = Abu ^ Agu ^ Aku ^ Amu ^ Asu
+
+#define KECCAK_24_ROUNDS()                                                    \
+    KECCAK_ROUND(A,E, 0)  KECCAK_ROUND(E,A, 1)                                \
+    KECCAK_ROUND(A,E, 2)  KECCAK_ROUND(E,A, 3)                                \
+    KECCAK_ROUND(A,E, 4)  KECCAK_ROUND(E,A, 5)                                \
+    KECCAK_ROUND(A,E, 6)  KECCAK_ROUND(E,A, 7)                                \
+    KECCAK_ROUND(A,E, 8)  KECCAK_ROUND(E,A, 9)                                \
+    KECCAK_ROUND(A,E,10)  KECCAK_ROUND(E,A,11)                                \
+    KECCAK_ROUND(A,E,12)  KECCAK_ROUND(E,A,13)                                \
+    KECCAK_ROUND(A,E,14)  KECCAK_ROUND(E,A,15)                                \
+    KECCAK_ROUND(A,E,16)  KECCAK_ROUND(E,A,17)                                \
+    KECCAK_ROUND(A,E,18)  KECCAK_ROUND(E,A,19)                                \
+    KECCAK_ROUND(A,E,20)  KECCAK_ROUND(E,A,21)                                \
+    KECCAK_ROUND(A,E,22)  KECCAK_ROUND(E,A,23)
+
+#define KECCAK_STORE(s)                                                       \
+    s[ 0] =  Aba; s[ 1] = ~Abe; s[ 2] = ~Abi; s[ 3] =  Abo; s[ 4] =  Abu;     \
+    s[ 5] =  Aga; s[ 6] =  Age; s[ 7] =  Agi; s[ 8] = ~Ago; s[ 9] =  Agu;     \
+    s[10] =  Aka; s[11] =  Ake; s[12] = ~Aki; s[13] =  Ako; s[14] =  Aku;     \
+    s[15] =  Ama; s[16] =  Ame; s[17] = ~Ami; s[18] =  Amo; s[19] =  Amu;     \
+    s[20] = ~Asa; s[21] =  Ase; s[22] =  Asi; s[23] =  Aso; s[24] =  Asu
+
+static void keccakf(uint64_t s[25])
+{
+    KECCAK_LANES(uint64_t);
+
+    KECCAK_LOAD(s);
+    KECCAK_24_ROUNDS()
+    KECCAK_STORE(s);
+}//eo keccakf
+
+#endif // SHA3_KECCAK_REFERENCE
+
+/* Little endian 64 bits load from a possibly unaligned buffer: the memcpy
+ * is turned into a single load by the compiler.
+ */
+static inline uint64_t sha3_load64(const uint8_t *p)
+{
+    uint64_t t;
+    memcpy(&t, p, sizeof(t));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    t = __builtin_bswap64(t);
+#endif
+    return t;
+}
+
+/* Little endian 64 bits store to a possibly unaligned buffer */
+static inline void sha3_store64(uint8_t *p, uint64_t t)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    t = __builtin_bswap64(t);
+#endif
+    memcpy(p, &t, sizeof(t));
+}
+
+/* XOR the domain suffix (with the first padding bit) after the buffered
+ * bytes and the last padding bit at the end of the rate, then permute.
+ */
+static void sha3_pad(sha3_context *ctx, const uint8_t suffix)
+{
+    ctx->s[ctx->wordIndex] ^=
+            (ctx->saved ^ ((uint64_t) suffix << ((ctx->byteIndex) * 8)));
+    ctx->s[SHA3_KECCAK_SPONGE_WORDS - ctx->capacityWords - 1] ^=
+            SHA3_CONST(0x8000000000000000UL);
+    keccakf(ctx->s);
+}
+
+/* left_encode of NIST SP 800-185: the minimal big endian encoding of x
+ * preceded by its size in bytes
+ */
+static size_t sha3_left_encode(uint8_t out[9], const uint64_t x)
+{
+    size_t n = 1, i;
+    while (n < sizeof(uint64_t) && (x >> (8 * n)))
+        n++;
+    out[0] = (uint8_t) n;
+    for(i = 1; i <= n; i++)
+        out[i] = (uint8_t) (x >> (8 * (n - i)));
+    return n + 1;
 }
 
 /* *************************** Public Inteface ************************ */
@@ -157,6 +346,63 @@ void sha3_init512( sha3_context *priv)
     ctx->capacityWords = 2 * 512 / (8 * sizeof(uint64_t));
 }
 
+/* SHAKE: suffix 1111, cSHAKE: suffix 00, both followed by the pad10*1 first bit */
+#define SHA3_SHAKE_SUFFIX  (0x1F)
+#define SHA3_CSHAKE_SUFFIX (0x04)
+
+static void cshake_init( sha3_context *ctx, const unsigned capacityWords,
+        const void *name, size_t name_len, const void *custom, size_t custom_len)
+{
+    const size_t rate = (SHA3_KECCAK_SPONGE_WORDS - capacityWords) * sizeof(uint64_t);
+    uint8_t enc[9];
+    size_t pos;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->capacityWords = capacityWords;
+
+    /* cSHAKE with empty N and S is SHAKE */
+    if(0 == name_len && 0 == custom_len) {
+        ctx->xofSuffix = SHA3_SHAKE_SUFFIX;
+        return;
+    }
+    ctx->xofSuffix = SHA3_CSHAKE_SUFFIX;
+
+    /* bytepad(encode_string(N) || encode_string(S), rate) */
+    sha3_update(ctx, enc, sha3_left_encode(enc, rate));
+    sha3_update(ctx, enc, sha3_left_encode(enc, (uint64_t) name_len * 8));
+    sha3_update(ctx, name, name_len);
+    sha3_update(ctx, enc, sha3_left_encode(enc, (uint64_t) custom_len * 8));
+    sha3_update(ctx, custom, custom_len);
+
+    pos = ctx->wordIndex * sizeof(uint64_t) + ctx->byteIndex;
+    if(pos) {
+        uint8_t zeros[SHA3_KECCAK_SPONGE_WORDS * 8];
+        memset(zeros, 0, sizeof(zeros));
+        sha3_update(ctx, zeros, rate - pos);
+    }
+    assert(0 == ctx->wordIndex && 0 == ctx->byteIndex);
+}//eo cshake_init
+
+void shake128_init( sha3_context *priv)
+{
+    cshake_init(priv, 2 * 128 / (8 * sizeof(uint64_t)), NULL, 0, NULL, 0);
+}
+
+void shake256_init( sha3_context *priv)
+{
+    cshake_init(priv, 2 * 256 / (8 * sizeof(uint64_t)), NULL, 0, NULL, 0);
+}
+
+void cshake128_init( sha3_context *priv, const void *name, size_t name_len, const void *custom, size_t custom_len)
+{
+    cshake_init(priv, 2 * 128 / (8 * sizeof(uint64_t)), name, name_len, custom, custom_len);
+}
+
+void cshake256_init( sha3_context *priv, const void *name, size_t name_len, const void *custom, size_t custom_len)
+{
+    cshake_init(priv, 2 * 256 / (8 * sizeof(uint64_t)), name, name_len, custom, custom_len);
+}
+
 void sha3_update( sha3_context *priv, void const *bufIn, size_t len)
 {
     sha3_context *ctx = (sha3_context *) priv;
@@ -167,13 +413,15 @@ void sha3_update( sha3_context *priv, void const *bufIn, size_t len)
     size_t words;
     unsigned tail;
     size_t i;
+    unsigned rateWords;
 
     const uint8_t *buf = bufIn;
 
-    DDEBUG_PRN("called to update with:", buf, len);
+    DDEBUG_PRN("called to update with %zu bytes", len);
 
     assert(ctx->byteIndex < 8);
     assert(ctx->wordIndex < sizeof(ctx->s) / sizeof(ctx->s[0]));
+    assert(!ctx->squeezing);
 
     if(len < old_tail) {        /* have no complete word or haven't started 
                                  * the word yet */
@@ -208,31 +456,36 @@ void sha3_update( sha3_context *priv, void const *bufIn, size_t len)
 
     assert(ctx->byteIndex == 0);
 
+    rateWords = SHA3_KECCAK_SPONGE_WORDS - ctx->capacityWords;
     words = len / sizeof(uint64_t);
     tail = len - words * sizeof(uint64_t);
 
     DDEBUG_PRN("have %d full words to process", (unsigned)words);
 
-    for(i = 0; i < words; i++, buf += sizeof(uint64_t)) {
-        const uint64_t t = (uint64_t) (buf[0]) |
-                ((uint64_t) (buf[1]) << 8 * 1) |
-                ((uint64_t) (buf[2]) << 8 * 2) |
-                ((uint64_t) (buf[3]) << 8 * 3) |
-                ((uint64_t) (buf[4]) << 8 * 4) |
-                ((uint64_t) (buf[5]) << 8 * 5) |
-                ((uint64_t) (buf[6]) << 8 * 6) |
-                ((uint64_t) (buf[7]) << 8 * 7);
-#if defined(__x86_64__ ) || defined(__i386__)
-        assert(memcmp(&t, buf, 8) == 0);
-#endif
-        ctx->s[ctx->wordIndex] ^= t;
-        if(++ctx->wordIndex ==
-                (SHA3_KECCAK_SPONGE_WORDS - ctx->capacityWords)) {
+    /* complete the current block word by word */
+    while (words && ctx->wordIndex) {
+        ctx->s[ctx->wordIndex] ^= sha3_load64(buf);
+        buf += sizeof(uint64_t);
+        words--;
+        if(++ctx->wordIndex == rateWords) {
             keccakf(ctx->s);
             ctx->wordIndex = 0;
         }
     }
 
+    /* block aligned: absorb whole rate-sized blocks */
+    while (words >= rateWords) {
+        for(i = 0; i < rateWords; i++)
+            ctx->s[i] ^= sha3_load64(buf + i * sizeof(uint64_t));
+        keccakf(ctx->s);
+        buf += rateWords * sizeof(uint64_t);
+        words -= rateWords;
+    }
+
+    /* start of the next block */
+    for(i = 0; i < words; i++, buf += sizeof(uint64_t))
+        ctx->s[ctx->wordIndex++] ^= sha3_load64(buf);
+
     DDEBUG_PRN("have %d bytes left to process, save them", (unsigned)tail);
 
     /* finally, save the partial word */
@@ -242,7 +495,7 @@ void sha3_update( sha3_context *priv, void const *bufIn, size_t len)
         ctx->saved |= (uint64_t) (*(buf++)) << ((ctx->byteIndex++) * 8);
     }
     assert(ctx->byteIndex < 8);
-    DDEBUG_PRN("Have saved=0x016 PRIx64  at the end %x", ctx->saved);
+    DDEBUG_PRN("Have saved=0x%016llx at the end", (unsigned long long)ctx->saved);
 }
 
 /* This is simply the 'update' with the padding block.
@@ -262,25 +515,19 @@ void const * sha3_finalize( sha3_context *priv)
 
 #ifndef SHA3_USE_KECCAK
     /* SHA3 version */
-    ctx->s[ctx->wordIndex] ^=
-            (ctx->saved ^ ((uint64_t) ((uint64_t) (0x02 | (1 << 2)) <<
-                            ((ctx->byteIndex) * 8))));
+    sha3_pad(ctx, 0x02 | (1 << 2));
 #else
     /* For testing the "pure" Keccak version */
-    ctx->s[ctx->wordIndex] ^=
-            (ctx->saved ^ ((uint64_t) ((uint64_t) 1 << (ctx->byteIndex *
-                                    8))));
+    sha3_pad(ctx, 1);
 #endif
 
-    ctx->s[SHA3_KECCAK_SPONGE_WORDS - ctx->capacityWords - 1] ^=
-            SHA3_CONST(0x8000000000000000UL);
-    keccakf(ctx->s);
-
     /* Return first bytes of the ctx->s. This conversion is not needed for
      * little-endian platforms e.g. wrap with #if !defined(__BYTE_ORDER__)
      * || !defined(__ORDER_LITTLE_ENDIAN__) || \
      * __BYTE_ORDER__!=__ORDER_LITTLE_ENDIAN__ ... the conversion below ...
      * #endif */
+#if !defined(__BYTE_ORDER__) || !defined(__ORDER_LITTLE_ENDIAN__) || \
+        __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
     {
         unsigned i;
         for(i = 0; i < SHA3_KECCAK_SPONGE_WORDS; i++) {
@@ -296,6 +543,7 @@ void const * sha3_finalize( sha3_context *priv)
             ctx->sb[i * 8 + 7] = (uint8_t) (t2 >> 24);
         }
     }
+#endif
 
     DEBUG_PRN("Hash (first 128bits): " \
             "%02x%02x%02x%02x %02x%02x%02x%02x - %02x%02x%02x%02x %02x%02x%02x%02x",
@@ -308,4 +556,202 @@ void const * sha3_finalize( sha3_context *priv)
     return (ctx->sb);
 }//eo sha3_Finalize
 
+void sha3_xof_squeeze( sha3_context *priv, void *out, size_t len)
+{
+    sha3_context *ctx = (sha3_context *) priv;
+    const unsigned rate = (SHA3_KECCAK_SPONGE_WORDS - ctx->capacityWords) * sizeof(uint64_t);
+    uint8_t *o = out;
+
+    assert(0 != ctx->xofSuffix);
+
+    if(!ctx->squeezing) {
+        sha3_pad(ctx, (uint8_t) ctx->xofSuffix);
+        ctx->squeezing = 1;
+        ctx->squeezeIndex = 0;
+    }
+
+    while (len) {
+        unsigned n;
+
+        if(ctx->squeezeIndex == rate) {
+            keccakf(ctx->s);
+            ctx->squeezeIndex = 0;
+        }
+        n = rate - ctx->squeezeIndex;
+        if(n > len)
+            n = len;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        memcpy(o, ctx->sb + ctx->squeezeIndex, n);
+#else
+        {
+            unsigned i;
+            for(i = 0; i < n; i++) {
+                const unsigned b = ctx->squeezeIndex + i;
+                o[i] = (uint8_t) (ctx->s[b / 8] >> (8 * (b % 8)));
+            }
+        }
+#endif
+        o += n;
+        len -= n;
+        ctx->squeezeIndex += n;
+    }
+}//eo sha3_xof_squeeze
+
+void sha3_256( void const *buf, size_t len, uint8_t *out)
+{
+    sha3_context ctx;
+
+    sha3_init256(&ctx);
+    sha3_update(&ctx, buf, len);
+    memcpy(out, sha3_finalize(&ctx), SHA3_256_DIGEST_LEN);
+    memset(&ctx, 0, sizeof(ctx));
+}//eo sha3_256
+
+#if defined(SHA3_X4_AVX2)
+
+/* Lane k of the vector holds the word of the k-th message: with GCC vector
+ * extensions the same permutation body compiles to 256 bits AVX2 operations.
+ */
+typedef uint64_t sha3_v4 __attribute__ ((vector_size(SHA3_X4_LANES * sizeof(uint64_t))));
+
+__attribute__ ((target("avx2")))
+static void keccakf_x4(sha3_v4 s[25])
+{
+    KECCAK_LANES(sha3_v4);
+
+    KECCAK_LOAD(s);
+    KECCAK_24_ROUNDS()
+    KECCAK_STORE(s);
+}//eo keccakf_x4
+
+/* The 4 messages are absorbed together, their padded last block included,
+ * as long as none of them is over; the longer ones are then finished one by
+ * one from their lane of the state.
+ */
+__attribute__ ((target("avx2")))
+static void sha3_256_x4_avx2( void const *bufs[SHA3_X4_LANES], const size_t lens[SHA3_X4_LANES],
+                              uint8_t *outs[SHA3_X4_LANES])
+{
+    const unsigned capacityWords = 2 * 256 / (8 * sizeof(uint64_t));
+    const unsigned rateWords = SHA3_KECCAK_SPONGE_WORDS - capacityWords;
+    const size_t rate = rateWords * sizeof(uint64_t);
+
+    sha3_v4 s[SHA3_KECCAK_SPONGE_WORDS];
+    uint8_t last[SHA3_X4_LANES][SHA3_KECCAK_SPONGE_WORDS * 8];
+    size_t  full[SHA3_X4_LANES];
+    size_t  blocks = SIZE_MAX;
+    size_t  b;
+    unsigned k, w;
+
+    for(k = 0; k < SHA3_X4_LANES; k++) {
+        const uint8_t *buf = bufs[k];
+        const size_t rem = lens[k] % rate;
+
+        full[k] = lens[k] / rate;
+        memset(last[k], 0, rate);
+        memcpy(last[k], buf + full[k] * rate, rem);
+        last[k][rem] ^= 0x06;
+        last[k][rate - 1] ^= 0x80;
+
+        if(full[k] + 1 < blocks)
+            blocks = full[k] + 1;
+    }
+
+    memset(s, 0, sizeof(s));
+    for(b = 0; b < blocks; b++) {
+        const uint8_t *p[SHA3_X4_LANES];
+        for(k = 0; k < SHA3_X4_LANES; k++)
+            p[k] = (b < full[k]) ? (const uint8_t *) bufs[k] + b * rate : last[k];
+
+        for(w = 0; w < rateWords; w++) {
+            const size_t o = w * sizeof(uint64_t);
+            const sha3_v4 t = { sha3_load64(p[0] + o), sha3_load64(p[1] + o),
+                                sha3_load64(p[2] + o), sha3_load64(p[3] + o) };
+            s[w] ^= t;
+        }
+        keccakf_x4(s);
+    }
+
+    for(k = 0; k < SHA3_X4_LANES; k++) {
+        if(full[k] + 1 == blocks) {
+            for(w = 0; w < SHA3_256_DIGEST_LEN / sizeof(uint64_t); w++)
+                sha3_store64(outs[k] + w * sizeof(uint64_t), s[w][k]);
+        } else {
+            sha3_context ctx;
+            memset(&ctx, 0, sizeof(ctx));
+            ctx.capacityWords = capacityWords;
+            for(w = 0; w < SHA3_KECCAK_SPONGE_WORDS; w++)
+                ctx.s[w] = s[w][k];
+            sha3_update(&ctx, (const uint8_t *) bufs[k] + blocks * rate, lens[k] - blocks * rate);
+            memcpy(outs[k], sha3_finalize(&ctx), SHA3_256_DIGEST_LEN);
+            secure_memzero(&ctx, sizeof(ctx));
+        }
+    }
+
+    // the messages may be secrets (Shamir shares)
+    secure_memzero(last, sizeof(last));
+    secure_memzero(s, sizeof(s));
+}//eo sha3_256_x4_avx2
+
+#endif // SHA3_X4_AVX2
+
+int sha3_x4_accelerated()
+{
+#if defined(SHA3_X4_AVX2)
+    static int avx2 = -1;
+    if(avx2 < 0) {
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+        DEBUG_PRN("SHA3 multi-buffer: %s", avx2 ? "AVX2" : "scalar");
+    }
+    return avx2;
+#else
+    return 0;
+#endif
+}//eo sha3_x4_accelerated
+
+void sha3_256_x4( void const *bufs[SHA3_X4_LANES], const size_t lens[SHA3_X4_LANES],
+                  uint8_t *outs[SHA3_X4_LANES])
+{
+    unsigned k;
+
+#if defined(SHA3_X4_AVX2)
+    if(sha3_x4_accelerated()) {
+        sha3_256_x4_avx2(bufs, lens, outs);
+        return;
+    }
+#endif
+    for(k = 0; k < SHA3_X4_LANES; k++)
+        sha3_256(bufs[k], lens[k], outs[k]);
+}//eo sha3_256_x4
+
+void sha3_256_multi( const unsigned nb, void const **bufs, const size_t *lens, uint8_t **outs)
+{
+    unsigned i = 0;
+
+    for(; i + SHA3_X4_LANES <= nb; i += SHA3_X4_LANES)
+        sha3_256_x4(bufs + i, lens + i, outs + i);
+
+    if(nb - i > 1 && sha3_x4_accelerated()) {
+        // fill the unused lanes with empty messages
+        void const *b[SHA3_X4_LANES] = { "", "", "", "" };
+        size_t l[SHA3_X4_LANES] = { 0, 0, 0, 0 };
+        uint8_t unused[SHA3_X4_LANES][SHA3_256_DIGEST_LEN];
+        uint8_t *o[SHA3_X4_LANES] = { unused[0], unused[1], unused[2], unused[3] };
+        unsigned k;
+
+        for(k = 0; i + k < nb; k++) {
+            b[k] = bufs[i + k];
+            l[k] = lens[i + k];
+            o[k] = outs[i + k];
+        }
+        sha3_256_x4(b, l, o);
+        return;
+    }
+
+    for(; i < nb; i++)
+        sha3_256(bufs[i], lens[i], outs[i]);
+}//eo sha3_256_multi
+
 //eof
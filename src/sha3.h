@@ -15,6 +15,11 @@
 
 
 
+#define SHA3_256_DIGEST_LEN (32)
+
+/* Number of messages hashed at once by the multi-buffer interface */
+#define SHA3_X4_LANES (4)
+
 /* 'Words' here refers to uint64_t */
 #define SHA3_KECCAK_SPONGE_WORDS \
     (((1600)/8/*bits to byte*/)/sizeof(uint64_t))
@@ -32,6 +37,9 @@ typedef struct sha3_context_ {
                                  * (starts from 0) */
     unsigned capacityWords;     /* the double size of the hash output in
                                  * words (e.g. 16 for Keccak 512) */
+    unsigned xofSuffix;         /* SHAKE/cSHAKE domain suffix, 0 for SHA3 */
+    unsigned squeezing;         /* XOF: input padded, output started */
+    unsigned squeezeIndex;      /* XOF: next byte of the rate to output */
 } sha3_context;
 
 /**
@@ -49,6 +57,36 @@ void sha3_init384( sha3_context *priv);
  */
 void sha3_init512( sha3_context *priv);
 
+/**
+ * Initialisation for SHAKE128, 128 bits security extendable output
+ */
+void shake128_init( sha3_context *priv);
+
+/**
+ * Initialisation for SHAKE256, 256 bits security extendable output
+ */
+void shake256_init( sha3_context *priv);
+
+/**
+ * Initialisation for cSHAKE128 (NIST SP 800-185)
+ *
+ * With an empty name and customization, this is SHAKE128.
+ *
+ * \param priv        context to initialize
+ * \param name        function name N, NIST defined functions only
+ * \param name_len    size of the function name
+ * \param custom      customization string S, for domain separation
+ * \param custom_len  size of the customization string
+ */
+void cshake128_init( sha3_context *priv, const void *name, size_t name_len, const void *custom, size_t custom_len);
+
+/**
+ * Initialisation for cSHAKE256 (NIST SP 800-185)
+ *
+ * \see cshake128_init
+ */
+void cshake256_init( sha3_context *priv, const void *name, size_t name_len, const void *custom, size_t custom_len);
+
 /**
  * Add some data to the hash
  *
@@ -68,6 +106,58 @@ void sha3_update( sha3_context *priv, void const *bufIn, size_t len);
  */
 void const * sha3_finalize( sha3_context *priv);
 
+/**
+ * Output bytes of a SHAKE/cSHAKE context
+ *
+ * The first call ends the input; it may be called as many times as needed,
+ * the output being one continuous stream.
+ *
+ * \param priv  context initialized with shake*_init or cshake*_init
+ * \param out   buffer receiving the output
+ * \param len   number of bytes to output
+ */
+void sha3_xof_squeeze( sha3_context *priv, void *out, size_t len);
+
+/**
+ * One-shot SHA3-256
+ *
+ * \param buf   data to hash
+ * \param len   size of the data
+ * \param out   SHA3_256_DIGEST_LEN bytes buffer receiving the hash
+ *
+ */
+void sha3_256( void const *buf, size_t len, uint8_t *out);
+
+/**
+ * Multi-buffer SHA3-256 of 4 independent messages
+ *
+ * Uses AVX2 when the CPU has it, otherwise hashes the messages one by one.
+ *
+ * \param bufs  the messages
+ * \param lens  size of each message
+ * \param outs  SHA3_256_DIGEST_LEN bytes buffers receiving the hashes
+ *
+ */
+void sha3_256_x4( void const *bufs[SHA3_X4_LANES], const size_t lens[SHA3_X4_LANES], uint8_t *outs[SHA3_X4_LANES]);
+
+/**
+ * SHA3-256 of any number of independent messages, 4 at a time
+ *
+ * \param nb    number of messages
+ * \param bufs  the messages
+ * \param lens  size of each message
+ * \param outs  SHA3_256_DIGEST_LEN bytes buffers receiving the hashes
+ *
+ */
+void sha3_256_multi( const unsigned nb, void const **bufs, const size_t *lens, uint8_t **outs);
+
+/**
+ * Tell whether the multi-buffer interface runs on AVX2
+ *
+ * \return 1 when accelerated, 0 for the scalar fallback
+ */
+int sha3_x4_accelerated();
+
 #endif //_S4_SHA3_H_
 
 //eof
@@ -15,25 +15,102 @@
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <time.h>
 #include <errno.h>
 #include <string.h>
 #include <sys/types.h>
 #include <gmp.h>
+#include <openssl/rand.h>
 
-#define DEEPDEBUG 1
 
 #include "utils.h"
 #include "shamir.h"
 #include "sha3.h"
+#include "trace.h"
+#include "secure_arena.h"
 
 #define SUCCESS     (EXIT_SUCCESS)
 #define FAIL_INPUTS (EINVAL)
 #define FAIL_ALLOC  (ENOMEM)
 #define FAIL_MATH   (EDOM)
+#define FAIL_RANDOM (EIO)
+
+// arena of a split or a recovery when the caller has entered none
+#define SHAMIR_ARENA_SIZE    (128*1024)
+
+// Seed of the coefficients and x-coordinates streams
+#define SHAMIR_SEED_LEN      (32)
+
+// cSHAKE256 customization strings, one domain per kind of value
+#define SHAMIR_XOF_COEFFS    ("4S Shamir polynomial coefficients")
+#define SHAMIR_XOF_SHARE_IDS ("4S Shamir share x-coordinates")
 
 //////////////////////////////////////////////////////// Low level functions
 
+/**
+ * \brief Wipe the limbs of an integer and release them
+ *
+ * Outside of an arena, or when the GMP memory functions are not those of the
+ * arenas (see secure_arena_init), the limbs are on the heap.
+ */
+static void mpz_wipe_clear( mpz_t value )
+{
+	if( value->_mp_alloc > 0 ) {
+		secure_memzero( mpz_limbs_write( value, value->_mp_alloc ), value->_mp_alloc * sizeof(mp_limb_t) );
+	}
+	mpz_clear( value );
+}//eo mpz_wipe_clear
+
+/**
+ * \brief Start a cSHAKE256 stream derived from the seed in a given domain
+ */
+static void xof_start( sha3_context *xof, const uint8_t *seed, const char *domain )
+{
+	cshake256_init( xof, "", 0, domain, strlen(domain) );
+	sha3_update( xof, seed, SHAMIR_SEED_LEN );
+}//eo xof_start
+
+/**
+ * \brief Read the next bits from the stream as an integer in [0, 2^bits[
+ */
+static void xof_draw_mpz( sha3_context *xof, mpz_t rop, const size_t bits )
+{
+	const size_t len = (bits + 7) / 8;
+	uint8_t buf[len];
+
+	sha3_xof_squeeze( xof, buf, len );
+	if( bits % 8 ) {
+		buf[0] &= (uint8_t)((1u << (bits % 8)) - 1);
+	}
+	mpz_import( rop, len, 1, 1, 0, 0, buf );
+	secure_memzero( buf, len );
+}//eo xof_draw_mpz
+
+/**
+ * \brief Seed a GMP generator from the OpenSSL one
+ *
+ * Unlike srand and rand, no state is shared between the threads, and two
+ * splits in the same second get different primes.
+ *
+ * \return 0 on success, -1 if no random seed is available
+ */
+static int shamir_rng_init( gmp_randstate_t state )
+{
+	uint8_t seed[SHAMIR_SEED_LEN];
+	mpz_t   value;
+
+	if( 1 != RAND_bytes( seed, sizeof(seed) ) ) {
+		return -1;
+	}
+	mpz_init( value );
+	mpz_import( value, sizeof(seed), 1, 1, 0, 0, seed );
+	secure_memzero( seed, sizeof(seed) );
+
+	gmp_randinit_default( state );
+	gmp_randseed( state, value );
+	mpz_wipe_clear( value );
+	return 0;
+}//eo shamir_rng_init
+
 static int split_secret(
 	const mpz_t secret,
 	const unsigned int num_shares,
@@ -47,7 +124,8 @@ static int split_secret(
 	
 	mpz_t * coefficients = NULL;
 	mpz_t y, tmp, degree;
-	gmp_randstate_t rng_state;
+	uint8_t seed[SHAMIR_SEED_LEN];
+	sha3_context xof;
 
 	/* Check the inputs */
 	if (mpz_cmp(secret, prime) >= 0 ||
@@ -57,7 +135,8 @@ static int split_secret(
 		return FAIL_INPUTS;
 	}
 
-	coefficients = (mpz_t *) malloc((threshold - 1) * sizeof(mpz_t));
+	// called within the arena of do_shamir_split, wiped with it
+	coefficients = (mpz_t *) secure_arena_alloc( secure_arena_current(), (threshold - 1) * sizeof(mpz_t) );
 	/*CSN: Ici tu as un problème si tu arrives à faire un integer overflow, car ton coefficients va être un pointer sur une mémoire alloué à 0, et pas null
 	il faudrait mettre:
 	if(coefficients){
@@ -69,23 +148,29 @@ static int split_secret(
 		return FAIL_ALLOC;
 	}
 
-	srand(time(NULL));
-	gmp_randinit_default(rng_state);
-	gmp_randseed_ui(rng_state, rand());
+	/* One random seed, expanded into the coefficients stream and the
+	 * x-coordinates stream */
+	if( 1 != RAND_bytes( seed, sizeof(seed) ) ) {
+		warn("Shamir secret splitting failed: no random seed");
+		return FAIL_RANDOM;
+	}
 	prime_size = mpz_sizeinbase(prime, 2);
 
 	/* Initialize coefficients and shares_xs */
+	xof_start( &xof, seed, SHAMIR_XOF_COEFFS );
 	for (i = 0; i < (threshold - 1); i++) {
 		mpz_init(coefficients[i]);
-		mpz_urandomb(coefficients[i], rng_state, prime_size - 1);
+		xof_draw_mpz( &xof, coefficients[i], prime_size - 1 );
 		mpz_add_ui(coefficients[i], coefficients[i], 1);
 	}
 
+	xof_start( &xof, seed, SHAMIR_XOF_SHARE_IDS );
 	for (i = 0; i < num_shares; i++) {
-		mpz_init(shares_xs[i]);
-		mpz_urandomb(shares_xs[i], rng_state, prime_size - 1);
+		xof_draw_mpz( &xof, shares_xs[i], prime_size - 1 );
 		mpz_add_ui(shares_xs[i], shares_xs[i], 1);
 	}
+	secure_memzero( &xof, sizeof(xof) );
+	secure_memzero( seed, sizeof(seed) );
 
 	mpz_init(tmp);
 	int retval = SUCCESS;
@@ -98,10 +183,9 @@ static int split_secret(
 			mpz_add_ui(degree, degree, 1);
 		}
 		mpz_clear(degree);
-		mpz_init(shares_ys[i]);
 		mpz_mod(y, y, prime);
 		mpz_set(shares_ys[i], y);
-		mpz_clear(y);
+		mpz_wipe_clear(y);
 		if (mpz_cmp(shares_xs[i], secret) == 0 ||
 			mpz_cmp(shares_ys[i], secret) == 0) {
 			retval = FAIL_MATH;
@@ -109,25 +193,32 @@ static int split_secret(
 		}
 
 	}
-	mpz_clear(tmp);
+	mpz_wipe_clear(tmp);
+
+	/* the x-coordinates must be distinct for the reconstruction */
+	for (i = 0; retval == SUCCESS && i < num_shares; i++) {
+		for (j = i + 1; j < num_shares; j++) {
+			if (mpz_cmp(shares_xs[i], shares_xs[j]) == 0) {
+				retval = FAIL_MATH;
+				break;
+			}
+		}
+	}
 
 	if (retval != SUCCESS) {
 		warn("Shamir splitting failed : %d", retval);
 		for (i = 0; i < num_shares; i++) {
-			mpz_init_set_ui(shares_xs[i], 0);
-			mpz_init_set_ui(shares_ys[i], 0);
+			mpz_set_ui(shares_xs[i], 0);
+			mpz_set_ui(shares_ys[i], 0);
 		}
 	}
 
-	gmp_randclear(rng_state);
 	/* Clear data */
 	/*CSN: Ca ferait pas un double free ton code la ?
 	*/
 	for (i = 0; i < (threshold - 1); i++) {
-		mpz_set_si(coefficients[i],0);
-		mpz_clear(coefficients[i]);
+		mpz_wipe_clear(coefficients[i]);
 	}
-	free(coefficients);
 	coefficients = NULL;
 
 	return retval;
@@ -162,46 +253,80 @@ static int reconstruct_secret
 	}
 
 	mpz_init_set_ui(reconstructed, 0);
+	mpz_init(product);
+	mpz_init(d);
+	mpz_init(r);
 
-    int retval = -1;
-	for (j = 0; j < num_shares; j++) {
-		mpz_init_set_ui(product, 1);
+    int retval = SUCCESS;
+	for (j = 0; j < num_shares && retval == SUCCESS; j++) {
+		mpz_set_ui(product, 1);
 		for (m = 0; m < num_shares; m++) {
-			mpz_init(d);
-			mpz_init(r);
 			if (m != j) {
 				mpz_sub(d, shares_xs[m], shares_xs[j]);
-				retval = mpz_invert(d, d, prime);
-                if( retval == 0 ){
+                if( 0 == mpz_invert(d, d, prime) ){
                 	warn("Failed Shamir reconstruction");
-                    return FAIL_MATH;
+                    retval = FAIL_MATH;
+                    break;
                 }
 				mpz_mul(r, shares_xs[m], d);
 				mpz_mul(product, product, r);
 			}
-			mpz_set_si(d,0);
-			mpz_clear(d);
-			mpz_set_si(r,0);
-			mpz_clear(r);
 		}
 		mpz_addmul(reconstructed, shares_ys[j], product);
 		mpz_mod(reconstructed, reconstructed, prime);
-		mpz_clear(product);
 	}
-	mpz_init_set(secret, reconstructed);
-	mpz_clear(reconstructed);
+	if (retval == SUCCESS) {
+		mpz_set(secret, reconstructed);
+	}
 
-	return SUCCESS;
+	mpz_wipe_clear(r);
+	mpz_wipe_clear(d);
+	mpz_wipe_clear(product);
+	mpz_wipe_clear(reconstructed);
+	return retval;
 }//eo reconstruct_secret
 
 
 //////////////////////////////////////////////////////// High level functions
 
-int do_shamir_split( int quorum, int nb_share, const uint8_t * secret_val, const size_t sec_len, s_share_t *shares ) 
+/**
+ * \brief Arena for the secrets of a computation: the one entered by the caller, or a temporary one
+ *
+ * \param temp  set to the temporary arena to destroy with shamir_arena_leave, NULL if none
+ *
+ * \return NULL on error
+ */
+static s_secure_arena_t* shamir_arena_enter( s_secure_arena_t **temp )
 {
-	DEBUG_PRN("do_shamir_split(quorum:%d, nb_share:%d, secret:%p, sec_len:%u, shares:%p)", 
-		                          quorum,    nb_share, secret_val,   sec_len, shares );
+	*temp = NULL;
+	s_secure_arena_t *arena = secure_arena_current();
+	if( NULL == arena ) {
+		arena = secure_arena_create( SHAMIR_ARENA_SIZE );
+		if( NULL == arena ) {
+			return NULL;
+		}
+		secure_arena_enter( arena );
+		*temp = arena;
+	}
+	return arena;
+}//eo shamir_arena_enter
 
+/**
+ * \brief Wipe every intermediate value of a computation at once
+ */
+static void shamir_arena_leave( s_secure_arena_t *arena, const size_t mark, s_secure_arena_t *temp )
+{
+	if( NULL != temp ) {
+		secure_arena_leave( NULL );
+		secure_arena_destroy( temp );
+	} else {
+		secure_arena_rewind( arena, mark );
+	}
+}//eo shamir_arena_leave
+
+// the mpz values are wiped and cleared, the caller rewinds the arena for the rest
+static int shamir_split_in_arena( s_secure_arena_t *arena, int quorum, int nb_share, const uint8_t * secret_val, const size_t sec_len, s_share_t *shares )
+{
     mpz_t 
         secret, 
         prime, 
@@ -213,47 +338,54 @@ int do_shamir_split( int quorum, int nb_share, const uint8_t * secret_val, const
 	// Hex encode password and load it in a mpz
 	DDEBUG_PRN("do_shamir_split: encoding secret");
 	const size_t hex_len = (sec_len*2)+1;
-	char hex_password[hex_len];
-	secure_memzero(hex_password,hex_len);
+	char *hex_password = secure_arena_alloc( arena, hex_len );
+	if( NULL == hex_password ) {
+		warn("No secure memory left to encode the password before splitting");
+		return FAIL_ALLOC;
+	}
 	ssize_t enc_res = hex_encode( hex_password, hex_len, secret_val, sec_len);
-	DDEBUG_PRN("do_shamir_split:hex_encode(%u) returned %d", sec_len, enc_res );	
+	DDEBUG_PRN("do_shamir_split:hex_encode(%zu) returned %zd", sec_len, enc_res );	
 	if( enc_res<0 ) {
 		warn("failed to encode password before splitting");
 		return -1;
 	}
 	mpz_init_set_str( secret, hex_password, 36 ); // loading the hex encoded password
-	secure_memzero( hex_password, hex_len);	
+	mpz_init(int_from);
+	mpz_init(prime);
+	for( int i = 0; i< nb_share; i++ ) {
+		mpz_init(xs[i]);
+		mpz_init(ys[i]);
+	}
 
 	// Get a long random 
 	DDEBUG_PRN("do_shamir_split: getting basis number");	
-	mpz_init(int_from);
-	srand( time(NULL) );
-	gmp_randinit_default (rng_state );
-	gmp_randseed_ui( rng_state, rand() );
+	int res = 0;
+	if( shamir_rng_init( rng_state ) ) {
+		warn("Shamir secret splitting failed: no random seed");
+		res = FAIL_RANDOM;
+		goto cleanup;
+	}
 	mpz_rrandomb( int_from, rng_state, RING_SIZE );
 
 	// Find a prime next to it
 	DDEBUG_PRN("do_shamir_split: finding next prime");	
-	mpz_init(prime);
 	mpz_nextprime(prime,int_from);
 
 
 	// Initialisation
 	DDEBUG_PRN("do_shamir_split: initialization");
 	while( mpz_cmp( secret, prime ) >= 0 ){
-		srand(time(NULL));
-		gmp_randinit_default( rng_state );
-		gmp_randseed_ui( rng_state, rand() );
 		mpz_rrandomb( int_from, rng_state, RING_SIZE );
 		mpz_nextprime( prime,int_from );
 	}
+	gmp_randclear( rng_state );
     
     // doing the split
     DDEBUG_PRN("do_shamir_split: splitting");
-    int res = split_secret(secret, nb_share, quorum, prime, xs, ys);
+    res = split_secret(secret, nb_share, quorum, prime, xs, ys);
     if( res != 0 ) {
     	warn("Failed low level secret splitting: %d",res);
-        return res;
+        goto cleanup;
     }
 
     // copying the secrets
@@ -270,15 +402,42 @@ int do_shamir_split( int quorum, int nb_share, const uint8_t * secret_val, const
 		mpz_get_str( shares[i].prime,36,prime);
     }
 
-    // TODO: zero mpz: secret, prime, xs[], ys[]
     DDEBUG_PRN("do_shamir_split: done");
-    return 0;
-}//eo do_split
 
-int do_shamir_recovery( const int nb_participants, const s_share_t* shares, uint8_t * result, size_t max_result ) 
+cleanup:
+	for( int i = nb_share-1; i >= 0; i-- ) {
+		mpz_wipe_clear(ys[i]);
+		mpz_wipe_clear(xs[i]);
+	}
+	mpz_wipe_clear(prime);
+	mpz_wipe_clear(int_from);
+	mpz_wipe_clear(secret);
+    return res;
+}//eo shamir_split_in_arena
+
+int do_shamir_split( int quorum, int nb_share, const uint8_t * secret_val, const size_t sec_len, s_share_t *shares ) 
 {
-	DEBUG_PRN("do_shamir_recovery( nb_participants:%d, shares:%x, result:%x, max_resize:%u )", nb_participants, shares, result, max_result);
+	DEBUG_PRN("do_shamir_split(quorum:%d, nb_share:%d, secret:%p, sec_len:%zu, shares:%p)", 
+		                          quorum,    nb_share, secret_val,   sec_len, (void*)shares );
+	TRACE_SPAN( span, "shamir split", NULL );
+
+	s_secure_arena_t *temp  = NULL;
+	s_secure_arena_t *arena = shamir_arena_enter( &temp );
+	if( NULL == arena ) {
+		warn("No secure memory for the Shamir split");
+		return FAIL_ALLOC;
+	}
+	const size_t mark = secure_arena_mark( arena );
 
+	int res = shamir_split_in_arena( arena, quorum, nb_share, secret_val, sec_len, shares );
+
+	shamir_arena_leave( arena, mark, temp );
+	return res;
+}//eo do_split
+
+// the mpz values are wiped and cleared, the caller rewinds the arena for the rest
+static int shamir_recovery_in_arena( s_secure_arena_t *arena, const int nb_participants, const s_share_t* shares, uint8_t * result, size_t max_result ) 
+{
     int retval = 0;
 	mpz_t xs[nb_participants], 
           ys[nb_participants], 
@@ -286,7 +445,11 @@ int do_shamir_recovery( const int nb_participants, const s_share_t* shares, uint
 	mpz_t reconstructed;
 	
 	const size_t hex_len = (2*max_result)+1;
-	char hex_val[hex_len];
+	char *hex_val = secure_arena_alloc( arena, hex_len );
+	if( NULL == hex_val ) {
+		warn("No secure memory left for the Shamir recovered value");
+		return FAIL_ALLOC;
+	}
 
 	// Get Xs Ys et prime from each share
 	mpz_init(reconstructed);
@@ -300,23 +463,56 @@ int do_shamir_recovery( const int nb_participants, const s_share_t* shares, uint
 	retval = reconstruct_secret( nb_participants, (const mpz_t *)xs, (const mpz_t *)ys,prime, reconstructed);
 	if( retval != EXIT_SUCCESS ) {
 		warn("Failed low level Shamir secret reconstruction: %d",retval );
-		return retval;
+		goto cleanup;
 	}
 
-	// hex decode the pass phrase	
-	mpz_get_str( hex_val, 36, reconstructed); // TODO check we do not overflow hex_val
-	DDEBUG_PRN("hex val: %s", hex_val);*
-	ssize_t dec_res = hex_decode( result, max_result, hex_val );
+	// hex decode the pass phrase, keeping room for the terminating zero
+	if( mpz_sizeinbase( reconstructed, 36 ) + 2 > hex_len ) {
+		warn("Shamir recovered value too large");
+		retval = FAIL_MATH;
+		goto cleanup;
+	}
+	mpz_get_str( hex_val, 36, reconstructed);
+	ssize_t dec_res = hex_decode( result, max_result-1, hex_val );
 	if( dec_res < 0 ) {
 		warn("Failed to hex decode the Shamir recovered value");
-		return -1;
+		retval = -1;
+		goto cleanup;
+	}
+    result[dec_res]='\0';
+
+cleanup:
+	mpz_wipe_clear(prime);
+	for( int i=nb_participants-1; i>=0; i-- ){
+		mpz_wipe_clear(ys[i]);
+		mpz_wipe_clear(xs[i]);
+	}
+	mpz_wipe_clear(reconstructed);
+    return retval;
+}//eo shamir_recovery_in_arena
+
+int do_shamir_recovery( const int nb_participants, const s_share_t* shares, uint8_t * result, size_t max_result ) 
+{
+	DEBUG_PRN("do_shamir_recovery( nb_participants:%d, shares:%p, result:%p, max_resize:%zu )", nb_participants, (const void*)shares, (void*)result, max_result);
+	TRACE_SPAN( span, "shamir recovery", NULL );
+
+	if( max_result < 1 ) {
+		warn("Invalid output buffer for the Shamir recovery");
+		return FAIL_INPUTS;
 	}
-	DDEBUG_PRN("Shamir_recov:%s", hex_val);
-	secure_memzero( hex_val, hex_len );	
-    result[max_result]='\0';
-    	    
-    return 0;
 
+	s_secure_arena_t *temp  = NULL;
+	s_secure_arena_t *arena = shamir_arena_enter( &temp );
+	if( NULL == arena ) {
+		warn("No secure memory for the Shamir recovery");
+		return FAIL_ALLOC;
+	}
+	const size_t mark = secure_arena_mark( arena );
+
+	int res = shamir_recovery_in_arena( arena, nb_participants, shares, result, max_result );
+
+	shamir_arena_leave( arena, mark, temp );
+	return res;
 }//eo do_recover
 
 /////////////////////////////////////////////////////////////////////////// Encoding secret
@@ -328,47 +524,72 @@ int do_shamir_recovery( const int nb_participants, const s_share_t* shares, uint
 #define SHAMIR_SHARE_FOOTER ("----- END SHAMIR SHARE -----")
 
 
+// next line of a mapped share, without its end of line; NULL at the end of the data
+static const char* share_next_line( const char **cursor, const char *end, size_t *len )
+{
+	const char *line = *cursor;
+	if( line >= end ) {
+		return NULL;
+	}
+
+	const char *eol = memchr( line, '\n', end-line );
+	*cursor = eol ? eol+1 : end;
+	*len    = (eol ? eol : end) - line;
+	if( *len > 0 && line[*len-1] == '\r' ) {
+		(*len)--;
+	}
+	return line;
+}//eo share_next_line
+
 int load_shamir_secret( const char* filename, s_share_t* share ) 
 {
+	TRACE_SPAN( span, "load share", filename );
 	size_t max_str_sze = SHARED_SECRETS_STR_MAX;
-	char line[255];
+	const size_t header_len = strlen( SHAMIR_SHARE_HEADER );
+	s_file_view_t view;
 
 	secure_memzero( share->X,     max_str_sze );
 	secure_memzero( share->Y,     max_str_sze );
 	secure_memzero( share->prime, max_str_sze );
 
-	FILE *fp = fopen(filename,"r");
-	if( fp == NULL){
+	if( file_view_open( filename, &view ) ) {
 		warn("Failed to open file '%s' for Shamir secret reading", filename);
 		return -1;
 	}
-	rewind(fp);
+
+	const char *cursor = (const char*)view.data;
+	const char *end    = cursor + view.size;
+	const char *line;
+	size_t len = 0;
 
 	int in_share = 0;
-	while( fgets(line, sizeof(line), fp)!=NULL ) {	
-		chomp(line);	
-		int x = strcmp( SHAMIR_SHARE_HEADER, line );
-		DDEBUG_PRN("load_shamir_secret: loaded [%s]==[%s]=> (%d)", line, SHAMIR_SHARE_HEADER, x);
-		if(  x == 0 ){
-			DDEBUG_PRN("load_shamir_secret: header found [%s]", line);
+	while( NULL != (line = share_next_line( &cursor, end, &len )) ) {
+		if( len == header_len && 0 == memcmp( line, SHAMIR_SHARE_HEADER, header_len ) ){
+			DDEBUG_PRN("load_shamir_secret: header found in '%s'", filename);
 			in_share = 1;
 			break;
 		}
 	}
 	if( !in_share ) {
 		warn("Failed to find Shamir secret header in '%s'", filename );
+		file_view_close( &view, FILE_VIEW_WIPE );
 		return -1;
 	}
 
-	fgets( share->X, max_str_sze, fp);
-	strtok( share->X, "\n");
-
-	fgets( share->Y, max_str_sze, fp);
-	strtok( share->Y, "\n");
-
-	fgets( share->prime, max_str_sze, fp);
+	char *fields[] = { share->X, share->Y, share->prime };
+	for( unsigned i = 0; i < sizeof(fields)/sizeof(fields[0]); i++ ) {
+		line = share_next_line( &cursor, end, &len );
+		if( NULL == line || len >= max_str_sze ) {
+			warn("Truncated or oversized Shamir share in '%s'", filename );
+			file_view_close( &view, FILE_VIEW_WIPE );
+			secure_memzero( share, sizeof(s_share_t) );
+			return -1;
+		}
+		memcpy( fields[i], line, len );
+		fields[i][len] = '\0';
+	}
 
-	fclose(fp);
+	file_view_close( &view, FILE_VIEW_WIPE );
 
 	return 0;
 
@@ -377,12 +598,15 @@ int load_shamir_secret( const char* filename, s_share_t* share )
 
 int save_shamir_secret( const char* filename, const s_share_t* share)
 {
-    size_t buffer_size = (3*SHARED_SECRETS_STR_MAX)+4;
-    char buffer[ buffer_size ];
+    // header, X, Y, prime and footer lines, and the terminating zero
+    char buffer[ sizeof(SHAMIR_SHARE_HEADER) + 3*SHARED_SECRETS_STR_MAX + sizeof(SHAMIR_SHARE_FOOTER) + 1 ];
 
-    snprintf(buffer, buffer_size-1, "%s\n%s\n%s\n%s\n%s\n", SHAMIR_SHARE_HEADER, share->X, share->Y, share->prime, SHAMIR_SHARE_FOOTER );
-    buffer[buffer_size-1] ='\0';
-    size_t len = strnlen( buffer, buffer_size);
+    int written = snprintf(buffer, sizeof(buffer), "%s\n%s\n%s\n%s\n%s\n", SHAMIR_SHARE_HEADER, share->X, share->Y, share->prime, SHAMIR_SHARE_FOOTER );
+    if( written < 0 || written >= (int)sizeof(buffer) ) {
+        warn("Shamir share too large to be saved to file: %s", filename);
+        return -1;
+    }
+    size_t len = (size_t)written;
 
 	ssize_t res = write_to_file(filename, len, buffer);
 
@@ -404,3 +628,41 @@ ssize_t shamir_share_fingerprint( const s_share_t* share, char *fingerprint, con
 	return hex_encode( fingerprint, max_size, hash, 32 );
 
 }//eo shamir_share_fingerprint
+
+int shamir_shares_fingerprints( const s_share_t* shares, const unsigned nb, char (*fingerprints)[SHARE_FINGERPRINT_LEN+1] )
+{
+	// X || Y || prime of up to 4 shares, hashed together
+	char        msg[SHA3_X4_LANES][3*SHARED_SECRETS_STR_MAX];
+	uint8_t     hash[SHA3_X4_LANES][SHA3_256_DIGEST_LEN];
+	void const *bufs[SHA3_X4_LANES];
+	size_t      lens[SHA3_X4_LANES];
+	uint8_t    *outs[SHA3_X4_LANES];
+	int         res = 0;
+
+	for( unsigned i=0; i<nb; i+=SHA3_X4_LANES ) {
+		unsigned n = (nb - i < SHA3_X4_LANES) ? nb - i : SHA3_X4_LANES;
+
+		for( unsigned k=0; k<n; k++ ) {
+			const s_share_t *share = &(shares[i+k]);
+			size_t lx = strnlen( share->X,     SHARED_SECRETS_STR_MAX );
+			size_t ly = strnlen( share->Y,     SHARED_SECRETS_STR_MAX );
+			size_t lp = strnlen( share->prime, SHARED_SECRETS_STR_MAX );
+			memcpy( msg[k],         share->X,     lx );
+			memcpy( msg[k]+lx,      share->Y,     ly );
+			memcpy( msg[k]+lx+ly,   share->prime, lp );
+			bufs[k] = msg[k];
+			lens[k] = lx + ly + lp;
+			outs[k] = hash[k];
+		}
+		sha3_256_multi( n, bufs, lens, outs );
+
+		for( unsigned k=0; k<n; k++ ) {
+			if( hex_encode( fingerprints[i+k], SHARE_FINGERPRINT_LEN+1, hash[k], SHA3_256_DIGEST_LEN ) < 0 ) {
+				res = -1;
+			}
+		}
+	}
+
+	secure_memzero( msg, sizeof(msg) );
+	return res;
+}//eo shamir_shares_fingerprints
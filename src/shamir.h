@@ -22,6 +22,9 @@
 #define RING_SIZE (512)
 #define SHARED_SECRETS_STR_MAX (1024)
 
+// hex encoded SHA3-256
+#define SHARE_FINGERPRINT_LEN  (64)
+
 
 /**
  *
@@ -74,8 +77,8 @@ int do_shamir_split( int quorum, int nb_share, const uint8_t * secret_val, const
  * 
  * \param nb_participants  number of participants to the reconstruction
  * \param shares           pointer to an array of at least nb_participants shares
- * \param result           allocated char array of at least max_result size+1 for the resulting secret
- * \param max_result       size of result, and maximum size for the resulting secret
+ * \param result           allocated char array of max_result bytes for the resulting secret
+ * \param max_result       size of result: the resulting secret takes at most max_result-1 bytes and a terminating zero
  *  
  * \return 0 on success, non 0 on error
  */
@@ -111,4 +114,18 @@ int load_shamir_secret( const char* filename, s_share_t* share );
  */
 ssize_t shamir_share_fingerprint( const s_share_t* share, char *fingerprint, const size_t max_size );
 
+/**
+ * Compute the fingerprints of several shares at once
+ *
+ * Same fingerprint as shamir_share_fingerprint, the shares being hashed
+ * 4 by 4 with the SHA3 multi-buffer interface.
+ *
+ * \param shares        shares to fingerprint
+ * \param nb            number of shares
+ * \param fingerprints  receives the hex encoded fingerprint of each share
+ *
+ * \return 0 on success, -1 on error
+ */
+int shamir_shares_fingerprints( const s_share_t* shares, const unsigned nb, char (*fingerprints)[SHARE_FINGERPRINT_LEN+1] );
+
 #endif
@@ -13,7 +13,6 @@
  *
  */
 
-//#define DEEPDEBUG 1
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,17 +25,20 @@
 
 #include "utils.h"
 #include "shared_secret.h"
+#include "trace.h"
 
 
 s_s4context* s4_init_context()
 {
      
-    s_s4context * ctx = (s_s4context*) malloc( sizeof( s_s4context ) );
-    if( NULL == ctx ) {
-        warn("Failed to allocate memory for context structure");
+    s_secure_arena_t *arena = secure_arena_create( sizeof(s_s4context) + SECRETS_ARENA_SIZE );
+    if( NULL == arena ) {
+        warn("Failed to allocate secure memory for context structure");
         return NULL;
     }
-    secure_memzero( ctx, sizeof( s_s4context ));
+    s_s4context * ctx = (s_s4context*) secure_arena_alloc( arena, sizeof( s_s4context ) );
+    assert( NULL != ctx );
+    ctx->arena = arena;
 
     ctx->quorum    = DEFAULT_QUORUM;
     ctx->nb_share  = DEFAULT_NB_SHARE;
@@ -46,6 +48,13 @@ s_s4context* s4_init_context()
     ctx->pki_params.subca_life_len = DEFAULT_SUBCA_LIFE_IN_DAYS;
     ctx->pki_params.crl_life_len   = DEFAULT_CRL_LIFE_DAYS;
 
+    ctx->crl_bundle_size   = DEFAULT_CRL_BUNDLE_SIZE;
+    ctx->crl_bundle_period = DEFAULT_CRL_BUNDLE_PERIOD;
+    ctx->ocsp_period       = DEFAULT_OCSP_PERIOD;
+
+    // the shares are allocated after the context, released by rewinding to here
+    ctx->shares_mark = secure_arena_mark( arena );
+
     ctx->op_status = "uninitialized";
     ctx->nb_share_exported=0;
     ctx->nb_share_loaded=0;
@@ -60,13 +69,89 @@ void s4_destroy_context( s_s4context* s4c )
     if( NULL == s4c ) {
         return;
     }
-    DDEBUG_PRN("erasing(%p,%lu)\n", s4c, sizeof(struct SS4Context));
-    secure_memzero( s4c, sizeof(struct SS4Context) );
-    DDEBUG_PRN("freeing(%p)\n", s4c);
-    free(s4c);
+    DDEBUG_PRN("erasing(%p,%zu)", (void*)s4c, sizeof(struct SS4Context));
+    free( s4c->shamir_secrets );
+    free( s4c->root_cert_infos );
+    secure_arena_destroy( s4c->arena );
 
 }//eo s4_destroy_context
 
+int s4_reserve_shares( s_s4context *s4c, unsigned nb )
+{
+    assert( NULL!=s4c );
+
+    if( nb > MAX_SHAMIR_SHARE_NUMBER ) {
+        warn("At most %d shares are supported, %u requested", MAX_SHAMIR_SHARE_NUMBER, nb);
+        return -1;
+    }
+
+    // wipes the shares in use, up to what their last computation touched
+    secure_arena_rewind( s4c->arena, s4c->shares_mark );
+    s4c->nb_share_slots     = 0;
+    s4c->shares             = NULL;
+    s4c->share_fingerprints = NULL;
+    s4c->shares_loaded      = NULL;
+    if( 0 == nb ) {
+        return 0;
+    }
+
+    s4c->shares             = secure_arena_alloc( s4c->arena, nb*sizeof(s_share_t) );
+    s4c->share_fingerprints = secure_arena_alloc( s4c->arena, nb*sizeof(*(s4c->share_fingerprints)) );
+    s4c->shares_loaded      = secure_arena_alloc( s4c->arena, nb*sizeof(int) );
+    if( NULL == s4c->shares || NULL == s4c->share_fingerprints || NULL == s4c->shares_loaded ) {
+        warn("No secure memory left for %u shares", nb);
+        s4_reserve_shares( s4c, 0 );
+        return -1;
+    }
+    s4c->nb_share_slots = nb;
+    return 0;
+}//eo s4_reserve_shares
+
+int s4_set_share_sources( s_s4context *s4c, const char *const *paths, unsigned nb )
+{
+    assert( NULL!=s4c );
+    assert( NULL!=paths || 0==nb );
+
+    if( nb > MAX_SHAMIR_SHARE_NUMBER ) {
+        warn("At most %d shares are supported, %u provided", MAX_SHAMIR_SHARE_NUMBER, nb);
+        return -1;
+    }
+
+    free( s4c->shamir_secrets );
+    s4c->shamir_secrets    = NULL;
+    s4c->nb_share_provided = 0;
+    if( 0 == nb ) {
+        return 0;
+    }
+
+    s4c->shamir_secrets = calloc( nb, sizeof(const char*) );
+    if( NULL == s4c->shamir_secrets ) {
+        warn("Failed to allocate memory for %u share paths", nb);
+        return -1;
+    }
+    memcpy( s4c->shamir_secrets, paths, nb*sizeof(const char*) );
+    s4c->nb_share_provided = nb;
+    return 0;
+}//eo s4_set_share_sources
+
+const s_ca_cert_infos_t* s4_load_root_cert_infos( s_s4context *s4c, const char *root_dir )
+{
+    assert( NULL!=s4c );
+    assert( NULL!=root_dir );
+
+    if( NULL == s4c->root_cert_infos ) {
+        s4c->root_cert_infos = calloc( 1, sizeof(s_ca_cert_infos_t) );
+        if( NULL == s4c->root_cert_infos ) {
+            DEBUG_PRN("s4_load_root_cert_infos: out of memory");
+            return NULL;
+        }
+    }
+    if( load_ca_cert_infos( root_dir, s4c->root_cert_infos ) ) {
+        return NULL;
+    }
+    return s4c->root_cert_infos;
+}//eo s4_load_root_cert_infos
+
 // returns 0 on success
 int check_pki_root_dir( const char* dirname )
 {
@@ -97,20 +182,37 @@ int check_pki_subject( const char* subject )
 
 int s4_split(s_s4context *s4c, s_s4eventhandlers_t * s4evt )
 {
-    uint8_t pass_converted[ MAX_HEX_ENC_PASS_SIZE+1 ];
-    memset(pass_converted, 0, MAX_HEX_ENC_PASS_SIZE );
-    secure_memzero( s4c->shares, MAX_SHAMIR_SHARE_NUMBER );
-
-    ssize_t dec_len = base64_decode( pass_converted, sizeof(pass_converted)-1, s4c->passphrase );
-    if(  dec_len <0 ) {
-        warn( "Share decoding failed" );
+    if( s4_reserve_shares( s4c, s4c->nb_share ) ) {
         return -1;
     }
 
-    int split_res = do_shamir_split( s4c->quorum, s4c->nb_share, pass_converted, dec_len, s4c->shares );
-    if( split_res != 0 ) {
+    // the decoded passphrase and the values of the split are wiped together
+    s_secure_arena_t *previous = secure_arena_enter( s4c->arena );
+    const size_t mark = secure_arena_mark( s4c->arena );
+
+    int res = 0;
+    uint8_t *pass_converted = secure_arena_alloc( s4c->arena, MAX_HEX_ENC_PASS_SIZE+1 );
+    ssize_t dec_len = -1;
+    if( NULL == pass_converted ) {
+        warn( "No secure memory left to decode the passphrase" );
+        res = -1;
+    } else if( (dec_len = base64_decode( pass_converted, MAX_HEX_ENC_PASS_SIZE, s4c->passphrase )) < 0 ) {
+        warn( "Share decoding failed" );
+        res = -1;
+    } else if( 0 != (res = do_shamir_split( s4c->quorum, s4c->nb_share, pass_converted, dec_len, s4c->shares )) ) {
         warn("Shamir split failed");
-        return split_res;
+    }
+
+    secure_arena_rewind( s4c->arena, mark );
+    secure_arena_leave( previous );
+    if( res ) {
+        return res;
+    }
+
+    // computed once, for the share holders to check their share later
+    if( shamir_shares_fingerprints( s4c->shares, s4c->nb_share, s4c->share_fingerprints ) ) {
+        warn("Shamir shares fingerprinting failed");
+        return -1;
     }
 
     return 0;
@@ -180,12 +282,16 @@ int s4_load_all_shares( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
     assert( NULL!=s4c   );
     assert( NULL!=s4evt );
 
-    s_share_t* shares = s4c->shares;
+    TRACE_SPAN( span, "load shares", NULL );
 
     if( (NULL==s4evt->do_file_prompt)  && s4c->nb_share_provided < s4c->quorum) {
         warn( "Only %d shares provided when at least %d are required", s4c->nb_share_provided, s4c->quorum );
         return -1;
     }
+    if( s4_reserve_shares( s4c, s4c->nb_share_provided ) ) {
+        return -1;
+    }
+    s_share_t* shares = s4c->shares;
 
     char fname[MAX_FILE_PATH+1];
     for( unsigned i=0; i<s4c->nb_share_provided; i++ ){        
@@ -225,13 +331,44 @@ int s4_load_all_shares( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
     return 0;
 }//eo s4_load_all_shares
 
+int s4_recover_passphrase( s_s4context *s4c )
+{
+    assert( NULL!=s4c );
+
+    // the recovered secret and the values of the recovery are wiped together
+    s_secure_arena_t *previous = secure_arena_enter( s4c->arena );
+    const size_t mark = secure_arena_mark( s4c->arena );
+
+    size_t  secret_max_size = MAX_HEX_ENC_PASS_SIZE+1;
+    uint8_t *secret = secure_arena_alloc( s4c->arena, secret_max_size );
+    int res = 0;
+    if( NULL == secret ) {
+        warn("No secure memory left to recover the passphrase");
+        res = -1;
+    } else if( EXIT_SUCCESS != (res = do_shamir_recovery( s4c->nb_share_provided, s4c->shares, secret, secret_max_size )) ) {
+        warn("Shamir recovery failed");
+    } else {
+        //base64_ encode the pass phrase 
+        ssize_t r2 = base64_encode( s4c->passphrase, MAX_B64_ENC_PASS_SIZE, secret, PASS_SIZE);
+        if( r2 <0 ) {
+            warn("base64 encoding of the passphrase failed");
+            res = -1;
+        } else {
+            s4c->passphrase_len = r2;
+        }
+    }
+
+    secure_arena_rewind( s4c->arena, mark );
+    secure_arena_leave( previous );
+    return res;
+}//eo s4_recover_passphrase
+
 int s4_reconstruct( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
 {
     assert( NULL!=s4c   );
     assert( NULL!=s4evt );
 
-    size_t  secret_max_size = MAX_HEX_ENC_PASS_SIZE+1;
-    uint8_t secret[secret_max_size];
+    TRACE_SPAN( span, "unlock", NULL );
 
     // read all the secrets
     int res = s4_load_all_shares( s4c, s4evt );
@@ -241,20 +378,7 @@ int s4_reconstruct( s_s4context *s4c, s_s4eventhandlers_t * s4evt )
     }
 
 	//Recontruct secret
-    int r1 = do_shamir_recovery( s4c->nb_share_provided, s4c->shares, secret, secret_max_size );
-	if( r1 != EXIT_SUCCESS ) {
-        warn("Shamir recovery failed");
-		return r1;
-	}
-
-	//base64_ encode the pass phrase 
-    ssize_t r2 = base64_encode( s4c->passphrase, MAX_B64_ENC_PASS_SIZE, secret, PASS_SIZE);
-	if( r2 <0 ) {
-        die( -1, "base64 encoding of the passphrase failed");
-    }    
-    s4c->passphrase_len = r2;
-
-	return 0;
+    return s4_recover_passphrase( s4c );
 }//eo reconstruct
 
 
@@ -263,24 +387,24 @@ int try_to_open_pki_info( s_s4context * ctx, const char *dirname )
     assert( NULL!=ctx );
     assert( NULL!=dirname );
 
-    DDEBUG_PRN("try_to_open_pki_info(%d)", dirname);
+    DDEBUG_PRN("try_to_open_pki_info(%s)", dirname);
     
     ctx->nb_share_exported=0;
     ctx->nb_share_loaded=0;
     ctx->nb_share_provided=0;
     ctx->secret_unlocked=0;
 
-    secure_memzero( ctx->csr_path, MAX_FILE_PATH+1);
-    secure_memzero( ctx->crl_path, MAX_FILE_PATH+1);
-    secure_memzero( ctx->shares, MAX_SHAMIR_SHARE_NUMBER*sizeof(s_share_t) );
-    secure_memzero( ctx->shares_loaded, MAX_SHAMIR_SHARE_NUMBER*sizeof(int) );
+    ctx->csr_path[0] = '\0';
+    ctx->crl_path[0] = '\0';
     secure_memzero( ctx->passphrase, MAX_B64_ENC_PASS_SIZE+1 );
-    secure_memzero( ctx->shamir_secrets, MAX_SHAMIR_SHARE_NUMBER*sizeof(char*));
+    ctx->passphrase_len = 0;
+    s4_set_share_sources( ctx, NULL, 0 );
+    s4_reserve_shares( ctx, 0 );
 
     DDEBUG_PRN("try_to_open_pki_info: copying '%s' to %p", dirname, ctx->pki_params.root_dir );
     size_t res = strlcpy( ctx->pki_params.root_dir, dirname, MAX_FILE_PATH);
     if( res > MAX_FILE_PATH ) {
-        DEBUG_PRN("try_to_open_pki_info: Failed to copy directory name to context (%u>%u)", res, MAX_FILE_PATH);
+        DEBUG_PRN("try_to_open_pki_info: Failed to copy directory name to context (%zu>%d)", res, MAX_FILE_PATH);
         return -1;
     }
 
@@ -294,7 +418,7 @@ int try_to_open_pki_info( s_s4context * ctx, const char *dirname )
         DEBUG_PRN("try_to_open_pki_info: Failed to read or invalid INI file from directory '%s'", dirname);
         return -1;
     }
-    return 0;
+    return s4_reserve_shares( ctx, ctx->nb_share );
 }//eo try to open pki info
 
 
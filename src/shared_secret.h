@@ -16,6 +16,7 @@
 
 #include "shamir.h"
 #include "pki.h"
+#include "secure_arena.h"
 
 #define PASS_SIZE             (40)
 #define B64_ENC_PASS_SIZE     (4 * ( (PASS_SIZE + 2) / 3))
@@ -26,12 +27,19 @@
 #define MAX_HEX_ENC_PASS_SIZE (2 * MAX_PASS_SIZE) 
 #define MAX_B64_ENC_PASS_SIZE  (4 * ( (MAX_PASS_SIZE + 2) / 3))
 
+// secure memory of a context beyond the context itself: its shares, and the temporary secrets and GMP integers of an unlock or a split
+#define SECRETS_ARENA_SIZE (256*1024)
 
 
 /**
  * \brief Application context
+ *
+ * Allocated in its own secure arena, with the passphrase it holds. The shares
+ * follow it in the arena, sized for the shares of the PKI by s4_reserve_shares:
+ * the wipes of the shares only cover those.
  */
 typedef struct SS4Context {
+    s_secure_arena_t *arena;
 
     unsigned    quorum;
     unsigned    nb_share;
@@ -46,14 +54,22 @@ typedef struct SS4Context {
     int         should_pause_for_secrets;
     
     s_pki_parameters_t pki_params;
+    s_ca_cert_infos_t *root_cert_infos;   // cached, see s4_load_root_cert_infos; not a secret, on the heap
 
     char        cert_path[MAX_FILE_PATH+1];
     char        csr_path[MAX_FILE_PATH+1];
     char        crl_path[MAX_FILE_PATH+1];    
 
-    s_share_t   shares[MAX_SHAMIR_SHARE_NUMBER];
-    int         shares_loaded[MAX_SHAMIR_SHARE_NUMBER];
-    const char *shamir_secrets[MAX_SHAMIR_SHARE_NUMBER];
+    unsigned    crl_bundle_size;
+    unsigned    crl_bundle_period;
+    unsigned    ocsp_period;
+
+    size_t      shares_mark;              // arena position of the shares
+    unsigned    nb_share_slots;           // entries of the 3 arrays below, see s4_reserve_shares
+    s_share_t  *shares;
+    char      (*share_fingerprints)[SHARE_FINGERPRINT_LEN+1];
+    int        *shares_loaded;
+    const char **shamir_secrets;          // nb_share_provided paths, on the heap, see s4_set_share_sources
 
     char        passphrase[MAX_B64_ENC_PASS_SIZE+1];
     size_t      passphrase_len;
@@ -66,6 +82,7 @@ typedef void (*progress_handler_t)   ( void* data, int pct, const char *descr);
 typedef void (*warning_handler_t)    ( void* data, const char * fmd, ... );
 typedef int  (*fileprompt_handler_t) ( void* data, const char * prompt, char* filepath, size_t  filepath_max);
 typedef void (*dialog_handler_t)     ( void* data, const char * title, const char* message );
+typedef int  (*cancel_handler_t)     ( void* data );
 
 /**
  * \brief Event handlers
@@ -76,6 +93,7 @@ typedef struct SS4EventHandlers {
 	warning_handler_t    on_warning;
     fileprompt_handler_t do_file_prompt;
     dialog_handler_t     do_message;
+    cancel_handler_t     is_cancelled;   // optional, polled between the steps of an operation
 } s_s4eventhandlers_t;
 
 /**
@@ -86,13 +104,46 @@ typedef struct SS4EventHandlers {
 s_s4context* s4_init_context();
 
 /**
- * Destroy an initialized application context
+ * Destroy an initialized application context, wiping it with its arena
  *
  * \param s4c an initialized context to destroy
  */
 void s4_destroy_context( s_s4context* s4c );
 
 
+/**
+ * Wipe the shares of the context and make room for a given number of them
+ *
+ * The shares, their fingerprints and loading flags are zeroed.
+ *
+ * \param s4c  application context, with no temporary secret allocated in its arena
+ * \param nb   number of shares, at most MAX_SHAMIR_SHARE_NUMBER; 0 only wipes
+ *
+ * \return 0 on success, -1 on failure
+ */
+int s4_reserve_shares( s_s4context *s4c, unsigned nb );
+
+/**
+ * Set the files of the shares to load or to write
+ *
+ * \param s4c    application context
+ * \param paths  nb paths, referenced not copied
+ * \param nb     number of paths, at most MAX_SHAMIR_SHARE_NUMBER
+ *
+ * \return 0 on success, -1 on failure
+ */
+int s4_set_share_sources( s_s4context *s4c, const char *const *paths, unsigned nb );
+
+/**
+ * Description of the PKI root certificate, cached in the context
+ *
+ * \param s4c       application context
+ * \param root_dir  PKI root directory
+ *
+ * \return NULL on error, the description otherwise, valid until the next call
+ */
+const s_ca_cert_infos_t* s4_load_root_cert_infos( s_s4context *s4c, const char *root_dir );
+
 /**
  * Check whether a directory path is illigible as a PKI root
  *
@@ -137,6 +188,15 @@ int s4_split( s_s4context *s4c, s_s4eventhandlers_t * s4evt );
 int s4_splitnsave( s_s4context *s4c, s_s4eventhandlers_t * s4evt );
 
 
+/**
+ * Recover the passphrase from the shares loaded in the context
+ *
+ * \param s4c   application context, with at least a quorum of shares loaded
+ *
+ * \return O on success, non 0 on failure
+ */
+int s4_recover_passphrase( s_s4context *s4c );
+
 /**
  * Reconstruct passphrase function for command line interface
  * 
@@ -0,0 +1,254 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+/**
+ *
+ * \file trace.c
+ *
+ * \brief Nested trace spans, exported in the Chrome trace event format
+ *
+ * Each thread owns a list of chunks of events, only appended to by itself.
+ * The buffers of the threads are pushed with a compare and swap on a global
+ * list, which the writer walks once the threads are over.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "trace.h"
+
+// events per chunk of a thread buffer
+#define TRACE_CHUNK_EVENTS (1024)
+
+/**
+ * \brief Closed span
+ */
+typedef struct STraceEvent {
+    char     name[MAX_TRACE_NAME_LEN+1];
+    char     arg[MAX_TRACE_ARG_LEN+1];
+    uint64_t start;
+    uint64_t duration;
+} s_trace_event_t;
+
+typedef struct STraceChunk {
+    struct STraceChunk *next;
+    s_trace_event_t     events[TRACE_CHUNK_EVENTS];
+} s_trace_chunk_t;
+
+/**
+ * \brief Events of one thread
+ */
+typedef struct STraceBuffer {
+    struct STraceBuffer *next;
+    unsigned             tid;
+    char                 name[MAX_TRACE_NAME_LEN+1];
+    s_trace_chunk_t     *first;
+    s_trace_chunk_t     *last;
+    unsigned             nb_events;   // published with a release store
+    unsigned long        nb_dropped;
+} s_trace_buffer_t;
+
+static int               trace_on      = 0;
+static uint64_t          trace_origin  = 0;
+static unsigned          trace_nb_tids = 0;
+static s_trace_buffer_t *trace_buffers = NULL;
+
+static __thread s_trace_buffer_t *trace_local = NULL;
+
+static uint64_t trace_now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}//eo trace_now
+
+/**
+ * \brief Buffer of the calling thread, created and published on first use
+ *
+ * \return NULL if out of memory
+ */
+static s_trace_buffer_t* trace_buffer( void )
+{
+	if( NULL != trace_local ) {
+		return trace_local;
+	}
+
+	s_trace_buffer_t *buf = calloc( 1, sizeof(s_trace_buffer_t) );
+	if( NULL == buf ) {
+		return NULL;
+	}
+	buf->tid = __atomic_add_fetch( &trace_nb_tids, 1, __ATOMIC_RELAXED );
+	snprintf( buf->name, sizeof(buf->name), "thread %u", buf->tid );
+
+	buf->next = __atomic_load_n( &trace_buffers, __ATOMIC_RELAXED );
+	while( !__atomic_compare_exchange_n( &trace_buffers, &(buf->next), buf, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) ) {
+		// buf->next was updated with the current head
+	}
+
+	trace_local = buf;
+	return buf;
+}//eo trace_buffer
+
+/**
+ * \brief Slot of the next event of the calling thread
+ *
+ * \return NULL if the event must be dropped
+ */
+static s_trace_event_t* trace_slot( s_trace_buffer_t *buf )
+{
+	const unsigned n   = buf->nb_events;
+	const unsigned pos = n % TRACE_CHUNK_EVENTS;
+
+	if( n >= MAX_TRACE_EVENTS ) {
+		buf->nb_dropped++;
+		return NULL;
+	}
+
+	if( 0 == pos ) {
+		s_trace_chunk_t *chunk = malloc( sizeof(s_trace_chunk_t) );
+		if( NULL == chunk ) {
+			buf->nb_dropped++;
+			return NULL;
+		}
+		chunk->next = NULL;
+		if( NULL == buf->last ) {
+			__atomic_store_n( &(buf->first), chunk, __ATOMIC_RELEASE );
+		} else {
+			__atomic_store_n( &(buf->last->next), chunk, __ATOMIC_RELEASE );
+		}
+		buf->last = chunk;
+	}
+	return &(buf->last->events[pos]);
+}//eo trace_slot
+
+///////////////////////////////// Exported functions
+
+void trace_enable( void )
+{
+	trace_origin = trace_now();
+	__atomic_store_n( &trace_on, 1, __ATOMIC_RELEASE );
+}//eo trace_enable
+
+void trace_thread_name( const char *name )
+{
+	assert( NULL!=name );
+
+	if( !__atomic_load_n( &trace_on, __ATOMIC_RELAXED ) ) {
+		return;
+	}
+	s_trace_buffer_t *buf = trace_buffer();
+	if( NULL != buf ) {
+		strlcpy( buf->name, name, sizeof(buf->name) );
+	}
+}//eo trace_thread_name
+
+uint64_t trace_begin( void )
+{
+	if( !__atomic_load_n( &trace_on, __ATOMIC_RELAXED ) ) {
+		return 0;
+	}
+	return trace_now();
+}//eo trace_begin
+
+void trace_span_end( s_trace_span_t *span )
+{
+	if( 0 == span->start ) {
+		return;
+	}
+	const uint64_t end = trace_now();
+
+	s_trace_buffer_t *buf = trace_buffer();
+	if( NULL == buf ) {
+		return;
+	}
+	s_trace_event_t *evt = trace_slot( buf );
+	if( NULL == evt ) {
+		return;
+	}
+
+	strlcpy( evt->name, NULL!=span->name ? span->name : "?", sizeof(evt->name) );
+	strlcpy( evt->arg,  NULL!=span->arg  ? span->arg  : "",  sizeof(evt->arg) );
+	evt->start    = span->start;
+	evt->duration = end - span->start;
+
+	__atomic_store_n( &(buf->nb_events), buf->nb_events+1, __ATOMIC_RELEASE );
+}//eo trace_span_end
+
+int trace_write_json( const char *filename )
+{
+	assert( NULL!=filename );
+
+	char  *text = NULL;
+	size_t size = 0;
+	FILE  *fp   = open_memstream( &text, &size );
+	if( NULL == fp ) {
+		DEBUG_PRN("trace_write_json: memory stream creation failed");
+		return -1;
+	}
+
+	const int pid = (int)getpid();
+	char name[(MAX_TRACE_NAME_LEN+1)*6];   // worst case: every byte escaped on 6 characters
+	char arg[(MAX_TRACE_ARG_LEN+1)*6];
+	const char *sep = "";
+
+	fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" );
+
+	for( s_trace_buffer_t *buf = __atomic_load_n( &trace_buffers, __ATOMIC_ACQUIRE ); NULL!=buf; buf=buf->next ) {
+		const unsigned nb_events = __atomic_load_n( &(buf->nb_events), __ATOMIC_ACQUIRE );
+
+		if( json_escape( name, sizeof(name), buf->name ) < 0 ) {
+			strlcpy( name, "?", sizeof(name) );
+		}
+		fprintf( fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", sep, pid, buf->tid, name );
+		sep = ",";
+		if( buf->nb_dropped ) {
+			warn("trace: %lu spans of %s were dropped", buf->nb_dropped, buf->name);
+		}
+
+		s_trace_chunk_t *chunk = __atomic_load_n( &(buf->first), __ATOMIC_ACQUIRE );
+		for( unsigned i=0; i<nb_events && NULL!=chunk; i++ ) {
+			const s_trace_event_t *evt = &(chunk->events[i % TRACE_CHUNK_EVENTS]);
+
+			if( json_escape( name, sizeof(name), evt->name ) < 0 ) {
+				strlcpy( name, "?", sizeof(name) );
+			}
+			if( json_escape( arg, sizeof(arg), evt->arg ) < 0 ) {
+				arg[0] = '\0';
+			}
+			// spans started before trace_enable are clipped to the origin
+			const uint64_t start = evt->start > trace_origin ? evt->start - trace_origin : 0;
+			fprintf( fp, ",\n{\"name\":\"%s\",\"cat\":\"4s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,\"args\":{\"detail\":\"%s\"}}",
+				name, (double)start / 1e3, (double)evt->duration / 1e3, pid, buf->tid, arg );
+
+			if( TRACE_CHUNK_EVENTS-1 == i % TRACE_CHUNK_EVENTS ) {
+				chunk = __atomic_load_n( &(chunk->next), __ATOMIC_ACQUIRE );
+			}
+		}
+	}
+	fprintf( fp, "\n]}\n" );
+
+	if( fclose( fp ) ) {
+		DEBUG_PRN("trace_write_json: memory stream write failed");
+		free( text );
+		return -1;
+	}
+
+	ssize_t w = write_to_file( filename, size, text );
+	free( text );
+	if( w < 0 || (size_t)w != size ) {
+		warn("Failed to write the trace to %s", filename);
+		return -1;
+	}
+	return 0;
+}//eo trace_write_json
+
+//eof
@@ -0,0 +1,85 @@
+/**
+ *
+ * \file trace.h
+ *
+ * \brief Nested trace spans, exported in the Chrome trace event format
+ *
+ * A span covers the scope of the variable declared by TRACE_SPAN: it is
+ * closed on any return of the function. Each thread records its spans in its
+ * own buffer, without lock, and the whole trace is written at the end by
+ * trace_write_json, to be opened in Perfetto or chrome://tracing.
+ *
+ * While tracing is not enabled, a span costs a test of a global flag.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#if !defined( _S4_TRACE_H_ )
+#define _S4_TRACE_H_
+
+#include <stdint.h>
+
+#define MAX_TRACE_NAME_LEN  (31)
+#define MAX_TRACE_ARG_LEN   (63)
+
+// events kept per thread, the following ones are counted as dropped
+#define MAX_TRACE_EVENTS    (65536)
+
+/**
+ * \brief Running span
+ */
+typedef struct STraceSpan {
+    const char *name;     // copied when the span ends
+    const char *arg;      // detail shown with the span, may be NULL
+    uint64_t    start;    // 0 when tracing is disabled
+} s_trace_span_t;
+
+/**
+ * \brief Open a span until the end of the current scope
+ *
+ * \param var   name of the span variable
+ * \param name  name of the span, valid until the end of the scope
+ * \param arg   detail of the span or NULL, valid until the end of the scope
+ */
+#define TRACE_SPAN(var,name,arg) \
+    s_trace_span_t var __attribute__((cleanup(trace_span_end))) = { (name), (arg), trace_begin() }
+
+/**
+ * \brief Start recording the spans of every thread
+ */
+void trace_enable( void );
+
+/**
+ * \brief Name the calling thread in the trace
+ *
+ * \param name  copied, truncated to MAX_TRACE_NAME_LEN
+ */
+void trace_thread_name( const char *name );
+
+/**
+ * \brief Timestamp of the beginning of a span, 0 if tracing is disabled
+ */
+uint64_t trace_begin( void );
+
+/**
+ * \brief Record a span of the calling thread, called at the end of the scope of a TRACE_SPAN
+ */
+void trace_span_end( s_trace_span_t *span );
+
+/**
+ * \brief Write every span recorded as a Chrome trace JSON file
+ *
+ * To call once the traced threads are over: the spans still running are
+ * not written.
+ *
+ * \param filename  path of the trace file
+ *
+ * \return 0 on success, -1 on error
+ */
+int trace_write_json( const char *filename );
+
+#endif
+//eof
@@ -13,7 +13,10 @@
  *
  */
 
-//#define DEEpDEBUG 1
+// pipe2(), to create the pipes of the children close-on-exec atomically
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 
 #include <errno.h>
 #include <stdio.h>
@@ -22,12 +25,47 @@
 #include <string.h>
 #include <stdarg.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <spawn.h>
+#include <time.h>
+#include <pthread.h>
 #include <openssl/bio.h>
 #include <openssl/evp.h>
 
 #include "utils.h"
+#include "trace.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTILS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// messages queued for the logging thread, and their longest size
+#define LOG_RING_SIZE (256)
+#define MAX_LOG_LINE  (1024)
 
-#define MAX_COMMAND_LEN (2048)
+// growth step of the captured outputs of a child
+#define EXEC_CAPTURE_CHUNK (4096)
+
+extern char **environ;
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/sendfile.h>
+#endif
+
+// chunk size of the buffered file copy, when the kernel cannot copy by itself
+#define FILE_COPY_BUFFER_SIZE (128*1024)
+
+// initial number of files of an atomic write group
+#define ATOMIC_GROUP_INITIAL_SIZE (8)
 
 #if defined(__linux__)
 #define OPENSSL_PATH ("/usr/bin/openssl")
@@ -175,7 +213,7 @@ ssize_t filename_prefix( const char * fullpath, char* prefix, size_t max_size  )
 	free(var_path);
 
 	if(sze>max_size) {
-		DEBUG_PRN("filename_prefix: insufficient size for storing drive in prefix (%u<%u)", max_size, sze );
+		DEBUG_PRN("filename_prefix: insufficient size for storing drive in prefix (%zu<%zu)", max_size, sze );
 		return -1;
 	}
 
@@ -205,7 +243,7 @@ ssize_t filename_base( const char * fullpath, char* bname, size_t max_size  )
 	free(var_path);
 
 	if(sze>max_size) {
-		DEBUG_PRN("filename_base: insufficient size for basename (%u<%u)", max_size, sze );
+		DEBUG_PRN("filename_base: insufficient size for basename (%zu<%zu)", max_size, sze );
 		return -1;
 	}
 
@@ -231,7 +269,7 @@ ssize_t filename_extension( const char * fullpath, char* extension, size_t max_s
 	free(var_path);
 
 	if(sze>max_size) {
-		DEBUG_PRN("filename_base: insufficient size for basename (%u<%u)", max_size, sze );
+		DEBUG_PRN("filename_base: insufficient size for basename (%zu<%zu)", max_size, sze );
 		return -1;
 	}
 
@@ -240,117 +278,925 @@ ssize_t filename_extension( const char * fullpath, char* extension, size_t max_s
 
 #endif//eo POSIX file manipulations
 
-int file_copy(const char * src_path, const char * dest_path )
+/**
+ * \brief Copy what remains of in_fd to out_fd with a plain read/write loop
+ *
+ * \return 0 on success, -1 otherwise
+ */
+static int file_copy_buffered( const int in_fd, const int out_fd )
+{
+	uint8_t *buffer = malloc( FILE_COPY_BUFFER_SIZE );
+	if( NULL == buffer ) {
+		DEBUG_PRN("file_copy: buffer allocation failed");
+		return -1;
+	}
+
+	int res = 0;
+	for(;;) {
+		ssize_t n = read( in_fd, buffer, FILE_COPY_BUFFER_SIZE );
+		if( n < 0 && errno == EINTR ) continue;
+		if( n <= 0 ) {
+			res = (n < 0) ? -1 : 0;
+			break;
+		}
+		
+		ssize_t done = 0;
+		while( done < n ) {
+			ssize_t w = write( out_fd, buffer + done, n - done );
+			if( w < 0 && errno == EINTR ) continue;
+			if( w <= 0 ) {
+				res = -1;
+				break;
+			}
+			done += w;
+		}
+		if( res ) break;
+	}//eo foreach chunk
+
+	free( buffer );
+	return res;
+}//eo file_copy_buffered
+
+#if defined(__linux__)
+/**
+ * \brief Copy size bytes from in_fd to out_fd without going through user space
+ *
+ * Tries copy_file_range (in-kernel, possibly reflink on the same file system)
+ * then sendfile; both advance the file offsets so that the next method simply
+ * resumes where the previous one gave up.
+ *
+ * \return 0 on success, 1 if the caller shall finish with a buffered copy, -1 on error
+ */
+static int file_copy_kernel( const int in_fd, const int out_fd, off_t size )
+{
+#if defined(SYS_copy_file_range)
+	while( size > 0 ) {
+		ssize_t n = syscall( SYS_copy_file_range, in_fd, NULL, out_fd, NULL, (size_t)size, 0u );
+		if( n < 0 && errno == EINTR ) continue;
+		if( n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF) ) break;
+		if( n < 0 ) return -1;
+		if( n == 0 ) return 1; // file shrunk or pseudo file: let read() tell
+		size -= n;
+	}
+	if( size == 0 ) return 0;
+	DDEBUG_PRN("file_copy: copy_file_range unavailable (%s), trying sendfile", strerror(errno));
+#endif
+
+	while( size > 0 ) {
+		ssize_t n = sendfile( out_fd, in_fd, NULL, (size_t)size );
+		if( n < 0 && errno == EINTR ) continue;
+		if( n < 0 && (errno == ENOSYS || errno == EINVAL) ) return 1;
+		if( n < 0 ) return -1;
+		if( n == 0 ) return 1;
+		size -= n;
+	}
+
+	return 0;
+}//eo file_copy_kernel
+#endif
+
+int file_copy(const char * src_path, const char * dest_path, const int flags )
 {
-	char   buffer[1024];
-    size_t n;
+	TRACE_SPAN( span, "copy file", dest_path );
+	struct stat st;
 
-    FILE* f_from = fopen(src_path,"r");
-    if( NULL== f_from ){
-    	DEBUG_PRN("file_copy: Failed to open source file '%s'", src_path );
-    	return -1;
-    }
+	int in_fd = open( src_path, O_RDONLY );
+	if( in_fd < 0 ){
+		DEBUG_PRN("file_copy: Failed to open source file '%s': %s", src_path, strerror(errno) );
+		return -1;
+	}
 
-    FILE* f_to   = fopen(dest_path,"w");
-    if( NULL== f_from ){
-    	DEBUG_PRN("file_copy: Failed to open destination file '%s'", dest_path );
-    	return -1;
-    }
+	if( fstat( in_fd, &st ) ) {
+		DEBUG_PRN("file_copy: Failed to stat source file '%s': %s", src_path, strerror(errno) );
+		close( in_fd );
+		return -1;
+	}
+
+	const mode_t mode = st.st_mode & 07777;
+	int out_fd = open( dest_path, O_WRONLY|O_CREAT|O_TRUNC, mode );
+	if( out_fd < 0 ){
+		DEBUG_PRN("file_copy: Failed to open destination file '%s': %s", dest_path, strerror(errno) );
+		close( in_fd );
+		return -1;
+	}
 
-    while ( (n = fread(buffer, sizeof(char), sizeof(buffer), f_from)) > 0 )
-    {
-        if (fwrite( buffer, sizeof(char), n, f_to) != n) {
-            DEBUG_PRN("file_copy: write to '%s' failed", dest_path);
-        	return -1;
-        }
-    }//eo foreach K
+	int res = 1;
+#if defined(__linux__)
+	// pseudo files (procfs, sysfs) claim a zero size: read them until EOF
+	if( S_ISREG(st.st_mode) && st.st_size > 0 ) {
+		res = file_copy_kernel( in_fd, out_fd, st.st_size );
+	}
+#endif
+	if( res > 0 ) {
+		res = file_copy_buffered( in_fd, out_fd );
+	}
+	if( res ) {
+		DEBUG_PRN("file_copy: copy from '%s' to '%s' failed: %s", src_path, dest_path, strerror(errno) );
+	}
 
-    fclose(f_from);
-    fclose(f_to);
+	// an already existing destination keeps its mode on open(): force it, umask included
+	if( 0 == res && fchmod( out_fd, mode ) ) {
+		DEBUG_PRN("file_copy: failed to set the permissions of '%s': %s", dest_path, strerror(errno) );
+		res = -1;
+	}
 
-    return 0;
+	if( 0 == res && (flags & FILE_COPY_SYNC) && fsync( out_fd ) ) {
+		DEBUG_PRN("file_copy: failed to sync '%s': %s", dest_path, strerror(errno) );
+		res = -1;
+	}
+
+	close( in_fd );
+	if( close( out_fd ) ) {
+		res = -1;
+	}
+
+	if( res ) {
+		unlink( dest_path ); // no half copied certificate left behind
+		return -1;
+	}
+
+	return 0;
 }//eo file_copy
 
 
-// real command call
-static int vcall_command( const char* fmt, va_list args ) 
+// read end of a capture pipe, grown as the child writes
+typedef struct SExecCapture {
+	int     fd;
+	char   *data;
+	size_t  len;
+	size_t  capacity;
+} s_exec_capture_t;
+
+// drain what is available on a capture pipe, close it at EOF
+static int exec_capture_read( s_exec_capture_t *cap )
 {
-	
-	// building the command line
-	char cmd[MAX_COMMAND_LEN+1]; // command line to call
-   	vsnprintf (cmd, MAX_COMMAND_LEN, fmt, args);
-	cmd[MAX_COMMAND_LEN]='\0';
+	if( cap->capacity - cap->len < EXEC_CAPTURE_CHUNK ) {
+		size_t capacity = cap->capacity + EXEC_CAPTURE_CHUNK + cap->capacity/2;
+		char *data = realloc( cap->data, capacity+1 );
+		if( NULL == data ) {
+			// keep draining: a child blocked on a full pipe would never exit
+			char discard[EXEC_CAPTURE_CHUNK];
+			ssize_t n = read( cap->fd, discard, sizeof(discard) );
+			return ( n > 0 || ( n < 0 && errno == EINTR ) ) ? 0 : -1;
+		}
+		cap->data     = data;
+		cap->capacity = capacity;
+	}
 
-	// calling
-	DDEBUG_PRN("> cmd: %s\n", cmd); 
+	ssize_t n = read( cap->fd, cap->data + cap->len, cap->capacity - cap->len );
+	if( n < 0 ) {
+		return ( errno == EINTR || errno == EAGAIN ) ? 0 : -1;
+	}
+	if( 0 == n ) {
+		close( cap->fd );
+		cap->fd = -1;
+	}
+	cap->len += n;
+	cap->data[cap->len] = '\0';
+	return 0;
+}//eo exec_capture_read
+
+// pipe whose ends are not inherited, but through the file actions; the flag
+// is set at creation, another thread may be spawning a child meanwhile
+static int exec_pipe( int fds[2] )
+{
+	return pipe2( fds, O_CLOEXEC ) ? -1 : 0;
+}//eo exec_pipe
+
+// counters of exec_get_stats, updated atomically by the threads running children
+static unsigned long      exec_nb_spawned = 0;
+static unsigned long long exec_wall_us    = 0;
+static unsigned long long exec_cpu_us     = 0;
+
+static double exec_elapsed( const struct timespec *start )
+{
+	struct timespec now;
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}//eo exec_elapsed
+
+int exec_argv( const char *const argv[], const char *secret, s_exec_result_t *result )
+{
+	assert( NULL!=argv && NULL!=argv[0] );
+	assert( NULL!=result );
+
+	const char *program = strrchr( argv[0], '/' );
+	TRACE_SPAN( span, NULL!=program ? program+1 : argv[0], argv[1] );
+
+	s_exec_capture_t caps[2] = { { -1, NULL, 0, 0 }, { -1, NULL, 0, 0 } };
+	int out_pipe[2] = { -1, -1 };
+	int err_pipe[2] = { -1, -1 };
+	int sec_pair[2] = { -1, -1 };
+	int res = -1;
+	pid_t pid = -1;
+	struct timespec start;
+	posix_spawn_file_actions_t actions;
+
+	memset( result, 0, sizeof(s_exec_result_t) );
+	result->status = -1;
+
+	if( exec_pipe( out_pipe ) || exec_pipe( err_pipe ) ) {
+		DEBUG_PRN("exec_argv: pipe creation failed: %s", strerror(errno));
+		goto cleanup;
+	}
+	// a socket rather than a pipe: a child dying early must not SIGPIPE us
+	if( NULL != secret ) {
+		if( socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sec_pair ) ) {
+			DEBUG_PRN("exec_argv: socketpair creation failed: %s", strerror(errno));
+			goto cleanup;
+		}
+		if( EXEC_SECRET_FD == sec_pair[0] ) {
+			// dup2() onto itself would keep the close-on-exec flag
+			int fd = fcntl( sec_pair[0], F_DUPFD_CLOEXEC, EXEC_SECRET_FD+1 );
+			close( sec_pair[0] );
+			sec_pair[0] = fd;
+		}
+	}
+
+	posix_spawn_file_actions_init( &actions );
+	posix_spawn_file_actions_addopen( &actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0 );
+	posix_spawn_file_actions_adddup2( &actions, out_pipe[1], STDOUT_FILENO );
+	posix_spawn_file_actions_adddup2( &actions, err_pipe[1], STDERR_FILENO );
+	if( NULL != secret ) {
+		posix_spawn_file_actions_adddup2( &actions, sec_pair[0], EXEC_SECRET_FD );
+	}
 
-	int res = system(cmd);
-	secure_memzero(cmd, MAX_COMMAND_LEN);
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	int err = posix_spawnp( &pid, argv[0], &actions, NULL, (char * const *)argv, environ );
+	posix_spawn_file_actions_destroy( &actions );
+	if( err ) {
+		DEBUG_PRN("exec_argv: failed to spawn '%s': %s", argv[0], strerror(err));
+		pid = -1;
+		goto cleanup;
+	}
+
+	close( out_pipe[1] ); out_pipe[1] = -1;
+	close( err_pipe[1] ); err_pipe[1] = -1;
+
+	if( NULL != secret ) {
+		close( sec_pair[0] ); sec_pair[0] = -1;
+		// one line, as read by "-passin fd:N"
+		size_t len = strlen( secret );
+		if( send( sec_pair[1], secret, len, MSG_NOSIGNAL ) != (ssize_t)len || send( sec_pair[1], "\n", 1, MSG_NOSIGNAL ) != 1 ) {
+			DEBUG_PRN("exec_argv: failed to pass the secret to '%s'", argv[0]);
+		}
+		close( sec_pair[1] ); sec_pair[1] = -1;
+	}
+
+	caps[0].fd = out_pipe[0]; out_pipe[0] = -1;
+	caps[1].fd = err_pipe[0]; err_pipe[0] = -1;
+	while( caps[0].fd >= 0 || caps[1].fd >= 0 ) {
+		struct pollfd pfds[2] = { { caps[0].fd, POLLIN, 0 }, { caps[1].fd, POLLIN, 0 } };
+		if( poll( pfds, 2, -1 ) < 0 ) {
+			if( errno == EINTR ) continue;
+			break;
+		}
+		for( unsigned i=0; i<2; i++ ) {
+			if( caps[i].fd >= 0 && pfds[i].revents && exec_capture_read( &caps[i] ) ) {
+				close( caps[i].fd );
+				caps[i].fd = -1;
+			}
+		}
+	}
+
+	int status;
+	struct rusage usage;
+	pid_t w;
+	do {
+		w = wait4( pid, &status, 0, &usage );
+	} while( w < 0 && errno == EINTR );
+
+	result->wall_time = exec_elapsed( &start );
+	if( w == pid ) {
+		result->cpu_time = (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+		                 + (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+		result->status   = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+		res = 0;
+	}
+	__atomic_add_fetch( &exec_nb_spawned, 1, __ATOMIC_RELAXED );
+	__atomic_add_fetch( &exec_wall_us, (unsigned long long)(result->wall_time*1e6), __ATOMIC_RELAXED );
+	__atomic_add_fetch( &exec_cpu_us,  (unsigned long long)(result->cpu_time*1e6),  __ATOMIC_RELAXED );
+
+cleanup:
+	for( unsigned i=0; i<2; i++ ) {
+		if( caps[i].fd >= 0 ) close( caps[i].fd );
+		if( out_pipe[i] >= 0 ) close( out_pipe[i] );
+		if( err_pipe[i] >= 0 ) close( err_pipe[i] );
+		if( sec_pair[i] >= 0 ) close( sec_pair[i] );
+	}
+	result->out     = caps[0].data;
+	result->out_len = caps[0].len;
+	result->err     = caps[1].data;
+	result->err_len = caps[1].len;
+	return res;
+}//eo exec_argv
+
+void exec_result_free( s_exec_result_t *result )
+{
+	free( result->out );
+	free( result->err );
+	result->out = result->err = NULL;
+	result->out_len = result->err_len = 0;
+}//eo exec_result_free
+
+void exec_get_stats( s_exec_stats_t *stats )
+{
+	assert( NULL!=stats );
+
+	stats->nb_spawned = __atomic_load_n( &exec_nb_spawned, __ATOMIC_RELAXED );
+	stats->wall_time  = (double)__atomic_load_n( &exec_wall_us, __ATOMIC_RELAXED ) / 1e6;
+	stats->cpu_time   = (double)__atomic_load_n( &exec_cpu_us,  __ATOMIC_RELAXED ) / 1e6;
+}//eo exec_get_stats
+
+int call_openssl( const char *const args[], const char *password )
+{
+	const char *argv[EXEC_MAX_ARGS+2];
+	s_exec_result_t result;
+	unsigned n = 0;
+
+	argv[n++] = OPENSSL_PATH;
+	while( NULL != args[n-1] ) {
+		if( n > EXEC_MAX_ARGS ) {
+			DEBUG_PRN("call_openssl: too many arguments for '%s'", args[0]);
+			return -1;
+		}
+		argv[n] = args[n-1];
+		n++;
+	}
+	argv[n] = NULL;
 
-	// processing result
-	if (res < 0) {
-		perror("internal error: external call failed");
+	if( exec_argv( argv, password, &result ) ) {
+		exec_result_free( &result );
 		return -1;
-	} else {
-		if (WIFEXITED(res)) {
-			DDEBUG_PRN("raw:%d refined:%d", res, WEXITSTATUS(res)); 
-			return WEXITSTATUS(res);
+	}
+
+	DEBUG_PRN("openssl %s: exit %d, %.3fs wall, %.3fs cpu", args[0], result.status, result.wall_time, result.cpu_time);
+	if( 0 != result.status && result.err_len > 0 ) {
+		warn("openssl %s: %s", args[0], result.err);
+	}
+
+	int res = result.status;
+	exec_result_free( &result );
+	return res;
+}//eo call_openssl
+
+// read exactly len bytes, 0 on end of file before the first byte
+static ssize_t frame_read_full( int fd, uint8_t *buf, const size_t len )
+{
+	size_t done = 0;
+	while( done < len ) {
+		ssize_t r = read( fd, buf+done, len-done );
+		if( r < 0 && EINTR == errno ) {
+			continue;
+		}
+		if( r < 0 || ( 0 == r && done > 0 ) ) {
+			return -1;
+		}
+		if( 0 == r ) {
+			return 0;
 		}
-		else return -1;
+		done += r;
 	}
+	return done;
+}//eo frame_read_full
 
-}//eo vcall_command
+static int frame_write_full( int fd, const uint8_t *buf, size_t len )
+{
+	while( len > 0 ) {
+		ssize_t w = write( fd, buf, len );
+		if( w < 0 && EINTR == errno ) {
+			continue;
+		}
+		if( w <= 0 ) {
+			return -1;
+		}
+		buf += w;
+		len -= w;
+	}
+	return 0;
+}//eo frame_write_full
 
-int call_command( const char* fmt, ... ) 
+int frame_write( int fd, const void *data, const size_t len )
 {
-	va_list args;
-	va_start (args, fmt);
-	
-	int res = vcall_command(fmt,args);
+	if( len > MAX_FRAME_SIZE ) {
+		DEBUG_PRN("frame_write: %zu bytes frame is too big", len);
+		return -1;
+	}
+	const uint8_t hdr[4] = { (uint8_t)(len >> 24), (uint8_t)(len >> 16), (uint8_t)(len >> 8), (uint8_t)len };
+	if( frame_write_full( fd, hdr, sizeof(hdr) ) || frame_write_full( fd, (const uint8_t*)data, len ) ) {
+		return -1;
+	}
+	return 0;
+}//eo frame_write
 
-	va_end(args);
+ssize_t frame_read( int fd, char *buf, const size_t max )
+{
+	uint8_t hdr[4];
+	ssize_t r = frame_read_full( fd, hdr, sizeof(hdr) );
+	if( r <= 0 ) {
+		return r;
+	}
 
-	return (res==0);
+	size_t len = ((size_t)hdr[0] << 24) | ((size_t)hdr[1] << 16) | ((size_t)hdr[2] << 8) | (size_t)hdr[3];
+	if( len > MAX_FRAME_SIZE || len+1 > max ) {
+		DEBUG_PRN("frame_read: %zu bytes frame refused", len);
+		return -1;
+	}
+	if( len > 0 && frame_read_full( fd, (uint8_t*)buf, len ) <= 0 ) {
+		return -1;
+	}
+	buf[len] = '\0';
+	return len;
+}//eo frame_read
 
-}//eo call_command
+static const char* json_skip_spaces( const char *p )
+{
+	while( ' '==*p || '\t'==*p || '\r'==*p || '\n'==*p ) {
+		p++;
+	}
+	return p;
+}//eo json_skip_spaces
 
+// append a code point to out as UTF-8
+static char* json_put_utf8( char *out, unsigned long cp )
+{
+	if( cp < 0x80 ) {
+		*out++ = (char)cp;
+	} else if( cp < 0x800 ) {
+		*out++ = (char)(0xC0 | (cp >> 6));
+		*out++ = (char)(0x80 | (cp & 0x3F));
+	} else if( cp < 0x10000 ) {
+		*out++ = (char)(0xE0 | (cp >> 12));
+		*out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (cp & 0x3F));
+	} else {
+		*out++ = (char)(0xF0 | (cp >> 18));
+		*out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+		*out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+		*out++ = (char)(0x80 | (cp & 0x3F));
+	}
+	return out;
+}//eo json_put_utf8
 
-int call_openssl( const char * fmt, ...) 
+static int json_hex4( const char *p, unsigned long *cp )
+{
+	char hex[5];
+	if( strspn( p, "0123456789abcdefABCDEF" ) < 4 ) {
+		return -1;
+	}
+	memcpy( hex, p, 4 );
+	hex[4] = '\0';
+	*cp = strtoul( hex, NULL, 16 );
+	return 0;
+}//eo json_hex4
+
+/*
+ * decode the string starting at the opening quote *p into out, which is at
+ * least as long as the input: the decoded form is never longer than the escaped one
+ * returns a pointer after the closing quote, NULL on error
+ */
+static const char* json_parse_string( const char *p, char *out )
 {
+	if( '"' != *p++ ) {
+		return NULL;
+	}
+	while( '"' != *p ) {
+		if( '\0' == *p || (unsigned char)*p < 0x20 ) {
+			return NULL;
+		}
+		if( '\\' != *p ) {
+			*out++ = *p++;
+			continue;
+		}
+		p++;
+		switch( *p++ ) {
+			case '"':  *out++ = '"';  break;
+			case '\\': *out++ = '\\'; break;
+			case '/':  *out++ = '/';  break;
+			case 'b':  *out++ = '\b'; break;
+			case 'f':  *out++ = '\f'; break;
+			case 'n':  *out++ = '\n'; break;
+			case 'r':  *out++ = '\r'; break;
+			case 't':  *out++ = '\t'; break;
+			case 'u': {
+				unsigned long cp, low;
+				if( json_hex4( p, &cp ) ) {
+					return NULL;
+				}
+				p += 4;
+				if( cp >= 0xD800 && cp < 0xDC00 ) {
+					// high surrogate, the low one must follow
+					if( '\\' != p[0] || 'u' != p[1] || json_hex4( p+2, &low ) || low < 0xDC00 || low >= 0xE000 ) {
+						return NULL;
+					}
+					p += 6;
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				} else if( ( cp >= 0xDC00 && cp < 0xE000 ) || 0 == cp ) {
+					return NULL;
+				}
+				out = json_put_utf8( out, cp );
+				break;
+			}
+			default:
+				return NULL;
+		}
+	}
+	*out = '\0';
+	return p+1;
+}//eo json_parse_string
 
-	char format[MAX_COMMAND_LEN+1];  
+int json_object_parse( const char *text, json_member_cb_t cb, void *data )
+{
+	assert( NULL!=text );
+	assert( NULL!=cb );
 
-	va_list args;
-	va_start (args, fmt);
+	char key[MAX_JSON_KEY_LEN+1];
+	char *value = malloc( strlen(text)+1 );
+	if( NULL == value ) {
+		return -1;
+	}
 
-	snprintf(format, MAX_COMMAND_LEN, "%s %s", OPENSSL_PATH, fmt);
-	format[MAX_COMMAND_LEN]=0;
+	int res = -1;
+	const char *p = json_skip_spaces( text );
+	if( '{' != *p++ ) {
+		DEBUG_PRN("json_object_parse: not an object");
+		goto cleanup;
+	}
 
-	// executing
-	int res = vcall_command(format, args);
+	p = json_skip_spaces( p );
+	int first = 1;
+	while( '}' != *p ) {
+		if( !first ) {
+			if( ',' != *p ) {
+				goto syntax;
+			}
+			p = json_skip_spaces( p+1 );
+		}
+		first = 0;
 
-	// cleanup
-	secure_memzero(format, MAX_COMMAND_LEN);
-	va_end (args);
+		// the key is decoded in the value buffer, then checked against its maximum size
+		p = json_parse_string( p, value );
+		if( NULL == p || strlcpy( key, value, sizeof(key) ) >= sizeof(key) ) {
+			goto syntax;
+		}
+		p = json_skip_spaces( p );
+		if( ':' != *p ) {
+			goto syntax;
+		}
+		p = json_skip_spaces( p+1 );
+
+		if( '[' == *p ) {
+			p = json_skip_spaces( p+1 );
+			int first_item = 1;
+			while( ']' != *p ) {
+				if( !first_item ) {
+					if( ',' != *p ) {
+						goto syntax;
+					}
+					p = json_skip_spaces( p+1 );
+				}
+				first_item = 0;
+				p = json_parse_string( p, value );
+				if( NULL == p ) {
+					goto syntax;
+				}
+				if( cb( data, key, value ) ) {
+					goto cleanup;
+				}
+				p = json_skip_spaces( p );
+			}
+			p++;
+		} else {
+			p = json_parse_string( p, value );
+			if( NULL == p ) {
+				goto syntax;
+			}
+			if( cb( data, key, value ) ) {
+				goto cleanup;
+			}
+		}
+		p = json_skip_spaces( p );
+	}
+
+	if( '\0' != *json_skip_spaces( p+1 ) ) {
+		goto syntax;
+	}
+	res = 0;
+	goto cleanup;
 
+syntax:
+	DEBUG_PRN("json_object_parse: syntax error at offset %zu", NULL != p ? (size_t)(p-text) : (size_t)0);
+cleanup:
+	free( value );
 	return res;
+}//eo json_object_parse
 
-}//eo call_openssl
+ssize_t json_escape( char *out, const size_t max, const char *in )
+{
+	assert( NULL!=out );
+	assert( NULL!=in );
+
+	size_t len = 0;
+	for( ; '\0' != *in; in++ ) {
+		char esc[8];
+		const unsigned char c = (unsigned char)*in;
+		if( '"' == c || '\\' == c ) {
+			snprintf( esc, sizeof(esc), "\\%c", c );
+		} else if( '\n' == c ) {
+			strcpy( esc, "\\n" );
+		} else if( '\t' == c ) {
+			strcpy( esc, "\\t" );
+		} else if( c < 0x20 ) {
+			snprintf( esc, sizeof(esc), "\\u%04x", c );
+		} else {
+			esc[0] = (char)c;
+			esc[1] = '\0';
+		}
+		size_t n = strlen( esc );
+		if( len+n+1 > max ) {
+			return -1;
+		}
+		memcpy( out+len, esc, n );
+		len += n;
+	}
+	out[len] = '\0';
+	return len;
+}//eo json_escape
 
-void _print_debug(const char* prefix, const char* fname, const int lnum, const char *fmt, ... )
-{	
+/**
+ * \brief Level of the messages of one module
+ */
+typedef struct SLogFilter {
+	char module[MAX_LOG_MODULE_LEN+1];
+	int  level;
+} s_log_filter_t;
+
+/**
+ * \brief Messages waiting for the logging thread
+ */
+typedef struct SLogRing {
+	pthread_mutex_t lock;
+	pthread_cond_t  queued;
+	pthread_cond_t  drained;
+	char            lines[LOG_RING_SIZE][MAX_LOG_LINE];
+	unsigned        first;
+	unsigned        count;
+	unsigned long   dropped;
+	int             writing;   // a line taken from the ring is being written
+	int             running;
+	int             stopping;
+	pthread_t       thread;
+	FILE           *out;
+} s_log_ring_t;
+
+static const char *const log_level_names[] = { "off", "error", "warn", "info", "debug", "trace" };
+
+#if !defined(NDEBUG)
+#define LOG_DEFAULT_LEVEL (LogDebug)
+#else
+#define LOG_DEFAULT_LEVEL (LogWarn)
+#endif
+
+int log_max_level = LOG_DEFAULT_LEVEL;
+
+static int            log_default_level = LOG_DEFAULT_LEVEL;
+static s_log_filter_t log_filters[MAX_LOG_FILTERS];
+static unsigned       log_nb_filters = 0;
+
+static s_log_ring_t log_ring = {
+	.lock    = PTHREAD_MUTEX_INITIALIZER,
+	.queued  = PTHREAD_COND_INITIALIZER,
+	.drained = PTHREAD_COND_INITIALIZER
+};
+
+static int log_level_from_name( const char *name, const size_t len )
+{
+	for( unsigned i=0; i<sizeof(log_level_names)/sizeof(log_level_names[0]); i++ ) {
+		if( strlen(log_level_names[i]) == len && 0 == strncmp( name, log_level_names[i], len ) ) {
+			return (int)i;
+		}
+	}
+	return -1;
+}//eo log_level_from_name
+
+static void* log_writer( void *data )
+{
+	s_log_ring_t *ring = (s_log_ring_t*)data;
+	char line[MAX_LOG_LINE];
+
+	pthread_mutex_lock( &(ring->lock) );
+	for(;;) {
+		while( 0 == ring->count && 0 == ring->dropped && !ring->stopping ) {
+			pthread_cond_wait( &(ring->queued), &(ring->lock) );
+		}
+		if( 0 == ring->count && 0 == ring->dropped ) {
+			break;
+		}
+
+		unsigned long dropped = ring->dropped;
+		ring->dropped = 0;
+		int has_line = ring->count > 0;
+		if( has_line ) {
+			memcpy( line, ring->lines[ring->first], MAX_LOG_LINE );
+			ring->first = (ring->first + 1) % LOG_RING_SIZE;
+			ring->count--;
+		}
+		ring->writing = 1;
+		pthread_mutex_unlock( &(ring->lock) );
+
+		// the producers are not blocked while writing
+		if( has_line ) {
+			fputs( line, ring->out );
+		}
+		if( dropped ) {
+			fprintf( ring->out, "WARN[log] %lu message(s) dropped\n", dropped );
+		}
+
+		pthread_mutex_lock( &(ring->lock) );
+		ring->writing = 0;
+		if( 0 == ring->count ) {
+			fflush( ring->out );
+			pthread_cond_broadcast( &(ring->drained) );
+		}
+	}
+	fflush( ring->out );
+	pthread_cond_broadcast( &(ring->drained) );
+	pthread_mutex_unlock( &(ring->lock) );
+	return NULL;
+}//eo log_writer
+
+static void log_stop( void )
+{
+	pthread_mutex_lock( &(log_ring.lock) );
+	if( !log_ring.running ) {
+		pthread_mutex_unlock( &(log_ring.lock) );
+		return;
+	}
+	log_ring.stopping = 1;
+	pthread_cond_signal( &(log_ring.queued) );
+	pthread_mutex_unlock( &(log_ring.lock) );
+
+	pthread_join( log_ring.thread, NULL );
+	log_ring.running = 0;
+}//eo log_stop
+
+int log_configure( const char *spec )
+{
+	if( NULL == spec || '\0' == spec[0] ) {
+		return 0;
+	}
+
+	int            dflt = log_default_level;
+	s_log_filter_t filters[MAX_LOG_FILTERS];
+	unsigned       nb_filters = 0;
+
+	const char *p = spec;
+	while( '\0' != *p ) {
+		size_t len = strcspn( p, "," );
+		const char *eq = memchr( p, '=', len );
+
+		if( NULL == eq ) {
+			dflt = log_level_from_name( p, len );
+			if( dflt < 0 ) {
+				warn("Unknown log level '%.*s'", (int)len, p);
+				return -1;
+			}
+		} else {
+			size_t mlen = eq - p;
+			int level = log_level_from_name( eq+1, len-mlen-1 );
+			if( 0 == mlen || mlen > MAX_LOG_MODULE_LEN || level < 0 || nb_filters == MAX_LOG_FILTERS ) {
+				warn("Invalid log filter '%.*s'", (int)len, p);
+				return -1;
+			}
+			memcpy( filters[nb_filters].module, p, mlen );
+			filters[nb_filters].module[mlen] = '\0';
+			filters[nb_filters].level = level;
+			nb_filters++;
+		}
+		p += len;
+		if( ',' == *p ) {
+			p++;
+		}
+	}
+
+	int max = dflt;
+	for( unsigned i=0; i<nb_filters; i++ ) {
+		log_filters[i] = filters[i];
+		if( filters[i].level > max ) {
+			max = filters[i].level;
+		}
+	}
+	log_nb_filters    = nb_filters;
+	log_default_level = dflt;
+	log_max_level     = max;
+	return 0;
+}//eo log_configure
+
+int log_enabled( const e_log_level level, const char *fname )
+{
+	if( 0 == log_nb_filters ) {
+		return (int)level <= log_default_level;
+	}
+
+	const char *module = strrchr( fname, '/' );
+	module = ( NULL != module ) ? module+1 : fname;
+	size_t len = strcspn( module, "." );
+
+	for( unsigned i=0; i<log_nb_filters; i++ ) {
+		if( 0 == strncmp( log_filters[i].module, module, len ) && '\0' == log_filters[i].module[len] ) {
+			return (int)level <= log_filters[i].level;
+		}
+	}
+	return (int)level <= log_default_level;
+}//eo log_enabled
+
+void log_write( const e_log_level level, const char *fname, const int lnum, const char *fmt, ... )
+{
+	char line[MAX_LOG_LINE];
+	const char *prefix = ( (unsigned)level < sizeof(log_level_names)/sizeof(log_level_names[0]) ) ? log_level_names[level] : "?";
+
+	int n = snprintf( line, sizeof(line), "%s[%s:%d] ", prefix, fname, lnum );
+	if( n < 0 || n >= MAX_LOG_LINE-1 ) {
+		n = 0;
+	}
 	va_list args;
-	va_start (args, fmt);
+	va_start( args, fmt );
+	int m = vsnprintf( line+n, sizeof(line)-n-1, fmt, args );
+	va_end( args );
+	size_t len = ( m < 0 ) ? (size_t)n : strnlen( line, sizeof(line)-2 );
+	line[len]   = '\n';
+	line[len+1] = '\0';
+
+	pthread_mutex_lock( &(log_ring.lock) );
+	if( !log_ring.running ) {
+		pthread_mutex_unlock( &(log_ring.lock) );
+		fputs( line, stderr );
+		return;
+	}
+	if( LOG_RING_SIZE == log_ring.count ) {
+		log_ring.dropped++;
+	} else {
+		memcpy( log_ring.lines[(log_ring.first + log_ring.count) % LOG_RING_SIZE], line, len+2 );
+		log_ring.count++;
+	}
+	pthread_cond_signal( &(log_ring.queued) );
+	pthread_mutex_unlock( &(log_ring.lock) );
+}//eo log_write
 
-	fprintf( stderr,"%s[%s:%d] ", prefix, fname, lnum);
-	vfprintf( stderr, fmt, args);
-	fprintf( stderr,"\n");
+int log_start( FILE *out )
+{
+	assert( NULL!=out );
 
-	va_end(args);
-}//eo print_debug
+	pthread_mutex_lock( &(log_ring.lock) );
+	if( log_ring.running ) {
+		pthread_mutex_unlock( &(log_ring.lock) );
+		return 0;
+	}
+	log_ring.out      = out;
+	log_ring.stopping = 0;
+	int err = pthread_create( &(log_ring.thread), NULL, log_writer, &log_ring );
+	log_ring.running  = ( 0 == err );
+	pthread_mutex_unlock( &(log_ring.lock) );
+
+	if( err ) {
+		warn("Failed to start the logging thread: %s", strerror(err));
+		return -1;
+	}
+
+	static int registered = 0;
+	if( !registered ) {
+		atexit( log_stop );
+		registered = 1;
+	}
+	return 0;
+}//eo log_start
+
+void log_flush( void )
+{
+	pthread_mutex_lock( &(log_ring.lock) );
+	while( log_ring.running && ( log_ring.count > 0 || log_ring.writing ) ) {
+		pthread_cond_wait( &(log_ring.drained), &(log_ring.lock) );
+	}
+	pthread_mutex_unlock( &(log_ring.lock) );
+}//eo log_flush
+
+static __thread warn_sink_t warn_sink      = NULL;
+static __thread void       *warn_sink_data = NULL;
+
+void warn_redirect( warn_sink_t sink, void *data )
+{
+	warn_sink      = sink;
+	warn_sink_data = data;
+}//eo warn_redirect
 
 void vwarn( const char * fmt, va_list args ) 
 {
+	if( NULL != warn_sink ) {
+		char message[MAX_LOG_LINE];
+		vsnprintf( message, sizeof(message), fmt, args );
+		warn_sink( warn_sink_data, message );
+		return;
+	}
 	fprintf( stderr,"WARNING: ");
 	vfprintf( stderr, fmt, args);
 	fprintf( stderr,"\n");
@@ -384,21 +1230,263 @@ void die( int code, const char * fmt, ...)
 
 ssize_t write_to_file(const char* fname, size_t size, const char * data)
 {
-	FILE* fp = fopen(fname,"w");
-	if( fp == NULL ) {
-		printf("Error during opening to write\n");
+	TRACE_SPAN( span, "write file", fname );
+	s_atomic_group_t grp;
+
+	atomic_group_init( &grp );
+	atomic_group_write( &grp, fname, data, size );
+	if( atomic_group_commit( &grp ) ) {
+		DEBUG_PRN("write_to_file: failed to write '%s'", fname);
 		return -1;
 	}
-	ssize_t res = fwrite(data, sizeof(char), size, fp );
-	fclose(fp);
 
-	if( res == 0 ) {
-		printf("Error during writing file\n");
+	return size;
+}//eo write_to_file
+
+void atomic_group_init( s_atomic_group_t *grp )
+{
+	grp->files    = NULL;
+	grp->nb_files = 0;
+	grp->capacity = 0;
+	grp->failed   = 0;
+}//eo atomic_group_init
+
+FILE* atomic_group_open( s_atomic_group_t *grp, const char *path )
+{
+	// unique among the threads of the process, each using its own group
+	static unsigned tmp_counter = 0;
+	struct stat st;
+
+	if( grp->nb_files == grp->capacity ) {
+		unsigned capacity = grp->capacity ? 2*grp->capacity : ATOMIC_GROUP_INITIAL_SIZE;
+		s_atomic_file_t *files = realloc( grp->files, capacity*sizeof(s_atomic_file_t) );
+		if( NULL == files ) {
+			DEBUG_PRN("atomic_group_open: allocation failed for %u files", capacity);
+			grp->failed = 1;
+			return NULL;
+		}
+		grp->files    = files;
+		grp->capacity = capacity;
+	}
+
+	s_atomic_file_t *file = &(grp->files[grp->nb_files]);
+	unsigned n = __sync_fetch_and_add( &tmp_counter, 1 );
+	if( strlcpy( file->path, path, sizeof(file->path) ) >= sizeof(file->path)
+	 || snprintf( file->tmp_path, sizeof(file->tmp_path), "%s.tmp%ld.%u", path, (long)getpid(), n ) >= (int)sizeof(file->tmp_path) ) {
+		DEBUG_PRN("atomic_group_open: path too long '%s'", path);
+		grp->failed = 1;
+		return NULL;
+	}
+
+	int fd = open( file->tmp_path, O_WRONLY|O_CREAT|O_EXCL, 0666 );
+	if( fd < 0 ) {
+		DEBUG_PRN("atomic_group_open: failed to create '%s': %s", file->tmp_path, strerror(errno));
+		grp->failed = 1;
+		return NULL;
+	}
+
+	// replacing a file must not change who can read it
+	if( 0 == stat( path, &st ) && fchmod( fd, st.st_mode & 07777 ) ) {
+		DEBUG_PRN("atomic_group_open: failed to set the permissions of '%s'", file->tmp_path);
+		close( fd );
+		unlink( file->tmp_path );
+		grp->failed = 1;
+		return NULL;
+	}
+
+	file->fp = fdopen( fd, "w" );
+	if( NULL == file->fp ) {
+		close( fd );
+		unlink( file->tmp_path );
+		grp->failed = 1;
+		return NULL;
+	}
+
+	grp->nb_files++;
+	return file->fp;
+}//eo atomic_group_open
+
+int atomic_group_write( s_atomic_group_t *grp, const char *path, const void *data, const size_t size )
+{
+	FILE *fp = atomic_group_open( grp, path );
+	if( NULL == fp ) {
+		return -1;
+	}
+	if( size > 0 && fwrite( data, 1, size, fp ) != size ) {
+		DEBUG_PRN("atomic_group_write: failed to write '%s'", path);
+		grp->failed = 1;
 		return -1;
-	} 
+	}
+	return 0;
+}//eo atomic_group_write
+
+// release the group, removing the files not renamed yet
+static void atomic_group_release( s_atomic_group_t *grp, const unsigned first_pending )
+{
+	for( unsigned i=0; i<grp->nb_files; i++ ) {
+		if( NULL != grp->files[i].fp ) {
+			fclose( grp->files[i].fp );
+		}
+		if( i >= first_pending ) {
+			unlink( grp->files[i].tmp_path );
+		}
+	}
+	free( grp->files );
+	atomic_group_init( grp );
+}//eo atomic_group_release
 
+// 1 if all the opened descriptors live on the same file system as the first one
+static int atomic_group_single_fs( const int *fds, const unsigned nb )
+{
+	struct stat st0, st;
+	if( fstat( fds[0], &st0 ) ) {
+		return 0;
+	}
+	for( unsigned i=1; i<nb; i++ ) {
+		if( fstat( fds[i], &st ) || st.st_dev != st0.st_dev ) {
+			return 0;
+		}
+	}
+	return 1;
+}//eo atomic_group_single_fs
+
+// one barrier for several descriptors: syncfs when possible, fsync each otherwise
+static int atomic_group_sync( const int *fds, const unsigned nb )
+{
+#if defined(__linux__) && defined(SYS_syncfs)
+	if( nb > 1 && atomic_group_single_fs( fds, nb ) ) {
+		if( 0 == syscall( SYS_syncfs, fds[0] ) ) {
+			return 0;
+		}
+		DDEBUG_PRN("atomic_group_sync: syncfs failed (%s), falling back on fsync", strerror(errno));
+	}
+#else
+	(void)atomic_group_single_fs;
+#endif
+	for( unsigned i=0; i<nb; i++ ) {
+		if( fsync( fds[i] ) ) {
+			DEBUG_PRN("atomic_group_sync: fsync failed: %s", strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}//eo atomic_group_sync
+
+// flush the renames: one descriptor per distinct parent directory
+static int atomic_group_sync_dirs( s_atomic_group_t *grp )
+{
+	char (*dirs)[MAX_FILE_PATH+1] = malloc( grp->nb_files * sizeof(*dirs) );
+	int  *fds = malloc( grp->nb_files * sizeof(int) );
+	unsigned nb_dirs = 0;
+	int res = ( NULL==dirs || NULL==fds ) ? -1 : 0;
+
+	for( unsigned i=0; i<grp->nb_files && 0==res; i++ ) {
+		const char *path  = grp->files[i].path;
+		const char *slash = strrchr( path, '/' );
+		char *dir = dirs[nb_dirs];
+		if( NULL == slash ) {
+			strcpy( dir, "." );
+		} else if( slash == path ) {
+			strcpy( dir, "/" );
+		} else {
+			memcpy( dir, path, slash-path );
+			dir[slash-path] = '\0';
+		}
+
+		unsigned j = 0;
+		while( j<nb_dirs && strcmp( dirs[j], dir ) ) {
+			j++;
+		}
+		if( j < nb_dirs ) {
+			continue;
+		}
+
+		fds[nb_dirs] = open( dir, O_RDONLY|O_DIRECTORY );
+		if( fds[nb_dirs] < 0 ) {
+			DEBUG_PRN("atomic_group_sync_dirs: failed to open '%s': %s", dir, strerror(errno));
+			res = -1;
+			break;
+		}
+		nb_dirs++;
+	}
+
+	if( 0 == res && nb_dirs > 0 ) {
+		res = atomic_group_sync( fds, nb_dirs );
+	}
+	for( unsigned i=0; i<nb_dirs; i++ ) {
+		close( fds[i] );
+	}
+	free( fds );
+	free( dirs );
 	return res;
-}//eo write_to_file
+}//eo atomic_group_sync_dirs
+
+int atomic_group_commit( s_atomic_group_t *grp )
+{
+	// the files are released before the span ends
+	char detail[MAX_TRACE_ARG_LEN+1] = "";
+	TRACE_SPAN( span, "commit files", detail );
+	if( span.start && grp->nb_files ) {
+		// a long path keeps its end, where the file name is
+		const char *path = grp->files[0].path;
+		const int   len  = snprintf( detail, sizeof(detail), "%u file(s): %s", grp->nb_files, path );
+		if( len >= (int)sizeof(detail) ) {
+			const size_t room = sizeof(detail)-1 - (size_t)(len - (int)strlen(path)) - 3;
+			snprintf( detail, sizeof(detail), "%u file(s): ...%s", grp->nb_files, path + strlen(path) - room );
+		}
+	}
+	int res = grp->failed ? -1 : 0;
+	if( 0 == grp->nb_files ) {
+		atomic_group_release( grp, 0 );
+		return res;
+	}
+
+	int *fds = malloc( grp->nb_files * sizeof(int) );
+	if( NULL == fds ) {
+		res = -1;
+	}
+	for( unsigned i=0; i<grp->nb_files && 0==res; i++ ) {
+		FILE *fp = grp->files[i].fp;
+		if( fflush( fp ) || ferror( fp ) ) {
+			DEBUG_PRN("atomic_group_commit: failed to write '%s'", grp->files[i].tmp_path);
+			res = -1;
+		}
+		fds[i] = fileno( fp );
+	}
+
+	if( 0 == res ) {
+		res = atomic_group_sync( fds, grp->nb_files );
+	}
+	free( fds );
+
+	for( unsigned i=0; i<grp->nb_files; i++ ) {
+		if( fclose( grp->files[i].fp ) ) {
+			res = -1;
+		}
+		grp->files[i].fp = NULL;
+	}
+	if( res ) {
+		atomic_group_release( grp, 0 );
+		return -1;
+	}
+
+	for( unsigned i=0; i<grp->nb_files; i++ ) {
+		if( rename( grp->files[i].tmp_path, grp->files[i].path ) ) {
+			DEBUG_PRN("atomic_group_commit: failed to rename '%s': %s", grp->files[i].tmp_path, strerror(errno));
+			atomic_group_release( grp, i );
+			return -1;
+		}
+	}
+
+	res = atomic_group_sync_dirs( grp );
+	atomic_group_release( grp, grp->nb_files );
+	return res;
+}//eo atomic_group_commit
+
+void atomic_group_abort( s_atomic_group_t *grp )
+{
+	atomic_group_release( grp, 0 );
+}//eo atomic_group_abort
 
 
 ssize_t prompt( const char* message, char * result, size_t max_size ) 
@@ -450,21 +1538,132 @@ int strtoint(const char* str, int* ival)
     return 0;
 }//eo strtoint
 
+/*
+ * Hex codec: the secrets of the Shamir split/recovery go through it, so
+ * neither the encoder nor the decoder branch or index memory on the data.
+ * The SSSE3 kernels translate with pshufb/compare masks, the scalar code
+ * with arithmetic; the decoder accumulates an error mask and only looks at
+ * it once everything is decoded.
+ */
+
+/**
+ * \brief Upper case hex digit of a nibble, without branch nor table
+ */
+static inline char hex_digit_ct( const uint32_t n )
+{
+	return (char)( n + '0' + (((9 - n) >> 8) & 7) );
+}//eo hex_digit_ct
+
+/**
+ * \brief Value of an hex digit (either case), without branch nor table
+ *
+ * \param c    character to decode
+ * \param err  set to non zero bits if c is not an hex digit
+ */
+static inline uint32_t hex_nibble_ct( const uint32_t c, uint32_t *err )
+{
+	const uint32_t num      = c ^ 0x30;                                      // '0'..'9' -> 0..9
+	const uint32_t num_ok   = ((num - 10) >> 8) & 0xFF;                      // 0xFF when num < 10
+	const uint32_t alpha    = (c & ~0x20u) - 55;                             // 'A'..'F', 'a'..'f' -> 10..15
+	const uint32_t alpha_ok = (((alpha - 10) ^ (alpha - 16)) >> 8) & 0xFF;   // 0xFF when 10 <= alpha < 16
+
+	*err |= ~(num_ok | alpha_ok) & 0xFF;
+	return ((num_ok & num) | (alpha_ok & alpha)) & 0x0F;
+}//eo hex_nibble_ct
+
+#if defined(UTILS_X86_SIMD)
+
+__attribute__ ((target("ssse3")))
+static size_t hex_encode_ssse3( char *out, const uint8_t *in, const size_t in_size )
+{
+	const __m128i digits = _mm_setr_epi8( '0','1','2','3','4','5','6','7','8','9','A','B','C','D','E','F' );
+	const __m128i nibble = _mm_set1_epi8( 0x0F );
+	size_t i = 0;
+
+	// 16 bytes to 32 characters
+	for( ; i+16<=in_size; i+=16, out+=32 ) {
+		const __m128i v  = _mm_loadu_si128( (const __m128i*)(in+i) );
+		const __m128i hi = _mm_shuffle_epi8( digits, _mm_and_si128( _mm_srli_epi16( v, 4 ), nibble ) );
+		const __m128i lo = _mm_shuffle_epi8( digits, _mm_and_si128( v, nibble ) );
+		_mm_storeu_si128( (__m128i*)out,      _mm_unpacklo_epi8( hi, lo ) );
+		_mm_storeu_si128( (__m128i*)(out+16), _mm_unpackhi_epi8( hi, lo ) );
+	}
+	return i;
+}//eo hex_encode_ssse3
+
+__attribute__ ((target("ssse3")))
+static inline __m128i hex_nibbles_ssse3( const __m128i c, __m128i *err )
+{
+	const __m128i num      = _mm_sub_epi8( c, _mm_set1_epi8('0') );
+	const __m128i num_ok   = _mm_cmpeq_epi8( _mm_min_epu8( num, _mm_set1_epi8(9) ), num );
+	const __m128i alpha    = _mm_sub_epi8( _mm_andnot_si128( _mm_set1_epi8(0x20), c ), _mm_set1_epi8('A') );
+	const __m128i alpha_ok = _mm_cmpeq_epi8( _mm_min_epu8( alpha, _mm_set1_epi8(5) ), alpha );
+
+	*err = _mm_or_si128( *err, _mm_andnot_si128( _mm_or_si128( num_ok, alpha_ok ), _mm_set1_epi8(-1) ) );
+	return _mm_or_si128( _mm_and_si128( num_ok, num ),
+	                     _mm_and_si128( alpha_ok, _mm_add_epi8( alpha, _mm_set1_epi8(10) ) ) );
+}//eo hex_nibbles_ssse3
+
+__attribute__ ((target("ssse3")))
+static size_t hex_decode_ssse3( uint8_t *out, const char *in, const size_t len, uint32_t *err )
+{
+	const __m128i weights = _mm_set1_epi16( 0x0110 );  // high nibble * 16 + low nibble
+	__m128i bad = _mm_setzero_si128();
+	size_t i = 0;
+
+	// 32 characters to 16 bytes
+	for( ; i+32<=len; i+=32, out+=16 ) {
+		const __m128i v0 = hex_nibbles_ssse3( _mm_loadu_si128( (const __m128i*)(in+i) ),    &bad );
+		const __m128i v1 = hex_nibbles_ssse3( _mm_loadu_si128( (const __m128i*)(in+i+16) ), &bad );
+		_mm_storeu_si128( (__m128i*)out,
+			_mm_packus_epi16( _mm_maddubs_epi16( v0, weights ), _mm_maddubs_epi16( v1, weights ) ) );
+	}
+	*err |= (uint32_t)_mm_movemask_epi8( bad );
+	return i;
+}//eo hex_decode_ssse3
+
+#endif // UTILS_X86_SIMD
+
+/**
+ * \brief Whether the SSSE3 hex kernels may be used, checked once
+ */
+static int hex_use_ssse3()
+{
+#if defined(UTILS_X86_SIMD)
+	static int ssse3 = -1;
+	if( ssse3 < 0 ) {
+		__builtin_cpu_init();
+		ssse3 = __builtin_cpu_supports("ssse3") ? 1 : 0;
+	}
+	return ssse3;
+#else
+	return 0;
+#endif
+}//eo hex_use_ssse3
+
 ssize_t hex_encode(char *out, const size_t max_out, const uint8_t *in, const size_t in_size )
 {
-	DDEBUG_PRN("hex_encode( out:%p, max_out:%u, in:%p, in_size:%u", out, max_out, in, in_size);
+	DDEBUG_PRN("hex_encode( out:%p, max_out:%zu, in:%p, in_size:%zu", out, max_out, in, in_size);
+	TRACE_SPAN( span, "hex encode", NULL );
 
   	size_t  out_size  = 2*in_size+1;
  
   	if( max_out < out_size ){
-  		DEBUG_PRN("Output buffer insufficient for the hex encoded data (%u<%u)", max_out, out_size );
+  		DEBUG_PRN("Output buffer insufficient for the hex encoded data (%zu<%zu)", max_out, out_size );
   		return -1;
  	}
 
-	secure_memzero(out,out_size);
-	for( unsigned i = 0; i<in_size; i++){		
-		sprintf(out+i*2, "%02X", in[i]);
-  	}
+	size_t i = 0;
+#if defined(UTILS_X86_SIMD)
+	if( hex_use_ssse3() ) {
+		i = hex_encode_ssse3( out, in, in_size );
+	}
+#endif
+	for( ; i<in_size; i++ ) {
+		out[2*i]   = hex_digit_ct( in[i] >> 4 );
+		out[2*i+1] = hex_digit_ct( in[i] & 0x0F );
+	}
+	out[out_size-1] = '\0';
  
 	return out_size-1;
 }//eo hex_encode
@@ -472,32 +1671,40 @@ ssize_t hex_encode(char *out, const size_t max_out, const uint8_t *in, const siz
 
 ssize_t hex_decode(uint8_t* out, const size_t max_out, const char *in )
 {
-	long s;
-	int i=0;
+	TRACE_SPAN( span, "hex decode", NULL );
 	size_t lim = strlen(in);
 	if( lim % 2 ){
-  		DEBUG_PRN("Invalid size to decode an hex encoded value %u", lim);
+  		DEBUG_PRN("Invalid size to decode an hex encoded value %zu", lim);
   		return -1;
 	}
 
 	size_t out_size = lim/2;
 	if( max_out < out_size ){
-		DEBUG_PRN("Output buffer insufficient for the hex encoded data (%u<%u)", max_out, out_size );
+		DEBUG_PRN("Output buffer insufficient for the hex encoded data (%zu<%zu)", max_out, out_size );
 		return -1;
 	}
 
-	char hex[3];
-	secure_memzero(out,lim);
+	uint32_t err = 0;
+	size_t   idx = 0;
+#if defined(UTILS_X86_SIMD)
+	if( hex_use_ssse3() ) {
+		idx = hex_decode_ssse3( out, in, lim, &err );
+	}
+#endif
+	for( ; idx<lim; idx+=2 ) {
+		const uint32_t hi = hex_nibble_ct( (uint8_t)in[idx],   &err );
+		const uint32_t lo = hex_nibble_ct( (uint8_t)in[idx+1], &err );
+		out[idx/2] = (uint8_t)( (hi << 4) | lo );
+	}
 
-	for( unsigned idx = 0; idx<lim; idx=idx+2 ){
-		memset(hex,0,3);
-		memcpy(hex, &in[idx], 2);
-		s = strtol(hex,NULL,16);
-		out[i]=(char)s;
-		i++;
+	// checked only once the whole input is decoded
+	if( err ) {
+		DEBUG_PRN("Invalid character in an hex encoded value");
+		secure_memzero( out, out_size );
+		return -1;
 	}
   
-  return i;
+	return out_size;
 }//eo hex_decode
 
 
@@ -511,42 +1718,126 @@ void chomp( char * line )
 }//eo chomp
 
 
-ssize_t file_slurp( const char *fname, uint8_t* buffer, const size_t max_size )
+// pseudo files have no meaningful size: read them chunk by chunk
+static int file_view_read( const int fd, s_file_view_t *view )
 {
-	FILE *f = fopen(fname, "rb");
-	if( NULL == f ){
-		DEBUG_PRN("slurp(%s: failed to open file", fname);
-		return -1;
+	size_t capacity = 0;
+	uint8_t *data = NULL;
+
+	for(;;) {
+		if( view->size == capacity ) {
+			capacity = capacity ? 2*capacity : 4096;
+			uint8_t *bigger = realloc( data, capacity );
+			if( NULL == bigger ) {
+				break;
+			}
+			data = bigger;
+		}
+		ssize_t n = read( fd, data + view->size, capacity - view->size );
+		if( n < 0 && errno == EINTR ) continue;
+		if( n == 0 ) {
+			view->data = data;
+			return 0;
+		}
+		if( n < 0 ) {
+			break;
+		}
+		view->size += n;
+	}//eo foreach chunk
+
+	if( NULL != data ) {
+		secure_memzero( data, view->size );
 	}
-	fseek(f, 0, SEEK_END);
-	size_t fsize = ftell(f);
-	fseek(f, 0, SEEK_SET);  //same as rewind(f);
+	free( data );
+	view->size = 0;
+	return -1;
+}//eo file_view_read
 
-	if( fsize > max_size ) {
-		DEBUG_PRN("slurp(%s): not enough room for the file size (%u>%u)", fname, fsize, max_size );
-		return -1;	
+int file_view_open( const char *fname, s_file_view_t *view )
+{
+	struct stat st;
+
+	view->data   = NULL;
+	view->size   = 0;
+	view->mapped = 0;
+
+	int fd = open( fname, O_RDONLY );
+	if( fd < 0 ) {
+		DEBUG_PRN("file_view_open: failed to open '%s': %s", fname, strerror(errno) );
+		return -1;
 	}
-		
-	size_t r = fread(buffer, fsize, 1, f);
-	if( r < 1 ) {
-		if( feof(f)) {
-			return fsize;
+	if( fstat( fd, &st ) ) {
+		DEBUG_PRN("file_view_open: failed to stat '%s': %s", fname, strerror(errno) );
+		close( fd );
+		return -1;
+	}
+
+	int res = 0;
+	if( S_ISREG(st.st_mode) && st.st_size > 0 ) {
+		void *map = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if( MAP_FAILED == map ) {
+			DEBUG_PRN("file_view_open: failed to map '%s': %s", fname, strerror(errno) );
+			res = -1;
 		} else {
-			DEBUG_PRN(
-				"slurp(%s): error encountered while reading file, %u bytes expected but got %d return", 
-				fname, fsize, r 
-			);
-			return -1;
+			view->data   = map;
+			view->size   = (size_t)st.st_size;
+			view->mapped = 1;
 		}
+	} else {
+		res = file_view_read( fd, view );
+		if( res ) {
+			DEBUG_PRN("file_view_open: failed to read '%s'", fname );
+		}
+	}
 
+	// the mapping stays valid once the descriptor is closed
+	close( fd );
+	return res;
+}//eo file_view_open
+
+void file_view_close( s_file_view_t *view, const int flags )
+{
+	if( NULL == view->data ) {
+		return;
+	}
+
+	void *data = (void*)view->data;
+	if( view->mapped ) {
+		// private mapping: the wipe only touches our copy on write pages, never the file
+		if( (flags & FILE_VIEW_WIPE) && 0 == mprotect( data, view->size, PROT_READ|PROT_WRITE ) ) {
+			secure_memzero( data, view->size );
+		}
+		munmap( data, view->size );
+	} else {
+		if( flags & FILE_VIEW_WIPE ) {
+			secure_memzero( data, view->size );
+		}
+		free( data );
 	}
 
-	if( fclose(f) ) {
-		DEBUG_PRN("slurp(%s): error when closing file", fname);
+	view->data   = NULL;
+	view->size   = 0;
+	view->mapped = 0;
+}//eo file_view_close
+
+ssize_t file_slurp( const char *fname, uint8_t* buffer, const size_t max_size )
+{
+	s_file_view_t view;
+
+	if( file_view_open( fname, &view ) ) {
 		return -1;
 	}
-	
-	return fsize;
+
+	ssize_t res = -1;
+	if( view.size > max_size ) {
+		DEBUG_PRN("slurp(%s): not enough room for the file size (%zu>%zu)", fname, view.size, max_size );
+	} else {
+		memcpy( buffer, view.data, view.size );
+		res = (ssize_t)view.size;
+	}
+
+	file_view_close( &view, 0 );
+	return res;
 }//eo slurp
 
 
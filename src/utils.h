@@ -22,19 +22,84 @@
 #include <math.h>
 
 
-void _print_debug(const char* prefix, const char* fname, const int lnum, const char *fmt, ... );
+/**
+ * \brief Levels of the diagnostic messages, from the least to the most verbose
+ */
+typedef enum ELogLevel {
+    LogOff   = 0,
+    LogError = 1,
+    LogWarn  = 2,
+    LogInfo  = 3,
+    LogDebug = 4,
+    LogTrace = 5
+} e_log_level;
 
-#if !defined(NDEBUG)
-#define DEBUG_PRN(...) ( _print_debug("DEBUG", __FILE__, __LINE__, __VA_ARGS__ ))
-#else
-#define DEBUG_PRN(...)
-#endif
+// environment variable holding the logging configuration, see log_configure
+#define LOG_ENV_VAR ("S4_LOG")
 
-#if defined(DEEPDEBUG)
-#define DDEBUG_PRN(...) ( _print_debug("DDEBUG", __FILE__, __LINE__, __VA_ARGS__ ))
-#else
-#define DDEBUG_PRN(...)
-#endif
+// most verbose level enabled for any module, tested before anything else
+extern int log_max_level;
+
+/**
+ * \brief Tell whether the messages of a level are enabled for a source file
+ *
+ * \param level  level of the message
+ * \param fname  source file, its name without directory nor extension is the module
+ */
+int log_enabled( const e_log_level level, const char *fname );
+
+/**
+ * \brief Log a message, use LOG_PRN instead
+ */
+void log_write( const e_log_level level, const char *fname, const int lnum, const char *fmt, ... ) __attribute__((format(printf,4,5)));
+
+/**
+ * \brief Log a message, the arguments are only evaluated if the level is enabled
+ */
+#define LOG_PRN(level,...) \
+    ( ( (int)(level) <= log_max_level && log_enabled( (level), __FILE__ ) ) ? log_write( (level), __FILE__, __LINE__, __VA_ARGS__ ) : (void)0 )
+
+#define DEBUG_PRN(...)  LOG_PRN( LogDebug, __VA_ARGS__ )
+#define DDEBUG_PRN(...) LOG_PRN( LogTrace, __VA_ARGS__ )
+
+// longest module name of a logging filter
+#define MAX_LOG_MODULE_LEN (31)
+
+// number of modules with their own level
+#define MAX_LOG_FILTERS (16)
+
+/**
+ * \brief Set the logging levels
+ *
+ * The configuration is a comma separated list of levels (off, error, warn,
+ * info, debug or trace): a bare level applies to every module, module=level
+ * to the source files of this name only, for example "warn,pki=debug".
+ * To call before starting the threads which log.
+ *
+ * \param spec  configuration, NULL or empty to keep the current one
+ *
+ * \return 0 on success, -1 if the configuration is invalid (then unchanged)
+ */
+int log_configure( const char *spec );
+
+/**
+ * \brief Write the messages from a background thread
+ *
+ * Until then the messages are written synchronously on stderr. Once started,
+ * they are queued in a memory ring, the messages arriving while it is full
+ * are counted and dropped. The thread is stopped, and the ring flushed, at
+ * exit.
+ *
+ * \param out  stream where the messages are written
+ *
+ * \return 0 on success, -1 if the thread could not be started
+ */
+int log_start( FILE *out );
+
+/**
+ * \brief Wait for the queued messages to be written
+ */
+void log_flush( void );
 
 #define INTPCT(max,val) (int)rint( 100 * (double)(val) / (double)(max) )
 
@@ -44,23 +109,135 @@ void _print_debug(const char* prefix, const char* fname, const int lnum, const c
 #define MAX_FILE_PATH (512)
 
 
+// maximum number of arguments of a child process
+#define EXEC_MAX_ARGS (32)
+
+// descriptor on which a child reads the secret passed to exec_argv
+#define EXEC_SECRET_FD (3)
+
+// openssl -passin/-passout source matching EXEC_SECRET_FD
+#define OPENSSL_SECRET_ARG ("fd:3")
+
 /**
- * Call a system command
+ * \brief Outcome of a child process run by exec_argv
+ */
+typedef struct SExecResult {
+    int     status;      // exit code, -1 if the child did not exit normally
+    char   *out;         // captured standard output, NUL terminated, may be NULL
+    size_t  out_len;
+    char   *err;         // captured standard error, NUL terminated, may be NULL
+    size_t  err_len;
+    double  wall_time;   // seconds from the spawn to the reaping of the child
+    double  cpu_time;    // user and system time of the child, in seconds
+} s_exec_result_t;
+
+/**
+ * \brief Run a program without shell and capture its outputs
  *
- * \param cmd       path to the command to call
- * \param variable  list of parameters to pass to the command
+ * The child is started with posix_spawnp, stdin on /dev/null, stdout and 
+ * stderr captured in memory. The secret, if any, is written as a single line
+ * on the descriptor EXEC_SECRET_FD of the child, so that it never appears on
+ * a command line.
  *
- * \return 0 on success, non 0 on error
- */ 
-int call_command( const char* cmd, ... );
+ * \param argv    NULL terminated argument vector, argv[0] is looked up in the PATH
+ * \param secret  NUL terminated secret to pass to the child, or NULL
+ * \param result  allocated result, to release with exec_result_free in any case
+ *
+ * \return 0 if the child ran (see result->status), -1 if it could not be run
+ */
+int exec_argv( const char *const argv[], const char *secret, s_exec_result_t *result );
+
+/**
+ * \brief Release the captured outputs of a result
+ */
+void exec_result_free( s_exec_result_t *result );
+
+/**
+ * \brief Subprocesses run by exec_argv since the program started
+ */
+typedef struct SExecStats {
+    unsigned long nb_spawned;
+    double        wall_time;   // cumulated seconds from the spawns to the reapings
+    double        cpu_time;    // cumulated user and system time of the children
+} s_exec_stats_t;
+
+/**
+ * \brief Read the counters of the subprocesses, from any thread
+ */
+void exec_get_stats( s_exec_stats_t *stats );
 
 /**
  * Call the openssl command line 
  *
- * \return 0 on success, -1 otherwise
+ * \param args      NULL terminated arguments, without the program name
+ * \param password  password passed through OPENSSL_SECRET_ARG, or NULL
+ *
+ * \return 0 on success, the exit code of openssl or -1 otherwise
+ *
+ */
+int call_openssl( const char *const args[], const char *password );
+
+// largest payload carried by a frame
+#define MAX_FRAME_SIZE (65536)
+
+/**
+ * \brief Send a frame: a 4 bytes big endian length, then the payload
+ *
+ * \param fd    connected stream descriptor
+ * \param data  payload
+ * \param len   payload size, at most MAX_FRAME_SIZE
+ *
+ * \return 0 on success, -1 on error
+ */
+int frame_write( int fd, const void *data, const size_t len );
+
+/**
+ * \brief Receive a frame sent by frame_write
+ *
+ * \param fd    connected stream descriptor
+ * \param buf   destination of the payload, NUL terminated
+ * \param max   size of buf, payload bigger than max-1 are refused
+ *
+ * \return the payload size, 0 when the peer closed between two frames,
+ *         -1 on error or truncated frame
+ */
+ssize_t frame_read( int fd, char *buf, const size_t max );
+
+// longest member name accepted by json_object_parse
+#define MAX_JSON_KEY_LEN (63)
+
+/**
+ * \brief Called for each value of a JSON object
+ *
+ * \return 0 to go on, non 0 to stop the parsing with an error
+ */
+typedef int (*json_member_cb_t)( void *data, const char *key, const char *value );
+
+/**
+ * \brief Parse a flat JSON object, such as one line of a JSON lines file
+ *
+ * Only string values and arrays of strings are accepted: the callback is
+ * called for every string, once per element of an array, in the order of
+ * the text.
  *
+ * \param text  the object, surrounding spaces allowed
+ * \param cb    called with the decoded member name and value
+ * \param data  passed to the callback
+ *
+ * \return 0 on success, -1 on syntax error or if the callback failed
+ */
+int json_object_parse( const char *text, json_member_cb_t cb, void *data );
+
+/**
+ * \brief Escape a string to be written between the quotes of a JSON string
+ *
+ * \param out  destination, NUL terminated
+ * \param max  size of out
+ * \param in   string to escape
+ *
+ * \return the length of the escaped string, -1 if out is too small
  */
-int call_openssl( const char * format, ...);
+ssize_t json_escape( char *out, const size_t max, const char *in );
 
 /** 
  * Securely erase some memory 
@@ -83,16 +260,110 @@ void secure_memzero(void* buffer, size_t sze);
  */
 void vwarn( const char * fmt, va_list args );
 
+/**
+ * Receiver of the warnings of a thread, see warn_redirect
+ */
+typedef void (*warn_sink_t)( void *data, const char *message );
+
+/**
+ * Redirect the warnings of the calling thread instead of printing them on stderr
+ *
+ * \param sink  called with each warning, NULL to print them on stderr again
+ * \param data  passed to sink
+ */
+void warn_redirect( warn_sink_t sink, void *data );
+
+/** file_copy flag: fsync the destination before returning */
+#define FILE_COPY_SYNC (0x01)
+
 /**
  * Copy a file from A to B
-  */
-int file_copy(const char * filepath, const char * dest_path );
+ *
+ * The copy is done by the kernel when possible (copy_file_range, then sendfile)
+ * and falls back on a buffered loop. The destination gets the permissions of 
+ * the source, and is removed if the copy fails.
+ *
+ * \param filepath source file
+ * \param dest_path destination file, created or truncated
+ * \param flags 0 or FILE_COPY_SYNC
+ *
+ * \return 0 on success, -1 otherwise
+ */
+int file_copy(const char * filepath, const char * dest_path, const int flags );
 
 /** 
  * Dump a buffer to a file 
+ *
+ * The file is replaced atomically and durably: see atomic_group_commit.
+ *
+ * \return size written on success, -1 otherwise
  */
 ssize_t write_to_file(const char* fname, size_t size, const char * data);
 
+/**
+ * \brief One file of an atomic write group
+ */
+typedef struct SAtomicFile {
+    char  path[MAX_FILE_PATH+1];       // final name
+    char  tmp_path[MAX_FILE_PATH+1];   // name while written
+    FILE *fp;
+} s_atomic_file_t;
+
+/**
+ * \brief Set of files made durable behind a single barrier, then replaced one by one
+ *
+ * Each file is written to a temporary sibling and only renamed over its final
+ * name once the content of all the files of the group is on disk, so that a
+ * crash leaves either the old or the new version of every file, never a
+ * truncated one. The renames happen in the order the files were added and the
+ * group as a whole is not atomic: a crash during the commit may leave the first
+ * files new and the last ones old. A group is not thread-safe.
+ */
+typedef struct SAtomicGroup {
+    s_atomic_file_t *files;
+    unsigned         nb_files;
+    unsigned         capacity;
+    int              failed;   // a write failed: the commit will be refused
+} s_atomic_group_t;
+
+/**
+ * \brief Initialise an empty group
+ */
+void atomic_group_init( s_atomic_group_t *grp );
+
+/**
+ * \brief Add a file to the group and return the stream to write its new content to
+ *
+ * The stream belongs to the group: do not close it. An existing file keeps its 
+ * permissions, a new one is created as fopen() would.
+ *
+ * \return the stream, NULL on error (the group is then marked as failed)
+ */
+FILE* atomic_group_open( s_atomic_group_t *grp, const char *path );
+
+/**
+ * \brief Add a file to the group with the given content
+ *
+ * \return 0 on success, -1 otherwise (the group is then marked as failed)
+ */
+int atomic_group_write( s_atomic_group_t *grp, const char *path, const void *data, const size_t size );
+
+/**
+ * \brief Make the files of the group durable, then rename them over their final names in order
+ *
+ * The content is flushed with a single syncfs() when all the files are on the
+ * same file system (one fsync per file otherwise), and so are the directory 
+ * entries after the renames. The group is released in any case.
+ *
+ * \return 0 on success, -1 if a write, the flush or a rename failed
+ */
+int atomic_group_commit( s_atomic_group_t *grp );
+
+/**
+ * \brief Drop the files of the group, leaving the final files untouched
+ */
+void atomic_group_abort( s_atomic_group_t *grp );
+
 /**
  * Read a whole file to a buffer
  */
@@ -167,6 +438,9 @@ ssize_t hex_encode(char *out, const size_t max_out, const uint8_t *data, const s
 /**
  * Decode an hex encoded string to a binary buffer
  *
+ * Both cases are accepted; the decoding time does not depend on the
+ * content, so that it can be used for secrets.
+ *
  * \param decoded      buffer to decode to
  * \param max_size     destination buffer size
  * \param encoded      message to decode
@@ -186,7 +460,7 @@ ssize_t hex_decode(uint8_t* decoded, const size_t max_size, const char *encoded
  * \param data         message to encode
  * \param data_size    number of byte to encode from msg
  * 
- * \return size of encoded data on success, -1 on error
+ * \return size of encoded data, terminating '\0' included, on success, -1 on error
  *
  */
 ssize_t base64_encode( char *encoded, const size_t max_size, const uint8_t *data, const size_t data_size );
@@ -195,6 +469,9 @@ ssize_t base64_encode( char *encoded, const size_t max_size, const uint8_t *data
  * 
  * Decode a base64 string to a buffer
  *
+ * The input is strictly checked: characters out of the alphabet, misplaced
+ * '=' or non zero padding bits are errors.
+ *
  * \param decoded      buffer to decode to
  * \param max_size     destination buffer size
  * \param encoded      message to decode
@@ -203,6 +480,14 @@ ssize_t base64_encode( char *encoded, const size_t max_size, const uint8_t *data
  */
 ssize_t base64_decode( uint8_t *decoded, const size_t max_size, const char *encoded ); 
 
+/**
+ *
+ * Name of the base64 implementation selected for this CPU
+ *
+ * \return "AVX2", "SSSE3" or "scalar"
+ */
+const char* base64_engine();
+
 
 
 
@@ -245,7 +530,46 @@ ssize_t filename_extension( const char * fullpath, char* ext, size_t max_size  )
 void chomp( char * line );
 
 
+/**
+ * Read a whole file to a caller buffer
+ *
+ * \return size of the file on success, -1 on failure or if it does not fit
+ */
 ssize_t file_slurp( const char *fname, uint8_t* buffer, const size_t max_size );
 
+/** file_view_close flag: zero the content before releasing it */
+#define FILE_VIEW_WIPE (0x01)
+
+/**
+ * \brief Read-only view of a whole file
+ *
+ * Regular files are memory mapped, so that the content is never copied;
+ * pseudo files which cannot be mapped are read to the heap. The data is
+ * borrowed until file_view_close and is not NUL terminated.
+ */
+typedef struct SFileView {
+    const uint8_t *data;
+    size_t         size;
+    int            mapped;   // 1 for a mapping, 0 for a heap copy
+} s_file_view_t;
+
+/**
+ * \brief Open a read-only view of a file
+ *
+ * \param fname file to read
+ * \param view  view to initialise, to release with file_view_close
+ *
+ * \return 0 on success, -1 otherwise
+ */
+int file_view_open( const char *fname, s_file_view_t *view );
+
+/**
+ * \brief Release a view opened by file_view_open
+ *
+ * \param view  view to release, reset to an empty view
+ * \param flags 0 or FILE_VIEW_WIPE for files holding secrets
+ */
+void file_view_close( s_file_view_t *view, const int flags );
+
 #endif
 
@@ -0,0 +1,89 @@
+/**
+ *
+ * \file bench_hex.c
+ *
+ * \brief Hex codec throughput benchmark, in cycles per input byte
+ *
+ * Not a test: run it by hand to check the hex codec cost.
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "utils.h"
+
+#define BENCH_SIZES   { 32, 1024, 64*1024, 1024*1024 }
+#define BENCH_BYTES   (64*1024*1024)
+
+/**
+ * \brief Timestamp counter, or nanoseconds where there is none
+ */
+static inline uint64_t bench_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}//eo bench_ticks
+
+int main( int argc, char **argv )
+{
+    const size_t sizes[] = BENCH_SIZES;
+    const size_t max_raw = sizes[sizeof(sizes)/sizeof(sizes[0]) - 1];
+    const size_t max_enc = 2 * max_raw + 1;
+
+    uint8_t *raw = malloc( max_raw );
+    char    *enc = malloc( max_enc );
+    uint8_t *dec = malloc( max_raw );
+    if( NULL == raw || NULL == enc || NULL == dec ) {
+        return 1;
+    }
+    for( size_t i = 0; i < max_raw; i++ ) {
+        raw[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    printf( "%10s %14s %14s\n", "bytes", "encode", "decode" );
+
+    for( unsigned s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++ ) {
+        const size_t len  = sizes[s];
+        const unsigned runs = (BENCH_BYTES / len) > 0 ? (BENCH_BYTES / len) : 1;
+        uint64_t t_enc = UINT64_MAX, t_dec = UINT64_MAX;
+
+        for( unsigned r = 0; r < runs; r++ ) {
+            uint64_t start = bench_ticks();
+            if( hex_encode( enc, max_enc, raw, len ) < 0 ) {
+                return 2;
+            }
+            uint64_t mid = bench_ticks();
+            if( hex_decode( dec, max_raw, enc ) != (ssize_t)len ) {
+                return 3;
+            }
+            uint64_t end = bench_ticks();
+            if( mid - start < t_enc ) t_enc = mid - start;
+            if( end - mid   < t_dec ) t_dec = end - mid;
+        }
+
+        printf( "%10u %9.3f c/B  %9.3f c/B\n", (unsigned)len, (double)t_enc / len, (double)t_dec / len );
+    }
+
+    free( raw );
+    free( enc );
+    free( dec );
+    return 0;
+}//eo main
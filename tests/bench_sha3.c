@@ -0,0 +1,130 @@
+/**
+ *
+ * \file bench_sha3.c
+ *
+ * \brief SHA3 throughput benchmark, in cycles per byte
+ *
+ * Not a test: run it by hand to compare the Keccak-f[1600] implementations
+ * (cmake -DKECCAK_REFERENCE=ON selects the reference loop).
+ *
+ * Tous droits réservés Hervé Schauer Consultants 2016 - All rights reserved Hervé Schauer Consultants 2016
+ *
+ * License: see LICENSE.md file
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "utils.h"
+#include "sha3.h"
+
+#define BENCH_LONG_SIZE   (1024*1024)
+#define BENCH_LONG_RUNS   (64)
+#define BENCH_SHORT_SIZE  (64)
+#define BENCH_SHORT_RUNS  (200000)
+
+/**
+ * \brief Timestamp counter, or nanoseconds where there is none
+ */
+static inline uint64_t bench_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}//eo bench_ticks
+
+typedef void (*sha3_init_func_ptr) ( sha3_context *priv );
+
+/**
+ * \brief Hash runs times a message and print the best cost per byte
+ */
+static void bench_run( const char *name, sha3_init_func_ptr do_init, const uint8_t *msg, const size_t len, const unsigned runs )
+{
+    sha3_context c;
+    uint64_t best = UINT64_MAX;
+    volatile uint8_t sink = 0;
+    unsigned i;
+
+    for( i = 0; i < runs; i++ ) {
+        uint64_t start = bench_ticks();
+        do_init( &c );
+        sha3_update( &c, msg, len );
+        sink ^= ((const uint8_t*)sha3_finalize( &c ))[0];
+        uint64_t t = bench_ticks() - start;
+        if( t < best )
+            best = t;
+    }
+
+    printf( "%-10s %8u bytes: %10.2f %s/byte\n", name, (unsigned)len, (double)best / len,
+#if defined(__x86_64__) || defined(__i386__)
+            "cycles"
+#else
+            "ns"
+#endif
+    );
+    (void)sink;
+}//eo bench_run
+
+/**
+ * \brief Hash 4 messages with the multi-buffer interface and print the best cost per byte
+ */
+static void bench_run_x4( const char *name, const uint8_t *msg, const size_t len, const unsigned runs )
+{
+    uint8_t digests[SHA3_X4_LANES][SHA3_256_DIGEST_LEN];
+    void const *bufs[SHA3_X4_LANES] = { msg, msg, msg, msg };
+    const size_t lens[SHA3_X4_LANES] = { len, len, len, len };
+    uint8_t *outs[SHA3_X4_LANES] = { digests[0], digests[1], digests[2], digests[3] };
+    uint64_t best = UINT64_MAX;
+    unsigned i;
+
+    for( i = 0; i < runs; i++ ) {
+        uint64_t start = bench_ticks();
+        sha3_256_x4( bufs, lens, outs );
+        uint64_t t = bench_ticks() - start;
+        if( t < best )
+            best = t;
+    }
+
+    printf( "%-10s %8u bytes: %10.2f %s/byte (%s)\n", name, (unsigned)len, (double)best / (SHA3_X4_LANES * len),
+#if defined(__x86_64__) || defined(__i386__)
+            "cycles",
+#else
+            "ns",
+#endif
+            sha3_x4_accelerated() ? "AVX2" : "scalar" );
+}//eo bench_run_x4
+
+int main( int argc, char **argv )
+{
+    uint8_t *msg = malloc( BENCH_LONG_SIZE );
+    if( NULL == msg )
+        return 1;
+    memset( msg, 0xA3, BENCH_LONG_SIZE );
+
+#if defined(SHA3_KECCAK_REFERENCE)
+    printf( "Keccak-f[1600]: reference loop\n" );
+#else
+    printf( "Keccak-f[1600]: unrolled, lane complemented\n" );
+#endif
+
+    bench_run( "SHA3-256", sha3_init256, msg, BENCH_LONG_SIZE,  BENCH_LONG_RUNS );
+    bench_run( "SHA3-512", sha3_init512, msg, BENCH_LONG_SIZE,  BENCH_LONG_RUNS );
+    bench_run( "SHA3-256", sha3_init256, msg, BENCH_SHORT_SIZE, BENCH_SHORT_RUNS );
+    bench_run_x4( "SHA3-256x4", msg, BENCH_LONG_SIZE,  BENCH_LONG_RUNS );
+    bench_run_x4( "SHA3-256x4", msg, BENCH_SHORT_SIZE, BENCH_SHORT_RUNS );
+
+    free( msg );
+    return 0;
+}//eo main
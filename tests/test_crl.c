@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <CUnit/Basic.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+
+#include "utils.h"
+#include "sha3.h"
+#include "ca_store.h"
+#include "shared_secret.h"
+#include "pki.h"
+
+
+#define TEST_PKI_DIR      ("test_crl_pki")
+#define TEST_PKI_PASSWORD ("test_crl_password")
+#define TEST_CRL_NUMBER   (0x10)
+
+// two valid, one revoked and one expired sub-CA
+#define TEST_PKI_INDEX ( \
+  "V\t361016080509Z\t\t02\tunknown\t/O=org/CN=valid\n" \
+  "R\t361016080509Z\t261019080509Z,keyCompromise\t03\tunknown\t/O=org/CN=revoked\n" \
+  "E\t161016080509Z\t\t04\tunknown\t/O=org/CN=expired\n" \
+  "V\t361016080509Z\t\t05\tunknown\t/O=org/CN=valid2\n" \
+)
+
+#define TEST_BUNDLE_SIZE   (3)
+#define TEST_BUNDLE_PERIOD (7)
+
+
+static X509     *test_cacert = NULL;
+static EVP_PKEY *test_key    = NULL;
+
+// sub-CA of the fixture index, issued by the test root
+static void make_test_cert( long serial, const char *cn )
+{
+  char  path[256];
+  FILE *fp;
+  X509 *cert = X509_new();
+  CU_ASSERT_FATAL( NULL != cert );
+
+  X509_NAME_add_entry_by_txt( X509_get_subject_name( cert ), "CN", MBSTRING_ASC, (const unsigned char*)cn, -1, -1, 0 );
+  X509_set_issuer_name( cert, X509_get_subject_name( test_cacert ) );
+  ASN1_INTEGER_set( X509_get_serialNumber( cert ), serial );
+  X509_gmtime_adj( X509_getm_notBefore( cert ), 0 );
+  X509_gmtime_adj( X509_getm_notAfter( cert ), 3600 );
+  X509_set_pubkey( cert, test_key );
+  CU_ASSERT_FATAL( 0 < X509_sign( cert, test_key, EVP_sha256() ) );
+
+  snprintf( path, sizeof(path), "%s/certs/%02lX.pem", TEST_PKI_DIR, serial );
+  CU_ASSERT_FATAL( NULL != (fp = fopen( path, "w" )) );
+  CU_ASSERT_FATAL( PEM_write_X509( fp, cert ) );
+  fclose( fp );
+  X509_free( cert );
+}//eo make_test_cert
+
+// self-signed root, its encrypted key, index, sub-CA and CRL number, as left by an init
+static void make_test_pki()
+{
+  char  path[256];
+  FILE *fp;
+
+  mkdir( TEST_PKI_DIR, 0700 );
+  snprintf( path, sizeof(path), "%s/cacert", TEST_PKI_DIR );
+  mkdir( path, 0700 );
+  snprintf( path, sizeof(path), "%s/private", TEST_PKI_DIR );
+  mkdir( path, 0700 );
+  snprintf( path, sizeof(path), "%s/crl", TEST_PKI_DIR );
+  mkdir( path, 0700 );
+  snprintf( path, sizeof(path), "%s/certs", TEST_PKI_DIR );
+  mkdir( path, 0700 );
+  snprintf( path, sizeof(path), "%s/p7", TEST_PKI_DIR );
+  mkdir( path, 0700 );
+
+  test_key = EVP_PKEY_Q_keygen( NULL, NULL, "EC", "P-256" );
+  CU_ASSERT_FATAL( NULL != test_key );
+
+  test_cacert = X509_new();
+  CU_ASSERT_FATAL( NULL != test_cacert );
+  X509_NAME *name = X509_get_subject_name( test_cacert );
+  X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, (const unsigned char*)"test_crl root", -1, -1, 0 );
+  X509_set_issuer_name( test_cacert, name );
+  ASN1_INTEGER_set( X509_get_serialNumber( test_cacert ), 1 );
+  X509_gmtime_adj( X509_getm_notBefore( test_cacert ), 0 );
+  X509_gmtime_adj( X509_getm_notAfter( test_cacert ), 3600 );
+  X509_set_pubkey( test_cacert, test_key );
+  // the authority key identifier of the CRL is taken from it
+  X509V3_CTX v3ctx;
+  X509V3_set_ctx( &v3ctx, test_cacert, test_cacert, NULL, NULL, 0 );
+  X509_EXTENSION *skid = X509V3_EXT_conf_nid( NULL, &v3ctx, NID_subject_key_identifier, "hash" );
+  CU_ASSERT_FATAL( NULL != skid );
+  X509_add_ext( test_cacert, skid, -1 );
+  X509_EXTENSION_free( skid );
+  CU_ASSERT_FATAL( 0 < X509_sign( test_cacert, test_key, EVP_sha256() ) );
+
+  snprintf( path, sizeof(path), "%s/cacert/%s", TEST_PKI_DIR, ROOT_CERT_FNAME );
+  CU_ASSERT_FATAL( NULL != (fp = fopen( path, "w" )) );
+  CU_ASSERT_FATAL( PEM_write_X509( fp, test_cacert ) );
+  fclose( fp );
+
+  snprintf( path, sizeof(path), "%s/private/%s", TEST_PKI_DIR, ROOT_KEY_FNAME );
+  CU_ASSERT_FATAL( NULL != (fp = fopen( path, "w" )) );
+  CU_ASSERT_FATAL( PEM_write_PrivateKey( fp, test_key, EVP_aes_256_cbc(), NULL, 0, NULL, TEST_PKI_PASSWORD ) );
+  fclose( fp );
+
+  snprintf( path, sizeof(path), "%s/%s", TEST_PKI_DIR, CERT_INDEX_FNAME );
+  CU_ASSERT_FATAL( 0 < write_to_file( path, strlen(TEST_PKI_INDEX), TEST_PKI_INDEX ) );
+
+  CU_ASSERT_FATAL( 0 == ca_write_crl_number( TEST_PKI_DIR, TEST_CRL_NUMBER, NULL ) );
+
+  make_test_cert( 2, "valid" );
+  make_test_cert( 3, "revoked" );
+  make_test_cert( 4, "expired" );
+  make_test_cert( 5, "valid2" );
+}//eo make_test_pki
+
+static void remove_test_pki()
+{
+  char path[256];
+  const char *files[] = {
+    "crl/bundle/root-0001.crl", "crl/bundle/root-0002.crl", "crl/bundle/root-0003.crl", "crl/bundle/manifest.txt", "crl/bundle",
+    "crl/crl_serial", "crl/root.crl", "crl", "certs/02.pem", "certs/03.pem", "certs/04.pem", "certs/05.pem", "certs",
+    "p7/CAs.der", "p7/CAs.p7b", "p7", "cacert/root.crt", "cacert", "private/root.key", "private", "cert.idx"
+  };
+
+  for( unsigned i = 0; i < sizeof(files)/sizeof(files[0]); i++ ) {
+    snprintf( path, sizeof(path), "%s/%s", TEST_PKI_DIR, files[i] );
+    remove( path );
+  }
+  rmdir( TEST_PKI_DIR );
+  X509_free( test_cacert );
+  EVP_PKEY_free( test_key );
+}//eo remove_test_pki
+
+
+// common names of the certificates of CAs.p7b, in order, separated by spaces
+static void read_chain( char *names, size_t max )
+{
+  char           path[256];
+  char          *pem_name = NULL, *pem_header = NULL;
+  unsigned char *der = NULL;
+  long           der_len = 0;
+
+  snprintf( path, sizeof(path), "%s/p7/%s", TEST_PKI_DIR, CHAIN_P7_FNAME );
+  FILE *fp = fopen( path, "r" );
+  CU_ASSERT_FATAL( NULL != fp );
+  CU_ASSERT_FATAL( PEM_read( fp, &pem_name, &pem_header, &der, &der_len ) );
+  fclose( fp );
+  CU_ASSERT( 0 == strcmp( pem_name, PEM_STRING_PKCS7 ) );
+
+  const unsigned char *p = der;
+  PKCS7 *p7 = d2i_PKCS7( NULL, &p, der_len );
+  CU_ASSERT_FATAL( NULL != p7 );
+  CU_ASSERT_FATAL( PKCS7_type_is_signed( p7 ) );
+  CU_ASSERT( p == der + der_len );
+
+  STACK_OF(X509) *certs = p7->d.sign->cert;
+  size_t len = 0;
+  names[0] = '\0';
+  for( int i = 0; i < sk_X509_num( certs ) && len < max; i++ ) {
+    char cn[64];
+    X509_NAME_get_text_by_NID( X509_get_subject_name( sk_X509_value( certs, i ) ), NID_commonName, cn, sizeof(cn) );
+    len += snprintf( names + len, max - len, "%s%s", i ? " " : "", cn );
+  }
+
+  PKCS7_free( p7 );
+  OPENSSL_free( pem_name );
+  OPENSSL_free( pem_header );
+  OPENSSL_free( der );
+}//eo read_chain
+
+// CRL number extension of a CRL
+static long crl_number( X509_CRL *crl )
+{
+  ASN1_INTEGER *number = X509_CRL_get_ext_d2i( crl, NID_crl_number, NULL, NULL );
+  long res = number ? ASN1_INTEGER_get( number ) : -1;
+  ASN1_INTEGER_free( number );
+  return res;
+}//eo crl_number
+
+// CRL reason code of a revoked entry, -1 if none
+static long revoked_reason( X509_REVOKED *rev )
+{
+  ASN1_ENUMERATED *reason = X509_REVOKED_get_ext_d2i( rev, NID_crl_reason, NULL, NULL );
+  long res = reason ? ASN1_ENUMERATED_get( reason ) : -1;
+  ASN1_ENUMERATED_free( reason );
+  return res;
+}//eo revoked_reason
+
+// checks a CRL of the bundle, returns it for the window checks
+static X509_CRL* check_bundle_crl( unsigned seq, const char *fingerprint )
+{
+  char    path[256];
+  uint8_t pem[16384];
+  uint8_t digest[SHA3_256_DIGEST_LEN];
+  char    hex[2*SHA3_256_DIGEST_LEN+1];
+
+  snprintf( path, sizeof(path), "%s/crl/bundle/root-%04u.crl", TEST_PKI_DIR, seq );
+  ssize_t len = file_slurp( path, pem, sizeof(pem) );
+  CU_ASSERT_FATAL( 0 < len );
+
+  // the manifest fingerprints the file as saved
+  sha3_256( pem, len, digest );
+  CU_ASSERT_FATAL( 0 < hex_encode( hex, sizeof(hex), digest, sizeof(digest) ) );
+  CU_ASSERT( 0 == strcmp( hex, fingerprint ) );
+
+  BIO *mem = BIO_new_mem_buf( pem, (int)len );
+  X509_CRL *crl = PEM_read_bio_X509_CRL( mem, NULL, NULL, NULL );
+  BIO_free( mem );
+  CU_ASSERT_FATAL( NULL != crl );
+  CU_ASSERT( 1 == X509_CRL_verify( crl, test_key ) );
+  CU_ASSERT( 0 > ASN1_TIME_compare( X509_CRL_get0_lastUpdate( crl ), X509_CRL_get0_nextUpdate( crl ) ) );
+  return crl;
+}//eo check_bundle_crl
+
+void CrlBundle_Test()
+{
+  s_s4eventhandlers_t evt;
+  char                path[256];
+  char                line[512];
+  X509_CRL           *previous = NULL;
+  unsigned long       number;
+
+  make_test_pki();
+  memset( &evt, 0, sizeof(evt) );
+  CU_ASSERT_FATAL( 0 == generate_crl_bundle( TEST_PKI_DIR, TEST_BUNDLE_SIZE, TEST_BUNDLE_PERIOD, TEST_PKI_PASSWORD, &evt ) );
+
+  // the CRL numbers of the bundle are consumed
+  CU_ASSERT_FATAL( 0 == ca_read_crl_number( TEST_PKI_DIR, &number ) );
+  CU_ASSERT( TEST_CRL_NUMBER + TEST_BUNDLE_SIZE == number );
+
+  snprintf( path, sizeof(path), "%s/crl/bundle/manifest.txt", TEST_PKI_DIR );
+  FILE *fp = fopen( path, "r" );
+  CU_ASSERT_FATAL( NULL != fp );
+  CU_ASSERT_FATAL( NULL != fgets( line, sizeof(line), fp ) );
+  CU_ASSERT( 0 == strcmp( line, "# seq\tcrl_number\tthis_update\tnext_update\tsha3-256\tfile\n" ) );
+
+  unsigned seq;
+  for( seq = 1; NULL != fgets( line, sizeof(line), fp ); seq++ ) {
+    unsigned      item_seq;
+    unsigned long item_number;
+    char          this_update[32], next_update[32], fingerprint[65], file[64], expected_file[64];
+
+    CU_ASSERT_FATAL( 6 == sscanf( line, "%u\t%lu\t%31s\t%31s\t%64s\t%63s", &item_seq, &item_number, this_update, next_update, fingerprint, file ) );
+    snprintf( expected_file, sizeof(expected_file), "root-%04u.crl", seq );
+    CU_ASSERT( seq == item_seq );
+    CU_ASSERT( 0 == strcmp( file, expected_file ) );
+
+    // increasing CRL numbers, from the one of the PKI
+    CU_ASSERT( TEST_CRL_NUMBER + seq - 1 == item_number );
+    X509_CRL *crl = check_bundle_crl( seq, fingerprint );
+    CU_ASSERT( (long)item_number == crl_number( crl ) );
+    CU_ASSERT( 1 == sk_X509_REVOKED_num( X509_CRL_get_REVOKED( crl ) ) );
+
+    // each window starts where the previous one ends
+    if( NULL != previous ) {
+      CU_ASSERT( 0 == ASN1_TIME_compare( X509_CRL_get0_nextUpdate( previous ), X509_CRL_get0_lastUpdate( crl ) ) );
+      X509_CRL_free( previous );
+    }
+    previous = crl;
+  }
+  fclose( fp );
+  X509_CRL_free( previous );
+  CU_ASSERT( TEST_BUNDLE_SIZE + 1 == seq );
+
+  remove_test_pki();
+}//eo CrlBundle_Test
+
+void CrlSign_Test()
+{
+  s_s4eventhandlers_t    evt;
+  s_revocation_request_t req;
+  char                   path[256];
+  unsigned long          number;
+
+  make_test_pki();
+  memset( &evt, 0, sizeof(evt) );
+
+  // the CRL is signed in-process from the index updated with the revocation
+  snprintf( path, sizeof(path), "%s/crl/root.crl", TEST_PKI_DIR );
+  CU_ASSERT_FATAL( 0 == parse_revocation_request( "0x05,superseded", &req ) );
+  CU_ASSERT_FATAL( 0 == revoke_subca_batch( TEST_PKI_DIR, &req, 1, path, TEST_PKI_PASSWORD, NULL, &evt ) );
+  CU_ASSERT_FATAL( 0 == ca_read_crl_number( TEST_PKI_DIR, &number ) );
+  CU_ASSERT( TEST_CRL_NUMBER + 1 == number );
+
+  FILE *fp = fopen( path, "r" );
+  CU_ASSERT_FATAL( NULL != fp );
+  X509_CRL *crl = PEM_read_X509_CRL( fp, NULL, NULL, NULL );
+  fclose( fp );
+  CU_ASSERT_FATAL( NULL != crl );
+
+  CU_ASSERT( 1 == X509_CRL_verify( crl, test_key ) );
+  CU_ASSERT( 0 == X509_NAME_cmp( X509_CRL_get_issuer( crl ), X509_get_subject_name( test_cacert ) ) );
+  CU_ASSERT( TEST_CRL_NUMBER == crl_number( crl ) );
+  CU_ASSERT( 0 > ASN1_TIME_compare( X509_CRL_get0_lastUpdate( crl ), X509_CRL_get0_nextUpdate( crl ) ) );
+
+  // the revoked certificate of the fixture and the new one, sorted by serial
+  STACK_OF(X509_REVOKED) *revoked = X509_CRL_get_REVOKED( crl );
+  CU_ASSERT_FATAL( 2 == sk_X509_REVOKED_num( revoked ) );
+  X509_REVOKED *rev = sk_X509_REVOKED_value( revoked, 0 );
+  CU_ASSERT( 3 == ASN1_INTEGER_get( X509_REVOKED_get0_serialNumber( rev ) ) );
+  CU_ASSERT( CRL_REASON_KEY_COMPROMISE == revoked_reason( rev ) );
+  rev = sk_X509_REVOKED_value( revoked, 1 );
+  CU_ASSERT( 5 == ASN1_INTEGER_get( X509_REVOKED_get0_serialNumber( rev ) ) );
+  CU_ASSERT( CRL_REASON_SUPERSEDED == revoked_reason( rev ) );
+
+  X509_CRL_free( crl );
+  remove_test_pki();
+}//eo CrlSign_Test
+
+void CaChain_Test()
+{
+  s_s4eventhandlers_t evt;
+  s_ca_index_t        index;
+  s_atomic_group_t    grp;
+  char                names[256];
+  char                path[256];
+
+  make_test_pki();
+
+  // the root, then the valid sub-CA in the order of the index
+  CU_ASSERT_FATAL( 0 == ca_index_load( TEST_PKI_DIR, &index ) );
+  atomic_group_init( &grp );
+  CU_ASSERT_FATAL( 0 == ca_chain_rebuild( TEST_PKI_DIR, &index, &grp ) );
+  CU_ASSERT_FATAL( 0 == atomic_group_commit( &grp ) );
+  ca_index_free( &index );
+  read_chain( names, sizeof(names) );
+  CU_ASSERT( 0 == strcmp( names, "test_crl root valid valid2" ) );
+
+  // a revoked sub-CA leaves the chain with the index update
+  memset( &evt, 0, sizeof(evt) );
+  snprintf( path, sizeof(path), "%s/certs/02.pem", TEST_PKI_DIR );
+  CU_ASSERT_FATAL( 0 == revoke_subca( TEST_PKI_DIR, path, TEST_PKI_PASSWORD, &evt ) );
+  read_chain( names, sizeof(names) );
+  CU_ASSERT( 0 == strcmp( names, "test_crl root valid2" ) );
+
+  CU_ASSERT_FATAL( 0 == ca_index_load( TEST_PKI_DIR, &index ) );
+  CU_ASSERT( 'R' == ca_index_find( &index, "02" )->status );
+  ca_index_free( &index );
+
+  remove_test_pki();
+}//eo CaChain_Test
+
+//
+//
+int main (int argc, char** argv)
+{
+
+  CU_pSuite pSuite = NULL;
+
+  /* initialize the CUnit test registry */
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  /* add a suite to the registry */
+  pSuite = CU_add_suite("Suite_1", NULL, NULL);
+  if (NULL == pSuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "CRL bundle test", CrlBundle_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "CRL signature test", CrlSign_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "CA chain test", CaChain_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Run all tests using the CUnit Basic interface */
+  CU_basic_set_mode(CU_BRM_VERBOSE);
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+
+}//eo main
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <CUnit/Basic.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+
+#include "utils.h"
+#include "ca_store.h"
+#include "shamir.h"
+#include "shared_secret.h"
+#include "pki.h"
+#include "lib4s.h"
+
+
+#define TEST_PKI_DIR1     ("test_lib4s_pki1")
+#define TEST_PKI_DIR2     ("test_lib4s_pki2")
+#define TEST_PKI_LINK     ("test_lib4s_link")
+#define TEST_PKI_DOTDOT   ("test_lib4s_pki2/../test_lib4s_pki1")
+#define TEST_PKI_SUBJECT  ("/CN=test_lib4s/O=org")
+
+// one valid, one revoked and one expired sub-CA
+#define TEST_PKI_INDEX ( \
+  "V\t361016080509Z\t\t02\tunknown\t/O=org/CN=valid\n" \
+  "R\t361016080509Z\t261019080509Z,keyCompromise\t03\tunknown\t/O=org/CN=revoked\n" \
+  "E\t161016080509Z\t\t04\tunknown\t/O=org/CN=expired\n" \
+)
+
+#define TEST_NB_SHARES (3)
+#define TEST_QUORUM    (2)
+
+
+static const char *test_shares[TEST_NB_SHARES] = {
+  "test_lib4s_share1.smr", "test_lib4s_share2.smr", "test_lib4s_share3.smr"
+};
+
+
+// configuration, self-signed root and index of a 2 of 3 PKI, as left by an init
+static void make_test_pki( const char *dir )
+{
+  char  path[256];
+  FILE *fp;
+
+  mkdir( dir, 0700 );
+  snprintf( path, sizeof(path), "%s/cacert", dir );
+  mkdir( path, 0700 );
+  CU_ASSERT_FATAL( 0 == write_ca_infos( dir, TEST_PKI_SUBJECT, TEST_NB_SHARES, TEST_QUORUM, 0, 0 ) );
+
+  EVP_PKEY *key = EVP_PKEY_Q_keygen( NULL, NULL, "EC", "P-256" );
+  CU_ASSERT_FATAL( NULL != key );
+  X509 *cert = X509_new();
+  CU_ASSERT_FATAL( NULL != cert );
+  X509_NAME *name = X509_get_subject_name( cert );
+  X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, (const unsigned char*)"test_lib4s root", -1, -1, 0 );
+  X509_set_issuer_name( cert, name );
+  ASN1_INTEGER_set( X509_get_serialNumber( cert ), 1 );
+  X509_gmtime_adj( X509_getm_notBefore( cert ), 0 );
+  X509_gmtime_adj( X509_getm_notAfter( cert ), 3600 );
+  X509_set_pubkey( cert, key );
+  CU_ASSERT_FATAL( 0 < X509_sign( cert, key, EVP_sha256() ) );
+
+  snprintf( path, sizeof(path), "%s/cacert/%s", dir, ROOT_CERT_FNAME );
+  CU_ASSERT_FATAL( NULL != (fp = fopen( path, "w" )) );
+  CU_ASSERT_FATAL( PEM_write_X509( fp, cert ) );
+  fclose( fp );
+  X509_free( cert );
+  EVP_PKEY_free( key );
+
+  snprintf( path, sizeof(path), "%s/%s", dir, CERT_INDEX_FNAME );
+  CU_ASSERT_FATAL( 0 < write_to_file( path, strlen(TEST_PKI_INDEX), TEST_PKI_INDEX ) );
+}//eo make_test_pki
+
+static void remove_test_pki( const char *dir )
+{
+  char path[256];
+  const char *files[] = { "cacert/root.crt", "cacert", "cert.idx", "pki.ini" };
+
+  for( unsigned i = 0; i < sizeof(files)/sizeof(files[0]); i++ ) {
+    snprintf( path, sizeof(path), "%s/%s", dir, files[i] );
+    remove( path );
+  }
+  rmdir( dir );
+}//eo remove_test_pki
+
+// shares of a random passphrase, the root key is not needed to unlock
+static void make_test_shares()
+{
+  s_s4eventhandlers_t evt;
+  memset( &evt, 0, sizeof(evt) );
+
+  s_s4context *ctx = s4_init_context();
+  CU_ASSERT_FATAL( NULL != ctx );
+  ssize_t len = gen_pass( ctx->passphrase, sizeof(ctx->passphrase) );
+  CU_ASSERT_FATAL( 0 < len );
+  ctx->passphrase_len = len;
+  ctx->nb_share = TEST_NB_SHARES;
+  ctx->quorum   = TEST_QUORUM;
+
+  CU_ASSERT_FATAL( 0 == s4_split( ctx, &evt ) );
+  for( unsigned i = 0; i < TEST_NB_SHARES; i++ ) {
+    CU_ASSERT_FATAL( 0 == save_shamir_secret( test_shares[i], &(ctx->shares[i]) ) );
+  }
+  s4_destroy_context( ctx );
+}//eo make_test_shares
+
+static void remove_test_shares()
+{
+  for( unsigned i = 0; i < TEST_NB_SHARES; i++ ) {
+    remove( test_shares[i] );
+  }
+}//eo remove_test_shares
+
+
+void Pki_Test()
+{
+  char buf[LIB4S_MAX_ERROR];
+  char expected[512];
+
+  make_test_pki( TEST_PKI_DIR1 );
+  make_test_shares();
+
+  // not a PKI
+  buf[0] = '\0';
+  CU_ASSERT_FATAL( NULL == s4_pki_open( "test_lib4s_missing", buf, sizeof(buf) ) );
+  CU_ASSERT_FATAL( '\0' != buf[0] );
+
+  s4_pki_t *pki = s4_pki_open( TEST_PKI_DIR1, buf, sizeof(buf) );
+  CU_ASSERT_FATAL( NULL != pki );
+  CU_ASSERT_FATAL( TEST_QUORUM == s4_pki_quorum( pki ) );
+  CU_ASSERT_FATAL( !s4_pki_is_unlocked( pki ) );
+
+  CU_ASSERT_FATAL( 0 == s4_pki_describe( pki, buf, sizeof(buf) ) );
+  snprintf( expected, sizeof(expected), "\nsubject=%s\nquorum=%u\nshares=%u\nstate=locked\ncertificates=1\nrevoked=1\n",
+    TEST_PKI_SUBJECT, TEST_QUORUM, TEST_NB_SHARES );
+  CU_ASSERT_FATAL( 0 == strncmp( buf, "root_dir=", 9 ) );
+  CU_ASSERT_FATAL( NULL != strstr( buf, expected ) );
+  CU_ASSERT_FATAL( NULL != strstr( buf, "\nroot_not_after=" ) );
+  CU_ASSERT_FATAL( NULL != strstr( buf, "\nroot_sha256=" ) );
+
+  // below the quorum
+  CU_ASSERT_FATAL( -1 == s4_pki_unlock( pki, test_shares, 1 ) );
+  CU_ASSERT_FATAL( !s4_pki_is_unlocked( pki ) );
+  CU_ASSERT_FATAL( '\0' != s4_pki_last_error( pki, buf, sizeof(buf) )[0] );
+
+  // any quorum of shares
+  const char *quorum[TEST_QUORUM] = { test_shares[2], test_shares[0] };
+  CU_ASSERT_FATAL( 0 == s4_pki_unlock( pki, quorum, TEST_QUORUM ) );
+  CU_ASSERT_FATAL( s4_pki_is_unlocked( pki ) );
+  CU_ASSERT_FATAL( 0 == s4_pki_describe( pki, buf, sizeof(buf) ) );
+  CU_ASSERT_FATAL( NULL != strstr( buf, "\nstate=unlocked\n" ) );
+
+  s4_pki_lock( pki );
+  CU_ASSERT_FATAL( !s4_pki_is_unlocked( pki ) );
+  CU_ASSERT_FATAL( 0 == s4_pki_describe( pki, buf, sizeof(buf) ) );
+  CU_ASSERT_FATAL( NULL != strstr( buf, "\nstate=locked\n" ) );
+
+  s4_pki_close( pki );
+  remove_test_shares();
+  remove_test_pki( TEST_PKI_DIR1 );
+}//eo Pki_Test
+
+void Manager_Test()
+{
+  char err[LIB4S_MAX_ERROR];
+
+  make_test_pki( TEST_PKI_DIR1 );
+  make_test_pki( TEST_PKI_DIR2 );
+  CU_ASSERT_FATAL( 0 == symlink( TEST_PKI_DIR1, TEST_PKI_LINK ) );
+
+  s4_manager_t *mgr = s4_manager_create();
+  CU_ASSERT_FATAL( NULL != mgr );
+  CU_ASSERT_FATAL( NULL == s4_manager_get( mgr, NULL ) );
+  CU_ASSERT_FATAL( 0 == s4_manager_count( mgr ) );
+
+  s4_pki_t *pki1 = s4_manager_open( mgr, "one", TEST_PKI_DIR1, err, sizeof(err) );
+  CU_ASSERT_FATAL( NULL != pki1 );
+
+  // invalid or duplicate id
+  CU_ASSERT_FATAL( NULL == s4_manager_open( mgr, "o/ne", TEST_PKI_DIR2, err, sizeof(err) ) );
+  CU_ASSERT_FATAL( NULL != strstr( err, "invalid id" ) );
+  CU_ASSERT_FATAL( NULL == s4_manager_open( mgr, "one", TEST_PKI_DIR2, err, sizeof(err) ) );
+  CU_ASSERT_FATAL( NULL != strstr( err, "id already used" ) );
+
+  // the same directory through another path
+  CU_ASSERT_FATAL( NULL == s4_manager_open( mgr, "link", TEST_PKI_LINK, err, sizeof(err) ) );
+  CU_ASSERT_FATAL( NULL != strstr( err, "directory already opened" ) );
+  CU_ASSERT_FATAL( NULL == s4_manager_open( mgr, "dotdot", TEST_PKI_DOTDOT, err, sizeof(err) ) );
+  CU_ASSERT_FATAL( NULL != strstr( err, "directory already opened" ) );
+  CU_ASSERT_FATAL( NULL == s4_manager_open( mgr, "missing", "test_lib4s_missing", err, sizeof(err) ) );
+  CU_ASSERT_FATAL( NULL != strstr( err, "directory not found" ) );
+
+  s4_pki_t *pki2 = s4_manager_open( mgr, "two", TEST_PKI_DIR2, err, sizeof(err) );
+  CU_ASSERT_FATAL( NULL != pki2 && pki1 != pki2 );
+
+  // routed by id, the first PKI by default
+  CU_ASSERT_FATAL( pki1 == s4_manager_get( mgr, "one" ) );
+  CU_ASSERT_FATAL( pki2 == s4_manager_get( mgr, "two" ) );
+  CU_ASSERT_FATAL( NULL == s4_manager_get( mgr, "three" ) );
+  CU_ASSERT_FATAL( pki1 == s4_manager_get( mgr, NULL ) );
+  CU_ASSERT_FATAL( pki1 == s4_manager_get( mgr, "" ) );
+
+  CU_ASSERT_FATAL( 2 == s4_manager_count( mgr ) );
+  CU_ASSERT_FATAL( 0 == strcmp( "one", s4_manager_id( mgr, 0 ) ) );
+  CU_ASSERT_FATAL( 0 == strcmp( "two", s4_manager_id( mgr, 1 ) ) );
+  CU_ASSERT_FATAL( NULL == s4_manager_id( mgr, 2 ) );
+
+  s4_manager_destroy( mgr );
+  remove( TEST_PKI_LINK );
+  remove_test_pki( TEST_PKI_DIR2 );
+  remove_test_pki( TEST_PKI_DIR1 );
+}//eo Manager_Test
+
+
+int main (int argc, char** argv)
+{
+
+  CU_pSuite pSuite = NULL;
+
+  // before any GMP integer exists
+  lib4s_init();
+
+  /* initialize the CUnit test registry */
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  /* add a suite to the registry */
+  pSuite = CU_add_suite("Suite_1", NULL, NULL);
+  if (NULL == pSuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "PKI handle test", Pki_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "PKI manager test", Manager_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Run all tests using the CUnit Basic interface */
+  CU_basic_set_mode(CU_BRM_VERBOSE);
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+
+}//eo main
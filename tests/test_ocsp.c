@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <CUnit/Basic.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <openssl/ocsp.h>
+
+
+#include "utils.h"
+#include "ca_store.h"
+#include "shared_secret.h"
+#include "ocsp.h"
+
+
+#define TEST_PKI_DIR      ("test_ocsp_pki")
+#define TEST_PKI_PASSWORD ("test_ocsp_password")
+
+// one valid, one revoked and one expired certificate
+#define TEST_PKI_INDEX ( \
+  "V\t361016080509Z\t\t02\tunknown\t/O=org/CN=valid\n" \
+  "R\t361016080509Z\t261019080509Z,keyCompromise\t03\tunknown\t/O=org/CN=revoked\n" \
+  "E\t161016080509Z\t\t04\tunknown\t/O=org/CN=expired\n" \
+)
+
+
+static X509     *test_cacert = NULL;
+static EVP_PKEY *test_key    = NULL;
+
+// self-signed root, its encrypted key and index, as left by an init
+static void make_test_pki()
+{
+  char  path[256];
+  FILE *fp;
+
+  mkdir( TEST_PKI_DIR, 0700 );
+  snprintf( path, sizeof(path), "%s/cacert", TEST_PKI_DIR );
+  mkdir( path, 0700 );
+  snprintf( path, sizeof(path), "%s/private", TEST_PKI_DIR );
+  mkdir( path, 0700 );
+
+  test_key = EVP_PKEY_Q_keygen( NULL, NULL, "EC", "P-256" );
+  CU_ASSERT_FATAL( NULL != test_key );
+
+  test_cacert = X509_new();
+  CU_ASSERT_FATAL( NULL != test_cacert );
+  X509_NAME *name = X509_get_subject_name( test_cacert );
+  X509_NAME_add_entry_by_txt( name, "CN", MBSTRING_ASC, (const unsigned char*)"test_ocsp root", -1, -1, 0 );
+  X509_set_issuer_name( test_cacert, name );
+  ASN1_INTEGER_set( X509_get_serialNumber( test_cacert ), 1 );
+  X509_gmtime_adj( X509_getm_notBefore( test_cacert ), 0 );
+  X509_gmtime_adj( X509_getm_notAfter( test_cacert ), 3600 );
+  X509_set_pubkey( test_cacert, test_key );
+  CU_ASSERT_FATAL( 0 < X509_sign( test_cacert, test_key, EVP_sha256() ) );
+
+  snprintf( path, sizeof(path), "%s/cacert/%s", TEST_PKI_DIR, ROOT_CERT_FNAME );
+  CU_ASSERT_FATAL( NULL != (fp = fopen( path, "w" )) );
+  CU_ASSERT_FATAL( PEM_write_X509( fp, test_cacert ) );
+  fclose( fp );
+
+  snprintf( path, sizeof(path), "%s/private/%s", TEST_PKI_DIR, ROOT_KEY_FNAME );
+  CU_ASSERT_FATAL( NULL != (fp = fopen( path, "w" )) );
+  CU_ASSERT_FATAL( PEM_write_PrivateKey( fp, test_key, EVP_aes_256_cbc(), NULL, 0, NULL, TEST_PKI_PASSWORD ) );
+  fclose( fp );
+
+  snprintf( path, sizeof(path), "%s/%s", TEST_PKI_DIR, CERT_INDEX_FNAME );
+  CU_ASSERT_FATAL( 0 < write_to_file( path, strlen(TEST_PKI_INDEX), TEST_PKI_INDEX ) );
+}//eo make_test_pki
+
+static void remove_test_pki()
+{
+  char path[256];
+  const char *files[] = { "ocsp/02.der", "ocsp/03.der", "ocsp/04.der", "ocsp/0F.der", "ocsp", "cacert/root.crt", "cacert", "private/root.key", "private", "cert.idx" };
+
+  for( unsigned i = 0; i < sizeof(files)/sizeof(files[0]); i++ ) {
+    snprintf( path, sizeof(path), "%s/%s", TEST_PKI_DIR, files[i] );
+    remove( path );
+  }
+  rmdir( TEST_PKI_DIR );
+  X509_free( test_cacert );
+  EVP_PKEY_free( test_key );
+}//eo remove_test_pki
+
+// HTTP POST of a DER OCSP request for a serial, as 'openssl ocsp' sends it
+static size_t build_post( unsigned char *post, size_t max, long serial, const char *extra_fields )
+{
+  OCSP_REQUEST  *req = OCSP_REQUEST_new();
+  ASN1_INTEGER  *sn  = ASN1_INTEGER_new();
+  unsigned char *der = NULL;
+
+  ASN1_INTEGER_set( sn, serial );
+  OCSP_CERTID *id = OCSP_cert_id_new( EVP_sha1(), X509_get_subject_name(test_cacert), X509_get0_pubkey_bitstr(test_cacert), sn );
+  CU_ASSERT_FATAL( NULL != id && NULL != OCSP_request_add0_id( req, id ) );
+  int der_len = i2d_OCSP_REQUEST( req, &der );
+  CU_ASSERT_FATAL( der_len > 0 );
+
+  int n = snprintf( (char*)post, max,
+    "POST / HTTP/1.0\r\nContent-Type: application/ocsp-request\r\nContent-Length: %d\r\n%s\r\n",
+    der_len, extra_fields );
+  CU_ASSERT_FATAL( n > 0 && (size_t)(n + der_len) <= max );
+  memcpy( post + n, der, der_len );
+
+  OPENSSL_free( der );
+  ASN1_INTEGER_free( sn );
+  OCSP_REQUEST_free( req );
+  return n + der_len;
+}//eo build_post
+
+// client side of a connection, the responses may come in the same reads
+typedef struct SClientConn {
+  int    fd;
+  char   buf[MAX_HTTP_HEADER];
+  size_t kept;
+} s_client_conn_t;
+
+// read one HTTP response and return the certificate status it carries
+static int read_status( s_client_conn_t *conn )
+{
+  unsigned char body[MAX_HTTP_HEADER];
+  size_t        hdr_len = 0;
+
+  ssize_t len = ocsp_http_read_header( conn->fd, conn->buf, sizeof(conn->buf), conn->kept, &hdr_len );
+  CU_ASSERT_FATAL( len > 0 );
+  CU_ASSERT_FATAL( 0 == strncmp( conn->buf, "HTTP/1.1 200", 12 ) );
+  size_t body_len = ocsp_http_content_length( conn->buf );
+  size_t already  = len - hdr_len;
+  CU_ASSERT_FATAL( body_len <= sizeof(body) );
+  if( already >= body_len ) {
+    memcpy( body, conn->buf + hdr_len, body_len );
+    conn->kept = already - body_len;
+    memmove( conn->buf, conn->buf + hdr_len + body_len, conn->kept );
+  } else {
+    memcpy( body, conn->buf + hdr_len, already );
+    CU_ASSERT_FATAL( ocsp_http_read( conn->fd, body + already, body_len - already ) >= 0 );
+    conn->kept = 0;
+  }
+
+  const unsigned char *p = body;
+  OCSP_RESPONSE  *resp = d2i_OCSP_RESPONSE( NULL, &p, (long)body_len );
+  CU_ASSERT_FATAL( NULL != resp );
+  CU_ASSERT_FATAL( OCSP_RESPONSE_STATUS_SUCCESSFUL == OCSP_response_status( resp ) );
+  OCSP_BASICRESP *bs = OCSP_response_get1_basic( resp );
+  CU_ASSERT_FATAL( NULL != bs );
+
+  // signed by the root
+  STACK_OF(X509) *signers = sk_X509_new_null();
+  CU_ASSERT_FATAL( NULL != signers && sk_X509_push( signers, test_cacert ) );
+  CU_ASSERT_FATAL( 1 == OCSP_basic_verify( bs, signers, NULL, OCSP_NOVERIFY ) );
+  sk_X509_free( signers );
+
+  OCSP_SINGLERESP *single = OCSP_resp_get0( bs, 0 );
+  CU_ASSERT_FATAL( NULL != single );
+  int status = OCSP_single_get0_status( single, NULL, NULL, NULL, NULL );
+
+  OCSP_BASICRESP_free( bs );
+  OCSP_RESPONSE_free( resp );
+  return status;
+}//eo read_status
+
+typedef struct SServeArg {
+  const s_ocsp_cache_t *cache;
+  int                   fd;
+} s_serve_arg_t;
+
+// responder side of the connection, as a worker of 4s-ocsp
+static void* serve_thread( void *arg )
+{
+  s_serve_arg_t *serve = (s_serve_arg_t*)arg;
+
+  ocsp_http_serve( serve->cache, serve->fd );
+  close( serve->fd );
+  return NULL;
+}//eo serve_thread
+
+void OcspResponder_Test()
+{
+  s_s4eventhandlers_t evt;
+  s_ocsp_cache_t      cache;
+  unsigned char       post[MAX_HTTP_HEADER];
+  int                 fds[2];
+  pthread_t           thread;
+  s_client_conn_t     conn;
+
+  make_test_pki();
+  memset( &evt, 0, sizeof(evt) );
+  CU_ASSERT_FATAL( 0 == ocsp_presign( TEST_PKI_DIR, 7, TEST_PKI_PASSWORD, &evt ) );
+
+  // the response left for a certificate expired since is removed by the next signing
+  char path[256];
+  snprintf( path, sizeof(path), "%s/ocsp/02.der", TEST_PKI_DIR );
+  char stale[256];
+  snprintf( stale, sizeof(stale), "%s/ocsp/04.der", TEST_PKI_DIR );
+  CU_ASSERT_FATAL( 0 == link( path, stale ) );
+  CU_ASSERT_FATAL( 0 == ocsp_presign( TEST_PKI_DIR, 7, TEST_PKI_PASSWORD, &evt ) );
+  CU_ASSERT_FATAL( 0 != access( stale, F_OK ) );
+
+  // a corrupt response is skipped, the others are still served
+  snprintf( path, sizeof(path), "%s/ocsp/0F.der", TEST_PKI_DIR );
+  CU_ASSERT_FATAL( 0 < write_to_file( path, 4, "junk" ) );
+  CU_ASSERT_FATAL( 0 == ocsp_cache_load( TEST_PKI_DIR, &cache ) );
+  CU_ASSERT_FATAL( 2 == cache.nb_entries );
+  CU_ASSERT_FATAL( NULL == ocsp_cache_find( &cache, "0F" ) );
+
+  // a lost request fails the test instead of blocking it
+  struct timeval timeout = { 5, 0 };
+  CU_ASSERT_FATAL( 0 == socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) );
+  CU_ASSERT_FATAL( 0 == setsockopt( fds[0], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) ) );
+  CU_ASSERT_FATAL( 0 == setsockopt( fds[1], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) ) );
+  s_serve_arg_t serve = { &cache, fds[1] };
+  CU_ASSERT_FATAL( 0 == pthread_create( &thread, NULL, serve_thread, &serve ) );
+  conn.fd   = fds[0];
+  conn.kept = 0;
+
+  // requests on the same keep-alive connection, one by one
+  size_t len = build_post( post, sizeof(post), 2, "" );
+  CU_ASSERT_FATAL( 0 == ocsp_http_write( conn.fd, post, len ) );
+  CU_ASSERT_FATAL( V_OCSP_CERTSTATUS_GOOD == read_status( &conn ) );
+
+  len = build_post( post, sizeof(post), 3, "" );
+  CU_ASSERT_FATAL( 0 == ocsp_http_write( conn.fd, post, len ) );
+  CU_ASSERT_FATAL( V_OCSP_CERTSTATUS_REVOKED == read_status( &conn ) );
+
+  // then pipelined in a single write, the last one closing the connection
+  len  = build_post( post, sizeof(post), 3, "" );
+  len += build_post( post + len, sizeof(post) - len, 2, "" );
+  len += build_post( post + len, sizeof(post) - len, 3, "connection: close\r\n" );
+  CU_ASSERT_FATAL( 0 == ocsp_http_write( conn.fd, post, len ) );
+  CU_ASSERT_FATAL( V_OCSP_CERTSTATUS_REVOKED == read_status( &conn ) );
+  CU_ASSERT_FATAL( V_OCSP_CERTSTATUS_GOOD == read_status( &conn ) );
+  CU_ASSERT_FATAL( V_OCSP_CERTSTATUS_REVOKED == read_status( &conn ) );
+
+  pthread_join( thread, NULL );
+  close( conn.fd );
+  ocsp_cache_free( &cache );
+  remove_test_pki();
+}//eo OcspResponder_Test
+
+// status of the pre-signed response of a serial, as loaded by the responder
+static int cached_status( const char *serial )
+{
+  s_ocsp_cache_t cache;
+
+  CU_ASSERT_FATAL( 0 == ocsp_cache_load( TEST_PKI_DIR, &cache ) );
+  const s_ocsp_cache_entry_t *slot = ocsp_cache_find( &cache, serial );
+  CU_ASSERT_FATAL( NULL != slot );
+
+  const unsigned char *p = slot->der;
+  OCSP_RESPONSE   *resp   = d2i_OCSP_RESPONSE( NULL, &p, (long)slot->der_len );
+  OCSP_BASICRESP  *bs     = resp ? OCSP_response_get1_basic( resp ) : NULL;
+  OCSP_SINGLERESP *single = bs ? OCSP_resp_get0( bs, 0 ) : NULL;
+  CU_ASSERT_FATAL( NULL != single );
+  int status = OCSP_single_get0_status( single, NULL, NULL, NULL, NULL );
+
+  OCSP_BASICRESP_free( bs );
+  OCSP_RESPONSE_free( resp );
+  ocsp_cache_free( &cache );
+  return status;
+}//eo cached_status
+
+void OcspRevocation_Test()
+{
+  s_s4eventhandlers_t evt;
+  s_ca_index_t        index;
+  s_atomic_group_t    grp;
+
+  make_test_pki();
+  memset( &evt, 0, sizeof(evt) );
+  CU_ASSERT_FATAL( 0 == ocsp_presign( TEST_PKI_DIR, 7, TEST_PKI_PASSWORD, &evt ) );
+  CU_ASSERT_FATAL( V_OCSP_CERTSTATUS_GOOD == cached_status( "02" ) );
+
+  // revoked in memory, the response is replaced with the group only
+  CU_ASSERT_FATAL( 0 == ca_index_load( TEST_PKI_DIR, &index ) );
+  s_ca_index_entry_t *entry = ca_index_find( &index, "02" );
+  CU_ASSERT_FATAL( NULL != entry );
+  entry->status = 'R';
+  entry->reason = CRL_REASON_UNSET;
+  strlcpy( entry->revocation, "261019080509Z", sizeof(entry->revocation) );
+
+  atomic_group_init( &grp );
+  CU_ASSERT_FATAL( 0 == ocsp_presign_revoked( &grp, TEST_PKI_DIR, test_cacert, test_key, &entry, 1 ) );
+  atomic_group_abort( &grp );
+  CU_ASSERT_FATAL( V_OCSP_CERTSTATUS_GOOD == cached_status( "02" ) );
+
+  atomic_group_init( &grp );
+  CU_ASSERT_FATAL( 0 == ocsp_presign_revoked( &grp, TEST_PKI_DIR, test_cacert, test_key, &entry, 1 ) );
+  CU_ASSERT_FATAL( 0 == atomic_group_commit( &grp ) );
+  CU_ASSERT_FATAL( V_OCSP_CERTSTATUS_REVOKED == cached_status( "02" ) );
+
+  ca_index_free( &index );
+  remove_test_pki();
+}//eo OcspRevocation_Test
+
+//
+//
+int main (int argc, char** argv)
+{
+
+  CU_pSuite pSuite = NULL;
+
+  /* initialize the CUnit test registry */
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  /* add a suite to the registry */
+  pSuite = CU_add_suite("Suite_1", NULL, NULL);
+  if (NULL == pSuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "OCSP responder test", OcspResponder_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "OCSP revocation test", OcspRevocation_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Run all tests using the CUnit Basic interface */
+  CU_basic_set_mode(CU_BRM_VERBOSE);
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+
+}//eo main
+
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/types.h>
+#include <stdint.h>
+
+#include <CUnit/Basic.h>
+
+
+#include "utils.h"
+#include "sha3.h"
+
+
+/*
+ * Known answers from the FIPS 202 examples and the NIST CAVP byte oriented
+ * test vectors. Whatever the Keccak-f[1600] implementation selected at build
+ * time, the digests must be bit exact.
+ */
+#define KAT_EMPTY_256 ( \
+    "A7FFC6F8BF1ED76651C14756A061D662F580FF4DE43B49FA82D80A4B80F8434A" )
+
+#define KAT_ABC_256 ( \
+    "3A985DA74FE225B2045C172D6BD390BD855F086E3E9D525B46BFE24511431532" )
+
+#define KAT_ABC_384 ( \
+    "EC01498288516FC926459F58E2C6AD8DF9B473CB0FC08C2596DA7CF0E49BE4B2" \
+    "98D88CEA927AC7F539F1EDF228376D25" )
+
+#define KAT_ABC_512 ( \
+    "B751850B1A57168A5693CD924B6B096E08F621827444F70D884F5D0240D2712E" \
+    "10E116E9192AF3C91A7EC57647E3934057340B4CF408D5A56592F8274EEC53F0" )
+
+// 200 bytes 0xA3: more than one block for every SHA3 variant
+#define KAT_A3x200_256 ( \
+    "79F38ADEC5C20307A98EF76E8324AFBFD46CFD81B22E3973C65FA1BD9DE31787" )
+
+#define KAT_A3x200_512 ( \
+    "E76DFAD22084A8B1467FCF2FFA58361BEC7628EDF5F3FDC0E4805DC48CAEECA8" \
+    "1B7C13C30ADF52A3659584739A2DF46BE589C51CA1A4A8416DF6545A1CE8BA00" )
+
+// 1 000 000 times 'a'
+#define KAT_MILLION_A_256 ( \
+    "5C8875AE474A3634BA4FD55EC85BFFD661F32ACA75C6D699D0CDCB6C115891C1" )
+
+// SHAKE of the empty message
+#define KAT_SHAKE128_EMPTY ( \
+    "7F9C2BA4E88F827D616045507605853ED73B8093F6EFBC88EB1A6EACFA66EF26" )
+
+#define KAT_SHAKE256_EMPTY ( \
+    "46B9DD2B0BA88D13233B3FEB743EEB243FCD52EA62B81B82B50C27646ED5762F" \
+    "D75DC4DDD8C0F200CB05019D67B592F6FC821C49479AB48640292EACB3B7C4BE" )
+
+// NIST SP 800-185 cSHAKE samples, S = "Email Signature"
+#define CSHAKE_CUSTOM ( "Email Signature" )
+
+#define KAT_CSHAKE128_SAMPLE1 ( \
+    "C1C36925B6409A04F1B504FCBCA9D82B4017277CB5ED2B2065FC1D3814D5AAF5" )
+
+#define KAT_CSHAKE128_SAMPLE2 ( \
+    "C5221D50E4F822D96A2E8881A961420F294B7B24FE3D2094BAED2C6524CC166B" )
+
+#define KAT_CSHAKE256_SAMPLE3 ( \
+    "D008828E2B80AC9D2218FFEE1D070C48B8E4C87BFF32C9699D5B6896EEE0EDD1" \
+    "64020E2BE0560858D9C00C037E34A96937C561A74C412BB4C746469527281C8C" )
+
+#define MILLION (1000000)
+
+typedef void (*sha3_init_func_ptr) ( sha3_context *priv );
+
+void check_digest( const char *name, sha3_init_func_ptr do_init, const size_t digest_len,
+                   const uint8_t *msg, const size_t msg_len, const size_t chunk, const char *ref )
+{
+    sha3_context c;
+    char hex[2*64+1];
+    size_t done = 0;
+
+    memset( hex, 0, sizeof(hex) );
+
+    do_init( &c );
+    while( done < msg_len ) {
+        size_t n = ( chunk > 0 && chunk < (msg_len - done) ) ? chunk : (msg_len - done);
+        sha3_update( &c, msg + done, n );
+        done += n;
+    }
+    const uint8_t *digest = sha3_finalize( &c );
+
+    ssize_t r = hex_encode( hex, sizeof(hex), digest, digest_len );
+    DDEBUG_PRN("%s (chunk %u): %s", name, (unsigned)chunk, hex);
+    CU_ASSERT_FATAL( r >= 0 );
+    CU_ASSERT_FATAL( 0 == strcmp( hex, ref ) );
+}//eo check_digest
+
+void SHA3_KAT_Test()
+{
+    uint8_t a3[200];
+    memset( a3, 0xA3, sizeof(a3) );
+
+    check_digest( "SHA3-256('')",    sha3_init256, 32, (const uint8_t*)"",    0, 0, KAT_EMPTY_256 );
+    check_digest( "SHA3-256('abc')", sha3_init256, 32, (const uint8_t*)"abc", 3, 0, KAT_ABC_256 );
+    check_digest( "SHA3-384('abc')", sha3_init384, 48, (const uint8_t*)"abc", 3, 0, KAT_ABC_384 );
+    check_digest( "SHA3-512('abc')", sha3_init512, 64, (const uint8_t*)"abc", 3, 0, KAT_ABC_512 );
+
+    check_digest( "SHA3-256(A3x200)", sha3_init256, 32, a3, sizeof(a3), 0, KAT_A3x200_256 );
+    check_digest( "SHA3-512(A3x200)", sha3_init512, 64, a3, sizeof(a3), 0, KAT_A3x200_512 );
+}//eo SHA3_KAT_Test
+
+void SHA3_Chunked_Test()
+{
+    uint8_t a3[200];
+    size_t  chunk;
+
+    memset( a3, 0xA3, sizeof(a3) );
+
+    // the sponge must not depend on how the message is split
+    for( chunk = 1; chunk <= 17; chunk++ ) {
+        check_digest( "SHA3-256(A3x200)", sha3_init256, 32, a3, sizeof(a3), chunk, KAT_A3x200_256 );
+        check_digest( "SHA3-512(A3x200)", sha3_init512, 64, a3, sizeof(a3), chunk, KAT_A3x200_512 );
+    }
+}//eo SHA3_Chunked_Test
+
+void SHA3_OneShot_Test()
+{
+    uint8_t raw[200 + 8];
+    uint8_t digest[SHA3_256_DIGEST_LEN];
+    char    hex[2*SHA3_256_DIGEST_LEN+1];
+    size_t  offset;
+
+    memset( raw, 0xA3, sizeof(raw) );
+
+    // every alignment of the input buffer
+    for( offset = 0; offset < 8; offset++ ) {
+        sha3_256( raw + offset, 200, digest );
+        CU_ASSERT_FATAL( hex_encode( hex, sizeof(hex), digest, sizeof(digest) ) >= 0 );
+        CU_ASSERT_FATAL( 0 == strcmp( hex, KAT_A3x200_256 ) );
+    }
+
+    sha3_256( "abc", 3, digest );
+    CU_ASSERT_FATAL( hex_encode( hex, sizeof(hex), digest, sizeof(digest) ) >= 0 );
+    CU_ASSERT_FATAL( 0 == strcmp( hex, KAT_ABC_256 ) );
+}//eo SHA3_OneShot_Test
+
+void SHA3_MultiBuffer_Test()
+{
+    // lengths around the 136 bytes rate, including an empty message
+    const size_t sizes[] = { 0, 3, 135, 136, 137, 200, 272, 1000, 3, 200 };
+    const unsigned nb = sizeof(sizes) / sizeof(sizes[0]);
+    // room for the largest message at the largest misalignment offset
+    uint8_t     raw[1000 + 8];
+    uint8_t     digests[10][SHA3_256_DIGEST_LEN];
+    uint8_t     ref[SHA3_256_DIGEST_LEN];
+    void const *bufs[10];
+    uint8_t    *outs[10];
+    unsigned    i, n;
+
+    for( i = 0; i < sizeof(raw); i++ )
+        raw[i] = (uint8_t)(i * 7 + 1);
+
+    DDEBUG_PRN("multi-buffer accelerated: %d", sha3_x4_accelerated());
+
+    // every number of messages, so that every lane filling is exercised
+    for( n = 1; n <= nb; n++ ) {
+        memset( digests, 0, sizeof(digests) );
+        for( i = 0; i < n; i++ ) {
+            bufs[i] = raw + (i % 8);
+            outs[i] = digests[i];
+        }
+        sha3_256_multi( n, bufs, sizes, outs );
+
+        for( i = 0; i < n; i++ ) {
+            sha3_256( bufs[i], sizes[i], ref );
+            CU_ASSERT_FATAL( 0 == memcmp( ref, digests[i], SHA3_256_DIGEST_LEN ) );
+        }
+    }
+}//eo SHA3_MultiBuffer_Test
+
+void check_xof( const char *name, sha3_context *c, const uint8_t *msg, const size_t msg_len, const size_t out_len, const char *ref )
+{
+    uint8_t out[64];
+    char    hex[2*64+1];
+
+    sha3_update( c, msg, msg_len );
+    sha3_xof_squeeze( c, out, out_len );
+    CU_ASSERT_FATAL( hex_encode( hex, sizeof(hex), out, out_len ) >= 0 );
+    DDEBUG_PRN("%s: %s", name, hex);
+    CU_ASSERT_FATAL( 0 == strcmp( hex, ref ) );
+}//eo check_xof
+
+void SHA3_XOF_Test()
+{
+    sha3_context c;
+    uint8_t      data[200];
+    uint8_t      stream[1000];
+    uint8_t      pieces[1000];
+    unsigned     i;
+
+    for( i = 0; i < sizeof(data); i++ )
+        data[i] = (uint8_t)i;
+
+    shake128_init( &c );
+    check_xof( "SHAKE128('')", &c, data, 0, 32, KAT_SHAKE128_EMPTY );
+    shake256_init( &c );
+    check_xof( "SHAKE256('')", &c, data, 0, 64, KAT_SHAKE256_EMPTY );
+
+    cshake128_init( &c, "", 0, CSHAKE_CUSTOM, strlen(CSHAKE_CUSTOM) );
+    check_xof( "cSHAKE128 #1", &c, data, 4, 32, KAT_CSHAKE128_SAMPLE1 );
+    cshake128_init( &c, "", 0, CSHAKE_CUSTOM, strlen(CSHAKE_CUSTOM) );
+    check_xof( "cSHAKE128 #2", &c, data, sizeof(data), 32, KAT_CSHAKE128_SAMPLE2 );
+    cshake256_init( &c, "", 0, CSHAKE_CUSTOM, strlen(CSHAKE_CUSTOM) );
+    check_xof( "cSHAKE256 #3", &c, data, 4, 64, KAT_CSHAKE256_SAMPLE3 );
+
+    // empty N and S is SHAKE
+    cshake256_init( &c, "", 0, "", 0 );
+    check_xof( "cSHAKE256('','')", &c, data, 0, 64, KAT_SHAKE256_EMPTY );
+
+    // the output is one stream, whatever the size of the squeezes
+    shake128_init( &c );
+    sha3_update( &c, data, sizeof(data) );
+    sha3_xof_squeeze( &c, stream, sizeof(stream) );
+    shake128_init( &c );
+    sha3_update( &c, data, sizeof(data) );
+    for( i = 0; i < sizeof(pieces); i += 13 )
+        sha3_xof_squeeze( &c, pieces + i, (sizeof(pieces) - i < 13) ? sizeof(pieces) - i : 13 );
+    CU_ASSERT_FATAL( 0 == memcmp( stream, pieces, sizeof(stream) ) );
+}//eo SHA3_XOF_Test
+
+void SHA3_Million_Test()
+{
+    uint8_t *msg = malloc( MILLION );
+    CU_ASSERT_FATAL( NULL != msg );
+    memset( msg, 'a', MILLION );
+
+    check_digest( "SHA3-256(1M 'a')", sha3_init256, 32, msg, MILLION, 0,    KAT_MILLION_A_256 );
+    check_digest( "SHA3-256(1M 'a')", sha3_init256, 32, msg, MILLION, 1000, KAT_MILLION_A_256 );
+
+    free( msg );
+}//eo SHA3_Million_Test
+
+//
+//
+int main (int argc, char** argv)
+{
+
+  CU_pSuite pSuite = NULL;
+
+  /* initialize the CUnit test registry */
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  /* add a suite to the registry */
+  pSuite = CU_add_suite("Suite_1", NULL, NULL);
+  if (NULL == pSuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "SHA3 known answers test", SHA3_KAT_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "SHA3 chunked input test", SHA3_Chunked_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "SHA3 one-shot test", SHA3_OneShot_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "SHA3 multi-buffer test", SHA3_MultiBuffer_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "SHAKE and cSHAKE test", SHA3_XOF_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "SHA3 long message test", SHA3_Million_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  /* Run all tests using the CUnit Basic interface */
+  CU_basic_set_mode(CU_BRM_VERBOSE);
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+
+}//eo main
@@ -3,9 +3,11 @@
 #include <assert.h>
 #include <string.h>
 #include <time.h>
+#include <gmp.h>
 #include <CUnit/Basic.h> 
 #include "shamir.h"
 #include "utils.h"
+#include "secure_arena.h"
 
 #define TEST_SECRET1 (const uint8_t*)("somethingcontinuousandillisiblewhilesecret")
 #define TEST_SECRET2 (const uint8_t*)("SomeThingContinuousAndIllisibleWhileSecret")
@@ -71,6 +73,134 @@ void ShamirShare_Many3Among5_Test(void)
 }// eo ShamirShare_Many3Among5_Test
 
 
+// Batch fingerprints must match the one share at a time ones
+void ShamirShare_Fingerprints_Test(void)
+{
+    s_share_t shares[7];
+    char      batch[7][SHARE_FINGERPRINT_LEN+1];
+    char      single[SHARE_FINGERPRINT_LEN+1];
+
+    CU_ASSERT_FATAL( 0 == do_shamir_split( 3, 7, TEST_SECRET4, BYTESLEN(TEST_SECRET4), shares ) );
+
+    for ( unsigned nb = 1; nb <= 7; nb++ ) {
+        memset( batch, 0, sizeof(batch) );
+        CU_ASSERT_FATAL( 0 == shamir_shares_fingerprints( shares, nb, batch ) );
+        for ( unsigned i = 0; i < nb; i++ ) {
+            CU_ASSERT_FATAL( shamir_share_fingerprint( &(shares[i]), single, sizeof(single) ) > 0 );
+            CU_ASSERT_FATAL( 0 == strcmp( single, batch[i] ) );
+        }
+    }
+}// eo ShamirShare_Fingerprints_Test
+
+// An integer of the host, created before any arena, is still handled by GMP afterwards
+void ShamirShare_HostGmp_Test(void)
+{
+    void *(*alloc_before)(size_t), *(*realloc_before)(void*, size_t, size_t);
+    void  (*free_before)(void*, size_t);
+    void *(*alloc_after)(size_t),  *(*realloc_after)(void*, size_t, size_t);
+    void  (*free_after)(void*, size_t);
+    mpz_t host;
+
+    mp_get_memory_functions( &alloc_before, &realloc_before, &free_before );
+    mpz_init_set_ui( host, 12345 );
+
+    s_secure_arena_t *arena = secure_arena_create( 64*1024 );
+    CU_ASSERT_FATAL( NULL != arena );
+    s_share_t shares[4];
+    CU_ASSERT_FATAL( 0 == do_shamir_split( 3, 4, TEST_SECRET4, BYTESLEN(TEST_SECRET4), shares ) );
+    secure_arena_destroy( arena );
+
+    mp_get_memory_functions( &alloc_after, &realloc_after, &free_after );
+    CU_ASSERT_FATAL( alloc_before == alloc_after && realloc_before == realloc_after && free_before == free_after );
+    mpz_mul_2exp( host, host, 4096 );
+    mpz_tdiv_q_2exp( host, host, 4096 );
+    CU_ASSERT_FATAL( 0 == mpz_cmp_ui( host, 12345 ) );
+    mpz_clear( host );
+}// eo ShamirShare_HostGmp_Test
+
+// Split and recovery within an arena entered by the caller, which gets it back as it was
+void ShamirShare_Arena_Test(void)
+{
+    // no GMP integer is left by the tests before
+    secure_arena_init();
+
+    s_secure_arena_t *arena = secure_arena_create( 256*1024 );
+    CU_ASSERT_FATAL( NULL != arena );
+
+    // zeroed, aligned allocations; exhaustion reported
+    uint8_t *keep = secure_arena_alloc( arena, 100 );
+    CU_ASSERT_FATAL( NULL != keep && 0 == ((uintptr_t)keep % 16) );
+    memset( keep, 0xA5, 100 );
+    const size_t mark = secure_arena_mark( arena );
+    uint8_t *tmp = secure_arena_alloc( arena, 64 );
+    CU_ASSERT_FATAL( NULL != tmp );
+    memset( tmp, 0x5A, 64 );
+    secure_arena_rewind( arena, mark );
+    tmp = secure_arena_alloc( arena, 64 );
+    CU_ASSERT_FATAL( NULL != tmp && 0 == tmp[0] && 0 == tmp[63] );
+    CU_ASSERT_FATAL( NULL == secure_arena_alloc( arena, 1024*1024 ) );
+    secure_arena_rewind( arena, mark );
+
+    s_secure_arena_t *previous = secure_arena_enter( arena );
+    CU_ASSERT_FATAL( arena == secure_arena_current() );
+
+    // the limbs come from the entered arena
+    mpz_t limbs;
+    mpz_init_set_str( limbs, "123456789012345678901234567890123456789012345678901234567890", 10 );
+    CU_ASSERT_FATAL( mark < secure_arena_mark( arena ) );
+    mpz_clear( limbs );
+    CU_ASSERT_FATAL( mark == secure_arena_mark( arena ) );
+
+    s_share_t shares[4];
+    uint8_t   secret[64];
+    CU_ASSERT_FATAL( 0 == do_shamir_split( 3, 4, TEST_SECRET5, TEST_SECRET5_LEN, shares ) );
+    CU_ASSERT_FATAL( mark == secure_arena_mark( arena ) );
+    CU_ASSERT_FATAL( 0 == do_shamir_recovery( 3, &(shares[1]), secret, sizeof(secret) ) );
+    CU_ASSERT_FATAL( mark == secure_arena_mark( arena ) );
+    CU_ASSERT_FATAL( 0 == memcmp( secret, TEST_SECRET5, TEST_SECRET5_LEN ) );
+    CU_ASSERT_FATAL( 0xA5 == keep[0] && 0xA5 == keep[99] );
+
+    secure_arena_leave( previous );
+    CU_ASSERT_FATAL( previous == secure_arena_current() );
+    secure_arena_destroy( arena );
+}// eo ShamirShare_Arena_Test
+
+void ShamirShare_SaveLoad_Test(void)
+{
+    const char *fname = "test_shamir_share.txt";
+    s_share_t shares[3];
+    s_share_t loaded;
+
+    CU_ASSERT_FATAL( 0 == do_shamir_split( 2, 3, TEST_SECRET4, BYTESLEN(TEST_SECRET4), shares ) );
+
+    for ( unsigned i = 0; i < 3; i++ ) {
+        CU_ASSERT_FATAL( 0 == save_shamir_secret( fname, &(shares[i]) ) );
+        CU_ASSERT_FATAL( 0 == load_shamir_secret( fname, &loaded ) );
+        CU_ASSERT_FATAL( 0 == strcmp( shares[i].X,     loaded.X ) );
+        CU_ASSERT_FATAL( 0 == strcmp( shares[i].Y,     loaded.Y ) );
+        CU_ASSERT_FATAL( 0 == strcmp( shares[i].prime, loaded.prime ) );
+    }
+
+    // edited on Windows, with some leading text
+    char buffer[4*SHARED_SECRETS_STR_MAX];
+    int len = snprintf( buffer, sizeof(buffer), "share of the root key\r\n----- BEGIN SHAMIR SHARE -----\r\n%s\r\n%s\r\n%s\r\n",
+                        shares[0].X, shares[0].Y, shares[0].prime );
+    CU_ASSERT_FATAL( write_to_file( fname, len, buffer ) == len );
+    CU_ASSERT_FATAL( 0 == load_shamir_secret( fname, &loaded ) );
+    CU_ASSERT_FATAL( 0 == strcmp( shares[0].Y,     loaded.Y ) );
+    CU_ASSERT_FATAL( 0 == strcmp( shares[0].prime, loaded.prime ) );
+
+    // truncated share, no header
+    len = snprintf( buffer, sizeof(buffer), "----- BEGIN SHAMIR SHARE -----\n%s\n", shares[0].X );
+    CU_ASSERT_FATAL( write_to_file( fname, len, buffer ) == len );
+    CU_ASSERT_FATAL( 0 != load_shamir_secret( fname, &loaded ) );
+    CU_ASSERT_FATAL( write_to_file( fname, 5, "hello" ) == 5 );
+    CU_ASSERT_FATAL( 0 != load_shamir_secret( fname, &loaded ) );
+
+    remove( fname );
+}// eo ShamirShare_SaveLoad_Test
+
+
 int main (int argc, char** argv) 
 {
  
@@ -87,7 +217,12 @@ int main (int argc, char** argv)
       return CU_get_error();
    }
  
-   /* add the tests to the suite */ 
+   /* add the tests to the suite, the GMP memory functions are replaced by the last one */ 
+   if (NULL == CU_add_test(pSuite, "GMP integers of the host around a secure arena", ShamirShare_HostGmp_Test)) {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+
    if (NULL == CU_add_test(pSuite, "Basic Test for Shamir Secret Sharing (3 among 4)", ShamirShare_Basic_Test)) {
       CU_cleanup_registry();
       return CU_get_error();
@@ -98,6 +233,19 @@ int main (int argc, char** argv)
       return CU_get_error();
    }
  
+   if (NULL == CU_add_test(pSuite, "Shamir shares batch fingerprints", ShamirShare_Fingerprints_Test)) {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+   if (NULL == CU_add_test(pSuite, "Shamir share file save and load", ShamirShare_SaveLoad_Test)) {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+   if (NULL == CU_add_test(pSuite, "Shamir split and recovery in a secure arena", ShamirShare_Arena_Test)) {
+      CU_cleanup_registry();
+      return CU_get_error();
+   }
+
    /* Run all tests using the CUnit Basic interface */ 
    CU_basic_set_mode(CU_BRM_VERBOSE);
    CU_basic_run_tests();
@@ -5,10 +5,15 @@
 #include <string.h>
 #include <sys/types.h>
 #include <stdint.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <sys/socket.h>
 
 #include <CUnit/Basic.h> 
+#include <openssl/evp.h>
 
-//#define DEEPDEBUG 1
 
 #include "utils.h"
 
@@ -90,23 +95,23 @@ void do_encoding_test
 
     ssize_t encoding_result = do_encode( buffer_enc, sizeof(buffer_enc), (uint8_t*)raw_ref, raw_size );
     
-    DDEBUG_PRN("%s ref    (%02u):[%s]", enc_name, encoded_ref_len, encoded_ref);
-    DDEBUG_PRN("%s encoded(%02d):[%s]", enc_name, encoding_result, buffer_enc);  
+    DDEBUG_PRN("%s ref    (%02zu):[%s]", enc_name, encoded_ref_len, encoded_ref);
+    DDEBUG_PRN("%s encoded(%02zd):[%s]", enc_name, encoding_result, buffer_enc);  
     CU_ASSERT_FATAL( encoding_result >= 0 );
 
     int encoded_invalid = memcmp( buffer_enc, encoded_ref, encoded_ref_len );
-    DDEBUG_PRN("memcmp(%u) = %d", encoded_ref_len, encoded_invalid );
+    DDEBUG_PRN("memcmp(%zu) = %d", encoded_ref_len, encoded_invalid );
     CU_ASSERT_FATAL( encoded_invalid==0  ) ;    
 
 
     ssize_t decoding_result = do_decode( buffer_dec, sizeof(buffer_dec), buffer_enc );
-    DDEBUG_PRN("%s decoded(%d):[%s]", enc_name, decoding_result, buffer_dec);
+    DDEBUG_PRN("%s decoded(%zd):[%s]", enc_name, decoding_result, buffer_dec);
     CU_ASSERT_FATAL( decoding_result >=0 );
 
     
 
     int decoded_invalid = memcmp( buffer_dec, raw_ref, raw_size);
-    DDEBUG_PRN("memcmp(%u) = %d", raw_size, decoded_invalid );
+    DDEBUG_PRN("memcmp(%zu) = %d", raw_size, decoded_invalid );
     CU_ASSERT_FATAL( decoded_invalid==0 );
 }//en gen_encoding_test
 
@@ -118,12 +123,123 @@ void HexEncode_Test()
 
 }//eo HexEncode_Test
 
+void HexBulk_Test()
+{
+  // long enough for the vector kernels and every tail length
+  static uint8_t raw[300];
+  static char    enc[601];
+  static char    ref[601];
+  static uint8_t dec[300];
+
+  for( unsigned i = 0; i < sizeof(raw); i++ ) {
+    raw[i] = (uint8_t)(i * 151 + 3);
+  }
+
+  for( size_t len = 0; len <= sizeof(raw); len++ ) {
+    for( size_t i = 0; i < len; i++ ) {
+      sprintf( ref + 2*i, "%02X", raw[i] );
+    }
+    ref[2*len] = '\0';
+
+    CU_ASSERT_FATAL( hex_encode( enc, sizeof(enc), raw, len ) == (ssize_t)(2*len) );
+    CU_ASSERT_FATAL( 0 == strcmp( enc, ref ) );
+    CU_ASSERT_FATAL( hex_decode( dec, sizeof(dec), enc ) == (ssize_t)len );
+    CU_ASSERT_FATAL( 0 == memcmp( dec, raw, len ) );
+
+    // lower case is accepted too (Shamir recovery goes through GMP)
+    for( size_t i = 0; i < 2*len; i++ ) {
+      enc[i] = tolower( enc[i] );
+    }
+    CU_ASSERT_FATAL( hex_decode( dec, sizeof(dec), enc ) == (ssize_t)len );
+    CU_ASSERT_FATAL( 0 == memcmp( dec, raw, len ) );
+
+    // any invalid character, in the vector part or not, is an error
+    if( len > 0 ) {
+      const char bad[] = { 'g', 'G', '/', ':', '@', '`', ' ', (char)0xB0 };
+      enc[(len * 7) % (2*len)] = bad[len % sizeof(bad)];
+      CU_ASSERT_FATAL( hex_decode( dec, sizeof(dec), enc ) < 0 );
+    }
+  }
+
+  // odd length and too small buffers
+  CU_ASSERT_FATAL( hex_decode( dec, sizeof(dec), "ABC" ) < 0 );
+  CU_ASSERT_FATAL( hex_decode( dec, 1, "ABCD" ) < 0 );
+  CU_ASSERT_FATAL( hex_encode( enc, 4, raw, 2 ) < 0 );
+}//eo HexBulk_Test
+
 void Base64Encode_Test()
 {
   do_encoding_test( "Base64/ASCII",       base64_encode, base64_decode, ASCII_SAMPLE, strlen(ASCII_SAMPLE), ASCII_B64_ENCODED_SAMPLE );
   do_encoding_test( "Base64/Binary even", base64_encode, base64_decode, BIN_SAMPLE,   BIN_SAMPLE_LEN,       BIN_B64_ENCODED_SAMPLE );     
 }//eo Base64Encode_Test
 
+void Base64Strict_Test()
+{
+  uint8_t out[64];
+  const char *invalid[] = {
+    "QUJD=",      // not a multiple of 4
+    "QU=D",       // '=' in the middle of the last quantum
+    "Q===",       // too much padding
+    "QUJDRA=A",   // '=' before a character
+    "QUJD RA=",   // out of the alphabet
+    "QUJDRB==",   // non zero padding bits
+    "QUJDRE=",    // truncated
+    "QUJDREU\x80", // 8 bits character
+    "QUJD====",   // padding only quantum
+  };
+
+  for( unsigned i = 0; i < sizeof(invalid)/sizeof(invalid[0]); i++ ) {
+    DDEBUG_PRN("strict base64: [%s]", invalid[i]);
+    CU_ASSERT_FATAL( base64_decode( out, sizeof(out), invalid[i] ) < 0 );
+  }
+
+  CU_ASSERT_FATAL( 0 == base64_decode( out, sizeof(out), "" ) );
+  CU_ASSERT_FATAL( 4 == base64_decode( out, sizeof(out), "QUJDRA==" ) );
+  CU_ASSERT_FATAL( 0 == memcmp( out, "ABCD", 4 ) );
+
+  // the destination must hold the decoded data
+  CU_ASSERT_FATAL( base64_decode( out, 3, "QUJDRA==" ) < 0 );
+}//eo Base64Strict_Test
+
+void Base64Bulk_Test()
+{
+  // long enough for the vector kernels and every tail length
+  static uint8_t raw[1100];
+  static char    enc[1500];
+  static char    ref[1500];
+  static uint8_t dec[1100];
+
+  DDEBUG_PRN("base64 engine: %s", base64_engine());
+
+  for( unsigned i = 0; i < sizeof(raw); i++ ) {
+    raw[i] = (uint8_t)(i * 131 + 7);
+  }
+
+  for( size_t len = 0; len <= sizeof(raw); len += (len < 100) ? 1 : 37 ) {
+    int ref_len = EVP_EncodeBlock( (unsigned char*)ref, raw, len );
+    ssize_t enc_len = base64_encode( enc, sizeof(enc), raw, len );
+    CU_ASSERT_FATAL( enc_len == ref_len + 1 );
+    CU_ASSERT_FATAL( 0 == strcmp( enc, ref ) );
+
+    ssize_t dec_len = base64_decode( dec, sizeof(dec), enc );
+    CU_ASSERT_FATAL( dec_len == (ssize_t)len );
+    CU_ASSERT_FATAL( 0 == memcmp( dec, raw, len ) );
+
+    // an invalid character anywhere is detected, vector part included
+    if( len > 3 ) {
+      size_t pos = (len * 7) % (size_t)(ref_len - 4);
+      char saved = enc[pos];
+      enc[pos] = '*';
+      CU_ASSERT_FATAL( base64_decode( dec, sizeof(dec), enc ) < 0 );
+      enc[pos] = saved;
+    }
+  }
+
+  // destination too small, terminating zero included
+  CU_ASSERT_FATAL( base64_encode( enc, 4, raw, 3 ) < 0 );
+  CU_ASSERT_FATAL( base64_encode( enc, 5, raw, 3 ) == 5 );
+}//eo Base64Bulk_Test
+
 void do_filename_manip_test()
 {
     char prefix[MAX_FILE_PATH];
@@ -153,6 +269,301 @@ void FilenameManip_Test()
     
 }//eo FilenameManip_Test
 
+void FileCopy_Test()
+{
+  const char *src = "test_utils_copy.src";
+  const char *dst = "test_utils_copy.dst";
+  // several buffered chunks, not a multiple of anything
+  const size_t size = 3*128*1024 + 4321;
+  uint8_t *data = malloc( size );
+  uint8_t *back = malloc( size );
+  CU_ASSERT_FATAL( NULL != data && NULL != back );
+
+  for( size_t i = 0; i < size; i++ ) {
+    data[i] = (uint8_t)(i * 31 + (i >> 9));
+  }
+  CU_ASSERT_FATAL( write_to_file( src, size, (const char*)data ) == (ssize_t)size );
+  CU_ASSERT_FATAL( 0 == chmod( src, 0640 ) );
+
+  // an existing, longer, destination is truncated and gets the source mode
+  CU_ASSERT_FATAL( write_to_file( dst, size, (const char*)back ) == (ssize_t)size );
+  CU_ASSERT_FATAL( 0 == chmod( dst, 0666 ) );
+  CU_ASSERT_FATAL( 0 == file_copy( src, dst, FILE_COPY_SYNC ) );
+
+  struct stat st;
+  CU_ASSERT_FATAL( 0 == stat( dst, &st ) );
+  CU_ASSERT_FATAL( (st.st_mode & 07777) == 0640 );
+  CU_ASSERT_FATAL( file_slurp( dst, back, size ) == (ssize_t)size );
+  CU_ASSERT_FATAL( 0 == memcmp( data, back, size ) );
+
+  // empty file
+  CU_ASSERT_FATAL( 0 == truncate( src, 0 ) );
+  CU_ASSERT_FATAL( 0 == file_copy( src, dst, 0 ) );
+  CU_ASSERT_FATAL( 0 == stat( dst, &st ) );
+  CU_ASSERT_FATAL( 0 == st.st_size );
+
+  // missing source
+  unlink( src );
+  CU_ASSERT_FATAL( file_copy( src, dst, 0 ) < 0 );
+
+  unlink( dst );
+  free( data );
+  free( back );
+}//eo FileCopy_Test
+
+void FileView_Test()
+{
+  const char *fname = "test_utils_view.bin";
+  uint8_t data[10000];
+  s_file_view_t view;
+
+  for( size_t i = 0; i < sizeof(data); i++ ) {
+    data[i] = (uint8_t)(i ^ (i >> 8));
+  }
+  CU_ASSERT_FATAL( write_to_file( fname, sizeof(data), (const char*)data ) == (ssize_t)sizeof(data) );
+
+  CU_ASSERT_FATAL( 0 == file_view_open( fname, &view ) );
+  CU_ASSERT_FATAL( view.mapped );
+  CU_ASSERT_FATAL( view.size == sizeof(data) );
+  CU_ASSERT_FATAL( 0 == memcmp( view.data, data, sizeof(data) ) );
+  file_view_close( &view, FILE_VIEW_WIPE );
+  CU_ASSERT_FATAL( NULL == view.data && 0 == view.size );
+
+  // the wipe never reaches the file
+  CU_ASSERT_FATAL( file_slurp( fname, data, sizeof(data) ) == (ssize_t)sizeof(data) );
+  CU_ASSERT_FATAL( data[1] == 1 && data[300] == (uint8_t)(300 ^ 1) );
+  CU_ASSERT_FATAL( file_slurp( fname, data, sizeof(data)-1 ) < 0 );
+
+  // empty and pseudo files are read, not mapped
+  CU_ASSERT_FATAL( 0 == truncate( fname, 0 ) );
+  CU_ASSERT_FATAL( 0 == file_view_open( fname, &view ) );
+  CU_ASSERT_FATAL( 0 == view.size );
+  file_view_close( &view, 0 );
+
+  if( 0 == access( "/proc/self/status", R_OK ) ) {
+    CU_ASSERT_FATAL( 0 == file_view_open( "/proc/self/status", &view ) );
+    CU_ASSERT_FATAL( !view.mapped && view.size > 0 );
+    file_view_close( &view, 0 );
+  }
+
+  unlink( fname );
+  CU_ASSERT_FATAL( file_view_open( fname, &view ) < 0 );
+}//eo FileView_Test
+
+// number of leftover temporary files of the atomic writes in the current directory
+static unsigned count_atomic_tmp_files()
+{
+  unsigned nb = 0;
+  DIR *d = opendir( "." );
+  struct dirent *e;
+  while( d && NULL != (e = readdir(d)) ) {
+    if( 0 == strncmp( e->d_name, "test_utils_atomic", 17 ) && strstr( e->d_name, ".tmp" ) ) {
+      nb++;
+    }
+  }
+  if( d ) closedir( d );
+  return nb;
+}//eo count_atomic_tmp_files
+
+void AtomicGroup_Test()
+{
+  const char *names[] = { "test_utils_atomic.a", "test_utils_atomic.b", "test_utils_atomic.c" };
+  char buffer[64];
+  struct stat st;
+  s_atomic_group_t grp;
+
+  CU_ASSERT_FATAL( write_to_file( names[0], 3, "old" ) == 3 );
+  CU_ASSERT_FATAL( 0 == chmod( names[0], 0600 ) );
+
+  // a committed group replaces every file, keeping the existing permissions
+  atomic_group_init( &grp );
+  for( unsigned i = 0; i < 3; i++ ) {
+    FILE *fp = atomic_group_open( &grp, names[i] );
+    CU_ASSERT_FATAL( NULL != fp );
+    fprintf( fp, "new content %u", i );
+  }
+  CU_ASSERT_FATAL( 0 == atomic_group_commit( &grp ) );
+  CU_ASSERT_FATAL( 0 == grp.nb_files && NULL == grp.files );
+  for( unsigned i = 0; i < 3; i++ ) {
+    char expected[32];
+    snprintf( expected, sizeof(expected), "new content %u", i );
+    memset( buffer, 0, sizeof(buffer) );
+    CU_ASSERT_FATAL( file_slurp( names[i], (uint8_t*)buffer, sizeof(buffer)-1 ) == (ssize_t)strlen(expected) );
+    CU_ASSERT_FATAL( 0 == strcmp( buffer, expected ) );
+  }
+  CU_ASSERT_FATAL( 0 == stat( names[0], &st ) && (st.st_mode & 07777) == 0600 );
+  CU_ASSERT_FATAL( 0 == count_atomic_tmp_files() );
+
+  // aborted, or failed, groups do not touch the files
+  atomic_group_init( &grp );
+  CU_ASSERT_FATAL( 0 == atomic_group_write( &grp, names[0], "lost", 4 ) );
+  atomic_group_abort( &grp );
+
+  atomic_group_init( &grp );
+  CU_ASSERT_FATAL( 0 == atomic_group_write( &grp, names[1], "lost", 4 ) );
+  CU_ASSERT_FATAL( 0 != atomic_group_write( &grp, "test_utils_no_such_dir/x", "lost", 4 ) );
+  CU_ASSERT_FATAL( 0 != atomic_group_commit( &grp ) );
+
+  memset( buffer, 0, sizeof(buffer) );
+  CU_ASSERT_FATAL( file_slurp( names[0], (uint8_t*)buffer, sizeof(buffer)-1 ) > 0 );
+  CU_ASSERT_FATAL( 0 == strcmp( buffer, "new content 0" ) );
+  memset( buffer, 0, sizeof(buffer) );
+  CU_ASSERT_FATAL( file_slurp( names[1], (uint8_t*)buffer, sizeof(buffer)-1 ) > 0 );
+  CU_ASSERT_FATAL( 0 == strcmp( buffer, "new content 1" ) );
+  CU_ASSERT_FATAL( 0 == count_atomic_tmp_files() );
+
+  for( unsigned i = 0; i < 3; i++ ) {
+    unlink( names[i] );
+  }
+}//eo AtomicGroup_Test
+
+void Exec_Test()
+{
+  s_exec_result_t result;
+
+  // the secret is read on its own descriptor, never on the command line
+  const char *cat_secret[] = { "sh", "-c", "read -r secret <&3; echo \"$secret\"", NULL };
+  CU_ASSERT_FATAL( 0 == exec_argv( cat_secret, "s3cr3t", &result ) );
+  CU_ASSERT_FATAL( 0 == result.status );
+  CU_ASSERT_FATAL( NULL != result.out && 0 == strcmp( result.out, "s3cr3t\n" ) );
+  CU_ASSERT_FATAL( result.wall_time >= 0.0 && result.cpu_time >= 0.0 );
+  exec_result_free( &result );
+
+  // both outputs are captured, larger than a pipe buffer
+  const char *big_output[] = { "sh", "-c", "head -c 300000 /dev/zero; echo oops >&2; exit 3", NULL };
+  CU_ASSERT_FATAL( 0 == exec_argv( big_output, NULL, &result ) );
+  CU_ASSERT_FATAL( 3 == result.status );
+  CU_ASSERT_FATAL( 300000 == result.out_len );
+  CU_ASSERT_FATAL( NULL != result.err && 0 == strcmp( result.err, "oops\n" ) );
+  exec_result_free( &result );
+
+  // arguments are not interpreted by a shell
+  const char *echo_args[] = { "echo", "$HOME", "a;b", NULL };
+  CU_ASSERT_FATAL( 0 == exec_argv( echo_args, NULL, &result ) );
+  CU_ASSERT_FATAL( NULL != result.out && 0 == strcmp( result.out, "$HOME a;b\n" ) );
+  exec_result_free( &result );
+
+  const char *missing[] = { "test_utils_no_such_program", NULL };
+  CU_ASSERT_FATAL( 0 != exec_argv( missing, NULL, &result ) || 0 != result.status );
+  exec_result_free( &result );
+}//eo Exec_Test
+
+void Frame_Test()
+{
+  int sv[2];
+  char buf[128];
+  CU_ASSERT_FATAL( 0 == socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) );
+
+  CU_ASSERT_FATAL( 0 == frame_write( sv[0], "sign\ncsr=a.csr", 14 ) );
+  CU_ASSERT_FATAL( 0 == frame_write( sv[0], "", 0 ) );
+  CU_ASSERT_FATAL( 14 == frame_read( sv[1], buf, sizeof(buf) ) );
+  CU_ASSERT_FATAL( 0 == strcmp( buf, "sign\ncsr=a.csr" ) );
+  CU_ASSERT_FATAL( 0 == frame_read( sv[1], buf, sizeof(buf) ) );
+  CU_ASSERT_FATAL( '\0' == buf[0] );
+
+  // a frame bigger than the buffer is refused
+  CU_ASSERT_FATAL( 0 == frame_write( sv[0], ASCII_SAMPLE, strlen(ASCII_SAMPLE) ) );
+  CU_ASSERT_FATAL( -1 == frame_read( sv[1], buf, 16 ) );
+  CU_ASSERT_FATAL( -1 == frame_write( sv[0], buf, MAX_FRAME_SIZE+1 ) );
+  close( sv[1] );
+  close( sv[0] );
+
+  // closing between two frames is not an error, in the middle of one is
+  CU_ASSERT_FATAL( 0 == socketpair( AF_UNIX, SOCK_STREAM, 0, sv ) );
+  CU_ASSERT_FATAL( 4 == write( sv[0], "\0\0\0\x08", 4 ) );
+  CU_ASSERT_FATAL( 3 == write( sv[0], "abc", 3 ) );
+  close( sv[0] );
+  CU_ASSERT_FATAL( -1 == frame_read( sv[1], buf, sizeof(buf) ) );
+  CU_ASSERT_FATAL( 0 == frame_read( sv[1], buf, sizeof(buf) ) );
+  close( sv[1] );
+}//eo Frame_Test
+
+// collect the members of a parsed object as "key=value;"
+static int json_collect( void *data, const char *key, const char *value )
+{
+  char *acc = (char*)data;
+  if( 0 == strcmp( key, "stop" ) ) {
+    return -1;
+  }
+  strcat( acc, key );
+  strcat( acc, "=" );
+  strcat( acc, value );
+  strcat( acc, ";" );
+  return 0;
+}//eo json_collect
+
+void Json_Test()
+{
+  char acc[256];
+  char esc[64];
+
+  acc[0] = '\0';
+  CU_ASSERT_FATAL( 0 == json_object_parse( " { \"op\":\"sign\", \"after\" : [ \"a\",\"b\" ],\"x\":[] } \n", json_collect, acc ) );
+  CU_ASSERT_FATAL( 0 == strcmp( acc, "op=sign;after=a;after=b;" ) );
+
+  acc[0] = '\0';
+  CU_ASSERT_FATAL( 0 == json_object_parse( "{\"p\":\"a\\\"b\\\\c\\/d\\u00e9\\ud83d\\ude00\"}", json_collect, acc ) );
+  CU_ASSERT_FATAL( 0 == strcmp( acc, "p=a\"b\\c/d\xc3\xa9\xf0\x9f\x98\x80;" ) );
+
+  acc[0] = '\0';
+  CU_ASSERT_FATAL( 0 == json_object_parse( "{}", json_collect, acc ) );
+  CU_ASSERT_FATAL( '\0' == acc[0] );
+
+  // syntax errors, unsupported values and callback failure
+  const char *bad[] = { "", "[]", "{", "{\"a\":\"b\"", "{\"a\":\"b\",}", "{\"a\" \"b\"}", "{\"a\":1}", "{\"a\":null}",
+                        "{\"a\":{\"b\":\"c\"}}", "{\"a\":\"b\"} x", "{\"a\":\"\\u0000\"}", "{\"a\":\"\\udc00\"}", "{\"a\":\"\\q\"}",
+                        "{\"a\":[\"b\" \"c\"]}", "{\"stop\":\"now\"}", NULL };
+  for( unsigned i=0; NULL!=bad[i]; i++ ) {
+    acc[0] = '\0';
+    CU_ASSERT( -1 == json_object_parse( bad[i], json_collect, acc ) );
+  }
+
+  CU_ASSERT_FATAL( 14 == json_escape( esc, sizeof(esc), "a\"b\\\n\x01" ) );
+  CU_ASSERT_FATAL( 0 == strcmp( esc, "a\\\"b\\\\\\n\\u0001" ) );
+  CU_ASSERT_FATAL( -1 == json_escape( esc, 4, "abcd" ) );
+}//eo Json_Test
+
+static int log_evaluated = 0;
+
+static int log_arg( void )
+{
+  log_evaluated++;
+  return 42;
+}//eo log_arg
+
+void Log_Test()
+{
+  CU_ASSERT_FATAL( 0 == log_configure( "warn,test_utils=debug" ) );
+  CU_ASSERT_FATAL(  log_enabled( LogDebug, "tests/test_utils.c" ) );
+  CU_ASSERT_FATAL( !log_enabled( LogTrace, "tests/test_utils.c" ) );
+  CU_ASSERT_FATAL(  log_enabled( LogWarn,  "src/pki.c" ) );
+  CU_ASSERT_FATAL( !log_enabled( LogDebug, "src/pki.c" ) );
+  CU_ASSERT_FATAL( !log_enabled( LogDebug, "test_utils_more.c" ) );
+
+  // invalid configurations are refused, the levels are left unchanged
+  CU_ASSERT_FATAL( -1 == log_configure( "verbose" ) );
+  CU_ASSERT_FATAL( -1 == log_configure( "warn,=debug" ) );
+  CU_ASSERT_FATAL( log_enabled( LogDebug, "tests/test_utils.c" ) );
+
+  // the arguments of a disabled message are not evaluated
+  LOG_PRN( LogTrace, "value %d", log_arg() );
+  CU_ASSERT_FATAL( 0 == log_evaluated );
+
+  // enabled messages are written by the background thread
+  FILE *fp = tmpfile();
+  CU_ASSERT_FATAL( NULL != fp );
+  CU_ASSERT_FATAL( 0 == log_start( fp ) );
+  LOG_PRN( LogDebug, "value %d", log_arg() );
+  CU_ASSERT_FATAL( 1 == log_evaluated );
+  log_flush();
+
+  char line[256];
+  rewind( fp );
+  CU_ASSERT_FATAL( NULL != fgets( line, sizeof(line), fp ) );
+  CU_ASSERT_FATAL( 0 == strncmp( line, "debug[", 6 ) );
+  CU_ASSERT_FATAL( NULL != strstr( line, "value 42\n" ) );
+}//eo Log_Test
+
 //
 //
 int main (int argc, char** argv) 
@@ -176,15 +587,58 @@ int main (int argc, char** argv)
     return CU_get_error();
   }
  
+  if (NULL == CU_add_test(pSuite, "Hex bulk encoding test", HexBulk_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
   if (NULL == CU_add_test(pSuite, "Base64 encoding test", Base64Encode_Test )) {
     CU_cleanup_registry();
     return CU_get_error();
   }
 
+  if (NULL == CU_add_test(pSuite, "Base64 strict decoding test", Base64Strict_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(pSuite, "Base64 bulk encoding test", Base64Bulk_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
   if (NULL == CU_add_test(pSuite, "Filename manipulation test", FilenameManip_Test )) {
     CU_cleanup_registry();
     return CU_get_error();
   }
+  if (NULL == CU_add_test(pSuite, "File copy test", FileCopy_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pSuite, "File view test", FileView_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pSuite, "Atomic write group test", AtomicGroup_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pSuite, "Subprocess executor test", Exec_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pSuite, "Framing test", Frame_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pSuite, "JSON lines test", Json_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+  if (NULL == CU_add_test(pSuite, "Logging test", Log_Test )) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
 
   /* Run all tests using the CUnit Basic interface */ 
   CU_basic_set_mode(CU_BRM_VERBOSE);